@@ -0,0 +1,285 @@
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <sys/socket.h>
+
+#include "addrsort.h"
+#include "config.h"
+
+// Scopes of addresses, as in RFC 4291, section 2.7.
+#define SCOPE_LINKLOCAL 0x2
+#define SCOPE_SITELOCAL 0x5
+#define SCOPE_GLOBAL 0xe
+
+// An entry of the default policy table of RFC 6724, section 2.1.
+typedef struct {
+    uint8_t prefix[16];
+    int len;
+    int precedence;
+    int label;
+} policy_t;
+
+// Longest prefixes first, so that the first match is the best one.
+static const policy_t policies[] = {
+    {{0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1}, 128, 50, 0},
+    {{0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff}, 96, 35, 4},
+    {{0}, 96, 1, 3},
+    {{0x20, 0x01, 0, 0}, 32, 5, 5},
+    {{0x20, 0x02}, 16, 30, 2},
+    {{0x3f, 0xfe}, 16, 1, 12},
+    {{0xfe, 0xc0}, 10, 1, 11},
+    {{0xfc}, 7, 3, 13},
+    {{0}, 0, 40, 1},
+};
+
+// An address with what the rules look at, IPv4 ones mapped into IPv6.
+typedef struct {
+    uint8_t address[16];
+    int scope;
+    int precedence;
+    int label;
+} classified_t;
+
+// A destination and the source address it would be reached from.
+typedef struct {
+    query_address_result_t result;
+    classified_t dst;
+    // Whether there is a source address at all.
+    int usable;
+    classified_t src;
+    // Bits of the source address's prefix it has in common with dst.
+    int matching_prefix;
+} candidate_t;
+
+static int common_prefix_len(const uint8_t* a, const uint8_t* b) {
+    int bits = 0;
+
+    for (int i = 0; i < 16; i++) {
+        uint8_t x = a[i] ^ b[i];
+
+        if (x == 0) {
+            bits += 8;
+            continue;
+        }
+        for (; !(x & 0x80); x <<= 1)
+            bits++;
+        break;
+    }
+
+    return bits;
+}
+
+static int scope_of(const uint8_t* a) {
+    static const uint8_t mapped[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff,
+                                       0xff};
+
+    if (memcmp(a, mapped, sizeof(mapped)) == 0) {
+        // Loopback and link-local IPv4 addresses are link-local, RFC 6724
+        // section 3.2.
+        if (a[12] == 127 || (a[12] == 169 && a[13] == 254))
+            return SCOPE_LINKLOCAL;
+        return SCOPE_GLOBAL;
+    }
+
+    if (a[0] == 0xff)
+        return a[1] & 0x0f;
+    // fe80::/10, and ::1 as in RFC 4007, section 4.
+    if ((a[0] == 0xfe && (a[1] & 0xc0) == 0x80) ||
+        memcmp(a, policies[0].prefix, 16) == 0)
+        return SCOPE_LINKLOCAL;
+    if (a[0] == 0xfe && (a[1] & 0xc0) == 0xc0)
+        return SCOPE_SITELOCAL;
+
+    return SCOPE_GLOBAL;
+}
+
+static void classify(int af, const void* address, classified_t* c) {
+    memset(c->address, 0, sizeof(c->address));
+    if (af == AF_INET) {
+        c->address[10] = c->address[11] = 0xff;
+        memcpy(c->address + 12, address, 4);
+    } else
+        memcpy(c->address, address, 16);
+
+    c->scope = scope_of(c->address);
+    for (size_t i = 0; i < sizeof(policies) / sizeof(policies[0]); i++)
+        if (common_prefix_len(c->address, policies[i].prefix) >=
+            policies[i].len) {
+            c->precedence = policies[i].precedence;
+            c->label = policies[i].label;
+            break;
+        }
+}
+
+// Returns whether source address a is preferred over b for destination
+// dst, by the rules of RFC 6724, section 5, that need no more than the
+// addresses.
+static int better_source(const classified_t* a, int a_prefixlen,
+                         const classified_t* b, int b_prefixlen,
+                         const classified_t* dst) {
+    int la, lb;
+
+    // Rule 2: prefer appropriate scope.
+    if (a->scope < b->scope)
+        return a->scope >= dst->scope;
+    if (b->scope < a->scope)
+        return b->scope < dst->scope;
+
+    // Rule 6: prefer matching label.
+    if ((a->label == dst->label) != (b->label == dst->label))
+        return a->label == dst->label;
+
+    // Rule 8: use longest matching prefix.
+    la = common_prefix_len(a->address, dst->address);
+    lb = common_prefix_len(b->address, dst->address);
+    if (la > a_prefixlen)
+        la = a_prefixlen;
+    if (lb > b_prefixlen)
+        lb = b_prefixlen;
+
+    return la > lb;
+}
+
+// Picks the source address the destination of c would be reached from:
+// one of its family on an interface that is up and running, on the
+// interface it was learned on for scoped addresses.
+static void pick_source(candidate_t* c, const ifstate_address_t* local,
+                        int n_local) {
+    int prefixlen = 0;
+
+    c->usable = 0;
+
+    for (int i = 0; i < n_local; i++) {
+        const ifstate_address_t* l = &local[i];
+        classified_t src;
+        int len = l->af == AF_INET ? l->prefixlen + 96 : l->prefixlen;
+
+        if (l->af != c->result.af ||
+            !(l->flags & (IFSTATE_USABLE | IFSTATE_LOOPBACK)))
+            continue;
+        if (c->result.scopeid && l->ifindex != c->result.scopeid)
+            continue;
+
+        classify(l->af, l->address, &src);
+        if (!c->usable ||
+            better_source(&src, len, &c->src, prefixlen, &c->dst)) {
+            c->src = src;
+            prefixlen = len;
+            c->usable = 1;
+        }
+    }
+
+    if (c->usable) {
+        c->matching_prefix = common_prefix_len(c->src.address, c->dst.address);
+        if (c->matching_prefix > prefixlen)
+            c->matching_prefix = prefixlen;
+    }
+}
+
+// Returns whether destination a is preferred over b, by the rules of RFC
+// 6724, section 6, that need no more than the addresses.
+static int better_destination(const candidate_t* a, const candidate_t* b) {
+    // Rule 1: avoid unusable destinations.
+    if (a->usable != b->usable)
+        return a->usable;
+    if (!a->usable)
+        return 0;
+
+    // Rule 2: prefer matching scope.
+    if ((a->dst.scope == a->src.scope) != (b->dst.scope == b->src.scope))
+        return a->dst.scope == a->src.scope;
+
+    // Rule 5: prefer matching label.
+    if ((a->dst.label == a->src.label) != (b->dst.label == b->src.label))
+        return a->dst.label == a->src.label;
+
+    // Rule 6: prefer higher precedence.
+    if (a->dst.precedence != b->dst.precedence)
+        return a->dst.precedence > b->dst.precedence;
+
+    // Rule 8: prefer smaller scope.
+    if (a->dst.scope != b->dst.scope)
+        return a->dst.scope < b->dst.scope;
+
+    // Rule 9: use longest matching prefix, within a family.
+    if (a->result.af == b->result.af)
+        return a->matching_prefix > b->matching_prefix;
+
+    // Rule 10: otherwise, leave the order unchanged.
+    return 0;
+}
+
+static int sorted_family(int af, unsigned families) {
+    return af == AF_INET ? (families & MDNS_SORT_IPV4) != 0
+                         : (families & MDNS_SORT_IPV6) != 0;
+}
+
+void addrsort_sort_with(query_address_result_t* results, int n,
+                        unsigned families, const ifstate_address_t* local,
+                        int n_local) {
+    candidate_t candidates[MAX_ENTRIES];
+    int positions[MAX_ENTRIES];
+    int m = 0;
+
+    for (int i = 0; i < n && m < MAX_ENTRIES; i++) {
+        candidate_t* c = &candidates[m];
+
+        if (!sorted_family(results[i].af, families))
+            continue;
+
+        c->result = results[i];
+        classify(c->result.af, &c->result.address, &c->dst);
+        pick_source(c, local, n_local);
+        positions[m++] = i;
+    }
+
+    if (m < 2)
+        return;
+
+    // An insertion sort is stable, and there are only a few of them.
+    for (int i = 1; i < m; i++) {
+        candidate_t c = candidates[i];
+        int j = i;
+
+        for (; j > 0 && better_destination(&c, &candidates[j - 1]); j--)
+            candidates[j] = candidates[j - 1];
+        candidates[j] = c;
+    }
+
+    for (int i = 0; i < m; i++)
+        results[positions[i]] = candidates[i].result;
+}
+
+void addrsort_sort(query_address_result_t* results, int n,
+                   unsigned families) {
+    ifstate_address_t local[IFSTATE_MAX_ADDRESSES];
+    int n_local;
+
+    if (n < 2 || !families)
+        return;
+
+    if ((n_local = ifstate_addresses(local, IFSTATE_MAX_ADDRESSES)) < 0)
+        return;
+
+    addrsort_sort_with(results, n, families, local, n_local);
+}
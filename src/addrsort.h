@@ -0,0 +1,39 @@
+#ifndef fooaddrsorthfoo
+#define fooaddrsorthfoo
+
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#include "avahi.h"
+#include "ifstate.h"
+
+// Sorts n results by the destination address selection rules of RFC 6724,
+// section 6, picking source addresses for them from local, the addresses
+// of this host. Only results of the families in families (MDNS_SORT_IPV4,
+// MDNS_SORT_IPV6) move, among the positions they hold; the order is kept
+// where the rules don't tell addresses apart.
+void addrsort_sort_with(query_address_result_t* results, int n,
+                        unsigned families, const ifstate_address_t* local,
+                        int n_local);
+
+// Like the above, with the current addresses of this host. Leaves the
+// results alone if those are unknown.
+void addrsort_sort(query_address_result_t* results, int n, unsigned families);
+
+#endif
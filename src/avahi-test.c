@@ -29,7 +29,7 @@ int main(int argc, char* argv[]) {
     int r;
 
     if ((r = avahi_resolve_name(AF_INET, argc >= 2 ? argv[1] : "cocaine.local",
-                                &result)) == 0) {
+                                &result, NULL)) == 0) {
         printf("AF_INET: %s\n",
                inet_ntop(AF_INET, &(result.address.ipv4), t, sizeof(t)));
 
@@ -42,7 +42,7 @@ int main(int argc, char* argv[]) {
         printf("AF_INET: failed (%i).\n", r);
 
     if ((r = avahi_resolve_name(AF_INET6, argc >= 2 ? argv[1] : "cocaine.local",
-                                &result)) == 0)
+                                &result, NULL)) == 0)
         printf("AF_INET6: %s\n",
                inet_ntop(AF_INET6, &(result.address.ipv6), t, sizeof(t)));
     else
@@ -32,38 +32,42 @@ SPDX-License-Identifier: LGPL-2.1-or-later
 #include <unistd.h>
 
 #include "avahi.h"
+#include "backend.h"
+#include "cache.h"
+#include "config.h"
+#include "hostname.h"
+#include "probes.h"
+#include "stats.h"
+#include "trace.h"
 #include "util.h"
 
 #define WHITESPACE " \t"
 
-static FILE* open_socket(void) {
-    int fd = -1;
-    struct sockaddr_un sa;
-    FILE* f = NULL;
+static const stats_counter_t result_counters[] = {
+    [AVAHI_RESOLVE_RESULT_SUCCESS] = STATS_RESULT_SUCCESS,
+    [AVAHI_RESOLVE_RESULT_HOST_NOT_FOUND] = STATS_RESULT_HOST_NOT_FOUND,
+    [AVAHI_RESOLVE_RESULT_UNAVAIL] = STATS_RESULT_UNAVAIL,
+};
 
-    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
-        goto fail;
+static FILE* open_socket(const backend_endpoint_t* endpoint, int timeout) {
+    int fd;
+    FILE* f;
 
-    set_cloexec(fd);
+    if ((fd = unix_socket_connect(endpoint->path[0] ? endpoint->path
+                                                    : AVAHI_SOCKET)) < 0)
+        return NULL;
 
-    memset(&sa, 0, sizeof(sa));
-    sa.sun_family = AF_UNIX;
-    strncpy(sa.sun_path, AVAHI_SOCKET, sizeof(sa.sun_path) - 1);
-    sa.sun_path[sizeof(sa.sun_path) - 1] = 0;
-
-    if (connect(fd, (struct sockaddr*)&sa, sizeof(sa)) < 0)
-        goto fail;
-
-    if (!(f = fdopen(fd, "r+")))
-        goto fail;
-
-    return f;
+    if (timeout >= 0 && set_socket_timeout(fd, timeout) < 0) {
+        close(fd);
+        return NULL;
+    }
 
-fail:
-    if (fd >= 0)
+    if (!(f = fdopen(fd, "r+"))) {
         close(fd);
+        return NULL;
+    }
 
-    return NULL;
+    return f;
 }
 
 static avahi_resolve_result_t
@@ -75,6 +79,7 @@ avahi_resolve_name_with_socket(FILE* f, int af, const char* name,
     fprintf(f, "RESOLVE-HOSTNAME%s %s\n", af == AF_INET ? "-IPV4" : "-IPV6",
             name);
     fflush(f);
+    PROBE2(request_sent, name, af);
 
     if (!(fgets(ln, sizeof(ln), f))) {
         return AVAHI_RESOLVE_RESULT_UNAVAIL;
@@ -112,23 +117,64 @@ avahi_resolve_name_with_socket(FILE* f, int af, const char* name,
     return AVAHI_RESOLVE_RESULT_SUCCESS;
 }
 
-avahi_resolve_result_t avahi_resolve_name(int af, const char* name,
-                                          query_address_result_t* result) {
-    if (af != AF_INET && af != AF_INET6) {
-        return AVAHI_RESOLVE_RESULT_UNAVAIL;
-    }
-
-    FILE* f = open_socket();
+static avahi_resolve_result_t
+avahi_backend_resolve_name(const backend_endpoint_t* endpoint, int af,
+                           const char* name, query_address_result_t* result,
+                           int timeout) {
+    FILE* f = open_socket(endpoint, timeout);
     if (!f) {
         return AVAHI_RESOLVE_RESULT_UNAVAIL;
     }
 
     avahi_resolve_result_t ret =
         avahi_resolve_name_with_socket(f, af, name, result);
+    PROBE3(reply_parsed, name, af, ret);
     fclose(f);
     return ret;
 }
 
+avahi_resolve_result_t avahi_resolve_name(int af, const char* name,
+                                          query_address_result_t* result,
+                                          int* cached) {
+    const mdns_config_t* cfg;
+    avahi_resolve_result_t ret;
+    uint64_t start;
+    int span = -1;
+
+    if (af != AF_INET && af != AF_INET6) {
+        return AVAHI_RESOLVE_RESULT_UNAVAIL;
+    }
+
+    if (cached)
+        *cached = 0;
+
+    if (cache_lookup(af, name, &ret, result)) {
+        stats_count(STATS_CACHE_HIT);
+        TRACE(trace_decision("cache"));
+        if (cached)
+            *cached = 1;
+        return ret;
+    }
+    stats_count(STATS_CACHE_MISS);
+
+    cfg = config_get();
+    start = stats_start();
+    TRACE(span = trace_phase_begin(TRACE_PHASE_BACKEND, af));
+    ret = backend_resolve_name(cfg, af, name, result);
+    TRACE(trace_phase_end(span, ret));
+    stats_observe(STATS_PHASE_BACKEND, start);
+    stats_count(result_counters[ret]);
+    // Answers for our own addresses tell us the name we are announced
+    // under.
+    if (ret == AVAHI_RESOLVE_RESULT_SUCCESS)
+        hostname_observe(name, af, &result->address);
+    cache_store(af, name, ret, result,
+                ret == AVAHI_RESOLVE_RESULT_SUCCESS ? cfg->cache_ttl
+                                                    : cfg->negative_cache_ttl);
+    config_put(cfg);
+    return ret;
+}
+
 static avahi_resolve_result_t
 avahi_resolve_address_with_socket(FILE* f, int af, const void* data, char* name,
                                   size_t name_len) {
@@ -137,6 +183,7 @@ avahi_resolve_address_with_socket(FILE* f, int af, const void* data, char* name,
 
     fprintf(f, "RESOLVE-ADDRESS %s\n", inet_ntop(af, data, a, sizeof(a)));
     fflush(f);
+    PROBE2(request_sent, data, af);
 
     if (!(fgets(ln, sizeof(ln), f))) {
         return AVAHI_RESOLVE_RESULT_UNAVAIL;
@@ -167,19 +214,60 @@ avahi_resolve_address_with_socket(FILE* f, int af, const void* data, char* name,
     return AVAHI_RESOLVE_RESULT_SUCCESS;
 }
 
-avahi_resolve_result_t avahi_resolve_address(int af, const void* data,
-                                             char* name, size_t name_len) {
-    if (af != AF_INET && af != AF_INET6) {
-        return AVAHI_RESOLVE_RESULT_UNAVAIL;
-    }
-
-    FILE* f = open_socket();
+static avahi_resolve_result_t
+avahi_backend_resolve_address(const backend_endpoint_t* endpoint, int af,
+                              const void* data, char* name, size_t name_len,
+                              int timeout) {
+    FILE* f = open_socket(endpoint, timeout);
     if (!f) {
         return AVAHI_RESOLVE_RESULT_UNAVAIL;
     }
 
     avahi_resolve_result_t ret =
         avahi_resolve_address_with_socket(f, af, data, name, name_len);
+    PROBE3(reply_parsed, data, af, ret);
     fclose(f);
     return ret;
 }
+
+const backend_ops_t backend_avahi = {
+    .name = "avahi",
+    .resolve_name = avahi_backend_resolve_name,
+    .resolve_address = avahi_backend_resolve_address,
+};
+
+avahi_resolve_result_t avahi_resolve_address(int af, const void* data,
+                                             char* name, size_t name_len) {
+    const mdns_config_t* cfg;
+    avahi_resolve_result_t ret;
+    uint64_t start;
+    int span = -1;
+
+    if (af != AF_INET && af != AF_INET6) {
+        return AVAHI_RESOLVE_RESULT_UNAVAIL;
+    }
+
+    // NSS callers don't pass the interface of scoped addresses.
+    if (cache_lookup_address(af, data, 0, &ret, name, name_len)) {
+        stats_count(STATS_CACHE_HIT);
+        TRACE(trace_decision("cache"));
+        return ret;
+    }
+    stats_count(STATS_CACHE_MISS);
+
+    cfg = config_get();
+    start = stats_start();
+    TRACE(span = trace_phase_begin(TRACE_PHASE_BACKEND, af));
+    ret = backend_resolve_address(cfg, af, data, name, name_len);
+    TRACE(trace_phase_end(span, ret));
+    stats_observe(STATS_PHASE_BACKEND, start);
+    stats_count(result_counters[ret]);
+    if (ret == AVAHI_RESOLVE_RESULT_SUCCESS)
+        hostname_observe(name, af, data);
+    cache_store_address(af, data, 0, ret, name,
+                        ret == AVAHI_RESOLVE_RESULT_SUCCESS
+                            ? cfg->cache_ttl
+                            : cfg->negative_cache_ttl);
+    config_put(cfg);
+    return ret;
+}
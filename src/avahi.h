@@ -54,8 +54,11 @@ typedef enum {
     AVAHI_RESOLVE_RESULT_UNAVAIL
 } avahi_resolve_result_t;
 
+// Resolves name, from the cache if it has the answer. If cached is not
+// NULL, it is set to whether it did.
 avahi_resolve_result_t avahi_resolve_name(int af, const char* name,
-                                          query_address_result_t* result);
+                                          query_address_result_t* result,
+                                          int* cached);
 
 avahi_resolve_result_t avahi_resolve_address(int af, const void* data,
                                              char* name, size_t name_len);
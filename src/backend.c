@@ -0,0 +1,458 @@
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+
+#include "backend.h"
+#include "mdns.h"
+#include "rtt.h"
+#include "stats.h"
+#include "util.h"
+
+static avahi_resolve_result_t
+multicast_resolve_name(const backend_endpoint_t* endpoint, int af,
+                       const char* name, query_address_result_t* result,
+                       int timeout) {
+    (void)endpoint;
+    return mdns_resolve_name(af, name, result, timeout);
+}
+
+static avahi_resolve_result_t
+multicast_resolve_address(const backend_endpoint_t* endpoint, int af,
+                          const void* data, char* name, size_t name_len,
+                          int timeout) {
+    (void)endpoint;
+    return mdns_resolve_address(af, data, name, name_len, timeout);
+}
+
+const backend_ops_t backend_multicast = {
+    .name = "multicast",
+    .resolve_name = multicast_resolve_name,
+    .resolve_address = multicast_resolve_address,
+};
+
+const backend_ops_t* backend_get_ops(backend_type_t type) {
+    switch (type) {
+    case BACKEND_AVAHI:
+        return &backend_avahi;
+    case BACKEND_RESOLVED:
+        return &backend_resolved;
+    case BACKEND_MULTICAST:
+        return &backend_multicast;
+    }
+
+    return NULL;
+}
+
+static const backend_endpoint_t multicast_endpoint = {
+    .type = BACKEND_MULTICAST,
+};
+
+// Kinds of queries whose response times are tracked separately.
+typedef enum {
+    QUERY_KIND_IPV4,
+    QUERY_KIND_IPV6,
+    QUERY_KIND_ADDRESS,
+    QUERY_KIND_MAX,
+} query_kind_t;
+
+// Health of the configured backends, by position in the backend list.
+typedef struct {
+    backend_endpoint_t endpoint;
+    // Number of failed attempts in a row.
+    unsigned failures;
+    // The backend is skipped, unless all others failed too, until then.
+    uint64_t down_until;
+    // Response times of answers, and of not-found replies, which can take
+    // much longer: avahi-daemon only gives up on a name after a while.
+    rtt_estimator_t rtt[QUERY_KIND_MAX];
+    rtt_estimator_t rtt_not_found[QUERY_KIND_MAX];
+} backend_health_t;
+
+static pthread_mutex_t health_mutex = PTHREAD_MUTEX_INITIALIZER;
+static backend_health_t health[MDNS_MAX_BACKENDS];
+
+static int same_endpoint(const backend_endpoint_t* a,
+                         const backend_endpoint_t* b) {
+    return a->type == b->type && strcmp(a->path, b->path) == 0;
+}
+
+// Returns the health slot of backend i, resetting it if the config changed
+// and another backend now occupies that position. Call with health_mutex
+// held.
+static backend_health_t* health_slot(int i, const backend_endpoint_t* ep) {
+    backend_health_t* h = &health[i];
+
+    if (!same_endpoint(&h->endpoint, ep)) {
+        memset(h, 0, sizeof(*h));
+        h->endpoint = *ep;
+    }
+
+    return h;
+}
+
+static int health_is_up(int i, const backend_endpoint_t* ep, uint64_t now) {
+    int up;
+
+    pthread_mutex_lock(&health_mutex);
+    up = now >= health_slot(i, ep)->down_until;
+    pthread_mutex_unlock(&health_mutex);
+
+    return up;
+}
+
+// Returns how long to wait for backend i to answer a query of the given
+// kind, from its recent response times. Whether the name exists is not
+// known beforehand, so the wait covers not-found replies as well; until
+// one was seen, that is the configured maximum.
+static int health_timeout(int i, const backend_endpoint_t* ep,
+                          query_kind_t kind, const mdns_config_t* cfg) {
+    backend_health_t* h;
+    int found, not_found;
+
+    pthread_mutex_lock(&health_mutex);
+    h = health_slot(i, ep);
+    found = rtt_timeout(&h->rtt[kind], cfg->backend_timeout_min,
+                        cfg->backend_timeout);
+    not_found = rtt_timeout(&h->rtt_not_found[kind], cfg->backend_timeout_min,
+                            cfg->backend_timeout);
+    pthread_mutex_unlock(&health_mutex);
+
+    return found > not_found ? found : not_found;
+}
+
+// Records the outcome of an attempt on backend i that took elapsed
+// milliseconds of the timeout it was given. An attempt cut short before
+// the configured maximum only makes later ones wait longer: the backend
+// may just have been slow, and is not taken for down.
+static void health_report(int i, const backend_endpoint_t* ep,
+                          query_kind_t kind, avahi_resolve_result_t ret,
+                          uint64_t now, uint64_t elapsed, int timeout,
+                          const mdns_config_t* cfg) {
+    backend_health_t* h;
+    int timed_out = 0;
+
+    pthread_mutex_lock(&health_mutex);
+    h = health_slot(i, ep);
+
+    if (ret == AVAHI_RESOLVE_RESULT_SUCCESS)
+        rtt_sample(&h->rtt[kind], elapsed);
+    else if (ret == AVAHI_RESOLVE_RESULT_HOST_NOT_FOUND)
+        rtt_sample(&h->rtt_not_found[kind], elapsed);
+    else if (elapsed >= (uint64_t)timeout) {
+        // Either kind of reply may have been on its way.
+        rtt_timed_out(&h->rtt[kind]);
+        rtt_timed_out(&h->rtt_not_found[kind]);
+        stats_count(STATS_TIMEOUT);
+        timed_out = 1;
+    }
+
+    if (ret != AVAHI_RESOLVE_RESULT_UNAVAIL) {
+        h->failures = 0;
+        h->down_until = 0;
+    } else if (!timed_out || timeout >= cfg->backend_timeout) {
+        // Back off exponentially while the backend keeps failing.
+        unsigned shift = h->failures < 16 ? h->failures : 16;
+        uint64_t backoff = (uint64_t)BACKEND_BACKOFF_MIN << shift;
+
+        if (backoff > BACKEND_BACKOFF_MAX)
+            backoff = BACKEND_BACKOFF_MAX;
+
+        h->failures++;
+        h->down_until = now + backoff;
+    }
+
+    pthread_mutex_unlock(&health_mutex);
+}
+
+void backend_health_reset(void) {
+    pthread_mutex_lock(&health_mutex);
+    memset(health, 0, sizeof(health));
+    pthread_mutex_unlock(&health_mutex);
+}
+
+// Admission control: at most cfg->max_concurrent backend attempts of the
+// process run at once. Lookups beyond that wait in a queue, in order of
+// arrival, until a running attempt hands its slot over or their deadline
+// passes; lookups beyond cfg->max_queued waiting ones are turned away.
+typedef struct admission_waiter {
+    struct admission_waiter* next;
+    // Each waiter sleeps on a condition of its own, so that a finished
+    // attempt wakes only the one it hands its slot to.
+    pthread_cond_t cond;
+    int admitted;
+} admission_waiter_t;
+
+static pthread_mutex_t admission_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t admission_once = PTHREAD_ONCE_INIT;
+static pthread_condattr_t admission_condattr;
+static int admission_active = 0;
+static int admission_queued = 0;
+static admission_waiter_t* queue_head = NULL;
+static admission_waiter_t** queue_tail = &queue_head;
+
+// A child only has the thread that forked; slots held by the others are
+// never given back there.
+static void admission_atfork_child(void) {
+    admission_active = 0;
+    admission_queued = 0;
+    queue_head = NULL;
+    queue_tail = &queue_head;
+    pthread_mutex_init(&admission_mutex, NULL);
+}
+
+static void admission_init(void) {
+    // Deadlines are on the monotonic clock.
+    pthread_condattr_init(&admission_condattr);
+    pthread_condattr_setclock(&admission_condattr, CLOCK_MONOTONIC);
+    pthread_atfork(NULL, NULL, admission_atfork_child);
+}
+
+static void queue_remove(admission_waiter_t* w) {
+    admission_waiter_t** p = &queue_head;
+
+    while (*p != w)
+        p = &(*p)->next;
+
+    *p = w->next;
+    if (queue_tail == &w->next)
+        queue_tail = p;
+}
+
+// Waits for a turn to make a backend attempt, until deadline. Returns 1 if
+// the caller now holds a slot it must give back with admission_leave(), 0
+// if there is no limit, or -1 if the lookup has to fail.
+static int admission_enter(const mdns_config_t* cfg, uint64_t deadline) {
+    admission_waiter_t w;
+    struct timespec ts;
+    uint64_t start;
+
+    if (cfg->max_concurrent <= 0)
+        return 0;
+
+    pthread_once(&admission_once, admission_init);
+    pthread_mutex_lock(&admission_mutex);
+
+    // Nobody may jump the queue.
+    if (admission_active < cfg->max_concurrent && !queue_head) {
+        admission_active++;
+        pthread_mutex_unlock(&admission_mutex);
+        stats_gauge_add(STATS_GAUGE_ACTIVE, 1);
+        return 1;
+    }
+
+    if (admission_queued >= cfg->max_queued) {
+        pthread_mutex_unlock(&admission_mutex);
+        stats_count(STATS_ADMISSION_REJECTED);
+        return -1;
+    }
+
+    w.next = NULL;
+    w.admitted = 0;
+    pthread_cond_init(&w.cond, &admission_condattr);
+    *queue_tail = &w;
+    queue_tail = &w.next;
+    admission_queued++;
+    stats_gauge_add(STATS_GAUGE_QUEUED, 1);
+    stats_count(STATS_ADMISSION_QUEUED);
+    start = stats_start();
+
+    ts.tv_sec = (time_t)(deadline / 1000);
+    ts.tv_nsec = (long)(deadline % 1000) * 1000000;
+    while (!w.admitted)
+        if (pthread_cond_timedwait(&w.cond, &admission_mutex, &ts) ==
+            ETIMEDOUT)
+            break;
+
+    // A slot handed over just as the deadline passed is still taken.
+    if (!w.admitted) {
+        queue_remove(&w);
+        admission_queued--;
+        stats_gauge_add(STATS_GAUGE_QUEUED, -1);
+    }
+
+    pthread_mutex_unlock(&admission_mutex);
+    pthread_cond_destroy(&w.cond);
+    stats_observe(STATS_PHASE_QUEUE, start);
+
+    if (!w.admitted) {
+        stats_count(STATS_ADMISSION_EXPIRED);
+        return -1;
+    }
+
+    return 1;
+}
+
+// Gives back a slot, handing it straight to the first waiting lookup if
+// there is one.
+static void admission_leave(void) {
+    admission_waiter_t* w;
+
+    pthread_mutex_lock(&admission_mutex);
+
+    if ((w = queue_head)) {
+        queue_remove(w);
+        admission_queued--;
+        stats_gauge_add(STATS_GAUGE_QUEUED, -1);
+        w->admitted = 1;
+        pthread_cond_signal(&w->cond);
+    } else {
+        admission_active--;
+        stats_gauge_add(STATS_GAUGE_ACTIVE, -1);
+    }
+
+    pthread_mutex_unlock(&admission_mutex);
+}
+
+// A forward or reverse lookup, as passed through the failover loop.
+typedef struct {
+    int af;
+    // Forward lookups.
+    const char* name;
+    query_address_result_t* result;
+    // Reverse lookups.
+    const void* data;
+    char* name_out;
+    size_t name_len;
+} backend_request_t;
+
+static avahi_resolve_result_t attempt(const backend_endpoint_t* ep,
+                                      const backend_request_t* req,
+                                      int timeout) {
+    const backend_ops_t* ops = backend_get_ops(ep->type);
+
+    if (req->data)
+        return ops->resolve_address(ep, req->af, req->data, req->name_out,
+                                    req->name_len, timeout);
+
+    return ops->resolve_name(ep, req->af, req->name, req->result, timeout);
+}
+
+static query_kind_t query_kind(const backend_request_t* req) {
+    if (req->data)
+        return QUERY_KIND_ADDRESS;
+
+    return req->af == AF_INET6 ? QUERY_KIND_IPV6 : QUERY_KIND_IPV4;
+}
+
+static int clamp_timeout(int timeout, uint64_t remaining) {
+    return remaining < (uint64_t)timeout ? (int)remaining : timeout;
+}
+
+// Tries the configured backends in order until one of them gives an
+// answer, within the time budget of the lookup. Backends that recently
+// failed are only tried once all healthy ones have failed as well. Each
+// attempt gets a timeout derived from how fast the backend answered
+// recently, and has to be admitted first.
+static avahi_resolve_result_t dispatch(const mdns_config_t* cfg,
+                                       const backend_request_t* req) {
+    uint64_t deadline = monotonic_msec() + cfg->timeout;
+    int tried[MDNS_MAX_BACKENDS] = {0};
+    int has_multicast = 0;
+    query_kind_t kind = query_kind(req);
+    avahi_resolve_result_t ret = AVAHI_RESOLVE_RESULT_UNAVAIL;
+
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < cfg->n_backends; i++) {
+            const backend_endpoint_t* ep = &cfg->backends[i];
+            uint64_t now = monotonic_msec(), end;
+            int timeout, slot;
+
+            has_multicast |= ep->type == BACKEND_MULTICAST;
+
+            if (tried[i] || (pass == 0 && !health_is_up(i, ep, now)))
+                continue;
+
+            if (now >= deadline)
+                return ret;
+
+            if ((slot = admission_enter(cfg, deadline)) < 0)
+                return ret;
+
+            now = monotonic_msec();
+            if (now >= deadline) {
+                if (slot)
+                    admission_leave();
+                return ret;
+            }
+
+            // Direct multicast queries always take their full time when
+            // nobody answers, so there is nothing to adapt to.
+            timeout = ep->type == BACKEND_MULTICAST
+                          ? cfg->multicast_timeout
+                          : health_timeout(i, ep, kind, cfg);
+            timeout = clamp_timeout(timeout, deadline - now);
+
+            tried[i] = 1;
+            ret = attempt(ep, req, timeout);
+            end = monotonic_msec();
+            if (slot)
+                admission_leave();
+            health_report(i, ep, kind, ret, end, end - now, timeout, cfg);
+
+            if (ret != AVAHI_RESOLVE_RESULT_UNAVAIL)
+                return ret;
+        }
+    }
+
+    if (cfg->multicast_fallback && !has_multicast &&
+        monotonic_msec() < deadline) {
+        int slot = admission_enter(cfg, deadline);
+        uint64_t now = monotonic_msec();
+
+        if (slot >= 0 && now < deadline)
+            ret = attempt(&multicast_endpoint, req,
+                          clamp_timeout(cfg->multicast_timeout,
+                                        deadline - now));
+        if (slot > 0)
+            admission_leave();
+    }
+
+    return ret;
+}
+
+avahi_resolve_result_t backend_resolve_name(const mdns_config_t* cfg, int af,
+                                            const char* name,
+                                            query_address_result_t* result) {
+    backend_request_t req = {.af = af, .name = name, .result = result};
+
+    assert(cfg);
+
+    return dispatch(cfg, &req);
+}
+
+avahi_resolve_result_t backend_resolve_address(const mdns_config_t* cfg,
+                                               int af, const void* data,
+                                               char* name, size_t name_len) {
+    backend_request_t req = {
+        .af = af, .data = data, .name_out = name, .name_len = name_len};
+
+    assert(cfg);
+
+    return dispatch(cfg, &req);
+}
@@ -0,0 +1,71 @@
+#ifndef foobackendhfoo
+#define foobackendhfoo
+
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#include <sys/types.h>
+
+#include "avahi.h"
+#include "config.h"
+
+// The operations every resolver backend implements. timeout is in
+// milliseconds; a negative value leaves it to the backend.
+typedef struct {
+    const char* name;
+    avahi_resolve_result_t (*resolve_name)(const backend_endpoint_t* endpoint,
+                                           int af, const char* name,
+                                           query_address_result_t* result,
+                                           int timeout);
+    avahi_resolve_result_t (*resolve_address)(
+        const backend_endpoint_t* endpoint, int af, const void* data,
+        char* name, size_t name_len, int timeout);
+} backend_ops_t;
+
+// The avahi-daemon simple protocol.
+extern const backend_ops_t backend_avahi;
+
+// systemd-resolved's io.systemd.Resolve varlink interface.
+extern const backend_ops_t backend_resolved;
+
+// Direct one-shot multicast queries.
+extern const backend_ops_t backend_multicast;
+
+// A backend that failed is skipped for BACKEND_BACKOFF_MIN milliseconds,
+// doubling with every further failure up to BACKEND_BACKOFF_MAX.
+#define BACKEND_BACKOFF_MIN 1000
+#define BACKEND_BACKOFF_MAX 30000
+
+const backend_ops_t* backend_get_ops(backend_type_t type);
+
+// Forgets the health of all backends.
+void backend_health_reset(void);
+
+// Resolves a name through the configured backends, failing over to the next
+// one when a backend is unavailable or does not answer in time, and finally
+// falling back to direct multicast queries if that is enabled.
+avahi_resolve_result_t backend_resolve_name(const mdns_config_t* cfg, int af,
+                                            const char* name,
+                                            query_address_result_t* result);
+
+avahi_resolve_result_t backend_resolve_address(const mdns_config_t* cfg,
+                                               int af, const void* data,
+                                               char* name, size_t name_len);
+
+#endif
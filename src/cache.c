@@ -0,0 +1,401 @@
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <ctype.h>
+#include <pthread.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+
+#ifdef HAVE_LINUX_RTNETLINK_H
+#include <linux/rtnetlink.h>
+#endif
+
+#include "cache.h"
+#include "util.h"
+
+typedef struct {
+    // Zero for an empty slot.
+    int af;
+    char name[256];
+    avahi_resolve_result_t status;
+    query_address_result_t result;
+    uint64_t expires_at;
+} cache_entry_t;
+
+// A reverse lookup answer.
+typedef struct {
+    // Zero for an empty slot.
+    int af;
+    uint8_t address[16];
+    uint32_t scopeid;
+    avahi_resolve_result_t status;
+    char name[256];
+    uint64_t expires_at;
+} address_entry_t;
+
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static cache_entry_t entries[CACHE_SIZE];
+static address_entry_t address_entries[CACHE_SIZE];
+
+static size_t address_size(int af) {
+    return af == AF_INET ? sizeof(ipv4_address_t) : sizeof(ipv6_address_t);
+}
+
+// FNV-1a over the lower-cased name and the family.
+static unsigned hash_name(int af, const char* name) {
+    uint32_t h = 2166136261u ^ (uint32_t)af;
+
+    for (; *name; name++)
+        h = (h ^ (uint8_t)tolower((unsigned char)*name)) * 16777619u;
+
+    return h;
+}
+
+static cache_entry_t* find(int af, const char* name) {
+    unsigned h = hash_name(af, name);
+
+    for (int i = 0; i < CACHE_WAYS; i++) {
+        cache_entry_t* e = &entries[(h + i) % CACHE_SIZE];
+
+        if (e->af == af && strcasecmp(e->name, name) == 0)
+            return e;
+    }
+
+    return NULL;
+}
+
+// FNV-1a over the family, the address and the scope.
+static unsigned hash_address(int af, const void* address, uint32_t scopeid) {
+    uint32_t h = 2166136261u ^ (uint32_t)af;
+    const uint8_t* p = address;
+
+    for (size_t i = 0; i < address_size(af); i++)
+        h = (h ^ p[i]) * 16777619u;
+    for (int i = 0; i < 4; i++, scopeid >>= 8)
+        h = (h ^ (scopeid & 0xFF)) * 16777619u;
+
+    return h;
+}
+
+static address_entry_t* find_address(int af, const void* address,
+                                     uint32_t scopeid) {
+    unsigned h = hash_address(af, address, scopeid);
+
+    for (int i = 0; i < CACHE_WAYS; i++) {
+        address_entry_t* e = &address_entries[(h + i) % CACHE_SIZE];
+
+        if (e->af == af && e->scopeid == scopeid &&
+            memcmp(e->address, address, address_size(af)) == 0)
+            return e;
+    }
+
+    return NULL;
+}
+
+// Forgets the reverse answers a forward answer for name contradicts, now
+// that it maps to result instead of old (either may be NULL). Call with
+// cache_mutex held.
+static void forward_changed(int af, const char* name,
+                            const query_address_result_t* old,
+                            const query_address_result_t* result) {
+    size_t size = address_size(af);
+
+    if (old && result && memcmp(&old->address, &result->address, size) == 0)
+        old = NULL;
+    if (!old && !result)
+        return;
+
+    for (int i = 0; i < CACHE_SIZE; i++) {
+        address_entry_t* e = &address_entries[i];
+        int positive = e->status == AVAHI_RESOLVE_RESULT_SUCCESS;
+
+        if (e->af != af)
+            continue;
+
+        // The name no longer has the old address.
+        if (old && positive && memcmp(e->address, &old->address, size) == 0 &&
+            strcasecmp(e->name, name) == 0)
+            e->af = 0;
+
+        // The new address belongs to this name now.
+        if (result && memcmp(e->address, &result->address, size) == 0 &&
+            (!positive || strcasecmp(e->name, name) != 0))
+            e->af = 0;
+    }
+}
+
+static void poll_changes(void) {
+    netlink_subscribe(cache_invalidate);
+    netlink_poll();
+}
+
+int cache_lookup(int af, const char* name, avahi_resolve_result_t* status,
+                 query_address_result_t* result) {
+    cache_entry_t* e;
+    int hit = 0;
+
+    poll_changes();
+
+    pthread_mutex_lock(&cache_mutex);
+
+    if ((e = find(af, name))) {
+        if (monotonic_msec() < e->expires_at) {
+            *status = e->status;
+            if (e->status == AVAHI_RESOLVE_RESULT_SUCCESS)
+                *result = e->result;
+            hit = 1;
+        } else
+            e->af = 0;
+    }
+
+    pthread_mutex_unlock(&cache_mutex);
+    return hit;
+}
+
+void cache_store(int af, const char* name, avahi_resolve_result_t status,
+                 const query_address_result_t* result, int ttl) {
+    const query_address_result_t* old;
+    cache_entry_t* e;
+    uint64_t now;
+
+    if (ttl <= 0 || status == AVAHI_RESOLVE_RESULT_UNAVAIL ||
+        strlen(name) >= sizeof(e->name))
+        return;
+
+    pthread_mutex_lock(&cache_mutex);
+
+    now = monotonic_msec();
+    e = find(af, name);
+    old = e && e->status == AVAHI_RESOLVE_RESULT_SUCCESS && now < e->expires_at
+              ? &e->result
+              : NULL;
+    forward_changed(af, name, old,
+                    status == AVAHI_RESOLVE_RESULT_SUCCESS ? result : NULL);
+
+    if (!e) {
+        unsigned h = hash_name(af, name);
+
+        // Take an empty or expired slot, or else the one expiring first.
+        for (int i = 0; i < CACHE_WAYS; i++) {
+            cache_entry_t* c = &entries[(h + i) % CACHE_SIZE];
+
+            if (!e || c->af == 0 || c->expires_at < e->expires_at)
+                e = c;
+            if (c->af == 0 || c->expires_at <= now)
+                break;
+        }
+    }
+
+    e->af = af;
+    strcpy(e->name, name);
+    e->status = status;
+    if (status == AVAHI_RESOLVE_RESULT_SUCCESS)
+        e->result = *result;
+    e->expires_at = now + ttl;
+
+    pthread_mutex_unlock(&cache_mutex);
+}
+
+int cache_lookup_address(int af, const void* address, uint32_t scopeid,
+                         avahi_resolve_result_t* status, char* name,
+                         size_t name_len) {
+    address_entry_t* e;
+    int hit = 0;
+
+    poll_changes();
+
+    pthread_mutex_lock(&cache_mutex);
+
+    if ((e = find_address(af, address, scopeid))) {
+        if (monotonic_msec() < e->expires_at) {
+            *status = e->status;
+            if (e->status == AVAHI_RESOLVE_RESULT_SUCCESS) {
+                strncpy(name, e->name, name_len - 1);
+                name[name_len - 1] = 0;
+            }
+            hit = 1;
+        } else
+            e->af = 0;
+    }
+
+    pthread_mutex_unlock(&cache_mutex);
+    return hit;
+}
+
+void cache_store_address(int af, const void* address, uint32_t scopeid,
+                         avahi_resolve_result_t status, const char* name,
+                         int ttl) {
+    address_entry_t* e;
+    uint64_t now;
+
+    if (ttl <= 0 || status == AVAHI_RESOLVE_RESULT_UNAVAIL ||
+        (status == AVAHI_RESOLVE_RESULT_SUCCESS &&
+         strlen(name) >= sizeof(e->name)))
+        return;
+
+    pthread_mutex_lock(&cache_mutex);
+
+    now = monotonic_msec();
+    if (!(e = find_address(af, address, scopeid))) {
+        unsigned h = hash_address(af, address, scopeid);
+
+        // Take an empty or expired slot, or else the one expiring first.
+        for (int i = 0; i < CACHE_WAYS; i++) {
+            address_entry_t* c = &address_entries[(h + i) % CACHE_SIZE];
+
+            if (!e || c->af == 0 || c->expires_at < e->expires_at)
+                e = c;
+            if (c->af == 0 || c->expires_at <= now)
+                break;
+        }
+    }
+
+    memset(e, 0, sizeof(*e));
+    e->af = af;
+    memcpy(e->address, address, address_size(af));
+    e->scopeid = scopeid;
+    e->status = status;
+    if (status == AVAHI_RESOLVE_RESULT_SUCCESS)
+        strcpy(e->name, name);
+    e->expires_at = now + ttl;
+
+    pthread_mutex_unlock(&cache_mutex);
+}
+
+void cache_flush(void) {
+    pthread_mutex_lock(&cache_mutex);
+    memset(entries, 0, sizeof(entries));
+    memset(address_entries, 0, sizeof(address_entries));
+    pthread_mutex_unlock(&cache_mutex);
+}
+
+static int in_prefix(const uint8_t* address, const uint8_t* prefix,
+                     int prefixlen) {
+    int bytes = prefixlen / 8, bits = prefixlen % 8;
+
+    if (memcmp(address, prefix, bytes) != 0)
+        return 0;
+
+    return bits == 0 ||
+           ((address[bytes] ^ prefix[bytes]) & (0xFF << (8 - bits))) == 0;
+}
+
+static int is_link_local(int af, const uint8_t* address) {
+    if (af == AF_INET)
+        return address[0] == 169 && address[1] == 254;
+
+    return address[0] == 0xFE && (address[1] & 0xC0) == 0x80;
+}
+
+// What an rtnetlink event changed.
+typedef struct {
+    const netlink_event_t* event;
+    int is_address;
+    int is_new;
+    int link_local;
+    int max_prefix;
+} change_t;
+
+// Returns whether an answer mapping a name to address, seen on interface
+// scopeid (0 if unknown), may have been made wrong by a change.
+static int is_stale(const change_t* change, int af,
+                    avahi_resolve_result_t status, const uint8_t* address,
+                    uint32_t scopeid) {
+    const netlink_event_t* event = change->event;
+    // Link-local peers of unknown interfaces may be on any of them.
+    int on_link = scopeid ? scopeid == event->ifindex
+                          : is_link_local(af, address);
+
+    if (status != AVAHI_RESOLVE_RESULT_SUCCESS)
+        // Something new may make unknown names resolvable.
+        return change->is_new;
+
+    if (!change->is_address)
+        return on_link;
+
+    if (af != event->af)
+        return 0;
+
+    if (event->prefixlen > 0 && event->prefixlen <= change->max_prefix &&
+        in_prefix(address, event->address, event->prefixlen))
+        // A prefix that went away, or that moved to another interface.
+        // Address lifetime refreshes on the same interface keep the
+        // entries seen there.
+        return !change->is_new || scopeid != event->ifindex;
+
+    // Link-local peers are reached through the interface's own link-local
+    // address.
+    return !change->is_new && change->link_local && on_link &&
+           is_link_local(af, address);
+}
+
+void cache_invalidate(const netlink_event_t* event) {
+    change_t change = {.event = event};
+
+    switch (event->type) {
+#ifdef HAVE_LINUX_RTNETLINK_H
+    case RTM_NEWLINK:
+        change.is_new = 1;
+        break;
+    case RTM_DELLINK:
+        break;
+    case RTM_NEWADDR:
+        change.is_new = 1;
+        change.is_address = 1;
+        break;
+    case RTM_DELADDR:
+        change.is_address = 1;
+        break;
+#endif
+    default:
+        cache_flush();
+        return;
+    }
+
+    if (change.is_address) {
+        change.link_local = is_link_local(event->af, event->address);
+        change.max_prefix = event->af == AF_INET ? 32 : 128;
+    }
+
+    pthread_mutex_lock(&cache_mutex);
+
+    for (int i = 0; i < CACHE_SIZE; i++) {
+        cache_entry_t* e = &entries[i];
+
+        if (e->af &&
+            is_stale(&change, e->af, e->status,
+                     (const uint8_t*)&e->result.address, e->result.scopeid))
+            e->af = 0;
+    }
+
+    for (int i = 0; i < CACHE_SIZE; i++) {
+        address_entry_t* e = &address_entries[i];
+
+        if (e->af &&
+            is_stale(&change, e->af, e->status, e->address, e->scopeid))
+            e->af = 0;
+    }
+
+    pthread_mutex_unlock(&cache_mutex);
+}
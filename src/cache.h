@@ -0,0 +1,66 @@
+#ifndef foocachehfoo
+#define foocachehfoo
+
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#include "avahi.h"
+#include "netlink.h"
+
+// Number of cached answers, and the number of slots a name may occupy.
+#define CACHE_SIZE 256
+#define CACHE_WAYS 4
+
+// Looks up the cached answer for name in family af. Returns true on a hit,
+// with the answer in *status and, if it is a success, *result.
+int cache_lookup(int af, const char* name, avahi_resolve_result_t* status,
+                 query_address_result_t* result);
+
+// Remembers the answer of a backend for ttl milliseconds. Failures to reach
+// the backends are not cached.
+void cache_store(int af, const char* name, avahi_resolve_result_t status,
+                 const query_address_result_t* result, int ttl);
+
+// Looks up the cached answer of a reverse lookup of the address of family
+// af on interface scopeid (0 for none in particular). Returns true on a
+// hit, with the answer in *status and, if it is a success, the name in
+// name.
+int cache_lookup_address(int af, const void* address, uint32_t scopeid,
+                         avahi_resolve_result_t* status, char* name,
+                         size_t name_len);
+
+// Remembers the answer of a reverse lookup for ttl milliseconds. Forward
+// answers that map a name to another address, or an address to another
+// name, drop it again.
+void cache_store_address(int af, const void* address, uint32_t scopeid,
+                         avahi_resolve_result_t status, const char* name,
+                         int ttl);
+
+// Forgets all cached answers.
+void cache_flush(void);
+
+// Forgets the answers a change of the interfaces may have made wrong: those
+// seen on an interface that changed, those within an address prefix that
+// was removed or appeared on another interface, and those seen on an
+// interface that lost its link-local address. Negative answers are
+// forgotten whenever something new appears. Called for rtnetlink events;
+// exposed for testing.
+void cache_invalidate(const netlink_event_t* event);
+
+#endif
@@ -0,0 +1,295 @@
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <sys/stat.h>
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "config.h"
+#include "util.h"
+
+#define WHITESPACE " \t"
+
+// How often the config file is checked for changes, in milliseconds.
+#define CONFIG_CHECK_INTERVAL 1000
+
+// The config file in use. NSS_MDNS_CONFIG points lookups at another one,
+// to test against a private setup.
+static const char* config_file(void) {
+    const char* path = secure_env("NSS_MDNS_CONFIG");
+
+    return path && *path ? path : MDNS_CONFIG_FILE;
+}
+
+// A loaded config, shared by the lookups using it. It is freed when the
+// last of them is done with it after a newer one was loaded.
+typedef struct {
+    mdns_config_t cfg;
+    unsigned refs;
+} config_snapshot_t;
+
+// Used while no config could be allocated. Never freed.
+static config_snapshot_t config_fallback;
+
+static pthread_mutex_t config_mutex = PTHREAD_MUTEX_INITIALIZER;
+static config_snapshot_t* config_current = NULL;
+static uint64_t config_checked_at = 0;
+static struct stat config_stat;
+
+void config_init(mdns_config_t* cfg) {
+    assert(cfg);
+
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->backends[0].type = BACKEND_AVAHI;
+    cfg->n_backends = 1;
+    cfg->timeout = MDNS_DEFAULT_TIMEOUT;
+    cfg->backend_timeout = MDNS_DEFAULT_BACKEND_TIMEOUT;
+    cfg->backend_timeout_min = MDNS_DEFAULT_BACKEND_TIMEOUT_MIN;
+    cfg->multicast_timeout = MDNS_DEFAULT_MULTICAST_TIMEOUT;
+    cfg->max_concurrent = MDNS_DEFAULT_MAX_CONCURRENT;
+    cfg->max_queued = MDNS_DEFAULT_MAX_QUEUED;
+    cfg->cache_ttl = MDNS_DEFAULT_CACHE_TTL;
+    cfg->negative_cache_ttl = MDNS_DEFAULT_NEGATIVE_CACHE_TTL;
+    cfg->addrconfig = 1;
+    cfg->family_miss_threshold = MDNS_DEFAULT_FAMILY_MISS_THRESHOLD;
+    cfg->family_probe_interval = MDNS_DEFAULT_FAMILY_PROBE_INTERVAL;
+    cfg->local_hostname = 1;
+    prefix_table_init(&cfg->reverse_prefixes);
+}
+
+static int parse_bool(const char* value, int* result) {
+    if (strcasecmp(value, "yes") == 0 || strcasecmp(value, "true") == 0 ||
+        strcmp(value, "1") == 0) {
+        *result = 1;
+        return 0;
+    }
+    if (strcasecmp(value, "no") == 0 || strcasecmp(value, "false") == 0 ||
+        strcmp(value, "0") == 0) {
+        *result = 0;
+        return 0;
+    }
+    return -1;
+}
+
+static int parse_int(const char* value, int min, int max, int* result) {
+    char* end;
+    long l = strtol(value, &end, 10);
+
+    if (*value == 0 || *end != 0 || l < min || l > max)
+        return -1;
+
+    *result = (int)l;
+    return 0;
+}
+
+// Parses "no" or a list of "ipv4" and "ipv6".
+static int parse_families(char* value, unsigned* result) {
+    unsigned families = 0;
+    char *word, *save;
+
+    for (word = strtok_r(value, WHITESPACE, &save); word;
+         word = strtok_r(NULL, WHITESPACE, &save)) {
+        if (strcasecmp(word, "ipv4") == 0)
+            families |= MDNS_SORT_IPV4;
+        else if (strcasecmp(word, "ipv6") == 0)
+            families |= MDNS_SORT_IPV6;
+        else if (strcasecmp(word, "no") != 0)
+            return -1;
+    }
+
+    *result = families;
+    return 0;
+}
+
+// Parses "TYPE [PATH]".
+static int parse_backend(char* value, backend_endpoint_t* backend) {
+    backend_endpoint_t b;
+    char* path = value + strcspn(value, WHITESPACE);
+
+    if (*path) {
+        *(path++) = 0;
+        path += strspn(path, WHITESPACE);
+    }
+
+    memset(&b, 0, sizeof(b));
+
+    if (strcasecmp(value, "avahi") == 0)
+        b.type = BACKEND_AVAHI;
+    else if (strcasecmp(value, "resolved") == 0)
+        b.type = BACKEND_RESOLVED;
+    else if (strcasecmp(value, "multicast") == 0)
+        b.type = BACKEND_MULTICAST;
+    else
+        return -1;
+
+    if (strlen(path) >= sizeof(b.path) ||
+        (*path && b.type == BACKEND_MULTICAST))
+        return -1;
+
+    strcpy(b.path, path);
+    *backend = b;
+    return 0;
+}
+
+void config_parse(FILE* f, mdns_config_t* cfg) {
+    char ln[256];
+    // The first backend line replaces the default list, later ones are
+    // appended to it.
+    int backends_seen = 0;
+
+    assert(f);
+    assert(cfg);
+
+    while (fgets(ln, sizeof(ln), f)) {
+        char *key, *value;
+
+        ln[strcspn(ln, "#\n\r")] = 0;
+
+        key = ln + strspn(ln, WHITESPACE);
+        value = key + strcspn(key, WHITESPACE);
+        if (*value) {
+            *(value++) = 0;
+            value += strspn(value, WHITESPACE);
+        }
+        // Strip trailing whitespace from the value.
+        for (size_t l = strlen(value); l > 0 && strchr(WHITESPACE, value[l - 1]);
+             l--)
+            value[l - 1] = 0;
+
+        if (*key == 0)
+            continue;
+
+        if (strcasecmp(key, "backend") == 0) {
+            backend_endpoint_t b;
+
+            if (parse_backend(value, &b) < 0)
+                continue;
+            if (!backends_seen)
+                cfg->n_backends = 0;
+            backends_seen = 1;
+            if (cfg->n_backends < MDNS_MAX_BACKENDS)
+                cfg->backends[cfg->n_backends++] = b;
+        } else if (strcasecmp(key, "timeout") == 0) {
+            parse_int(value, 1, 600000, &cfg->timeout);
+        } else if (strcasecmp(key, "backend-timeout") == 0) {
+            parse_int(value, 1, 600000, &cfg->backend_timeout);
+        } else if (strcasecmp(key, "backend-timeout-min") == 0) {
+            parse_int(value, 1, 600000, &cfg->backend_timeout_min);
+        } else if (strcasecmp(key, "multicast-fallback") == 0) {
+            parse_bool(value, &cfg->multicast_fallback);
+        } else if (strcasecmp(key, "multicast-timeout") == 0) {
+            parse_int(value, 1, 60000, &cfg->multicast_timeout);
+        } else if (strcasecmp(key, "max-concurrent") == 0) {
+            parse_int(value, 0, 100000, &cfg->max_concurrent);
+        } else if (strcasecmp(key, "max-queued") == 0) {
+            parse_int(value, 0, 100000, &cfg->max_queued);
+        } else if (strcasecmp(key, "cache-ttl") == 0) {
+            parse_int(value, 0, 3600000, &cfg->cache_ttl);
+        } else if (strcasecmp(key, "negative-cache-ttl") == 0) {
+            parse_int(value, 0, 3600000, &cfg->negative_cache_ttl);
+        } else if (strcasecmp(key, "addrconfig") == 0) {
+            parse_bool(value, &cfg->addrconfig);
+        } else if (strcasecmp(key, "family-miss-threshold") == 0) {
+            parse_int(value, 0, 1000000, &cfg->family_miss_threshold);
+        } else if (strcasecmp(key, "family-probe-interval") == 0) {
+            parse_int(value, 1, 3600000, &cfg->family_probe_interval);
+        } else if (strcasecmp(key, "reverse-prefix") == 0) {
+            prefix_table_parse(&cfg->reverse_prefixes, value);
+        } else if (strcasecmp(key, "stats") == 0) {
+            parse_bool(value, &cfg->stats);
+        } else if (strcasecmp(key, "local-hostname") == 0) {
+            parse_bool(value, &cfg->local_hostname);
+        } else if (strcasecmp(key, "sort-addresses") == 0) {
+            parse_families(value, &cfg->sort_addresses);
+        }
+    }
+}
+
+static void snapshot_release(config_snapshot_t* s) {
+    if (s != &config_fallback &&
+        __atomic_sub_fetch(&s->refs, 1, __ATOMIC_ACQ_REL) == 0)
+        free(s);
+}
+
+// Reads the config file into a new snapshot, holding the reference of
+// config_current. Returns NULL if out of memory.
+static config_snapshot_t* snapshot_load(const char* path) {
+    config_snapshot_t* s;
+    FILE* f;
+
+    if (!(s = malloc(sizeof(*s))))
+        return NULL;
+
+    config_init(&s->cfg);
+    if ((f = fopen(path, "re"))) {
+        config_parse(f, &s->cfg);
+        fclose(f);
+    }
+    s->refs = 1;
+
+    return s;
+}
+
+const mdns_config_t* config_get(void) {
+    config_snapshot_t* s;
+
+    pthread_mutex_lock(&config_mutex);
+
+    uint64_t now = monotonic_msec();
+    if (!config_current || now - config_checked_at >= CONFIG_CHECK_INTERVAL) {
+        const char* path = config_file();
+        struct stat st;
+        memset(&st, 0, sizeof(st));
+        // A missing file is treated like an empty one.
+        stat(path, &st);
+
+        if (!config_current || stat_changed(&st, &config_stat)) {
+            if ((s = snapshot_load(path))) {
+                if (config_current)
+                    snapshot_release(config_current);
+                config_current = s;
+                config_stat = st;
+            } else if (!config_current) {
+                config_init(&config_fallback.cfg);
+                config_current = &config_fallback;
+            }
+        }
+        config_checked_at = now;
+    }
+
+    s = config_current;
+    __atomic_add_fetch(&s->refs, 1, __ATOMIC_RELAXED);
+
+    pthread_mutex_unlock(&config_mutex);
+
+    return &s->cfg;
+}
+
+void config_put(const mdns_config_t* cfg) {
+    // The settings are the first member of their snapshot.
+    if (cfg)
+        snapshot_release((config_snapshot_t*)cfg);
+}
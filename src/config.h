@@ -0,0 +1,138 @@
+#ifndef fooconfighfoo
+#define fooconfighfoo
+
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#include <stdio.h>
+#include <sys/un.h>
+
+#include "prefix.h"
+
+// Default timeout of a direct multicast query, in milliseconds.
+#define MDNS_DEFAULT_MULTICAST_TIMEOUT 2000
+
+// Default time budget of a single lookup across all backends, and the
+// default bounds of the time a single attempt on one backend may take, in
+// milliseconds.
+#define MDNS_DEFAULT_TIMEOUT 15000
+#define MDNS_DEFAULT_BACKEND_TIMEOUT 6000
+#define MDNS_DEFAULT_BACKEND_TIMEOUT_MIN 1000
+
+// Default number of backend attempts a process makes at once, and of
+// lookups that may wait for their turn.
+#define MDNS_DEFAULT_MAX_CONCURRENT 32
+#define MDNS_DEFAULT_MAX_QUEUED 256
+
+// Default time answers are cached for, in milliseconds.
+#define MDNS_DEFAULT_CACHE_TTL 10000
+#define MDNS_DEFAULT_NEGATIVE_CACHE_TTL 2000
+
+// Default number of lookups in a row of existing hosts without addresses of
+// a family after which that family is only asked for now and then, and the
+// default interval of asking, in milliseconds. Off by default: hosts that
+// have the family lose those addresses until it is asked for again.
+#define MDNS_DEFAULT_FAMILY_MISS_THRESHOLD 0
+#define MDNS_DEFAULT_FAMILY_PROBE_INTERVAL 30000
+
+// Families whose answers are put in order of preference, for
+// sort_addresses.
+#define MDNS_SORT_IPV4 0x1
+#define MDNS_SORT_IPV6 0x2
+
+// Maximum number of backends that can be configured.
+#define MDNS_MAX_BACKENDS 8
+
+typedef enum {
+    BACKEND_AVAHI,
+    BACKEND_RESOLVED,
+    BACKEND_MULTICAST,
+} backend_type_t;
+
+// A resolver to send lookups to.
+typedef struct {
+    backend_type_t type;
+    // Socket path of the resolver. Empty for the built-in default.
+    char path[sizeof(((struct sockaddr_un*)0)->sun_path)];
+} backend_endpoint_t;
+
+// Runtime settings read from MDNS_CONFIG_FILE.
+typedef struct {
+    // The resolvers used for lookups, in order of preference.
+    backend_endpoint_t backends[MDNS_MAX_BACKENDS];
+    int n_backends;
+    // Time budget of a lookup across all backends, in milliseconds.
+    int timeout;
+    // Bounds of the time limit of a single attempt on one backend, in
+    // milliseconds. Within them, the limit follows the backend's recent
+    // response times.
+    int backend_timeout;
+    int backend_timeout_min;
+    // If true, fall back to direct multicast queries when no backend can
+    // be reached. Off by default, as every such lookup of a name that does
+    // not exist then takes the full multicast timeout.
+    int multicast_fallback;
+    // Total time to wait for a multicast answer, in milliseconds.
+    int multicast_timeout;
+    // At most this many backend attempts of a process run at once; zero
+    // lifts the limit. Up to max_queued more wait for their turn in order
+    // of arrival, within the time budget of their lookup; beyond that,
+    // lookups fail right away.
+    int max_concurrent;
+    int max_queued;
+    // How long answers and "not found" answers are cached, in
+    // milliseconds. Zero disables caching.
+    int cache_ttl;
+    int negative_cache_ttl;
+    // If true, do not look up addresses of a family this host has no
+    // address of.
+    int addrconfig;
+    // After this many lookups in a row of existing hosts in a domain
+    // without addresses of one family, that family is only asked for every
+    // family_probe_interval milliseconds. Zero disables this.
+    int family_miss_threshold;
+    int family_probe_interval;
+    // The addresses reverse lookups are sent for. Empty for all of them.
+    prefix_table_t reverse_prefixes;
+    // If true, export lookup statistics in shared memory.
+    int stats;
+    // If true, answer lookups of this host's own name from the local
+    // interfaces.
+    int local_hostname;
+    // The families (MDNS_SORT_*) whose addresses are ordered by the
+    // destination address selection rules of RFC 6724 before they are
+    // returned. Zero leaves them in the order they arrived in.
+    unsigned sort_addresses;
+} mdns_config_t;
+
+// Fills in the built-in defaults, used when there is no config file.
+void config_init(mdns_config_t* cfg);
+
+// Parses a config file on top of the values already in cfg. Unknown
+// directives and malformed values are ignored.
+void config_parse(FILE* f, mdns_config_t* cfg);
+
+// Returns the current settings. The config file is re-read if it has
+// changed since it was last loaded. The settings are shared and must not
+// be modified; they stay valid, and unchanged by reloads, until they are
+// handed back with config_put().
+const mdns_config_t* config_get(void);
+void config_put(const mdns_config_t* cfg);
+
+#endif
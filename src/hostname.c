@@ -0,0 +1,200 @@
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <ctype.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include "hostname.h"
+#include "ifstate.h"
+#include "netlink.h"
+#include "util.h"
+
+#ifndef HOST_NAME_MAX
+#define HOST_NAME_MAX 255
+#endif
+
+// How long the host name is remembered, in milliseconds. Interface changes
+// reported by rtnetlink, which come with a host being reconfigured, make
+// it be read again earlier.
+#define HOSTNAME_CHECK_INTERVAL 1000
+
+static pthread_mutex_t hostname_mutex = PTHREAD_MUTEX_INITIALIZER;
+// The host name as last read, empty if it could not be.
+static char host_name[HOST_NAME_MAX + 1];
+static int host_dirty = 1;
+static uint64_t host_read_at = 0;
+// The host name the renamed form was learned for, and that name. Empty if
+// we are announced under the plain name.
+static char learned_for[HOST_NAME_MAX + 1];
+static char learned[256];
+
+int hostname_equal(const char* a, const char* b) {
+    size_t la = strlen(a), lb = strlen(b);
+
+    if (la > 0 && a[la - 1] == '.')
+        la--;
+    if (lb > 0 && b[lb - 1] == '.')
+        lb--;
+
+    return la == lb && strncasecmp(a, b, la) == 0;
+}
+
+int hostname_mdns_name(const char* host, char* buf, size_t len) {
+    size_t l = strcspn(host, ".");
+
+    if (l == 0 || strcasecmp(host, "localhost") == 0 ||
+        strncasecmp(host, "localhost.", 10) == 0)
+        return -1;
+
+    if ((size_t)snprintf(buf, len, "%.*s.local", (int)l, host) >= len)
+        return -1;
+
+    return 0;
+}
+
+int hostname_is_conflict_form(const char* mdns_name, const char* name) {
+    size_t l = strcspn(mdns_name, ".");
+    const char* p;
+
+    if (hostname_equal(mdns_name, name))
+        return 1;
+
+    if (strncasecmp(mdns_name, name, l) != 0 || name[l] != '-')
+        return 0;
+
+    // A number without leading zeros, at least 2.
+    p = name + l + 1;
+    if (!isdigit((unsigned char)*p) || *p == '0' ||
+        (*p == '1' && !isdigit((unsigned char)p[1])))
+        return 0;
+    while (isdigit((unsigned char)*p))
+        p++;
+
+    return hostname_equal(p, mdns_name + l);
+}
+
+static void on_change(const netlink_event_t* event) {
+    (void)event;
+
+    pthread_mutex_lock(&hostname_mutex);
+    host_dirty = 1;
+    pthread_mutex_unlock(&hostname_mutex);
+}
+
+// Copies the host name to host, reading it again if it may have changed.
+// The netlink events are polled for by ifstate and the cache. Call with
+// hostname_mutex held.
+static int current_host(char* host) {
+    uint64_t now = monotonic_msec();
+
+    if (host_dirty || now - host_read_at >= HOSTNAME_CHECK_INTERVAL) {
+        if (gethostname(host_name, sizeof(host_name)) < 0)
+            host_name[0] = 0;
+        host_name[sizeof(host_name) - 1] = 0;
+        host_dirty = 0;
+        host_read_at = now;
+    }
+
+    if (!host_name[0])
+        return -1;
+
+    strcpy(host, host_name);
+    return 0;
+}
+
+// Determines the current mDNS name of this host. Call with hostname_mutex
+// held.
+static int current_name(char* buf, size_t len) {
+    char host[HOST_NAME_MAX + 1];
+
+    if (current_host(host) < 0)
+        return -1;
+
+    // Forget what was learned about a previous host name.
+    if (strcmp(host, learned_for) != 0) {
+        strcpy(learned_for, host);
+        learned[0] = 0;
+    }
+
+    if (learned[0]) {
+        if (strlen(learned) >= len)
+            return -1;
+        strcpy(buf, learned);
+        return 0;
+    }
+
+    return hostname_mdns_name(host, buf, len);
+}
+
+int hostname_is_self(const char* name) {
+    char self[256];
+    int ret;
+
+    // Cheap test first; most lookups are for other hosts anyway.
+    if (!ends_with(name, ".local") && !ends_with(name, ".local."))
+        return 0;
+
+    // Not while holding hostname_mutex, which on_change takes.
+    netlink_subscribe(on_change);
+
+    pthread_mutex_lock(&hostname_mutex);
+    ret = current_name(self, sizeof(self)) == 0 && hostname_equal(self, name);
+    pthread_mutex_unlock(&hostname_mutex);
+
+    return ret;
+}
+
+void hostname_observe(const char* name, int af, const void* address) {
+    char host[HOST_NAME_MAX + 1], plain[256];
+
+    int ret;
+
+    if (!ends_with(name, ".local") && !ends_with(name, ".local."))
+        return;
+
+    netlink_subscribe(on_change);
+
+    pthread_mutex_lock(&hostname_mutex);
+    ret = current_host(host);
+    pthread_mutex_unlock(&hostname_mutex);
+
+    // Only answers for our own name take the ifstate lock.
+    if (ret < 0 || hostname_mdns_name(host, plain, sizeof(plain)) < 0 ||
+        !hostname_is_conflict_form(plain, name) ||
+        strlen(name) >= sizeof(learned) ||
+        !ifstate_is_local_address(af, address))
+        return;
+
+    pthread_mutex_lock(&hostname_mutex);
+    strcpy(learned_for, host);
+    if (hostname_equal(plain, name))
+        learned[0] = 0;
+    else
+        strcpy(learned, name);
+    pthread_mutex_unlock(&hostname_mutex);
+}
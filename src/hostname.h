@@ -0,0 +1,47 @@
+#ifndef foohostnamehfoo
+#define foohostnamehfoo
+
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#include <stddef.h>
+
+// Returns true if name is the mDNS name of this host: the first label of
+// the host name followed by ".local", or the name the mDNS responder
+// renamed it to after a conflict ("HOST-2.local"), once that is known.
+int hostname_is_self(const char* name);
+
+// Learns the mDNS name of this host from an answer of the mDNS responder:
+// if name is "HOST.local" or "HOST-N.local" and address is one of ours,
+// that is the name we are announced under. Meant for answers fresh from a
+// backend; answers from the cache have nothing new to tell.
+void hostname_observe(const char* name, int af, const void* address);
+
+// Writes the first label of host followed by ".local" to buf. Returns -1 if
+// that does not fit or host is not usable as an mDNS name.
+int hostname_mdns_name(const char* host, char* buf, size_t len);
+
+// Returns true if name is "HOST.local" or "HOST-N.local", where N is a
+// number of at least 2 as used by avahi when renaming after a conflict.
+int hostname_is_conflict_form(const char* mdns_name, const char* name);
+
+// Compares two host names, ignoring case and a trailing dot.
+int hostname_equal(const char* a, const char* b);
+
+#endif
@@ -0,0 +1,305 @@
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <arpa/inet.h>
+#include <assert.h>
+#include <ctype.h>
+#include <net/if.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include "hosts.h"
+#include "util.h"
+
+#define WHITESPACE " \t"
+
+// How often the hosts file is checked for changes, in milliseconds.
+#define HOSTS_CHECK_INTERVAL 1000
+
+static pthread_mutex_t hosts_mutex = PTHREAD_MUTEX_INITIALIZER;
+static hosts_table_t hosts_current;
+static int hosts_loaded = 0;
+static uint64_t hosts_checked_at = 0;
+static struct stat hosts_stat, hosts_allow_stat;
+
+void hosts_table_init(hosts_table_t* table) {
+    assert(table);
+
+    memset(table, 0, sizeof(*table));
+}
+
+static size_t address_size(int af) {
+    return af == AF_INET ? sizeof(ipv4_address_t) : sizeof(ipv6_address_t);
+}
+
+// The length of a name without its trailing dot.
+static size_t name_length(const char* name) {
+    size_t l = strlen(name);
+
+    return l > 0 && name[l - 1] == '.' ? l - 1 : l;
+}
+
+// FNV-1a over the first len characters of the lower-cased name.
+static unsigned hash_name(const char* name, size_t len) {
+    uint32_t h = 2166136261u;
+
+    for (size_t i = 0; i < len; i++)
+        h = (h ^ (uint8_t)tolower((unsigned char)name[i])) * 16777619u;
+
+    return h;
+}
+
+// FNV-1a over the address.
+static unsigned hash_address(int af, const void* address) {
+    uint32_t h = 2166136261u ^ (uint32_t)af;
+    const uint8_t* p = address;
+
+    for (size_t i = 0; i < address_size(af); i++)
+        h = (h ^ p[i]) * 16777619u;
+
+    return h;
+}
+
+static const hosts_entry_t* find_address(const hosts_table_t* table, int af,
+                                         const void* address) {
+    unsigned h = hash_address(af, address);
+
+    for (unsigned i = 0; i < HOSTS_INDEX_SIZE; i++) {
+        uint16_t slot = table->by_address[(h + i) % HOSTS_INDEX_SIZE];
+        const hosts_entry_t* e;
+
+        if (!slot)
+            break;
+
+        e = &table->entries[slot - 1];
+        if (e->address.af == af &&
+            memcmp(&e->address.address, address, address_size(af)) == 0)
+            return e;
+    }
+
+    return NULL;
+}
+
+// There are fewer entries than index slots, so a free one is always found.
+static void index_add(uint16_t* index, unsigned h, int entry) {
+    while (index[h % HOSTS_INDEX_SIZE])
+        h++;
+    index[h % HOSTS_INDEX_SIZE] = (uint16_t)(entry + 1);
+}
+
+static int add_entry(hosts_table_t* table,
+                     const query_address_result_t* address, const char* name,
+                     int canonical) {
+    size_t len = name_length(name);
+    hosts_entry_t* e;
+
+    if (table->n_entries >= HOSTS_MAX_ENTRIES || len == 0 ||
+        table->names_used + len + 1 > HOSTS_NAMES_SIZE)
+        return -1;
+
+    e = &table->entries[table->n_entries];
+    e->address = *address;
+    e->name = (uint16_t)table->names_used;
+    memcpy(table->names + table->names_used, name, len);
+    table->names[table->names_used + len] = 0;
+    table->names_used += len + 1;
+
+    index_add(table->by_name, hash_name(name, len), table->n_entries);
+    // The first line of an address wins, as with /etc/hosts.
+    if (canonical && !find_address(table, address->af, &address->address))
+        index_add(table->by_address,
+                  hash_address(address->af, &address->address),
+                  table->n_entries);
+
+    table->n_entries++;
+    return 0;
+}
+
+// Parses "ADDRESS[%SCOPE]", where SCOPE is an interface name or index.
+static int parse_address(char* text, query_address_result_t* result) {
+    char* scope = strchr(text, '%');
+
+    memset(result, 0, sizeof(*result));
+
+    if (scope)
+        *(scope++) = 0;
+
+    if (!scope && inet_pton(AF_INET, text, &result->address) == 1)
+        result->af = AF_INET;
+    else if (inet_pton(AF_INET6, text, &result->address) == 1)
+        result->af = AF_INET6;
+    else
+        return -1;
+
+    if (scope) {
+        char* end;
+        unsigned long index = strtoul(scope, &end, 10);
+
+        result->scopeid =
+            *scope && !*end ? (uint32_t)index : if_nametoindex(scope);
+        if (!result->scopeid)
+            return -1;
+    }
+
+    return 0;
+}
+
+void hosts_parse(FILE* f, FILE* mdns_allow_file, hosts_table_t* table) {
+    char ln[512];
+
+    assert(f);
+    assert(table);
+
+    while (fgets(ln, sizeof(ln), f)) {
+        query_address_result_t address;
+        char *save, *name;
+        int canonical = 1;
+
+        ln[strcspn(ln, "#\n\r")] = 0;
+
+        if (!(name = strtok_r(ln, WHITESPACE, &save)) ||
+            parse_address(name, &address) < 0)
+            continue;
+
+        while ((name = strtok_r(NULL, WHITESPACE, &save))) {
+            if (mdns_allow_file)
+                rewind(mdns_allow_file);
+            if (verify_name_allowed(name, mdns_allow_file) ==
+                VERIFY_NAME_RESULT_NOT_ALLOWED)
+                continue;
+
+            if (add_entry(table, &address, name, canonical) == 0)
+                canonical = 0;
+        }
+    }
+}
+
+int hosts_table_lookup_name(const hosts_table_t* table, int af,
+                            const char* name, query_address_result_t* result,
+                            int max) {
+    size_t len = name_length(name);
+    unsigned h = hash_name(name, len);
+    int n = 0;
+
+    assert(table);
+
+    // Entries of the same name follow each other in file order.
+    for (unsigned i = 0; i < HOSTS_INDEX_SIZE && n < max; i++) {
+        uint16_t slot = table->by_name[(h + i) % HOSTS_INDEX_SIZE];
+        const hosts_entry_t* e;
+        const char* entry_name;
+
+        if (!slot)
+            break;
+
+        e = &table->entries[slot - 1];
+        entry_name = table->names + e->name;
+        if ((af == AF_UNSPEC || e->address.af == af) &&
+            strlen(entry_name) == len &&
+            strncasecmp(entry_name, name, len) == 0)
+            result[n++] = e->address;
+    }
+
+    return n;
+}
+
+int hosts_table_lookup_address(const hosts_table_t* table, int af,
+                               const void* address, char* name,
+                               size_t name_len) {
+    const hosts_entry_t* e;
+
+    assert(table);
+
+    if (!(e = find_address(table, af, address)))
+        return 0;
+
+    strncpy(name, table->names + e->name, name_len - 1);
+    name[name_len - 1] = 0;
+    return 1;
+}
+
+// Reloads the hosts file if it or the allow file, which filters its names,
+// changed. Call with hosts_mutex held.
+static void refresh(void) {
+    uint64_t now = monotonic_msec();
+    struct stat st, allow_st;
+
+    if (hosts_loaded && now - hosts_checked_at < HOSTS_CHECK_INTERVAL)
+        return;
+
+    memset(&st, 0, sizeof(st));
+    memset(&allow_st, 0, sizeof(allow_st));
+    // A missing file is treated like an empty one.
+    stat(MDNS_HOSTS_FILE, &st);
+    stat(MDNS_ALLOW_FILE, &allow_st);
+
+    if (!hosts_loaded || stat_changed(&st, &hosts_stat) ||
+        stat_changed(&allow_st, &hosts_allow_stat)) {
+        FILE *f, *mdns_allow_file;
+
+        hosts_table_init(&hosts_current);
+        if ((f = fopen(MDNS_HOSTS_FILE, "re"))) {
+            mdns_allow_file = fopen(MDNS_ALLOW_FILE, "re");
+            hosts_parse(f, mdns_allow_file, &hosts_current);
+            if (mdns_allow_file)
+                fclose(mdns_allow_file);
+            fclose(f);
+        }
+        hosts_stat = st;
+        hosts_allow_stat = allow_st;
+        hosts_loaded = 1;
+    }
+    hosts_checked_at = now;
+}
+
+int hosts_resolve_name(int af, const char* name,
+                       query_address_result_t* result, int max) {
+    int n;
+
+    pthread_mutex_lock(&hosts_mutex);
+    refresh();
+    n = hosts_current.n_entries
+            ? hosts_table_lookup_name(&hosts_current, af, name, result, max)
+            : 0;
+    pthread_mutex_unlock(&hosts_mutex);
+
+    return n;
+}
+
+int hosts_resolve_address(int af, const void* address, char* name,
+                          size_t name_len) {
+    int found;
+
+    pthread_mutex_lock(&hosts_mutex);
+    refresh();
+    found = hosts_current.n_entries &&
+            hosts_table_lookup_address(&hosts_current, af, address, name,
+                                       name_len);
+    pthread_mutex_unlock(&hosts_mutex);
+
+    return found;
+}
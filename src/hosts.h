@@ -0,0 +1,77 @@
+#ifndef foohostshfoo
+#define foohostshfoo
+
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#include <stdio.h>
+
+#include "avahi.h"
+
+// Maximum number of names in the hosts file, and the size of the index
+// slots and of the string space for them.
+#define HOSTS_MAX_ENTRIES 256
+#define HOSTS_INDEX_SIZE 512
+#define HOSTS_NAMES_SIZE 16384
+
+// A name with one of its addresses; name is its offset in the string
+// space.
+typedef struct {
+    query_address_result_t address;
+    uint16_t name;
+} hosts_entry_t;
+
+// A parsed hosts file, indexed by name and by address. Index slots hold
+// entry numbers plus one, or 0 if unused. Only the first name of an
+// address, its canonical name, is in the address index.
+typedef struct {
+    hosts_entry_t entries[HOSTS_MAX_ENTRIES];
+    int n_entries;
+    char names[HOSTS_NAMES_SIZE];
+    size_t names_used;
+    uint16_t by_name[HOSTS_INDEX_SIZE];
+    uint16_t by_address[HOSTS_INDEX_SIZE];
+} hosts_table_t;
+
+void hosts_table_init(hosts_table_t* table);
+
+// Adds the entries of a file in hosts(5) syntax to the table. Names that
+// mdns_allow_file (see verify_name_allowed) doesn't allow are skipped, as
+// are entries that don't fit.
+void hosts_parse(FILE* f, FILE* mdns_allow_file, hosts_table_t* table);
+
+// Looks up the addresses of name of family af, or of all families for
+// AF_UNSPEC. Returns how many of them were stored in result.
+int hosts_table_lookup_name(const hosts_table_t* table, int af,
+                            const char* name, query_address_result_t* result,
+                            int max);
+
+// Looks up the canonical name of an address. Returns true if it is known.
+int hosts_table_lookup_address(const hosts_table_t* table, int af,
+                               const void* address, char* name,
+                               size_t name_len);
+
+// Like the above, on MDNS_HOSTS_FILE, which is reloaded when it or
+// MDNS_ALLOW_FILE changed. Every name found passed verify_name_allowed().
+int hosts_resolve_name(int af, const char* name,
+                       query_address_result_t* result, int max);
+int hosts_resolve_address(int af, const void* address, char* name,
+                          size_t name_len);
+
+#endif
@@ -0,0 +1,234 @@
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <net/if.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/socket.h>
+#ifdef HAVE_IFADDRS_H
+#include <ifaddrs.h>
+#endif
+
+#include "ifstate.h"
+#include "netlink.h"
+#include "util.h"
+
+// How often the interfaces are scanned when changes cannot be monitored,
+// in milliseconds.
+#define IFSTATE_SCAN_INTERVAL 1000
+
+static pthread_mutex_t ifstate_mutex = PTHREAD_MUTEX_INITIALIZER;
+static ifstate_address_t addresses[IFSTATE_MAX_ADDRESSES];
+static int n_addresses = 0;
+// True if the interfaces could not be read, in which case nothing is known
+// about them.
+static int unknown = 1;
+static int dirty = 1;
+static uint64_t scanned_at = 0;
+
+static void on_change(const netlink_event_t* event) {
+    (void)event;
+
+    pthread_mutex_lock(&ifstate_mutex);
+    dirty = 1;
+    pthread_mutex_unlock(&ifstate_mutex);
+}
+
+#ifdef HAVE_IFADDRS_H
+static int prefix_length(const uint8_t* mask, size_t len) {
+    int bits = 0;
+
+    for (size_t i = 0; i < len && mask[i] == 0xFF; i++)
+        bits += 8;
+    if (bits < (int)len * 8)
+        for (uint8_t b = mask[bits / 8]; b & 0x80; b <<= 1)
+            bits++;
+
+    return bits;
+}
+
+static void scan(void) {
+    struct ifaddrs *ifa, *i;
+    const char* last_name = NULL;
+    uint32_t last_index = 0;
+
+    n_addresses = 0;
+    unknown = 1;
+
+    if (getifaddrs(&ifa) < 0)
+        return;
+
+    unknown = 0;
+
+    for (i = ifa; i && n_addresses < IFSTATE_MAX_ADDRESSES; i = i->ifa_next) {
+        ifstate_address_t* a = &addresses[n_addresses];
+        const uint8_t *address, *mask = NULL;
+        size_t len;
+
+        if (!i->ifa_addr || !(i->ifa_flags & IFF_UP))
+            continue;
+
+        if (i->ifa_addr->sa_family == AF_INET) {
+            address = (const uint8_t*)&((struct sockaddr_in*)i->ifa_addr)
+                          ->sin_addr;
+            if (i->ifa_netmask)
+                mask = (const uint8_t*)&((struct sockaddr_in*)i->ifa_netmask)
+                           ->sin_addr;
+            len = 4;
+        } else if (i->ifa_addr->sa_family == AF_INET6) {
+            address = ((struct sockaddr_in6*)i->ifa_addr)->sin6_addr.s6_addr;
+            if (i->ifa_netmask)
+                mask = ((struct sockaddr_in6*)i->ifa_netmask)->sin6_addr.s6_addr;
+            len = 16;
+        } else
+            continue;
+
+        memset(a, 0, sizeof(*a));
+        a->af = i->ifa_addr->sa_family;
+        memcpy(a->address, address, len);
+        a->prefixlen = mask ? prefix_length(mask, len) : (int)len * 8;
+
+        // Link-local addresses carry their interface, others need a lookup.
+        // getifaddrs() lists the addresses of an interface together, so
+        // remembering the last one saves most of them.
+        if (a->af == AF_INET6 &&
+            ((struct sockaddr_in6*)i->ifa_addr)->sin6_scope_id)
+            a->ifindex = ((struct sockaddr_in6*)i->ifa_addr)->sin6_scope_id;
+        else {
+            if (!last_name || strcmp(i->ifa_name, last_name) != 0) {
+                last_name = i->ifa_name;
+                last_index = if_nametoindex(i->ifa_name);
+            }
+            a->ifindex = last_index;
+        }
+
+        if (i->ifa_flags & IFF_LOOPBACK)
+            a->flags |= IFSTATE_LOOPBACK;
+        else if ((i->ifa_flags & IFF_RUNNING) && (i->ifa_flags & IFF_MULTICAST))
+            a->flags |= IFSTATE_USABLE;
+
+        n_addresses++;
+    }
+
+    freeifaddrs(ifa);
+}
+#else
+static void scan(void) {
+    n_addresses = 0;
+    unknown = 1;
+}
+#endif
+
+// Brings the snapshot up to date. Call with ifstate_mutex held.
+static void refresh(int monitored) {
+    uint64_t now = monotonic_msec();
+
+    if (dirty || (!monitored && now - scanned_at >= IFSTATE_SCAN_INTERVAL)) {
+        scan();
+        dirty = 0;
+        scanned_at = now;
+    }
+}
+
+static void lock_current(void) {
+    int monitored;
+
+    netlink_subscribe(on_change);
+    monitored = netlink_poll() == 0;
+
+    pthread_mutex_lock(&ifstate_mutex);
+    refresh(monitored);
+}
+
+int ifstate_usable_addresses(int af, query_address_result_t* result,
+                             int max) {
+    static const int families[] = {AF_INET, AF_INET6};
+    int n = 0;
+
+    lock_current();
+
+    for (size_t f = 0; f < sizeof(families) / sizeof(families[0]); f++) {
+        if (af != AF_UNSPEC && af != families[f])
+            continue;
+
+        for (int i = 0; i < n_addresses && n < max; i++) {
+            const ifstate_address_t* a = &addresses[i];
+
+            if (a->af != families[f] || !(a->flags & IFSTATE_USABLE))
+                continue;
+
+            memset(&result[n], 0, sizeof(result[n]));
+            result[n].af = a->af;
+            result[n].scopeid = a->ifindex;
+            memcpy(&result[n].address, a->address,
+                   a->af == AF_INET ? sizeof(ipv4_address_t)
+                                    : sizeof(ipv6_address_t));
+            n++;
+        }
+    }
+
+    pthread_mutex_unlock(&ifstate_mutex);
+    return n;
+}
+
+int ifstate_is_local_address(int af, const void* address) {
+    size_t len = af == AF_INET ? 4 : 16;
+    int found = 0;
+
+    lock_current();
+
+    for (int i = 0; i < n_addresses && !found; i++)
+        found = addresses[i].af == af &&
+                memcmp(addresses[i].address, address, len) == 0;
+
+    pthread_mutex_unlock(&ifstate_mutex);
+    return found;
+}
+
+int ifstate_has_family(int af) {
+    int found;
+
+    lock_current();
+
+    found = unknown;
+    for (int i = 0; i < n_addresses && !found; i++)
+        found = addresses[i].af == af &&
+                !(addresses[i].flags & IFSTATE_LOOPBACK);
+
+    pthread_mutex_unlock(&ifstate_mutex);
+    return found;
+}
+
+int ifstate_addresses(ifstate_address_t* result, int max) {
+    int n = -1;
+
+    lock_current();
+
+    if (!unknown)
+        for (n = 0; n < n_addresses && n < max; n++)
+            result[n] = addresses[n];
+
+    pthread_mutex_unlock(&ifstate_mutex);
+    return n;
+}
@@ -0,0 +1,64 @@
+#ifndef fooifstatehfoo
+#define fooifstatehfoo
+
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#include <inttypes.h>
+
+#include "avahi.h"
+
+// Maximum number of addresses remembered.
+#define IFSTATE_MAX_ADDRESSES 64
+
+// The address is on a loopback interface.
+#define IFSTATE_LOOPBACK 0x1
+// The address is on an interface that is up and multicast capable, so the
+// mDNS responder announces it.
+#define IFSTATE_USABLE 0x2
+
+// An address configured on this host.
+typedef struct {
+    int af;
+    uint32_t ifindex;
+    uint8_t address[16];
+    int prefixlen;
+    unsigned flags;
+} ifstate_address_t;
+
+// Copies up to max usable addresses of family af (AF_UNSPEC for both, IPv4
+// first) into result, with the interface index as scope id. Returns the
+// number of addresses copied.
+int ifstate_usable_addresses(int af, query_address_result_t* result, int max);
+
+// Returns true if address is configured on any interface of this host.
+int ifstate_is_local_address(int af, const void* address);
+
+// Returns true if an interface that is up has an address of family af
+// other than a loopback one, or if the interfaces cannot be read. Like
+// AI_ADDRCONFIG, except that link-local addresses count, as they are all
+// mDNS needs.
+int ifstate_has_family(int af);
+
+// Copies up to max addresses of the interfaces that are up into result.
+// Returns the number of addresses copied, or -1 if the interfaces cannot
+// be read.
+int ifstate_addresses(ifstate_address_t* result, int max);
+
+#endif
@@ -0,0 +1,189 @@
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pthread.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+
+#include "learn.h"
+#include "stats.h"
+#include "util.h"
+
+// The probe interval doubles up to 1 << LEARN_MAX_BACKOFF times the
+// configured one.
+#define LEARN_MAX_BACKOFF 4
+
+typedef struct {
+    unsigned misses;
+    // Whether misses reached the threshold, as counted by the
+    // STATS_GAUGE_MISSING_* gauges.
+    int missing;
+    unsigned backoff;
+    uint64_t next_probe;
+} family_state_t;
+
+typedef struct {
+    // Empty for an unused slot.
+    char suffix[256];
+    // IPv4 and IPv6.
+    family_state_t family[2];
+    // Value of use_counter when last used.
+    uint64_t used_at;
+} suffix_state_t;
+
+static pthread_mutex_t learn_mutex = PTHREAD_MUTEX_INITIALIZER;
+static suffix_state_t suffixes[LEARN_MAX_SUFFIXES];
+static uint64_t use_counter = 0;
+
+static const stats_gauge_t missing_gauges[2] = {STATS_GAUGE_MISSING_IPV4,
+                                                 STATS_GAUGE_MISSING_IPV6};
+
+static void set_missing(family_state_t* f, int j, int missing) {
+    if (f->missing != missing)
+        stats_gauge_add(missing_gauges[j], missing ? 1 : -1);
+    f->missing = missing;
+}
+
+// Drops what was learned about a domain.
+static void forget(suffix_state_t* s) {
+    for (int j = 0; j < 2; j++)
+        set_missing(&s->family[j], j, 0);
+    memset(s, 0, sizeof(*s));
+}
+
+// Returns the domain of name, and its length without a trailing dot in
+// *len.
+static const char* domain_of(const char* name, size_t* len) {
+    const char* dot = strchr(name, '.');
+    const char* d = dot && dot[1] ? dot + 1 : name;
+
+    *len = strlen(d);
+    if (*len > 0 && d[*len - 1] == '.')
+        (*len)--;
+
+    return d;
+}
+
+// Finds the state of the domain of name. If create is true, a missing one
+// is set up, replacing the least recently used. Call with learn_mutex held.
+static family_state_t* find(const char* name, int af, int create) {
+    size_t len;
+    const char* domain = domain_of(name, &len);
+    suffix_state_t *s = NULL, *victim = &suffixes[0];
+
+    if (len >= sizeof(s->suffix))
+        return NULL;
+
+    for (int i = 0; i < LEARN_MAX_SUFFIXES; i++) {
+        suffix_state_t* c = &suffixes[i];
+
+        if (c->suffix[0] && strncasecmp(c->suffix, domain, len) == 0 &&
+            c->suffix[len] == 0) {
+            s = c;
+            break;
+        }
+        if (victim->suffix[0] &&
+            (!c->suffix[0] || c->used_at < victim->used_at))
+            victim = c;
+    }
+
+    if (!s) {
+        if (!create)
+            return NULL;
+        s = victim;
+        forget(s);
+        memcpy(s->suffix, domain, len);
+    }
+
+    s->used_at = ++use_counter;
+    return &s->family[af == AF_INET6];
+}
+
+int learn_is_missing(const char* name, int af, unsigned threshold) {
+    family_state_t* f;
+    int missing;
+
+    pthread_mutex_lock(&learn_mutex);
+    f = find(name, af, 0);
+    missing = f && threshold > 0 && f->misses >= threshold;
+    pthread_mutex_unlock(&learn_mutex);
+
+    return missing;
+}
+
+static void schedule_probe(family_state_t* f, int interval, uint64_t now) {
+    f->next_probe = now + ((uint64_t)interval << f->backoff);
+    if (f->backoff < LEARN_MAX_BACKOFF)
+        f->backoff++;
+}
+
+int learn_should_query(const char* name, int af, unsigned threshold,
+                       int interval) {
+    family_state_t* f;
+    uint64_t now = monotonic_msec();
+    int query = 1;
+
+    pthread_mutex_lock(&learn_mutex);
+
+    f = find(name, af, 0);
+    if (f && threshold > 0 && f->misses >= threshold) {
+        if (now >= f->next_probe) {
+            stats_count(STATS_FAMILY_PROBED);
+            schedule_probe(f, interval, now);
+        } else {
+            stats_count(STATS_FAMILY_SKIPPED);
+            query = 0;
+        }
+    }
+
+    pthread_mutex_unlock(&learn_mutex);
+    return query;
+}
+
+void learn_report(const char* name, int af, int found, unsigned threshold,
+                  int interval) {
+    family_state_t* f;
+
+    pthread_mutex_lock(&learn_mutex);
+
+    if ((f = find(name, af, !found))) {
+        if (found) {
+            f->misses = 0;
+            f->backoff = 0;
+            set_missing(f, af == AF_INET6, 0);
+        } else if (++f->misses == threshold) {
+            schedule_probe(f, interval, monotonic_msec());
+            set_missing(f, af == AF_INET6, 1);
+        }
+    }
+
+    pthread_mutex_unlock(&learn_mutex);
+}
+
+void learn_reset(void) {
+    pthread_mutex_lock(&learn_mutex);
+    for (int i = 0; i < LEARN_MAX_SUFFIXES; i++)
+        forget(&suffixes[i]);
+    pthread_mutex_unlock(&learn_mutex);
+}
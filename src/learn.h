@@ -0,0 +1,50 @@
+#ifndef foolearnhfoo
+#define foolearnhfoo
+
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#include <inttypes.h>
+
+// Number of domains whose answers are learned from. What is learned is
+// shared by all hosts of a domain, so for two-label names such as
+// foo.local it holds for the whole local link. The number of domains a
+// family is missing in, and the queries skipped and probes sent because of
+// it, are exported as statistics.
+#define LEARN_MAX_SUFFIXES 32
+
+// Returns true if hosts in the domain of name were found without an
+// address of family af at least threshold times in a row.
+int learn_is_missing(const char* name, int af, unsigned threshold);
+
+// Decides whether to ask for addresses of family af of a host that has
+// been found with the other family. Once the family is learned to be
+// missing, it is only asked for every interval milliseconds, doubling up to
+// 16 times that while it stays missing.
+int learn_should_query(const char* name, int af, unsigned threshold,
+                       int interval);
+
+// Records whether a host that exists had an address of family af.
+void learn_report(const char* name, int af, int found, unsigned threshold,
+                  int interval);
+
+// Forgets everything learned.
+void learn_reset(void);
+
+#endif
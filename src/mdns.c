@@ -0,0 +1,763 @@
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <assert.h>
+#include <errno.h>
+#include <ifaddrs.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include "mdns.h"
+#include "util.h"
+
+// Maximum number of interfaces a query is sent on, per address family.
+#define MDNS_MAX_INTERFACES 32
+
+// Delay before the first retransmission of a query, in milliseconds. It is
+// doubled for every following one.
+#define MDNS_RETRANSMIT_INTERVAL 1000
+
+// Maximum number of compression pointers followed while reading a name.
+#define MDNS_MAX_POINTERS 64
+
+#define MDNS_HEADER_SIZE 12
+
+static void put16(uint8_t* p, uint16_t v) {
+    p[0] = v >> 8;
+    p[1] = v & 0xFF;
+}
+
+static uint16_t get16(const uint8_t* p) { return (uint16_t)(p[0] << 8 | p[1]); }
+
+static uint32_t get32(const uint8_t* p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 |
+           p[3];
+}
+
+// Writes name in DNS wire format. Returns the number of bytes written, or
+// 0 on error.
+static size_t name_to_wire(const char* name, uint8_t* out, size_t len) {
+    size_t o = 0;
+    const char* p = name;
+
+    while (*p) {
+        size_t l = strcspn(p, ".");
+
+        if (l == 0 || l > 63 || o + l + 1 > len)
+            return 0;
+
+        out[o++] = (uint8_t)l;
+        memcpy(out + o, p, l);
+        o += l;
+        p += l;
+
+        if (*p == '.')
+            p++;
+    }
+
+    if (o + 1 > len || o + 1 > 255)
+        return 0;
+
+    out[o++] = 0;
+    return o;
+}
+
+// Reads a possibly compressed name starting at offset off. Returns the
+// offset just after the name, or -1 if the name is malformed.
+static int read_name(const uint8_t* packet, size_t len, size_t off, char* out,
+                     size_t out_len) {
+    size_t o = 0;
+    int end = -1;
+    int pointers = 0;
+
+    assert(out_len > 0);
+
+    for (;;) {
+        if (off >= len)
+            return -1;
+
+        uint8_t l = packet[off];
+
+        if ((l & 0xC0) == 0xC0) {
+            if (off + 1 >= len || ++pointers > MDNS_MAX_POINTERS)
+                return -1;
+            if (end < 0)
+                end = (int)off + 2;
+            off = (size_t)(l & 0x3F) << 8 | packet[off + 1];
+            continue;
+        }
+
+        if (l & 0xC0)
+            return -1;
+
+        off++;
+
+        if (l == 0)
+            break;
+
+        if (off + l > len || o + l + 2 > out_len)
+            return -1;
+
+        if (o > 0)
+            out[o++] = '.';
+
+        for (unsigned i = 0; i < l; i++) {
+            char c = (char)packet[off + i];
+            if (c == 0 || c == '.')
+                return -1;
+            out[o++] = c;
+        }
+
+        off += l;
+    }
+
+    out[o] = 0;
+
+    return end >= 0 ? end : (int)off;
+}
+
+// Compares two names, ignoring case and a trailing dot.
+static int name_equal(const char* a, const char* b) {
+    size_t la = strlen(a), lb = strlen(b);
+
+    if (la > 0 && a[la - 1] == '.')
+        la--;
+    if (lb > 0 && b[lb - 1] == '.')
+        lb--;
+
+    return la == lb && strncasecmp(a, b, la) == 0;
+}
+
+size_t mdns_build_query(uint8_t* packet, size_t len, const char* name,
+                        uint16_t type) {
+    size_t l;
+
+    assert(packet);
+    assert(name);
+
+    if (len < MDNS_HEADER_SIZE + 4)
+        return 0;
+
+    // Multicast queries carry a zero ID and no flags (RFC 6762 section 18).
+    memset(packet, 0, MDNS_HEADER_SIZE);
+    put16(packet + 4, 1);
+
+    if (!(l = name_to_wire(name, packet + MDNS_HEADER_SIZE,
+                           len - MDNS_HEADER_SIZE - 4)))
+        return 0;
+
+    l += MDNS_HEADER_SIZE;
+    put16(packet + l, type);
+    put16(packet + l + 2, MDNS_CLASS_IN | MDNS_CLASS_QU);
+
+    return l + 4;
+}
+
+int mdns_parse_response(const uint8_t* packet, size_t len, const char* name,
+                        uint16_t type, mdns_answer_t* answer) {
+    char rname[256];
+    int off;
+
+    assert(packet);
+    assert(name);
+    assert(answer);
+
+    if (len < MDNS_HEADER_SIZE)
+        return -1;
+
+    uint16_t flags = get16(packet + 2);
+
+    // Ignore queries from other hosts and error responses.
+    if (!(flags & 0x8000) || (flags & 0x000F))
+        return 0;
+
+    unsigned questions = get16(packet + 4);
+    unsigned records =
+        get16(packet + 6) + get16(packet + 8) + get16(packet + 10);
+
+    int asked = questions == 0;
+
+    off = MDNS_HEADER_SIZE;
+
+    for (unsigned i = 0; i < questions; i++) {
+        if ((off = read_name(packet, len, off, rname, sizeof(rname))) < 0 ||
+            (size_t)off + 4 > len)
+            return -1;
+
+        asked |= get16(packet + off) == type &&
+                 (get16(packet + off + 2) & 0x7FFF) == MDNS_CLASS_IN &&
+                 name_equal(rname, name);
+        off += 4;
+    }
+
+    // Unicast responses repeat the question they answer (RFC 6762 section
+    // 6.7). One that repeats another question is not meant for us.
+    if (!asked)
+        return 0;
+
+    // Answers to our question may appear in any section, for example as
+    // additional records of a response to another host's query.
+    for (unsigned i = 0; i < records; i++) {
+        if ((off = read_name(packet, len, off, rname, sizeof(rname))) < 0 ||
+            (size_t)off + 10 > len)
+            return -1;
+
+        uint16_t rtype = get16(packet + off);
+        uint16_t rclass = get16(packet + off + 2) & 0x7FFF;
+        uint32_t ttl = get32(packet + off + 4);
+        uint16_t rdlength = get16(packet + off + 8);
+        size_t rdata = off + 10;
+
+        if (rdata + rdlength > len)
+            return -1;
+
+        off = rdata + rdlength;
+
+        if (rtype != type || rclass != MDNS_CLASS_IN || ttl == 0 ||
+            !name_equal(rname, name))
+            continue;
+
+        switch (type) {
+        case MDNS_TYPE_A:
+        case MDNS_TYPE_AAAA:
+            if (rdlength != (type == MDNS_TYPE_A ? 4 : 16))
+                continue;
+            memcpy(answer->data.address, packet + rdata, rdlength);
+            break;
+
+        case MDNS_TYPE_PTR:
+            if (read_name(packet, rdata + rdlength, rdata, answer->data.name,
+                          sizeof(answer->data.name)) < 0)
+                continue;
+            break;
+
+        default:
+            continue;
+        }
+
+        answer->type = rtype;
+        answer->ttl = ttl;
+        answer->ifindex = 0;
+        return 1;
+    }
+
+    return 0;
+}
+
+int mdns_reverse_name(int af, const void* data, char* name, size_t name_len) {
+    const uint8_t* a = data;
+    size_t o = 0;
+    int n;
+
+    if (af == AF_INET) {
+        n = snprintf(name, name_len, "%u.%u.%u.%u.in-addr.arpa", a[3], a[2],
+                     a[1], a[0]);
+        return n < 0 || (size_t)n >= name_len ? -1 : 0;
+    }
+
+    if (af != AF_INET6)
+        return -1;
+
+    for (int i = 15; i >= 0; i--) {
+        n = snprintf(name + o, name_len - o, "%x.%x.", a[i] & 0xF, a[i] >> 4);
+        if (n < 0 || (size_t)n >= name_len - o)
+            return -1;
+        o += n;
+    }
+
+    n = snprintf(name + o, name_len - o, "ip6.arpa");
+    return n < 0 || (size_t)n >= name_len - o ? -1 : 0;
+}
+
+typedef struct {
+    int count4, count6;
+    struct in_addr addr4[MDNS_MAX_INTERFACES];
+    unsigned index6[MDNS_MAX_INTERFACES];
+} interfaces_t;
+
+// Collects the interfaces multicast queries should be sent on.
+static void find_interfaces(const struct ifaddrs* ifa_list,
+                            interfaces_t* ifs) {
+    const struct ifaddrs* ifa;
+
+    memset(ifs, 0, sizeof(*ifs));
+
+    for (ifa = ifa_list; ifa; ifa = ifa->ifa_next) {
+        if (!ifa->ifa_addr || !(ifa->ifa_flags & IFF_UP) ||
+            !(ifa->ifa_flags & IFF_MULTICAST) ||
+            (ifa->ifa_flags & IFF_LOOPBACK))
+            continue;
+
+        if (ifa->ifa_addr->sa_family == AF_INET &&
+            ifs->count4 < MDNS_MAX_INTERFACES) {
+            ifs->addr4[ifs->count4++] =
+                ((struct sockaddr_in*)ifa->ifa_addr)->sin_addr;
+        } else if (ifa->ifa_addr->sa_family == AF_INET6 &&
+                   ifs->count6 < MDNS_MAX_INTERFACES) {
+            unsigned idx = if_nametoindex(ifa->ifa_name);
+            int dup = 0;
+
+            for (int i = 0; i < ifs->count6; i++)
+                dup |= ifs->index6[i] == idx;
+
+            if (idx && !dup)
+                ifs->index6[ifs->count6++] = idx;
+        }
+    }
+}
+
+// Returns non-zero if the first bits of a and b selected by mask are equal.
+static int prefix_equal(const uint8_t* a, const uint8_t* b,
+                        const uint8_t* mask, size_t len) {
+    for (size_t i = 0; i < len; i++)
+        if ((a[i] ^ b[i]) & mask[i])
+            return 0;
+    return 1;
+}
+
+static int source_on_link(const struct ifaddrs* ifa_list,
+                          const struct sockaddr* source, uint32_t ifindex) {
+    const uint8_t *src, *addr, *mask;
+    size_t len;
+
+    // Link-local addresses (RFC 3927, RFC 4291) are on every link.
+    if (source->sa_family == AF_INET) {
+        src = (const uint8_t*)&((const struct sockaddr_in*)source)->sin_addr;
+        len = 4;
+        if (src[0] == 169 && src[1] == 254)
+            return 1;
+    } else if (source->sa_family == AF_INET6) {
+        const struct in6_addr* a6 =
+            &((const struct sockaddr_in6*)source)->sin6_addr;
+        if (IN6_IS_ADDR_LINKLOCAL(a6))
+            return 1;
+        src = (const uint8_t*)a6;
+        len = 16;
+    } else
+        return 0;
+
+    for (const struct ifaddrs* ifa = ifa_list; ifa; ifa = ifa->ifa_next) {
+        if (!ifa->ifa_addr || !ifa->ifa_netmask ||
+            ifa->ifa_addr->sa_family != source->sa_family ||
+            (ifindex && if_nametoindex(ifa->ifa_name) != ifindex))
+            continue;
+
+        if (source->sa_family == AF_INET) {
+            addr = (const uint8_t*)&((struct sockaddr_in*)ifa->ifa_addr)
+                       ->sin_addr;
+            mask = (const uint8_t*)&((struct sockaddr_in*)ifa->ifa_netmask)
+                       ->sin_addr;
+        } else {
+            addr = (const uint8_t*)&((struct sockaddr_in6*)ifa->ifa_addr)
+                       ->sin6_addr;
+            mask = (const uint8_t*)&((struct sockaddr_in6*)ifa->ifa_netmask)
+                       ->sin6_addr;
+        }
+
+        if (prefix_equal(src, addr, mask, len))
+            return 1;
+    }
+
+    return 0;
+}
+
+int mdns_source_on_link(const struct sockaddr* source, uint32_t ifindex) {
+    struct ifaddrs* ifa_list;
+    int r;
+
+    assert(source);
+
+    if (getifaddrs(&ifa_list) < 0)
+        return 0;
+
+    r = source_on_link(ifa_list, source, ifindex);
+    freeifaddrs(ifa_list);
+    return r;
+}
+
+static int open_query_socket(int af) {
+    int fd, one = 1, ttl = 255;
+
+    if ((fd = socket(af, SOCK_DGRAM, 0)) < 0)
+        return -1;
+
+    set_cloexec(fd);
+
+    // Responses to multicast queries are sent with TTL 255, and so are
+    // our queries (RFC 6762 section 11).
+    if (af == AF_INET) {
+        unsigned char mttl = 255, loop = 1;
+        setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &mttl, sizeof(mttl));
+        setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+        setsockopt(fd, IPPROTO_IP, IP_TTL, &ttl, sizeof(ttl));
+#ifdef IP_PKTINFO
+        setsockopt(fd, IPPROTO_IP, IP_PKTINFO, &one, sizeof(one));
+#endif
+#ifdef IP_RECVTTL
+        setsockopt(fd, IPPROTO_IP, IP_RECVTTL, &one, sizeof(one));
+#endif
+    } else {
+        setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &one, sizeof(one));
+        setsockopt(fd, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, &ttl, sizeof(ttl));
+        setsockopt(fd, IPPROTO_IPV6, IPV6_MULTICAST_LOOP, &one, sizeof(one));
+        setsockopt(fd, IPPROTO_IPV6, IPV6_UNICAST_HOPS, &ttl, sizeof(ttl));
+#ifdef IPV6_RECVPKTINFO
+        setsockopt(fd, IPPROTO_IPV6, IPV6_RECVPKTINFO, &one, sizeof(one));
+#endif
+#ifdef IPV6_RECVHOPLIMIT
+        setsockopt(fd, IPPROTO_IPV6, IPV6_RECVHOPLIMIT, &one, sizeof(one));
+#endif
+    }
+
+    return fd;
+}
+
+static int is_multicast(const struct sockaddr* sa) {
+    if (sa->sa_family == AF_INET)
+        return IN_MULTICAST(ntohl(((const struct sockaddr_in*)sa)->sin_addr.s_addr));
+    return IN6_IS_ADDR_MULTICAST(&((const struct sockaddr_in6*)sa)->sin6_addr);
+}
+
+static uint16_t sockaddr_port(const struct sockaddr* sa) {
+    if (sa->sa_family == AF_INET)
+        return ((const struct sockaddr_in*)sa)->sin_port;
+    return ((const struct sockaddr_in6*)sa)->sin6_port;
+}
+
+// Sends the query to dest. Returns the number of packets sent.
+static int send_query(int fd, const uint8_t* packet, size_t len,
+                      const struct sockaddr* dest, socklen_t dest_len,
+                      const interfaces_t* ifs) {
+    int sent = 0;
+
+    if (!is_multicast(dest) ||
+        (dest->sa_family == AF_INET ? ifs->count4 : ifs->count6) == 0)
+        return sendto(fd, packet, len, 0, dest, dest_len) >= 0;
+
+    if (dest->sa_family == AF_INET) {
+        for (int i = 0; i < ifs->count4; i++) {
+            if (setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &ifs->addr4[i],
+                           sizeof(ifs->addr4[i])) < 0)
+                continue;
+            sent += sendto(fd, packet, len, 0, dest, dest_len) >= 0;
+        }
+    } else {
+        struct sockaddr_in6 sa6;
+        memcpy(&sa6, dest, sizeof(sa6));
+
+        for (int i = 0; i < ifs->count6; i++) {
+            unsigned idx = ifs->index6[i];
+            if (setsockopt(fd, IPPROTO_IPV6, IPV6_MULTICAST_IF, &idx,
+                           sizeof(idx)) < 0)
+                continue;
+            sa6.sin6_scope_id = idx;
+            sent += sendto(fd, packet, len, 0, (struct sockaddr*)&sa6,
+                           sizeof(sa6)) >= 0;
+        }
+    }
+
+    return sent;
+}
+
+// Reads one packet from fd. Returns its length, or -1. Its source address
+// is returned in from, the interface index it arrived on in ifindex (0 if
+// unknown) and its IP TTL or hop limit in ttl (-1 if unknown).
+static ssize_t receive_packet(int fd, uint8_t* packet, size_t len,
+                              struct sockaddr_storage* from, uint32_t* ifindex,
+                              int* ttl) {
+    union {
+        struct cmsghdr align;
+        char buf[256];
+    } control;
+    struct iovec iov = {.iov_base = packet, .iov_len = len};
+    struct msghdr msg;
+    ssize_t r;
+
+    memset(&msg, 0, sizeof(msg));
+    memset(from, 0, sizeof(*from));
+    msg.msg_name = from;
+    msg.msg_namelen = sizeof(*from);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    if ((r = recvmsg(fd, &msg, 0)) < 0)
+        return -1;
+
+    *ifindex = 0;
+    *ttl = -1;
+
+    if (from->ss_family == AF_INET6)
+        *ifindex = ((struct sockaddr_in6*)from)->sin6_scope_id;
+
+    for (struct cmsghdr* c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+#ifdef IP_PKTINFO
+        if (c->cmsg_level == IPPROTO_IP && c->cmsg_type == IP_PKTINFO)
+            *ifindex = ((struct in_pktinfo*)CMSG_DATA(c))->ipi_ifindex;
+#endif
+#ifdef IP_RECVTTL
+        if (c->cmsg_level == IPPROTO_IP && c->cmsg_type == IP_TTL)
+            memcpy(ttl, CMSG_DATA(c), sizeof(*ttl));
+#endif
+#ifdef IPV6_RECVPKTINFO
+        if (c->cmsg_level == IPPROTO_IPV6 && c->cmsg_type == IPV6_PKTINFO)
+            *ifindex = ((struct in6_pktinfo*)CMSG_DATA(c))->ipi6_ifindex;
+#endif
+#ifdef IPV6_RECVHOPLIMIT
+        if (c->cmsg_level == IPPROTO_IPV6 && c->cmsg_type == IPV6_HOPLIMIT)
+            memcpy(ttl, CMSG_DATA(c), sizeof(*ttl));
+#endif
+    }
+
+    return r;
+}
+
+static int sockaddr_equal(const struct sockaddr* a, const struct sockaddr* b) {
+    if (a->sa_family != b->sa_family || sockaddr_port(a) != sockaddr_port(b))
+        return 0;
+    if (a->sa_family == AF_INET)
+        return ((const struct sockaddr_in*)a)->sin_addr.s_addr ==
+               ((const struct sockaddr_in*)b)->sin_addr.s_addr;
+    return IN6_ARE_ADDR_EQUAL(&((const struct sockaddr_in6*)a)->sin6_addr,
+                              &((const struct sockaddr_in6*)b)->sin6_addr);
+}
+
+// Decides whether a packet from source may answer a query sent to target.
+// A query sent to a unicast address is answered by that address. Answers to
+// a multicast query must come from the mDNS port of a host on the link they
+// arrived on, and must not have crossed a router (RFC 6762 section 11).
+static int source_acceptable(const struct ifaddrs* ifa_list,
+                             const struct sockaddr* target,
+                             const struct sockaddr* source, uint32_t ifindex,
+                             int ttl) {
+    if (!is_multicast(target))
+        return sockaddr_equal(source, target);
+
+    return sockaddr_port(source) == sockaddr_port(target) &&
+           (ttl < 0 || ttl == 255) &&
+           source_on_link(ifa_list, source, ifindex);
+}
+
+static avahi_resolve_result_t
+mdns_query_targets(const char* name, uint16_t type,
+                   const struct sockaddr_storage* targets, int n_targets,
+                   int timeout, mdns_answer_t* answer) {
+    uint8_t query[512], packet[MDNS_PACKET_MAX];
+    size_t query_len;
+    struct pollfd fds[2];
+    int families[2];
+    const struct sockaddr* fd_targets[2];
+    int n_fds = 0;
+    struct ifaddrs* ifa_list = NULL;
+    interfaces_t ifs;
+    avahi_resolve_result_t ret = AVAHI_RESOLVE_RESULT_UNAVAIL;
+
+    if (!(query_len = mdns_build_query(query, sizeof(query), name, type)))
+        return AVAHI_RESOLVE_RESULT_UNAVAIL;
+
+    // The interface addresses are also needed to tell on-link sources.
+    if (getifaddrs(&ifa_list) < 0)
+        ifa_list = NULL;
+
+    find_interfaces(ifa_list, &ifs);
+
+    // One socket per address family, shared by all targets of that family.
+    for (int i = 0; i < n_targets && n_fds < 2; i++) {
+        int af = targets[i].ss_family, fd;
+
+        if ((n_fds > 0 && families[0] == af) ||
+            (fd = open_query_socket(af)) < 0)
+            continue;
+
+        fds[n_fds].fd = fd;
+        fds[n_fds].events = POLLIN;
+        families[n_fds] = af;
+        fd_targets[n_fds] = (const struct sockaddr*)&targets[i];
+        n_fds++;
+    }
+
+    uint64_t start = monotonic_msec();
+    uint64_t deadline = start + timeout;
+    uint64_t next_send = start;
+    int interval = MDNS_RETRANSMIT_INTERVAL;
+
+    for (;;) {
+        uint64_t now = monotonic_msec();
+
+        if (now >= deadline)
+            break;
+
+        if (now >= next_send) {
+            int sent = 0;
+
+            for (int i = 0; i < n_targets; i++)
+                for (int j = 0; j < n_fds; j++)
+                    if (families[j] == targets[i].ss_family)
+                        sent += send_query(
+                            fds[j].fd, query, query_len,
+                            (const struct sockaddr*)&targets[i],
+                            targets[i].ss_family == AF_INET
+                                ? sizeof(struct sockaddr_in)
+                                : sizeof(struct sockaddr_in6),
+                            &ifs);
+
+            // Only report the host as not found if a query actually went
+            // out at least once.
+            if (sent > 0)
+                ret = AVAHI_RESOLVE_RESULT_HOST_NOT_FOUND;
+            else if (ret == AVAHI_RESOLVE_RESULT_UNAVAIL)
+                break;
+
+            next_send = now + interval;
+            interval *= 2;
+        }
+
+        uint64_t wake = next_send < deadline ? next_send : deadline;
+        int r = poll(fds, n_fds, (int)(wake - now));
+
+        if (r < 0 && errno != EINTR)
+            break;
+        if (r <= 0)
+            continue;
+
+        for (int i = 0; i < n_fds; i++) {
+            struct sockaddr_storage from;
+            uint32_t ifindex;
+            int ttl;
+            ssize_t l;
+
+            if (!(fds[i].revents & POLLIN))
+                continue;
+
+            if ((l = receive_packet(fds[i].fd, packet, sizeof(packet), &from,
+                                    &ifindex, &ttl)) < 0)
+                continue;
+
+            if (!source_acceptable(ifa_list, fd_targets[i],
+                                   (struct sockaddr*)&from, ifindex, ttl))
+                continue;
+
+            if (mdns_parse_response(packet, l, name, type, answer) == 1) {
+                answer->ifindex = ifindex;
+                ret = AVAHI_RESOLVE_RESULT_SUCCESS;
+                goto finish;
+            }
+        }
+    }
+
+finish:
+    for (int i = 0; i < n_fds; i++)
+        close(fds[i].fd);
+
+    if (ifa_list)
+        freeifaddrs(ifa_list);
+
+    return ret;
+}
+
+avahi_resolve_result_t mdns_query(const char* name, uint16_t type,
+                                  const struct sockaddr* dest,
+                                  socklen_t dest_len, int timeout,
+                                  mdns_answer_t* answer) {
+    struct sockaddr_storage target;
+
+    if (dest_len > sizeof(target))
+        return AVAHI_RESOLVE_RESULT_UNAVAIL;
+
+    memset(&target, 0, sizeof(target));
+    memcpy(&target, dest, dest_len);
+
+    return mdns_query_targets(name, type, &target, 1, timeout, answer);
+}
+
+// Queries both the IPv4 and the IPv6 mDNS group.
+static avahi_resolve_result_t mdns_query_groups(const char* name,
+                                                uint16_t type, int timeout,
+                                                mdns_answer_t* answer) {
+    struct sockaddr_storage targets[2];
+    struct sockaddr_in* sa4 = (struct sockaddr_in*)&targets[0];
+    struct sockaddr_in6* sa6 = (struct sockaddr_in6*)&targets[1];
+
+    memset(targets, 0, sizeof(targets));
+
+    sa4->sin_family = AF_INET;
+    sa4->sin_port = htons(MDNS_PORT);
+    inet_pton(AF_INET, MDNS_GROUP_IPV4, &sa4->sin_addr);
+
+    sa6->sin6_family = AF_INET6;
+    sa6->sin6_port = htons(MDNS_PORT);
+    inet_pton(AF_INET6, MDNS_GROUP_IPV6, &sa6->sin6_addr);
+
+    return mdns_query_targets(name, type, targets, 2, timeout, answer);
+}
+
+avahi_resolve_result_t mdns_resolve_name(int af, const char* name,
+                                         query_address_result_t* result,
+                                         int timeout) {
+    mdns_answer_t answer;
+    avahi_resolve_result_t ret;
+
+    if (af != AF_INET && af != AF_INET6)
+        return AVAHI_RESOLVE_RESULT_UNAVAIL;
+
+    ret = mdns_query_groups(name, af == AF_INET ? MDNS_TYPE_A : MDNS_TYPE_AAAA,
+                            timeout, &answer);
+    if (ret != AVAHI_RESOLVE_RESULT_SUCCESS)
+        return ret;
+
+    result->af = af;
+    result->scopeid = answer.ifindex;
+    memcpy(&result->address, answer.data.address,
+           af == AF_INET ? sizeof(ipv4_address_t) : sizeof(ipv6_address_t));
+
+    return AVAHI_RESOLVE_RESULT_SUCCESS;
+}
+
+avahi_resolve_result_t mdns_resolve_address(int af, const void* data,
+                                            char* name, size_t name_len,
+                                            int timeout) {
+    mdns_answer_t answer;
+    avahi_resolve_result_t ret;
+    char reverse[80];
+
+    if (mdns_reverse_name(af, data, reverse, sizeof(reverse)) < 0)
+        return AVAHI_RESOLVE_RESULT_UNAVAIL;
+
+    ret = mdns_query_groups(reverse, MDNS_TYPE_PTR, timeout, &answer);
+    if (ret != AVAHI_RESOLVE_RESULT_SUCCESS)
+        return ret;
+
+    strncpy(name, answer.data.name, name_len - 1);
+    name[name_len - 1] = 0;
+
+    return AVAHI_RESOLVE_RESULT_SUCCESS;
+}
@@ -0,0 +1,94 @@
+#ifndef foomdnshfoo
+#define foomdnshfoo
+
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+// A minimal one-shot multicast DNS querier (RFC 6762 section 5.1), used
+// when avahi-daemon is not available.
+
+#include <inttypes.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include "avahi.h"
+
+#define MDNS_PORT 5353
+#define MDNS_GROUP_IPV4 "224.0.0.251"
+#define MDNS_GROUP_IPV6 "ff02::fb"
+
+#define MDNS_TYPE_A 1
+#define MDNS_TYPE_PTR 12
+#define MDNS_TYPE_AAAA 28
+#define MDNS_CLASS_IN 1
+
+// Set in the class of a question to request a unicast response.
+#define MDNS_CLASS_QU 0x8000
+
+// Largest mDNS packet we send or accept (RFC 6762 section 17).
+#define MDNS_PACKET_MAX 9000
+
+typedef struct {
+    uint16_t type;
+    uint32_t ttl;
+    // Interface the answer was received on, or 0 if unknown.
+    uint32_t ifindex;
+    union {
+        uint8_t address[16];
+        char name[256];
+    } data;
+} mdns_answer_t;
+
+// Builds a query packet with a single QU question. Returns the length of
+// the packet, or 0 if the name is invalid or does not fit.
+size_t mdns_build_query(uint8_t* packet, size_t len, const char* name,
+                        uint16_t type);
+
+// Searches a response packet for a record answering the question (name,
+// type). Returns 1 and fills in answer if one was found, 0 if not, and -1
+// if the packet is malformed. Goodbye records (TTL 0) are ignored, and so
+// are responses whose question section does not include the question.
+int mdns_parse_response(const uint8_t* packet, size_t len, const char* name,
+                        uint16_t type, mdns_answer_t* answer);
+
+// Returns non-zero if source is on the link of the interface ifindex, that
+// is, if it is link-local or within the prefix of one of the addresses of
+// that interface. If ifindex is 0, any interface will do.
+int mdns_source_on_link(const struct sockaddr* source, uint32_t ifindex);
+
+// Builds the in-addr.arpa or ip6.arpa name for a reverse lookup.
+int mdns_reverse_name(int af, const void* data, char* name, size_t name_len);
+
+// Sends the question (name, type) to dest and waits up to timeout
+// milliseconds for an answer. If dest is a multicast group, the query is
+// sent on every multicast capable interface.
+avahi_resolve_result_t mdns_query(const char* name, uint16_t type,
+                                  const struct sockaddr* dest,
+                                  socklen_t dest_len, int timeout,
+                                  mdns_answer_t* answer);
+
+avahi_resolve_result_t mdns_resolve_name(int af, const char* name,
+                                         query_address_result_t* result,
+                                         int timeout);
+
+avahi_resolve_result_t mdns_resolve_address(int af, const void* data,
+                                            char* name, size_t name_len,
+                                            int timeout);
+
+#endif
@@ -0,0 +1,216 @@
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifdef HAVE_LINUX_RTNETLINK_H
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#endif
+
+#include "netlink.h"
+
+static pthread_mutex_t netlink_mutex = PTHREAD_MUTEX_INITIALIZER;
+static netlink_listener_t listeners[NETLINK_MAX_LISTENERS];
+static int n_listeners = 0;
+
+void netlink_subscribe(netlink_listener_t listener) {
+    pthread_mutex_lock(&netlink_mutex);
+
+    for (int i = 0; i < n_listeners; i++)
+        if (listeners[i] == listener)
+            goto finish;
+
+    if (n_listeners < NETLINK_MAX_LISTENERS)
+        listeners[n_listeners++] = listener;
+
+finish:
+    pthread_mutex_unlock(&netlink_mutex);
+}
+
+#ifdef HAVE_LINUX_RTNETLINK_H
+
+static int netlink_fd = -1;
+// The process that opened netlink_fd. A child inherits the socket, but
+// must not share its events with the parent.
+static pid_t netlink_pid = 0;
+
+static void dispatch(const netlink_event_t* event) {
+    for (int i = 0; i < n_listeners; i++)
+        listeners[i](event);
+}
+
+static void parse_address(const struct nlmsghdr* nh, netlink_event_t* event) {
+    const struct ifaddrmsg* ifa = NLMSG_DATA(nh);
+    const struct rtattr* rta = IFA_RTA(ifa);
+    int len = IFA_PAYLOAD(nh);
+    size_t alen = ifa->ifa_family == AF_INET6 ? 16 : 4;
+
+    event->ifindex = ifa->ifa_index;
+    event->af = ifa->ifa_family;
+    event->prefixlen = ifa->ifa_prefixlen;
+
+    for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+        // IFA_LOCAL is the address of this end of point-to-point links; on
+        // others it equals IFA_ADDRESS.
+        if ((rta->rta_type == IFA_ADDRESS || rta->rta_type == IFA_LOCAL) &&
+            RTA_PAYLOAD(rta) >= alen) {
+            memcpy(event->address, RTA_DATA(rta), alen);
+            if (rta->rta_type == IFA_LOCAL)
+                break;
+        }
+    }
+}
+
+void netlink_parse(const void* buf, size_t len, netlink_listener_t listener) {
+    const struct nlmsghdr* nh;
+
+    for (nh = buf; NLMSG_OK(nh, len); nh = NLMSG_NEXT(nh, len)) {
+        netlink_event_t event;
+
+        memset(&event, 0, sizeof(event));
+        event.type = nh->nlmsg_type;
+
+        switch (nh->nlmsg_type) {
+        case RTM_NEWLINK:
+        case RTM_DELLINK:
+            if (nh->nlmsg_len < NLMSG_LENGTH(sizeof(struct ifinfomsg)))
+                continue;
+            event.ifindex =
+                ((const struct ifinfomsg*)NLMSG_DATA(nh))->ifi_index;
+            break;
+
+        case RTM_NEWADDR:
+        case RTM_DELADDR:
+            if (nh->nlmsg_len < NLMSG_LENGTH(sizeof(struct ifaddrmsg)))
+                continue;
+            parse_address(nh, &event);
+            if (event.af != AF_INET && event.af != AF_INET6)
+                continue;
+            break;
+
+        default:
+            continue;
+        }
+
+        listener(&event);
+    }
+}
+
+static int open_socket(void) {
+    struct sockaddr_nl sa;
+    int fd;
+
+    if ((fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK,
+                     NETLINK_ROUTE)) < 0)
+        return -1;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.nl_family = AF_NETLINK;
+    sa.nl_groups =
+        RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR;
+
+    if (bind(fd, (struct sockaddr*)&sa, sizeof(sa)) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+int netlink_poll(void) {
+    static const netlink_event_t reset = {.type = 0};
+    // Large enough for the bursts of messages of an interface going down.
+    char buf[8192] __attribute__((aligned(NLMSG_ALIGNTO)));
+    int ret = 0;
+
+    pthread_mutex_lock(&netlink_mutex);
+
+    if (n_listeners == 0)
+        goto finish;
+
+    if (netlink_fd >= 0 && netlink_pid != getpid()) {
+        close(netlink_fd);
+        netlink_fd = -1;
+    }
+
+    if (netlink_fd < 0) {
+        if ((netlink_fd = open_socket()) < 0) {
+            ret = -1;
+            goto finish;
+        }
+        netlink_pid = getpid();
+        // Nothing was monitored before, so nothing derived from the
+        // interfaces can be trusted.
+        dispatch(&reset);
+    }
+
+    for (;;) {
+        struct sockaddr_nl sa;
+        socklen_t salen = sizeof(sa);
+        ssize_t r = recvfrom(netlink_fd, buf, sizeof(buf), MSG_DONTWAIT,
+                             (struct sockaddr*)&sa, &salen);
+
+        if (r < 0) {
+            if (errno == ENOBUFS) {
+                // The socket buffer overflowed; events were lost.
+                dispatch(&reset);
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                close(netlink_fd);
+                netlink_fd = -1;
+                ret = -1;
+            }
+            break;
+        }
+
+        // Only the kernel speaks for the interfaces.
+        if (sa.nl_pid != 0)
+            continue;
+
+        netlink_parse(buf, r, dispatch);
+    }
+
+finish:
+    pthread_mutex_unlock(&netlink_mutex);
+    return ret;
+}
+
+#else
+
+void netlink_parse(const void* buf, size_t len, netlink_listener_t listener) {
+    (void)buf;
+    (void)len;
+    (void)listener;
+}
+
+int netlink_poll(void) {
+    return -1;
+}
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef foonetlinkhfoo
+#define foonetlinkhfoo
+
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#include <inttypes.h>
+#include <stddef.h>
+
+// A change of the interfaces or addresses of this host.
+typedef struct {
+    // RTM_NEWLINK, RTM_DELLINK, RTM_NEWADDR or RTM_DELADDR. Zero if events
+    // were lost, in which case all state derived from the interfaces must be
+    // considered stale.
+    int type;
+    uint32_t ifindex;
+    // Address events only.
+    int af;
+    uint8_t address[16];
+    int prefixlen;
+} netlink_event_t;
+
+typedef void (*netlink_listener_t)(const netlink_event_t* event);
+
+// Maximum number of listeners.
+#define NETLINK_MAX_LISTENERS 4
+
+// Registers a listener for interface and address changes. The rtnetlink
+// socket is opened on the next netlink_poll(). Registering the same
+// listener twice has no effect.
+void netlink_subscribe(netlink_listener_t listener);
+
+// Passes the pending events to the listeners, without blocking. Listeners
+// are called from the polling thread; callers must not hold locks the
+// listeners take. Returns 0 if changes are being monitored, or -1 if they
+// are not (no rtnetlink on this system) and state derived from the
+// interfaces has to be refreshed by other means.
+int netlink_poll(void);
+
+// Decodes the rtnetlink messages in buf and calls listener for every
+// interface or address change. Exposed for testing.
+void netlink_parse(const void* buf, size_t len, netlink_listener_t listener);
+
+#endif
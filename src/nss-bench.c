@@ -0,0 +1,417 @@
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+// Drives the NSS entry points of the built libraries directly from many
+// threads, bypassing glibc's NSS dispatch, and reports throughput, latency
+// percentiles, syscalls per lookup and how well lookups scale with the
+// number of threads. Best run against fake-avahi, with NSS_MDNS_CONFIG
+// pointing at its socket.
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "nss-module.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#define MAX_OPS 4096
+#define MAX_THREADS 64
+// Latencies kept per thread for the percentiles; beyond that, a uniform
+// sample of them.
+#define MAX_SAMPLES (1 << 18)
+
+typedef struct {
+    const nss_module_t* module;
+    int index;
+    uint64_t lookups;
+    uint64_t failed;
+    uint64_t n_samples;
+    uint32_t* samples;
+} worker_t;
+
+typedef struct {
+    double rate;
+    double p50, p99, p999;
+    double syscalls;
+    uint64_t failed;
+} result_t;
+
+static nss_lookup_t ops[MAX_OPS];
+static int n_ops;
+
+static pthread_barrier_t barrier;
+static int stop;
+
+static const char* const default_libraries[] = {
+    ".libs/libnss_mdns.so.2",          ".libs/libnss_mdns4.so.2",
+    ".libs/libnss_mdns6.so.2",         ".libs/libnss_mdns_minimal.so.2",
+    ".libs/libnss_mdns4_minimal.so.2", ".libs/libnss_mdns6_minimal.so.2",
+};
+
+static void usage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s [-w WORKLOAD] [-d SECONDS] [-t THREADS] [LIBRARY...]\n"
+            "\n"
+            "  -w WORKLOAD  file of lookups to mix, one per line:\n"
+            "               name4|name3|name3v6|canon|addr NAME-OR-ADDRESS "
+            "[WEIGHT]\n"
+            "               default: name4 foo.local\n"
+            "  -d SECONDS   duration of each run, default 2\n"
+            "  -t THREADS   largest number of threads, default 64; runs\n"
+            "               with 1, 2, 4, ... threads up to it\n"
+            "\n"
+            "LIBRARY defaults to the six variants in .libs/.\n",
+            argv0);
+}
+
+static uint64_t now_nsec(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+static int add_op(const char* kind, const char* argument, int weight) {
+    nss_lookup_t op;
+
+    memset(&op, 0, sizeof(op));
+
+    if (strcmp(kind, "name4") == 0 || strcmp(kind, "name3") == 0 ||
+        strcmp(kind, "name3v6") == 0) {
+        op.type = kind[4] == '4' ? NSS_LOOKUP_NAME4 : NSS_LOOKUP_NAME3;
+        op.af = strcmp(kind, "name3v6") == 0 ? AF_INET6 : AF_INET;
+        if (strlen(argument) >= sizeof(op.name))
+            return -1;
+        strcpy(op.name, argument);
+    } else if (strcmp(kind, "canon") == 0) {
+        op.type = NSS_LOOKUP_CANONNAME;
+        if (strlen(argument) >= sizeof(op.name))
+            return -1;
+        strcpy(op.name, argument);
+    } else if (strcmp(kind, "addr") == 0) {
+        op.type = NSS_LOOKUP_ADDRESS;
+        op.af = strchr(argument, ':') ? AF_INET6 : AF_INET;
+        if (inet_pton(op.af, argument, op.address) != 1)
+            return -1;
+    } else
+        return -1;
+
+    // The mix is the sequence of lookups every thread walks through.
+    for (int i = 0; i < weight; i++) {
+        if (n_ops >= MAX_OPS)
+            return -1;
+        ops[n_ops++] = op;
+    }
+
+    return 0;
+}
+
+static int read_workload(const char* path) {
+    char line[512];
+    FILE* f;
+    int n = 0;
+
+    if (!(f = fopen(path, "r"))) {
+        perror(path);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        char kind[16], argument[256];
+        int weight = 1, fields;
+
+        n++;
+        fields = sscanf(line, " %15s %255s %d", kind, argument, &weight);
+        if (fields <= 0 || kind[0] == '#')
+            continue;
+
+        if (fields < 2 || weight < 1 || add_op(kind, argument, weight) < 0) {
+            fprintf(stderr, "%s:%d: bad lookup\n", path, n);
+            fclose(f);
+            return -1;
+        }
+    }
+
+    fclose(f);
+    return 0;
+}
+
+static void* worker_thread(void* arg) {
+    worker_t* w = arg;
+    char buffer[4096];
+    unsigned seed = (unsigned)w->index + 1;
+    // Threads start at different points of the mix.
+    int next = w->index % n_ops;
+
+    pthread_barrier_wait(&barrier);
+
+    while (!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+        uint64_t start = now_nsec(), elapsed, slot;
+
+        if (nss_module_lookup(w->module, &ops[next], buffer,
+                              sizeof(buffer)) != NSS_STATUS_SUCCESS)
+            w->failed++;
+        elapsed = now_nsec() - start;
+
+        // Reservoir sampling keeps a uniform sample of the latencies.
+        slot = w->lookups < MAX_SAMPLES ? w->lookups
+                                        : (uint64_t)rand_r(&seed) %
+                                              (w->lookups + 1);
+        if (slot < MAX_SAMPLES)
+            w->samples[slot] = elapsed > UINT32_MAX ? UINT32_MAX
+                                                    : (uint32_t)elapsed;
+
+        w->lookups++;
+        if (++next == n_ops)
+            next = 0;
+    }
+
+    w->n_samples = w->lookups < MAX_SAMPLES ? w->lookups : MAX_SAMPLES;
+    return NULL;
+}
+
+// Counts the syscalls of this process and the threads it starts from now
+// on. Returns -1 where that isn't allowed.
+static int count_syscalls(void) {
+#ifdef __linux__
+    static const char* const paths[] = {
+        "/sys/kernel/tracing/events/raw_syscalls/sys_enter/id",
+        "/sys/kernel/debug/tracing/events/raw_syscalls/sys_enter/id",
+    };
+    struct perf_event_attr attr;
+    unsigned long long id;
+
+    for (size_t i = 0; i < sizeof(paths) / sizeof(paths[0]); i++) {
+        FILE* f = fopen(paths[i], "r");
+        int ok;
+
+        if (!f)
+            continue;
+        ok = fscanf(f, "%llu", &id) == 1;
+        fclose(f);
+        if (!ok)
+            continue;
+
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_TRACEPOINT;
+        attr.size = sizeof(attr);
+        attr.config = id;
+        attr.inherit = 1;
+        return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+#endif
+    return -1;
+}
+
+static int compare_samples(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static double percentile(const uint32_t* sorted, uint64_t n, double q) {
+    return n ? sorted[(uint64_t)(q * (double)(n - 1))] / 1000.0 : 0;
+}
+
+static void run(const nss_module_t* module, int threads, unsigned seconds,
+                result_t* result) {
+    worker_t workers[MAX_THREADS];
+    pthread_t ids[MAX_THREADS];
+    uint32_t* all;
+    uint64_t lookups = 0, n = 0, start, elapsed;
+    int fd = count_syscalls();
+    long long syscalls = -1;
+
+    memset(workers, 0, sizeof(workers));
+    memset(result, 0, sizeof(*result));
+    __atomic_store_n(&stop, 0, __ATOMIC_RELAXED);
+    pthread_barrier_init(&barrier, NULL, (unsigned)threads + 1);
+
+    for (int i = 0; i < threads; i++) {
+        workers[i].module = module;
+        workers[i].index = i;
+        if (!(workers[i].samples = malloc(MAX_SAMPLES * sizeof(uint32_t))) ||
+            pthread_create(&ids[i], NULL, worker_thread, &workers[i]) != 0) {
+            fprintf(stderr, "nss-bench: can't start thread\n");
+            exit(1);
+        }
+    }
+
+    pthread_barrier_wait(&barrier);
+    start = now_nsec();
+    sleep(seconds);
+    __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+
+    for (int i = 0; i < threads; i++)
+        pthread_join(ids[i], NULL);
+    elapsed = now_nsec() - start;
+    pthread_barrier_destroy(&barrier);
+
+    if (fd >= 0) {
+        if (read(fd, &syscalls, sizeof(syscalls)) != sizeof(syscalls))
+            syscalls = -1;
+        close(fd);
+    }
+
+    for (int i = 0; i < threads; i++) {
+        lookups += workers[i].lookups;
+        result->failed += workers[i].failed;
+        n += workers[i].n_samples;
+    }
+
+    if (!(all = malloc((n ? n : 1) * sizeof(uint32_t)))) {
+        fprintf(stderr, "nss-bench: out of memory\n");
+        exit(1);
+    }
+    n = 0;
+    for (int i = 0; i < threads; i++) {
+        memcpy(all + n, workers[i].samples,
+               workers[i].n_samples * sizeof(uint32_t));
+        n += workers[i].n_samples;
+        free(workers[i].samples);
+    }
+    qsort(all, n, sizeof(uint32_t), compare_samples);
+
+    result->rate = (double)lookups * 1e9 / (double)elapsed;
+    result->p50 = percentile(all, n, 0.5);
+    result->p99 = percentile(all, n, 0.99);
+    result->p999 = percentile(all, n, 0.999);
+    // Includes the few syscalls of starting and stopping the threads.
+    result->syscalls =
+        syscalls >= 0 && lookups ? (double)syscalls / (double)lookups : -1;
+
+    free(all);
+}
+
+static int bench(const char* library, int max_threads, unsigned seconds) {
+    nss_module_t module;
+    double base = 0;
+
+    if (nss_module_open(&module, library) < 0)
+        return -1;
+
+    for (int i = 0; i < n_ops; i++)
+        if (!nss_module_supports(&module, &ops[i])) {
+            fprintf(stderr, "nss-bench: %s lacks an entry point used\n",
+                    library);
+            nss_module_close(&module);
+            return -1;
+        }
+
+    printf("%s\n", library);
+    printf("%7s %12s %9s %9s %9s %9s %9s %10s\n", "threads", "lookups/s",
+           "p50/us", "p99/us", "p99.9/us", "syscalls", "failed",
+           "efficiency");
+
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        result_t r;
+        char syscalls[16];
+
+        run(&module, threads, seconds, &r);
+        if (threads == 1)
+            base = r.rate;
+
+        if (r.syscalls >= 0)
+            snprintf(syscalls, sizeof(syscalls), "%.2f", r.syscalls);
+        else
+            strcpy(syscalls, "-");
+
+        // Efficiency is the throughput relative to that of one thread
+        // times the number of threads.
+        printf("%7d %12.0f %9.2f %9.2f %9.2f %9s %9llu %9.0f%%\n", threads,
+               r.rate, r.p50, r.p99, r.p999, syscalls,
+               (unsigned long long)r.failed,
+               base > 0 ? 100 * r.rate / (base * threads) : 0);
+        fflush(stdout);
+    }
+    printf("\n");
+
+    nss_module_close(&module);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    const char* workload = NULL;
+    unsigned seconds = 2;
+    int max_threads = MAX_THREADS, c, ret = 0;
+
+    while ((c = getopt(argc, argv, "w:d:t:h")) != -1) {
+        switch (c) {
+        case 'w':
+            workload = optarg;
+            break;
+        case 'd':
+            seconds = (unsigned)atoi(optarg);
+            if (seconds == 0) {
+                usage(argv[0]);
+                return 2;
+            }
+            break;
+        case 't':
+            max_threads = atoi(optarg);
+            if (max_threads < 1 || max_threads > MAX_THREADS) {
+                usage(argv[0]);
+                return 2;
+            }
+            break;
+        case 'h':
+            usage(argv[0]);
+            return 0;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (workload ? read_workload(workload) < 0
+                 : add_op("name4", "foo.local", 1) < 0)
+        return 1;
+    if (n_ops == 0) {
+        fprintf(stderr, "nss-bench: empty workload\n");
+        return 1;
+    }
+
+    if (optind == argc) {
+        for (size_t i = 0;
+             i < sizeof(default_libraries) / sizeof(default_libraries[0]); i++)
+            if (bench(default_libraries[i], max_threads, seconds) < 0)
+                ret = 1;
+    } else
+        for (int i = optind; i < argc; i++)
+            if (bench(argv[i], max_threads, seconds) < 0)
+                ret = 1;
+
+    return ret;
+}
@@ -0,0 +1,352 @@
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+// Shows the lookup statistics nss-mdns exports with "stats yes", either as
+// a table or in the Prometheus text format for node_exporter's textfile
+// collector.
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "stats.h"
+
+#define MAX_PROCESSES 1024
+
+typedef struct {
+    pid_t pid;
+    char comm[32];
+    stats_shard_t total;
+} sample_t;
+
+static void usage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s [-p PID] [-i SECONDS]\n"
+            "       %s -o [-p PID]\n"
+            "\n"
+            "  -p PID      only the process PID, instead of all of them\n"
+            "  -i SECONDS  interval rates and latencies are measured over,\n"
+            "              default 1\n"
+            "  -o          print Prometheus text, by process name\n",
+            argv0, argv0);
+}
+
+static void read_comm(pid_t pid, char* comm, size_t len) {
+    char path[64];
+    FILE* f;
+
+    snprintf(path, sizeof(path), "/proc/%d/comm", (int)pid);
+    if (!(f = fopen(path, "re")) || !fgets(comm, (int)len, f))
+        snprintf(comm, len, "%d", (int)pid);
+    comm[strcspn(comm, "\n")] = 0;
+    if (f)
+        fclose(f);
+}
+
+static int sample(pid_t pid, sample_t* s) {
+    const stats_segment_t* segment;
+
+    // Segments of processes that died without removing them, or whose ID
+    // was taken by another process since. They are left to the next
+    // process that starts exporting to remove: this tool only reads.
+    if (stats_stale(pid))
+        return -1;
+
+    if (!(segment = stats_attach(pid)))
+        return -1;
+
+    s->pid = pid;
+    stats_sum(segment, &s->total);
+    stats_detach(segment);
+    read_comm(pid, s->comm, sizeof(s->comm));
+    return 0;
+}
+
+// Samples process only, or all processes exporting statistics if it is 0.
+// Returns the number of samples taken.
+static int collect(pid_t only, sample_t* samples, int max) {
+    size_t prefix_len = strlen(STATS_SEGMENT_PREFIX) - 1;
+    struct dirent* de;
+    DIR* d;
+    int n = 0;
+
+    if (only)
+        return sample(only, &samples[0]) == 0;
+
+    if (!(d = opendir(STATS_SEGMENT_DIR)))
+        return 0;
+
+    while (n < max && (de = readdir(d))) {
+        char* end;
+        long pid;
+
+        // The segment name without its leading slash.
+        if (strncmp(de->d_name, STATS_SEGMENT_PREFIX + 1, prefix_len) != 0)
+            continue;
+
+        pid = strtol(de->d_name + prefix_len, &end, 10);
+        if (pid > 0 && !*end && sample((pid_t)pid, &samples[n]) == 0)
+            n++;
+    }
+
+    closedir(d);
+    return n;
+}
+
+static void add(stats_shard_t* a, const stats_shard_t* b) {
+    for (int c = 0; c < STATS_COUNTER_MAX; c++)
+        a->counters[c] += b->counters[c];
+
+    for (int g = 0; g < STATS_GAUGE_MAX; g++)
+        a->gauges[g] += b->gauges[g];
+
+    for (int p = 0; p < STATS_PHASE_MAX; p++) {
+        for (int i = 0; i < STATS_BUCKETS; i++)
+            a->latency[p][i] += b->latency[p][i];
+        a->latency_sum[p] += b->latency_sum[p];
+    }
+}
+
+// Levels are left alone: only their current value is shown.
+static void subtract(stats_shard_t* a, const stats_shard_t* b) {
+    for (int c = 0; c < STATS_COUNTER_MAX; c++)
+        a->counters[c] -= b->counters[c];
+
+    for (int p = 0; p < STATS_PHASE_MAX; p++) {
+        for (int i = 0; i < STATS_BUCKETS; i++)
+            a->latency[p][i] -= b->latency[p][i];
+        a->latency_sum[p] -= b->latency_sum[p];
+    }
+}
+
+static uint64_t histogram_count(const uint64_t* buckets) {
+    uint64_t count = 0;
+
+    for (int i = 0; i < STATS_BUCKETS; i++)
+        count += buckets[i];
+
+    return count;
+}
+
+static int show_table(pid_t only, unsigned interval) {
+    static sample_t before[MAX_PROCESSES], after[MAX_PROCESSES];
+    stats_shard_t total, delta;
+    int n_before, n_after;
+
+    n_before = collect(only, before, MAX_PROCESSES);
+    sleep(interval);
+    n_after = collect(only, after, MAX_PROCESSES);
+
+    if (n_after == 0) {
+        fprintf(stderr, "No process exports nss-mdns statistics.\n");
+        return 1;
+    }
+
+    memset(&total, 0, sizeof(total));
+    memset(&delta, 0, sizeof(delta));
+
+    for (int i = 0; i < n_after; i++) {
+        add(&total, &after[i].total);
+        add(&delta, &after[i].total);
+
+        // Processes that started in between count from zero.
+        for (int j = 0; j < n_before; j++)
+            if (before[j].pid == after[i].pid) {
+                subtract(&delta, &before[j].total);
+                break;
+            }
+    }
+
+    printf("%d process%s\n\n", n_after, n_after == 1 ? "" : "es");
+
+    printf("%-24s %14s %10s\n", "EVENT", "TOTAL", "PER SEC");
+    for (int c = 0; c < STATS_COUNTER_MAX; c++)
+        printf("%-24s %14" PRIu64 " %10.1f\n", stats_counter_name(c),
+               total.counters[c], (double)delta.counters[c] / interval);
+
+    printf("\n%-24s %14s\n", "LEVEL", "NOW");
+    for (int g = 0; g < STATS_GAUGE_MAX; g++)
+        printf("%-24s %14" PRId64 "\n", stats_gauge_name(g),
+               total.gauges[g]);
+
+    printf("\nLatencies over the last %u s, in microseconds:\n", interval);
+    printf("%-10s %10s %10s %10s %10s %10s\n", "PHASE", "COUNT", "MEAN", "P50",
+           "P99", "P999");
+    for (int p = 0; p < STATS_PHASE_MAX; p++) {
+        const uint64_t* buckets = delta.latency[p];
+        uint64_t count = histogram_count(buckets);
+
+        printf("%-10s %10" PRIu64 " %10.0f %10.0f %10.0f %10.0f\n",
+               stats_phase_name(p), count,
+               count ? (double)delta.latency_sum[p] / count : 0.0,
+               stats_quantile(buckets, 0.5), stats_quantile(buckets, 0.99),
+               stats_quantile(buckets, 0.999));
+    }
+
+    return 0;
+}
+
+// Starts a sample of metric for the processes named comm, escaping the
+// name as the Prometheus text format wants it. More labels may follow.
+static void print_sample(const char* metric, const char* comm) {
+    printf("%s{process=\"", metric);
+    for (; *comm; comm++) {
+        if (*comm == '\\' || *comm == '"')
+            putchar('\\');
+        if (*comm == '\n')
+            fputs("\\n", stdout);
+        else
+            putchar(*comm);
+    }
+    putchar('"');
+}
+
+static int show_prometheus(pid_t only) {
+    static sample_t samples[MAX_PROCESSES];
+    // Processes are summed up by name; their IDs would make for too many
+    // series.
+    static sample_t groups[MAX_PROCESSES];
+    int counts[MAX_PROCESSES];
+    int n, n_groups = 0;
+
+    n = collect(only, samples, MAX_PROCESSES);
+
+    for (int i = 0; i < n; i++) {
+        int g;
+
+        for (g = 0; g < n_groups; g++)
+            if (strcmp(groups[g].comm, samples[i].comm) == 0)
+                break;
+
+        if (g == n_groups) {
+            memset(&groups[g], 0, sizeof(groups[g]));
+            strcpy(groups[g].comm, samples[i].comm);
+            counts[g] = 0;
+            n_groups++;
+        }
+
+        add(&groups[g].total, &samples[i].total);
+        counts[g]++;
+    }
+
+    printf("# TYPE nss_mdns_processes gauge\n"
+           "# HELP nss_mdns_processes Processes exporting statistics.\n");
+    for (int g = 0; g < n_groups; g++) {
+        print_sample("nss_mdns_processes", groups[g].comm);
+        printf("} %d\n", counts[g]);
+    }
+
+    // Counter samples carry the name of their metric, _total included.
+    printf("# TYPE nss_mdns_events_total counter\n"
+           "# HELP nss_mdns_events_total Events counted by nss-mdns.\n");
+    for (int g = 0; g < n_groups; g++)
+        for (int c = 0; c < STATS_COUNTER_MAX; c++) {
+            print_sample("nss_mdns_events_total", groups[g].comm);
+            printf(",event=\"%s\"} %" PRIu64 "\n", stats_counter_name(c),
+                   groups[g].total.counters[c]);
+        }
+
+    printf("# TYPE nss_mdns_level gauge\n"
+           "# HELP nss_mdns_level Levels tracked by nss-mdns.\n");
+    for (int g = 0; g < n_groups; g++)
+        for (int l = 0; l < STATS_GAUGE_MAX; l++) {
+            print_sample("nss_mdns_level", groups[g].comm);
+            printf(",level=\"%s\"} %" PRId64 "\n", stats_gauge_name(l),
+                   groups[g].total.gauges[l]);
+        }
+
+    printf("# TYPE nss_mdns_latency_seconds histogram\n"
+           "# HELP nss_mdns_latency_seconds Latencies of lookup phases.\n");
+    for (int g = 0; g < n_groups; g++)
+        for (int p = 0; p < STATS_PHASE_MAX; p++) {
+            const uint64_t* buckets = groups[g].total.latency[p];
+            const char* phase = stats_phase_name(p);
+            uint64_t cumulative = 0;
+
+            // The last bucket is open-ended. Latencies are kept in
+            // microseconds, which six decimals show without rounding; %g
+            // would cut the larger bounds and sums to six digits.
+            for (int i = 0; i < STATS_BUCKETS - 1; i++) {
+                cumulative += buckets[i];
+                print_sample("nss_mdns_latency_seconds_bucket",
+                             groups[g].comm);
+                printf(",phase=\"%s\",le=\"%.6f\"} %" PRIu64 "\n", phase,
+                       (double)(1ULL << i) / 1e6, cumulative);
+            }
+            cumulative += buckets[STATS_BUCKETS - 1];
+            print_sample("nss_mdns_latency_seconds_bucket", groups[g].comm);
+            printf(",phase=\"%s\",le=\"+Inf\"} %" PRIu64 "\n", phase,
+                   cumulative);
+
+            print_sample("nss_mdns_latency_seconds_count", groups[g].comm);
+            printf(",phase=\"%s\"} %" PRIu64 "\n", phase, cumulative);
+            print_sample("nss_mdns_latency_seconds_sum", groups[g].comm);
+            printf(",phase=\"%s\"} %.6f\n", phase,
+                   (double)groups[g].total.latency_sum[p] / 1e6);
+        }
+
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    pid_t only = 0;
+    unsigned interval = 1;
+    int prometheus = 0, c;
+
+    while ((c = getopt(argc, argv, "p:i:oh")) != -1) {
+        switch (c) {
+        case 'p':
+            only = (pid_t)atoi(optarg);
+            if (only <= 0) {
+                usage(argv[0]);
+                return 2;
+            }
+            break;
+        case 'i':
+            interval = (unsigned)atoi(optarg);
+            if (interval == 0) {
+                usage(argv[0]);
+                return 2;
+            }
+            break;
+        case 'o':
+            prometheus = 1;
+            break;
+        case 'h':
+            usage(argv[0]);
+            return 0;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (optind != argc) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    return prometheus ? show_prometheus(only) : show_table(only, interval);
+}
@@ -0,0 +1,113 @@
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "nss-module.h"
+
+static void* find_symbol(void* handle, const char* library,
+                         const char* function) {
+    const char* base = strrchr(library, '/');
+    char symbol[128];
+    size_t len;
+
+    base = base ? base + 1 : library;
+    if (strncmp(base, "lib", 3) == 0)
+        base += 3;
+    len = strcspn(base, ".");
+
+    snprintf(symbol, sizeof(symbol), "_%.*s_%s", (int)len, base, function);
+    return dlsym(handle, symbol);
+}
+
+int nss_module_open(nss_module_t* module, const char* library) {
+    memset(module, 0, sizeof(*module));
+
+    if (!(module->handle = dlopen(library, RTLD_NOW | RTLD_LOCAL))) {
+        fprintf(stderr, "%s\n", dlerror());
+        return -1;
+    }
+
+    module->gethostbyname4_r = (nss_gethostbyname4_r_t)find_symbol(
+        module->handle, library, "gethostbyname4_r");
+    module->gethostbyname3_r = (nss_gethostbyname3_r_t)find_symbol(
+        module->handle, library, "gethostbyname3_r");
+    module->gethostbyaddr_r = (nss_gethostbyaddr_r_t)find_symbol(
+        module->handle, library, "gethostbyaddr_r");
+    module->getcanonname_r = (nss_getcanonname_r_t)find_symbol(
+        module->handle, library, "getcanonname_r");
+
+    return 0;
+}
+
+void nss_module_close(nss_module_t* module) {
+    if (module->handle)
+        dlclose(module->handle);
+    memset(module, 0, sizeof(*module));
+}
+
+int nss_module_supports(const nss_module_t* module,
+                        const nss_lookup_t* lookup) {
+    switch (lookup->type) {
+    case NSS_LOOKUP_NAME4:
+        return module->gethostbyname4_r != NULL;
+    case NSS_LOOKUP_NAME3:
+        return module->gethostbyname3_r != NULL;
+    case NSS_LOOKUP_ADDRESS:
+        return module->gethostbyaddr_r != NULL;
+    case NSS_LOOKUP_CANONNAME:
+        return module->getcanonname_r != NULL;
+    }
+
+    return 0;
+}
+
+enum nss_status nss_module_lookup(const nss_module_t* module,
+                                  const nss_lookup_t* lookup, char* buffer,
+                                  size_t buflen) {
+    struct gaih_addrtuple* pat = NULL;
+    struct hostent he;
+    char* canon;
+    int err, herr;
+
+    switch (lookup->type) {
+    case NSS_LOOKUP_NAME4:
+        return module->gethostbyname4_r(lookup->name, &pat, buffer, buflen,
+                                        &err, &herr, NULL);
+    case NSS_LOOKUP_NAME3:
+        return module->gethostbyname3_r(lookup->name, lookup->af, &he, buffer,
+                                        buflen, &err, &herr, NULL, NULL);
+    case NSS_LOOKUP_ADDRESS:
+        return module->gethostbyaddr_r(
+            lookup->address, lookup->af == AF_INET ? 4 : 16, lookup->af, &he,
+            buffer, buflen, &err, &herr);
+    case NSS_LOOKUP_CANONNAME:
+        return module->getcanonname_r(lookup->name, buffer, buflen, &canon,
+                                      &err, &herr);
+    }
+
+    return NSS_STATUS_UNAVAIL;
+}
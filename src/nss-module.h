@@ -0,0 +1,86 @@
+#ifndef foonssmodulehfoo
+#define foonssmodulehfoo
+
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#include <netdb.h>
+#include <nss.h>
+#include <stddef.h>
+
+// The NSS entry points of a built library, loaded with dlopen(), for the
+// tools that drive it directly.
+
+typedef enum nss_status (*nss_gethostbyname4_r_t)(const char*,
+                                                  struct gaih_addrtuple**,
+                                                  char*, size_t, int*, int*,
+                                                  int32_t*);
+typedef enum nss_status (*nss_gethostbyname3_r_t)(const char*, int,
+                                                  struct hostent*, char*,
+                                                  size_t, int*, int*,
+                                                  int32_t*, char**);
+typedef enum nss_status (*nss_gethostbyaddr_r_t)(const void*, int, int,
+                                                 struct hostent*, char*,
+                                                 size_t, int*, int*);
+typedef enum nss_status (*nss_getcanonname_r_t)(const char*, char*, size_t,
+                                                char**, int*, int*);
+
+typedef struct {
+    void* handle;
+    nss_gethostbyname4_r_t gethostbyname4_r;
+    nss_gethostbyname3_r_t gethostbyname3_r;
+    nss_gethostbyaddr_r_t gethostbyaddr_r;
+    nss_getcanonname_r_t getcanonname_r;
+} nss_module_t;
+
+// The kinds of lookups.
+typedef enum {
+    NSS_LOOKUP_NAME4,
+    NSS_LOOKUP_NAME3,
+    NSS_LOOKUP_ADDRESS,
+    NSS_LOOKUP_CANONNAME,
+} nss_lookup_type_t;
+
+typedef struct {
+    nss_lookup_type_t type;
+    // AF_INET or AF_INET6; ignored for NSS_LOOKUP_NAME4 and
+    // NSS_LOOKUP_CANONNAME.
+    int af;
+    char name[256];
+    unsigned char address[16];
+} nss_lookup_t;
+
+// Loads a library and finds its entry points, which are named after the
+// service it provides: _nss_mdns4_minimal_gethostbyaddr_r in
+// libnss_mdns4_minimal.so.2. Returns -1 and reports why on stderr if it
+// can't be loaded.
+int nss_module_open(nss_module_t* module, const char* library);
+
+void nss_module_close(nss_module_t* module);
+
+// Returns whether the module has the entry point a lookup needs.
+int nss_module_supports(const nss_module_t* module,
+                        const nss_lookup_t* lookup);
+
+// Runs a lookup with a buffer of buflen bytes.
+enum nss_status nss_module_lookup(const nss_module_t* module,
+                                  const nss_lookup_t* lookup, char* buffer,
+                                  size_t buflen);
+
+#endif
@@ -0,0 +1,682 @@
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+// Replays lookups captured with NSS_MDNS_TRACE against a library, with
+// fake-avahi standing in for the resolver and answering the way the real
+// one did during the capture, so that settings such as the cache TTLs and
+// the timeouts can be tried out on a real workload offline.
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "nss-module.h"
+#include "../tests/fake-avahi.h"
+
+// The result codes of the backend spans, as in avahi.h.
+#define RESULT_SUCCESS 0
+#define RESULT_UNAVAIL 2
+
+// A captured lookup.
+typedef struct {
+    double ts, dur;
+    int status;
+    nss_lookup_type_t type;
+    int af;
+    int target;
+} record_t;
+
+// What the resolver was asked about a name or an address during the
+// capture, and how it answered.
+typedef struct {
+    char name[256];
+    int reverse;
+    int af;
+    unsigned char address[16];
+    // Families the resolver found addresses of.
+    int found4, found6;
+    // Whether any lookup of it succeeded, from the cache or not.
+    int succeeded;
+    unsigned n_unavail;
+    // Backend response times in microseconds.
+    unsigned n_samples, size;
+    double* samples;
+} target_t;
+
+static record_t* records;
+static size_t n_records, size_records;
+
+static target_t* targets;
+static size_t n_targets, size_targets;
+// Open addressing hash table of the targets, by name.
+static int* slots;
+static size_t n_slots;
+
+static unsigned n_backend;
+
+static void usage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s [-l LIBRARY] [-c CONFIG] [-s SPEED] [-p PID] "
+            "[-m SCRIPT] TRACE\n"
+            "\n"
+            "  -l LIBRARY  library to replay against, default\n"
+            "              .libs/libnss_mdns.so.2\n"
+            "  -c CONFIG   config lines to add, such as cache-ttl or\n"
+            "              backend-timeout; not backend\n"
+            "  -s SPEED    how many times faster than captured to replay,\n"
+            "              default 1; 0 replays without pauses\n"
+            "  -p PID      only replay lookups of that process\n"
+            "  -m SCRIPT   also write the fake-avahi script modelled from\n"
+            "              the capture to SCRIPT\n",
+            argv0);
+}
+
+static double now_usec(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+}
+
+// Moves *p past the next "key": in a trace line.
+static int find_key(const char** p, const char* key) {
+    char pattern[32];
+    const char* q;
+
+    snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+    if (!(q = strstr(*p, pattern)))
+        return -1;
+
+    *p = q + strlen(pattern);
+    return 0;
+}
+
+static int read_number(const char** p, const char* key, double* value) {
+    char* end;
+
+    if (find_key(p, key) < 0)
+        return -1;
+
+    *value = strtod(*p, &end);
+    if (end == *p)
+        return -1;
+
+    *p = end;
+    return 0;
+}
+
+// Reads and unescapes the string after the next "key":.
+static int read_string(const char** p, const char* key, char* s,
+                       size_t size) {
+    const char* q;
+    size_t n = 0;
+
+    if (find_key(p, key) < 0 || **p != '"')
+        return -1;
+
+    for (q = *p + 1; *q && *q != '"'; q++) {
+        char c = *q;
+
+        if (c == '\\') {
+            unsigned u;
+
+            if (q[1] == 'u' && sscanf(q + 2, "%4x", &u) == 1) {
+                c = (char)u;
+                q += 5;
+            } else if (q[1])
+                c = *++q;
+        }
+
+        if (n + 1 < size)
+            s[n++] = c;
+    }
+    if (*q != '"')
+        return -1;
+
+    s[n] = 0;
+    *p = q + 1;
+    return 0;
+}
+
+static void* grow(void* array, size_t n, size_t* size, size_t element) {
+    if (n < *size)
+        return array;
+
+    *size = *size ? *size * 2 : 256;
+    if (!(array = realloc(array, *size * element))) {
+        perror("realloc");
+        exit(1);
+    }
+
+    return array;
+}
+
+static size_t hash_target(const char* name, int reverse) {
+    size_t h = 5381 + (size_t)reverse;
+
+    for (; *name; name++)
+        h = h * 33 + (size_t)tolower((unsigned char)*name);
+
+    return h;
+}
+
+static void index_target(int i) {
+    size_t slot = hash_target(targets[i].name, targets[i].reverse);
+
+    while (slots[slot &= n_slots - 1] >= 0)
+        slot++;
+    slots[slot] = i;
+}
+
+static int find_target(const nss_lookup_t* lookup) {
+    int reverse = lookup->type == NSS_LOOKUP_ADDRESS;
+    size_t slot = hash_target(lookup->name, reverse);
+    target_t* t;
+
+    if (n_slots)
+        for (; slots[slot &= n_slots - 1] >= 0; slot++) {
+            t = &targets[slots[slot]];
+            if (t->reverse == reverse && strcasecmp(t->name, lookup->name) == 0)
+                return slots[slot];
+        }
+
+    // Keep the table at most half full.
+    if (2 * (n_targets + 1) > n_slots) {
+        free(slots);
+        n_slots = n_slots ? n_slots * 2 : 1024;
+        if (!(slots = malloc(n_slots * sizeof(*slots)))) {
+            perror("malloc");
+            exit(1);
+        }
+        memset(slots, 0xff, n_slots * sizeof(*slots));
+        for (size_t i = 0; i < n_targets; i++)
+            index_target((int)i);
+    }
+
+    targets = grow(targets, n_targets, &size_targets, sizeof(*targets));
+    t = &targets[n_targets];
+    memset(t, 0, sizeof(*t));
+    strcpy(t->name, lookup->name);
+    t->reverse = reverse;
+    t->af = lookup->af;
+    memcpy(t->address, lookup->address, sizeof(t->address));
+    index_target((int)n_targets);
+
+    return (int)n_targets++;
+}
+
+static void observe(target_t* t, int af, int result, double dur) {
+    size_t size = t->size;
+
+    n_backend++;
+    t->samples = grow(t->samples, t->n_samples, &size, sizeof(double));
+    t->size = (unsigned)size;
+    t->samples[t->n_samples++] = dur;
+
+    if (result == RESULT_SUCCESS) {
+        t->found4 |= af == AF_INET;
+        t->found6 |= af == AF_INET6;
+    } else if (result == RESULT_UNAVAIL)
+        t->n_unavail++;
+}
+
+// Parses one line of a trace: the lookup, followed by its phases.
+static int parse_line(const char* line, int only_pid) {
+    char entry[32], name[256], phase[32];
+    double pid, af, status, value, dur, result;
+    const char* p = line;
+    nss_lookup_t lookup;
+    record_t r;
+    target_t* t;
+
+    memset(&r, 0, sizeof(r));
+    memset(&lookup, 0, sizeof(lookup));
+
+    if (read_string(&p, "name", entry, sizeof(entry)) < 0 ||
+        read_number(&p, "ts", &r.ts) < 0 ||
+        read_number(&p, "dur", &r.dur) < 0 ||
+        read_number(&p, "pid", &pid) < 0 ||
+        read_string(&p, "name", name, sizeof(name)) < 0 ||
+        read_number(&p, "af", &af) < 0 ||
+        read_number(&p, "status", &status) < 0)
+        return -1;
+
+    if (only_pid && (int)pid != only_pid)
+        return 0;
+
+    lookup.af = (int)af;
+    strcpy(lookup.name, name);
+
+    if (strcmp(entry, "gethostbyname4_r") == 0)
+        lookup.type = NSS_LOOKUP_NAME4;
+    else if (strcmp(entry, "gethostbyname3_r") == 0)
+        lookup.type = NSS_LOOKUP_NAME3;
+    else if (strcmp(entry, "getcanonname_r") == 0)
+        lookup.type = NSS_LOOKUP_CANONNAME;
+    else if (strcmp(entry, "gethostbyaddr_r") == 0) {
+        lookup.type = NSS_LOOKUP_ADDRESS;
+        if (inet_pton(lookup.af, name, lookup.address) != 1)
+            return -1;
+    } else
+        return -1;
+
+    r.status = (int)status;
+    r.type = lookup.type;
+    r.af = lookup.af;
+    r.target = find_target(&lookup);
+    t = &targets[r.target];
+    t->succeeded |= r.status == NSS_STATUS_SUCCESS;
+
+    while (read_string(&p, "name", phase, sizeof(phase)) == 0) {
+        if (read_number(&p, "ts", &value) < 0 ||
+            read_number(&p, "dur", &dur) < 0 ||
+            read_number(&p, "af", &af) < 0 ||
+            read_number(&p, "result", &result) < 0)
+            return -1;
+
+        if (strcmp(phase, "backend") == 0)
+            observe(t, (int)af, (int)result, dur);
+    }
+
+    records = grow(records, n_records, &size_records, sizeof(*records));
+    records[n_records++] = r;
+    return 0;
+}
+
+static int read_trace(const char* path, int only_pid) {
+    char line[8192];
+    FILE* f;
+    int n = 0;
+
+    if (!(f = fopen(path, "r"))) {
+        perror(path);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        n++;
+        if (line[0] != '{')
+            continue;
+
+        if (parse_line(line, only_pid) < 0)
+            fprintf(stderr, "%s:%d: bad record, skipped\n", path, n);
+    }
+
+    fclose(f);
+    return 0;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static double percentile(double* values, size_t n, double q) {
+    if (n == 0)
+        return 0;
+
+    qsort(values, n, sizeof(double), compare_doubles);
+    return values[(size_t)(q * (double)(n - 1))];
+}
+
+static int msec(double usec) {
+    return (int)(usec / 1000.0 + 0.5);
+}
+
+// Writes a fake-avahi script that answers every name and address the way
+// the resolver did: with the latencies it had, with made-up addresses of
+// the families it found, and not at all where it was mostly unavailable.
+// Names only ever answered from the cache get the median latency of all.
+static char* model(void) {
+    double* all = malloc((n_backend + 1) * sizeof(double));
+    size_t n = 0, size = 4096, len = 0;
+    char* script = malloc(size);
+    int median;
+
+    if (!all || !script) {
+        perror("malloc");
+        exit(1);
+    }
+
+    for (size_t i = 0; i < n_targets; i++)
+        for (unsigned j = 0; j < targets[i].n_samples; j++)
+            all[n++] = targets[i].samples[j];
+    median = msec(percentile(all, n, 0.5));
+    free(all);
+
+    // Addresses nobody knew about during the capture.
+    len = (size_t)snprintf(script, size, "* latency=%d\n", median);
+
+    for (int i = 0; i < (int)n_targets; i++) {
+        target_t* t = &targets[i];
+        char line[512], text[INET6_ADDRSTRLEN];
+        int p50 = median, p90 = median, k = 0;
+        int found4 = t->found4, found6 = t->found6;
+
+        if (t->n_samples) {
+            p50 = msec(percentile(t->samples, t->n_samples, 0.5));
+            p90 = msec(percentile(t->samples, t->n_samples, 0.9));
+        } else if (t->succeeded) {
+            found4 = t->af != AF_INET6;
+            found6 = t->af == AF_INET6;
+        }
+
+        if (t->reverse) {
+            // Only answers can be tied to an address.
+            if (!t->succeeded)
+                continue;
+            inet_ntop(t->af, t->address, text, sizeof(text));
+            k = snprintf(line, sizeof(line), "reverse-%d.local", i);
+        } else {
+            if (strcmp(t->name, "*") == 0 || !t->name[0] ||
+                t->name[strcspn(t->name, " \t\r\n#")])
+                continue;
+            k = snprintf(line, sizeof(line), "%s", t->name);
+        }
+
+        if (t->n_unavail * 2 > t->n_samples)
+            // Until the module gives up, as it did during the capture.
+            k += snprintf(line + k, sizeof(line) - (size_t)k, " hang");
+        else
+            k += snprintf(line + k, sizeof(line) - (size_t)k,
+                          " latency=%d jitter=%d", p50, p90 - p50);
+
+        if (t->reverse)
+            k += snprintf(line + k, sizeof(line) - (size_t)k, " %s", text);
+        else {
+            if (found4)
+                k += snprintf(line + k, sizeof(line) - (size_t)k,
+                              " 198.%d.%d.%d", 18 + (i >> 16 & 1),
+                              i >> 8 & 0xff, i & 0xff);
+            if (found6)
+                k += snprintf(line + k, sizeof(line) - (size_t)k,
+                              " 2001:db8::%x:%x", i >> 16 & 0xffff,
+                              i & 0xffff);
+        }
+
+        while (len + (size_t)k + 2 > size)
+            if (!(script = realloc(script, size *= 2))) {
+                perror("realloc");
+                exit(1);
+            }
+        len += (size_t)snprintf(script + len, size - len, "%s\n", line);
+    }
+
+    return script;
+}
+
+static int compare_records(const void* a, const void* b) {
+    double x = ((const record_t*)a)->ts, y = ((const record_t*)b)->ts;
+
+    return x < y ? -1 : x > y;
+}
+
+static void sleep_until(double usec) {
+    double left = usec - now_usec();
+    struct timespec ts;
+
+    if (left <= 0)
+        return;
+
+    ts.tv_sec = (time_t)(left / 1e6);
+    ts.tv_nsec = (long)((left - (double)ts.tv_sec * 1e6) * 1e3);
+    while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+        ;
+}
+
+static const char* status_name(int status) {
+    switch (status) {
+    case NSS_STATUS_SUCCESS:
+        return "success";
+    case NSS_STATUS_NOTFOUND:
+        return "notfound";
+    case NSS_STATUS_UNAVAIL:
+        return "unavail";
+    case NSS_STATUS_TRYAGAIN:
+        return "tryagain";
+    default:
+        return "other";
+    }
+}
+
+static int status_index(int status) {
+    return status >= NSS_STATUS_TRYAGAIN && status <= NSS_STATUS_SUCCESS
+               ? status - NSS_STATUS_TRYAGAIN
+               : 4;
+}
+
+static void replay(const nss_module_t* module, double speed,
+                   fake_avahi_t* fake) {
+    double* captured = malloc((n_records + 1) * sizeof(double));
+    double* replayed = malloc((n_records + 1) * sizeof(double));
+    double* lag = malloc((n_records + 1) * sizeof(double));
+    unsigned counts[2][5] = {{0}};
+    size_t n = 0, same = 0, skipped = 0;
+    double start, ts0;
+    char buffer[4096];
+
+    if (!captured || !replayed || !lag) {
+        perror("malloc");
+        exit(1);
+    }
+
+    qsort(records, n_records, sizeof(*records), compare_records);
+    ts0 = n_records ? records[0].ts : 0;
+    start = now_usec();
+
+    for (size_t i = 0; i < n_records; i++) {
+        const record_t* r = &records[i];
+        const target_t* t = &targets[r->target];
+        double due = start + (speed > 0 ? (r->ts - ts0) / speed : 0), begin;
+        nss_lookup_t lookup = {.type = r->type, .af = r->af};
+        int status;
+
+        strcpy(lookup.name, t->name);
+        memcpy(lookup.address, t->address, sizeof(lookup.address));
+
+        if (!nss_module_supports(module, &lookup)) {
+            skipped++;
+            continue;
+        }
+
+        if (speed > 0)
+            sleep_until(due);
+
+        begin = now_usec();
+        status = nss_module_lookup(module, &lookup, buffer, sizeof(buffer));
+        replayed[n] = now_usec() - begin;
+        captured[n] = r->dur;
+        lag[n] = speed > 0 && begin > due ? begin - due : 0;
+        n++;
+
+        same += status == r->status;
+        counts[0][status_index(r->status)]++;
+        counts[1][status_index(status)]++;
+    }
+
+    printf("lookups        %zu replayed, %zu not supported by the library\n",
+           n, skipped);
+    printf("same status    %zu (%.1f%%)\n", same,
+           n ? 100.0 * (double)same / (double)n : 0.0);
+    printf("backend        %u queries captured, %u replayed\n", n_backend,
+           fake_avahi_requests(fake));
+    printf("\n%-14s %10s %10s\n", "status", "captured", "replayed");
+    for (int s = NSS_STATUS_TRYAGAIN; s <= NSS_STATUS_SUCCESS + 1; s++) {
+        int k = status_index(s);
+
+        if (counts[0][k] || counts[1][k])
+            printf("%-14s %10u %10u\n", status_name(s), counts[0][k],
+                   counts[1][k]);
+    }
+
+    printf("\n%-14s %10s %10s %10s %10s\n", "latency/usec", "p50", "p90",
+           "p99", "max");
+    printf("%-14s %10.1f %10.1f %10.1f %10.1f\n", "captured",
+           percentile(captured, n, 0.5), percentile(captured, n, 0.9),
+           percentile(captured, n, 0.99), percentile(captured, n, 1));
+    printf("%-14s %10.1f %10.1f %10.1f %10.1f\n", "replayed",
+           percentile(replayed, n, 0.5), percentile(replayed, n, 0.9),
+           percentile(replayed, n, 0.99), percentile(replayed, n, 1));
+    // Lookups run one after another; those that overlapped in the
+    // capture start late.
+    if (speed > 0)
+        printf("%-14s %10.1f %10.1f %10.1f %10.1f\n", "start lag",
+               percentile(lag, n, 0.5), percentile(lag, n, 0.9),
+               percentile(lag, n, 0.99), percentile(lag, n, 1));
+
+    free(captured);
+    free(replayed);
+    free(lag);
+}
+
+static int write_file(const char* path, const char* contents) {
+    FILE* f = fopen(path, "w");
+
+    if (!f || fputs(contents, f) < 0 || fclose(f) != 0) {
+        perror(path);
+        return -1;
+    }
+
+    return 0;
+}
+
+static char* read_file(const char* path) {
+    char* contents = NULL;
+    size_t size = 0, n = 0;
+    FILE* f = fopen(path, "r");
+
+    if (!f) {
+        perror(path);
+        return NULL;
+    }
+
+    do {
+        contents = grow(contents, n + 1, &size, 1);
+        n += fread(contents + n, 1, size - n - 1, f);
+    } while (!feof(f) && !ferror(f));
+    contents[n] = 0;
+
+    fclose(f);
+    return contents;
+}
+
+int main(int argc, char* argv[]) {
+    const char *library = ".libs/libnss_mdns.so.2", *extra = NULL;
+    const char* script_path = NULL;
+    char dir[] = "/tmp/nss-replay-XXXXXX", path[64], config[4096];
+    char *script, *lines = NULL;
+    double speed = 1;
+    int only_pid = 0, c, ret = 1;
+    fake_avahi_t* fake;
+    nss_module_t module;
+
+    while ((c = getopt(argc, argv, "l:c:s:p:m:h")) != -1) {
+        switch (c) {
+        case 'l':
+            library = optarg;
+            break;
+        case 'c':
+            extra = optarg;
+            break;
+        case 's':
+            speed = atof(optarg);
+            if (speed < 0) {
+                usage(argv[0]);
+                return 2;
+            }
+            break;
+        case 'p':
+            only_pid = atoi(optarg);
+            break;
+        case 'm':
+            script_path = optarg;
+            break;
+        case 'h':
+            usage(argv[0]);
+            return 0;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (optind + 1 != argc) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    if (read_trace(argv[optind], only_pid) < 0)
+        return 1;
+    if (n_records == 0) {
+        fprintf(stderr, "nss-replay: no lookups in %s\n", argv[optind]);
+        return 1;
+    }
+
+    script = model();
+    if (script_path && write_file(script_path, script) < 0)
+        return 1;
+    if (extra && !(lines = read_file(extra)))
+        return 1;
+
+    if (!mkdtemp(dir)) {
+        perror(dir);
+        return 1;
+    }
+
+    snprintf(path, sizeof(path), "%s/socket", dir);
+    if (!(fake = fake_avahi_start(path, script)))
+        goto finish;
+
+    // The module reads it when it's loaded, and whenever it changes.
+    snprintf(config, sizeof(config),
+             "backend avahi %s\nmulticast-fallback no\naddrconfig no\n%s",
+             path, lines ? lines : "");
+    snprintf(path, sizeof(path), "%s/mdns.conf", dir);
+    if (write_file(path, config) < 0)
+        goto stop;
+    setenv("NSS_MDNS_CONFIG", path, 1);
+
+    if (nss_module_open(&module, library) < 0)
+        goto stop;
+
+    replay(&module, speed, fake);
+    nss_module_close(&module);
+    ret = 0;
+
+stop:
+    fake_avahi_stop(fake);
+finish:
+    unlink(path);
+    rmdir(dir);
+    free(script);
+    free(lines);
+    return ret;
+}
@@ -32,38 +32,127 @@ SPDX-License-Identifier: LGPL-2.1-or-later
 #include <stdbool.h>
 #include <stdlib.h>
 
+#include "addrsort.h"
 #include "avahi.h"
+#include "config.h"
+#include "hostname.h"
+#include "hosts.h"
+#include "ifstate.h"
+#include "learn.h"
+#include "probes.h"
+#include "stats.h"
+#include "trace.h"
 #include "util.h"
 #include "nss.h"
 
-static avahi_resolve_result_t do_avahi_resolve_name(int af, const char* name,
-                                                    userdata_t* userdata) {
-    bool ipv4_found = false;
-    bool ipv6_found = false;
+static const stats_counter_t allow_counters[] = {
+    [USE_NAME_RESULT_SKIP] = STATS_ALLOW_SKIP,
+    [USE_NAME_RESULT_AUTHORITATIVE] = STATS_ALLOW_AUTHORITATIVE,
+    [USE_NAME_RESULT_OPTIONAL] = STATS_ALLOW_OPTIONAL,
+};
+
+// Accounts for the end of a lookup through one of the NSS entry points.
+static enum nss_status lookup_done(enum nss_status status, const int* errnop,
+                                   uint64_t start) {
+    if (status == NSS_STATUS_TRYAGAIN && *errnop == ERANGE)
+        stats_count(STATS_ERANGE);
+    stats_observe(STATS_PHASE_LOOKUP, start);
+    TRACE(trace_end(status));
+    return status;
+}
 
-    if (af == AF_INET || af == AF_UNSPEC) {
-        query_address_result_t address_result;
-        switch (avahi_resolve_name(AF_INET, name, &address_result)) {
-        case AVAHI_RESOLVE_RESULT_SUCCESS:
-            append_address_to_userdata(&address_result, userdata);
-            ipv4_found = true;
-            break;
+// Answers a lookup of this host's own name from the addresses of the local
+// interfaces, as the mDNS responder would announce them.
+static avahi_resolve_result_t resolve_self(int af, userdata_t* userdata) {
+    int n = ifstate_usable_addresses(af, &userdata->result[userdata->count],
+                                     MAX_ENTRIES - userdata->count);
 
-        case AVAHI_RESOLVE_RESULT_HOST_NOT_FOUND:
-            break;
+    for (int i = 0; i < n; i++)
+        append_address_to_userdata(&userdata->result[userdata->count],
+                                   userdata);
 
-        case AVAHI_RESOLVE_RESULT_UNAVAIL:
-            // Something went wrong, just fail.
-            return AVAHI_RESOLVE_RESULT_UNAVAIL;
-        }
+    return n > 0 ? AVAHI_RESOLVE_RESULT_SUCCESS
+                 : AVAHI_RESOLVE_RESULT_HOST_NOT_FOUND;
+}
+
+// Answers a lookup from MDNS_HOSTS_FILE. Returns true if it has the name.
+static bool resolve_static(const nss_variant_t* variant, int af,
+                           const char* name, userdata_t* userdata) {
+    int n;
+
+    if (variant->minimal)
+        return false;
+
+    n = hosts_resolve_name(af, name, &userdata->result[userdata->count],
+                           MAX_ENTRIES - userdata->count);
+
+    for (int i = 0; i < n; i++)
+        append_address_to_userdata(&userdata->result[userdata->count],
+                                   userdata);
+
+    return n > 0;
+}
+
+// Looks up the addresses of name of family af. Sets *cached to whether the
+// answer came from the cache.
+static avahi_resolve_result_t resolve_family(int af, const char* name,
+                                             userdata_t* userdata,
+                                             int* cached) {
+    query_address_result_t spare;
+    // Answers go straight to their place in userdata, if there is one.
+    query_address_result_t* address_result =
+        userdata->count < MAX_ENTRIES ? &userdata->result[userdata->count]
+                                      : &spare;
+    avahi_resolve_result_t ret;
+    int span = -1;
+
+    TRACE(span = trace_phase_begin(TRACE_PHASE_QUERY, af));
+    ret = avahi_resolve_name(af, name, address_result, cached);
+    TRACE(trace_phase_end(span, ret));
+
+    if (ret == AVAHI_RESOLVE_RESULT_SUCCESS)
+        append_address_to_userdata(address_result, userdata);
+
+    return ret;
+}
+
+static avahi_resolve_result_t do_avahi_resolve_name(int af, const char* name,
+                                                    userdata_t* userdata,
+                                                    const mdns_config_t* cfg) {
+    int families[2], n = 0;
+    bool found[2] = {false, false}, queried[2] = {false, false};
+    int cached[2] = {0, 0};
+    bool found_any = false;
+    unsigned threshold = cfg->family_miss_threshold;
+    // Only learn which families hosts have when asked for both.
+    bool learn = af == AF_UNSPEC && threshold > 0;
+
+    // A host without an address of a family cannot reach peers of that
+    // family, so don't wait for their addresses.
+    if ((af == AF_INET || af == AF_UNSPEC) &&
+        (!cfg->addrconfig || ifstate_has_family(AF_INET)))
+        families[n++] = AF_INET;
+    if ((af == AF_INET6 || af == AF_UNSPEC) &&
+        (!cfg->addrconfig || ifstate_has_family(AF_INET6)))
+        families[n++] = AF_INET6;
+
+    // Ask for a family hosts in this domain usually lack last, so it can be
+    // skipped once the host was found with the other one.
+    if (learn && n == 2 && learn_is_missing(name, AF_INET, threshold) &&
+        !learn_is_missing(name, AF_INET6, threshold)) {
+        families[0] = AF_INET6;
+        families[1] = AF_INET;
     }
 
-    if (af == AF_INET6 || af == AF_UNSPEC) {
-        query_address_result_t address_result;
-        switch (avahi_resolve_name(AF_INET6, name, &address_result)) {
+    for (int i = 0; i < n; i++) {
+        if (learn && found_any &&
+            !learn_should_query(name, families[i], threshold,
+                                cfg->family_probe_interval))
+            continue;
+
+        switch (resolve_family(families[i], name, userdata, &cached[i])) {
         case AVAHI_RESOLVE_RESULT_SUCCESS:
-            append_address_to_userdata(&address_result, userdata);
-            ipv6_found = true;
+            found[i] = found_any = true;
             break;
 
         case AVAHI_RESOLVE_RESULT_HOST_NOT_FOUND:
@@ -73,42 +162,42 @@ static avahi_resolve_result_t do_avahi_resolve_name(int af, const char* name,
             // Something went wrong, just fail.
             return AVAHI_RESOLVE_RESULT_UNAVAIL;
         }
+        queried[i] = true;
     }
 
-    if (ipv4_found || ipv6_found) {
-        return AVAHI_RESOLVE_RESULT_SUCCESS;
-    } else {
+    if (!found_any)
         return AVAHI_RESOLVE_RESULT_HOST_NOT_FOUND;
-    }
+
+    // The host exists, so a family it was not found with is missing. Only
+    // fresh answers count: a cached one would count again on every hit.
+    if (learn)
+        for (int i = 0; i < n; i++)
+            if (queried[i] && !cached[i])
+                learn_report(name, families[i], found[i], threshold,
+                             cfg->family_probe_interval);
+
+    return AVAHI_RESOLVE_RESULT_SUCCESS;
 }
 
-enum nss_status _nss_mdns_gethostbyname_impl(const char* name, int af,
+enum nss_status mdns_core_gethostbyname_impl(const nss_variant_t* variant,
+                                             const char* name, int af,
                                              userdata_t* u, int* errnop,
                                              int* h_errnop) {
 
     FILE* mdns_allow_file = NULL;
-    use_name_result_t result;
-
-#ifdef NSS_IPV4_ONLY
-    if (af == AF_UNSPEC) {
-        af = AF_INET;
-    }
-#endif
-
-#ifdef NSS_IPV6_ONLY
-    if (af == AF_UNSPEC) {
-        af = AF_INET6;
-    }
-#endif
-
-#ifdef NSS_IPV4_ONLY
-    if (af != AF_INET)
-#elif NSS_IPV6_ONLY
-    if (af != AF_INET6)
-#else
-    if (af != AF_INET && af != AF_INET6 && af != AF_UNSPEC)
-#endif
-    {
+    use_name_result_t result = USE_NAME_RESULT_AUTHORITATIVE;
+    avahi_resolve_result_t resolved;
+    const mdns_config_t* cfg;
+    uint64_t start;
+    bool found_static;
+    int span = -1;
+
+    if (af == AF_UNSPEC)
+        af = variant->af;
+
+    if (variant->af != AF_UNSPEC ? af != variant->af
+                                 : af != AF_INET && af != AF_INET6 &&
+                                       af != AF_UNSPEC) {
         *errnop = EINVAL;
         *h_errnop = NO_RECOVERY;
         return NSS_STATUS_UNAVAIL;
@@ -116,23 +205,52 @@ enum nss_status _nss_mdns_gethostbyname_impl(const char* name, int af,
 
     u->count = 0;
 
-#ifndef MDNS_MINIMAL
-    mdns_allow_file = fopen(MDNS_ALLOW_FILE, "r");
-#endif
-    result = verify_name_allowed_with_soa(name, mdns_allow_file,
-                                          TEST_LOCAL_SOA_AUTO);
-#ifndef MDNS_MINIMAL
-    if (mdns_allow_file)
-        fclose(mdns_allow_file);
-#endif
+    // Names in the static table were checked against the allow file when
+    // it was loaded, so they need neither the file nor the SOA probe.
+    found_static = resolve_static(variant, af, name, u);
+
+    if (!found_static) {
+        start = stats_start();
+        TRACE(span = trace_phase_begin(TRACE_PHASE_ALLOW, af));
+        if (!variant->minimal)
+            mdns_allow_file = fopen(MDNS_ALLOW_FILE, "r");
+        result = verify_name_allowed_with_soa(name, mdns_allow_file,
+                                              TEST_LOCAL_SOA_AUTO);
+        if (mdns_allow_file)
+            fclose(mdns_allow_file);
+        PROBE3(allow, name, af, result);
+        TRACE(trace_phase_end(span, result));
+        TRACE(trace_decision(stats_counter_name(allow_counters[result])));
+        stats_observe(STATS_PHASE_ALLOW, start);
+        stats_count(allow_counters[result]);
+
+        if (result == USE_NAME_RESULT_SKIP) {
+            *errnop = EINVAL;
+            *h_errnop = NO_RECOVERY;
+            return NSS_STATUS_UNAVAIL;
+        }
+    }
 
-    if (result == USE_NAME_RESULT_SKIP) {
-        *errnop = EINVAL;
-        *h_errnop = NO_RECOVERY;
-        return NSS_STATUS_UNAVAIL;
+    cfg = config_get();
+    if (cfg->stats)
+        stats_export();
+
+    if (found_static) {
+        TRACE(trace_decision("static"));
+        resolved = AVAHI_RESOLVE_RESULT_SUCCESS;
+    } else if (cfg->local_hostname && hostname_is_self(name)) {
+        TRACE(trace_decision("self"));
+        resolved = resolve_self(af, u);
+    } else {
+        TRACE(trace_decision("backend"));
+        resolved = do_avahi_resolve_name(af, name, u, cfg);
     }
 
-    switch (do_avahi_resolve_name(af, name, u)) {
+    if (resolved == AVAHI_RESOLVE_RESULT_SUCCESS)
+        addrsort_sort(u->result, u->count, cfg->sort_addresses);
+    config_put(cfg);
+
+    switch (resolved) {
     case AVAHI_RESOLVE_RESULT_SUCCESS:
         return NSS_STATUS_SUCCESS;
 
@@ -155,7 +273,8 @@ enum nss_status _nss_mdns_gethostbyname_impl(const char* name, int af,
 }
 
 #ifndef __FreeBSD__
-enum nss_status _nss_mdns_gethostbyname4_r(const char* name,
+enum nss_status mdns_core_gethostbyname4_r(const nss_variant_t* variant,
+                                           const char* name,
                                            struct gaih_addrtuple** pat,
                                            char* buffer, size_t buflen,
                                            int* errnop, int* h_errnop,
@@ -165,111 +284,218 @@ enum nss_status _nss_mdns_gethostbyname4_r(const char* name,
 
     userdata_t u;
     buffer_t buf;
+    uint64_t start = stats_start();
+    int span = -1;
 
-    enum nss_status status =
-        _nss_mdns_gethostbyname_impl(name, AF_UNSPEC, &u, errnop, h_errnop);
-    if (status != NSS_STATUS_SUCCESS) {
-        return status;
+    PROBE2(gethostbyname4_entry, name, AF_UNSPEC);
+    TRACE(trace_begin("gethostbyname4_r", name, AF_UNSPEC, NULL));
+    stats_count(STATS_LOOKUP_NAME4);
+
+    enum nss_status status = mdns_core_gethostbyname_impl(
+        variant, name, AF_UNSPEC, &u, errnop, h_errnop);
+    if (status == NSS_STATUS_SUCCESS) {
+        buffer_init(&buf, buffer, buflen);
+        TRACE(span = trace_phase_begin(TRACE_PHASE_CONVERT, AF_UNSPEC));
+        status = convert_userdata_to_addrtuple(&u, name, pat, &buf, errnop,
+                                               h_errnop);
+        TRACE(trace_phase_end(span, status));
+        PROBE3(convert, name, AF_UNSPEC, status);
     }
-    buffer_init(&buf, buffer, buflen);
-    return convert_userdata_to_addrtuple(&u, name, pat, &buf, errnop, h_errnop);
+    status = lookup_done(status, errnop, start);
+    PROBE3(gethostbyname4_return, name, AF_UNSPEC, status);
+    return status;
 }
 #endif
 
-enum nss_status _nss_mdns_gethostbyname3_r(const char* name, int af,
+enum nss_status mdns_core_gethostbyname3_r(const nss_variant_t* variant,
+                                           const char* name, int af,
                                            struct hostent* result, char* buffer,
                                            size_t buflen, int* errnop,
                                            int* h_errnop, int32_t* ttlp,
                                            char** canonp) {
 
     (void)ttlp;
-    (void)canonp;
 
     buffer_t buf;
     userdata_t u;
+    uint64_t start = stats_start();
+    int span = -1;
+
+    PROBE2(gethostbyname3_entry, name, af);
+    TRACE(trace_begin("gethostbyname3_r", name, af, NULL));
+    stats_count(STATS_LOOKUP_NAME3);
 
     // The interfaces for gethostbyname3_r and below do not actually support
     // returning results for more than one address family
-    if (af == AF_UNSPEC) {
-#ifdef NSS_IPV6_ONLY
-        af = AF_INET6;
-#else
-        af = AF_INET;
-#endif
+    if (af == AF_UNSPEC)
+        af = variant->af == AF_INET6 ? AF_INET6 : AF_INET;
+
+    enum nss_status status =
+        mdns_core_gethostbyname_impl(variant, name, af, &u, errnop, h_errnop);
+    if (status == NSS_STATUS_SUCCESS) {
+        buffer_init(&buf, buffer, buflen);
+        TRACE(span = trace_phase_begin(TRACE_PHASE_CONVERT, af));
+        status = convert_userdata_for_name_to_hostent(&u, name, af, result,
+                                                      &buf, errnop, h_errnop);
+        TRACE(trace_phase_end(span, status));
+        PROBE3(convert, name, af, status);
+        // Spares getaddrinfo() a getcanonname_r call for AI_CANONNAME.
+        if (status == NSS_STATUS_SUCCESS && canonp)
+            *canonp = result->h_name;
     }
+    status = lookup_done(status, errnop, start);
+    PROBE3(gethostbyname3_return, name, af, status);
+    return status;
+}
 
-    enum nss_status status = _nss_mdns_gethostbyname_impl(name, af, &u, errnop, h_errnop);
-    if (status != NSS_STATUS_SUCCESS) {
-        return status;
+#ifndef __FreeBSD__
+static enum nss_status copy_canonname(const char* name, buffer_t* buf,
+                                      char** result, int* errnop,
+                                      int* h_errnop) {
+    *result = buffer_strdup(buf, name);
+    RETURN_IF_FAILED_ALLOC(*result);
+
+    return NSS_STATUS_SUCCESS;
+}
+
+// mDNS has no aliases, so a name that resolves is its own canonical name.
+// getaddrinfo() asks right after looking up the addresses, so the lookup
+// is normally answered by the cache.
+enum nss_status mdns_core_getcanonname_r(const nss_variant_t* variant,
+                                         const char* name, char* buffer,
+                                         size_t buflen, char** result,
+                                         int* errnop, int* h_errnop) {
+    userdata_t u;
+    buffer_t buf;
+    uint64_t start = stats_start();
+
+    PROBE2(getcanonname_entry, name, AF_UNSPEC);
+    TRACE(trace_begin("getcanonname_r", name, AF_UNSPEC, NULL));
+    stats_count(STATS_LOOKUP_CANONNAME);
+
+    enum nss_status status = mdns_core_gethostbyname_impl(
+        variant, name, AF_UNSPEC, &u, errnop, h_errnop);
+    if (status == NSS_STATUS_SUCCESS) {
+        buffer_init(&buf, buffer, buflen);
+        status = copy_canonname(name, &buf, result, errnop, h_errnop);
     }
-    buffer_init(&buf, buffer, buflen);
-    return convert_userdata_for_name_to_hostent(&u, name, af, result, &buf,
-                                                errnop, h_errnop);
+    status = lookup_done(status, errnop, start);
+    PROBE3(getcanonname_return, name, AF_UNSPEC, status);
+    return status;
 }
+#endif
 
-enum nss_status _nss_mdns_gethostbyname2_r(const char* name, int af,
+enum nss_status mdns_core_gethostbyname2_r(const nss_variant_t* variant,
+                                           const char* name, int af,
                                            struct hostent* result, char* buffer,
                                            size_t buflen, int* errnop,
                                            int* h_errnop) {
+    enum nss_status status;
 
-    return _nss_mdns_gethostbyname3_r(name, af, result, buffer, buflen, errnop,
-                                      h_errnop, NULL, NULL);
+    PROBE2(gethostbyname2_entry, name, af);
+    status = mdns_core_gethostbyname3_r(variant, name, af, result, buffer,
+                                        buflen, errnop, h_errnop, NULL, NULL);
+    PROBE3(gethostbyname2_return, name, af, status);
+    return status;
 }
 
-enum nss_status _nss_mdns_gethostbyname_r(const char* name,
+enum nss_status mdns_core_gethostbyname_r(const nss_variant_t* variant,
+                                          const char* name,
                                           struct hostent* result, char* buffer,
                                           size_t buflen, int* errnop,
                                           int* h_errnop) {
+    enum nss_status status;
 
-    return _nss_mdns_gethostbyname2_r(name, AF_UNSPEC, result, buffer, buflen,
-                                      errnop, h_errnop);
+    PROBE2(gethostbyname_entry, name, AF_UNSPEC);
+    status = mdns_core_gethostbyname2_r(variant, name, AF_UNSPEC, result,
+                                        buffer, buflen, errnop, h_errnop);
+    PROBE3(gethostbyname_return, name, AF_UNSPEC, status);
+    return status;
 }
 
-enum nss_status _nss_mdns_gethostbyaddr_r(const void* addr, int len, int af,
+static enum nss_status gethostbyaddr_impl(const nss_variant_t* variant,
+                                          const void* addr, int len, int af,
                                           struct hostent* result, char* buffer,
                                           size_t buflen, int* errnop,
                                           int* h_errnop) {
 
     size_t address_length;
     char t[256];
+    const mdns_config_t* cfg;
+    buffer_t buf;
+    int wanted;
+    avahi_resolve_result_t resolved;
+    enum nss_status status;
+    int span = -1;
 
     /* Check for address types */
     address_length =
         af == AF_INET ? sizeof(ipv4_address_t) : sizeof(ipv6_address_t);
 
     if (len < (int)address_length ||
-#ifdef NSS_IPV4_ONLY
-        af != AF_INET
-#elif NSS_IPV6_ONLY
-        af != AF_INET6
-#else
-        (af != AF_INET && af != AF_INET6)
-#endif
-    ) {
+        (variant->af != AF_UNSPEC ? af != variant->af
+                                  : af != AF_INET && af != AF_INET6)) {
         *errnop = EINVAL;
         *h_errnop = NO_RECOVERY;
         return NSS_STATUS_UNAVAIL;
     }
 
-#ifdef MDNS_MINIMAL
+    TRACE(trace_begin("gethostbyaddr_r", NULL, af, addr));
+
     /* Only query for 169.254.0.0/16 IPv4 in minimal mode */
-    if ((af == AF_INET &&
-         ((ntohl(*(const uint32_t*)addr) & 0xFFFF0000UL) != 0xA9FE0000UL)) ||
-        (af == AF_INET6 && !(((const uint8_t*)addr)[0] == 0xFE &&
-                             (((const uint8_t*)addr)[1] >> 6) == 2))) {
+    if (variant->minimal &&
+        ((af == AF_INET &&
+          ((ntohl(*(const uint32_t*)addr) & 0xFFFF0000UL) != 0xA9FE0000UL)) ||
+         (af == AF_INET6 && !(((const uint8_t*)addr)[0] == 0xFE &&
+                              (((const uint8_t*)addr)[1] >> 6) == 2)))) {
         *errnop = EINVAL;
         *h_errnop = NO_RECOVERY;
         return NSS_STATUS_UNAVAIL;
     }
-#endif
+
+    if (!variant->minimal && hosts_resolve_address(af, addr, t, sizeof(t))) {
+        TRACE(trace_decision("static"));
+        buffer_init(&buf, buffer, buflen);
+        TRACE(span = trace_phase_begin(TRACE_PHASE_CONVERT, af));
+        status = convert_name_and_addr_to_hostent(
+            t, addr, address_length, af, result, &buf, errnop, h_errnop);
+        TRACE(trace_phase_end(span, status));
+        PROBE3(convert, t, af, status);
+        return status;
+    }
+
+    cfg = config_get();
+    if (cfg->stats)
+        stats_export();
+
+    // Don't bother the backends with addresses no mDNS host has.
+    wanted = cfg->reverse_prefixes.n_prefixes == 0 ||
+             prefix_table_lookup(&cfg->reverse_prefixes, af, addr) ==
+                 PREFIX_ALLOW;
+    config_put(cfg);
+
+    if (!wanted) {
+        TRACE(trace_decision("reverse_prefix"));
+        *errnop = ENOENT;
+        *h_errnop = HOST_NOT_FOUND;
+        return NSS_STATUS_NOTFOUND;
+    }
 
     /* Lookup using Avahi */
-    buffer_t buf;
-    switch (avahi_resolve_address(af, addr, t, sizeof(t))) {
+    TRACE(trace_decision("backend"));
+    TRACE(span = trace_phase_begin(TRACE_PHASE_QUERY, af));
+    resolved = avahi_resolve_address(af, addr, t, sizeof(t));
+    TRACE(trace_phase_end(span, resolved));
+
+    switch (resolved) {
     case AVAHI_RESOLVE_RESULT_SUCCESS:
         buffer_init(&buf, buffer, buflen);
-        return convert_name_and_addr_to_hostent(t, addr, address_length, af,
-                                                result, &buf, errnop, h_errnop);
+        TRACE(span = trace_phase_begin(TRACE_PHASE_CONVERT, af));
+        status = convert_name_and_addr_to_hostent(
+            t, addr, address_length, af, result, &buf, errnop, h_errnop);
+        TRACE(trace_phase_end(span, status));
+        PROBE3(convert, t, af, status);
+        return status;
 
     case AVAHI_RESOLVE_RESULT_HOST_NOT_FOUND:
         *errnop = ETIMEDOUT;
@@ -283,3 +509,21 @@ enum nss_status _nss_mdns_gethostbyaddr_r(const void* addr, int len, int af,
         return NSS_STATUS_UNAVAIL;
     }
 }
+
+enum nss_status mdns_core_gethostbyaddr_r(const nss_variant_t* variant,
+                                          const void* addr, int len, int af,
+                                          struct hostent* result, char* buffer,
+                                          size_t buflen, int* errnop,
+                                          int* h_errnop) {
+    uint64_t start = stats_start();
+    enum nss_status status;
+
+    PROBE2(gethostbyaddr_entry, addr, af);
+    stats_count(STATS_LOOKUP_ADDRESS);
+
+    status = lookup_done(gethostbyaddr_impl(variant, addr, len, af, result,
+                                            buffer, buflen, errnop, h_errnop),
+                         errnop, start);
+    PROBE3(gethostbyaddr_return, addr, af, status);
+    return status;
+}
@@ -24,36 +24,79 @@ SPDX-License-Identifier: LGPL-2.1-or-later
 #define _nss_mdns_gethostbyname2_r _nss_mdns4_gethostbyname2_r
 #define _nss_mdns_gethostbyname_r _nss_mdns4_gethostbyname_r
 #define _nss_mdns_gethostbyaddr_r _nss_mdns4_gethostbyaddr_r
+#define _nss_mdns_getcanonname_r _nss_mdns4_getcanonname_r
 #elif defined(NSS_IPV4_ONLY) && defined(MDNS_MINIMAL)
 #define _nss_mdns_gethostbyname4_r _nss_mdns4_minimal_gethostbyname4_r
 #define _nss_mdns_gethostbyname3_r _nss_mdns4_minimal_gethostbyname3_r
 #define _nss_mdns_gethostbyname2_r _nss_mdns4_minimal_gethostbyname2_r
 #define _nss_mdns_gethostbyname_r _nss_mdns4_minimal_gethostbyname_r
 #define _nss_mdns_gethostbyaddr_r _nss_mdns4_minimal_gethostbyaddr_r
+#define _nss_mdns_getcanonname_r _nss_mdns4_minimal_getcanonname_r
 #elif defined(NSS_IPV6_ONLY) && !defined(MDNS_MINIMAL)
 #define _nss_mdns_gethostbyname4_r _nss_mdns6_gethostbyname4_r
 #define _nss_mdns_gethostbyname3_r _nss_mdns6_gethostbyname3_r
 #define _nss_mdns_gethostbyname2_r _nss_mdns6_gethostbyname2_r
 #define _nss_mdns_gethostbyname_r _nss_mdns6_gethostbyname_r
 #define _nss_mdns_gethostbyaddr_r _nss_mdns6_gethostbyaddr_r
+#define _nss_mdns_getcanonname_r _nss_mdns6_getcanonname_r
 #elif defined(NSS_IPV6_ONLY) && defined(MDNS_MINIMAL)
 #define _nss_mdns_gethostbyname4_r _nss_mdns6_minimal_gethostbyname4_r
 #define _nss_mdns_gethostbyname3_r _nss_mdns6_minimal_gethostbyname3_r
 #define _nss_mdns_gethostbyname2_r _nss_mdns6_minimal_gethostbyname2_r
 #define _nss_mdns_gethostbyname_r _nss_mdns6_minimal_gethostbyname_r
 #define _nss_mdns_gethostbyaddr_r _nss_mdns6_minimal_gethostbyaddr_r
+#define _nss_mdns_getcanonname_r _nss_mdns6_minimal_getcanonname_r
 #elif defined(MDNS_MINIMAL)
 #define _nss_mdns_gethostbyname4_r _nss_mdns_minimal_gethostbyname4_r
 #define _nss_mdns_gethostbyname3_r _nss_mdns_minimal_gethostbyname3_r
 #define _nss_mdns_gethostbyname2_r _nss_mdns_minimal_gethostbyname2_r
 #define _nss_mdns_gethostbyname_r _nss_mdns_minimal_gethostbyname_r
 #define _nss_mdns_gethostbyaddr_r _nss_mdns_minimal_gethostbyaddr_r
+#define _nss_mdns_getcanonname_r _nss_mdns_minimal_getcanonname_r
 #endif
 
+#include "util.h"
+
+// The policy a module variant applies on top of the shared core: which
+// address families it answers for, and whether it only resolves .local
+// names and link-local addresses without consulting MDNS_ALLOW_FILE or
+// MDNS_HOSTS_FILE.
+typedef struct {
+    // AF_INET, AF_INET6, or AF_UNSPEC for both.
+    int af;
+    int minimal;
+} nss_variant_t;
+
+// The core of the lookups, shared by all module variants loaded in a
+// process. Each variant is a thin shim that passes its policy along.
+enum nss_status mdns_core_gethostbyname_impl(const nss_variant_t*, const char*,
+                                             int, userdata_t*, int*, int*);
+#ifndef __FreeBSD__
+enum nss_status mdns_core_gethostbyname4_r(const nss_variant_t*, const char*,
+                                           struct gaih_addrtuple**, char*,
+                                           size_t, int*, int*, int32_t*);
+enum nss_status mdns_core_getcanonname_r(const nss_variant_t*, const char*,
+                                         char*, size_t, char**, int*, int*);
+#endif
+enum nss_status mdns_core_gethostbyname3_r(const nss_variant_t*, const char*,
+                                           int, struct hostent*, char*, size_t,
+                                           int*, int*, int32_t*, char**);
+enum nss_status mdns_core_gethostbyname2_r(const nss_variant_t*, const char*,
+                                           int, struct hostent*, char*, size_t,
+                                           int*, int*);
+enum nss_status mdns_core_gethostbyname_r(const nss_variant_t*, const char*,
+                                          struct hostent*, char*, size_t, int*,
+                                          int*);
+enum nss_status mdns_core_gethostbyaddr_r(const nss_variant_t*, const void*,
+                                          int, int, struct hostent*, char*,
+                                          size_t, int*, int*);
+
 // Define prototypes for nss function we're going to export (fixes GCC warnings)
 #ifndef __FreeBSD__
 enum nss_status _nss_mdns_gethostbyname4_r(const char*, struct gaih_addrtuple**,
                                            char*, size_t, int*, int*, int32_t*);
+enum nss_status _nss_mdns_getcanonname_r(const char*, char*, size_t, char**,
+                                         int*, int*);
 #endif
 enum nss_status _nss_mdns_gethostbyname3_r(const char*, int, struct hostent*,
                                            char*, size_t, int*, int*, int32_t*,
@@ -0,0 +1,223 @@
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <arpa/inet.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "prefix.h"
+
+void prefix_table_init(prefix_table_t* table) {
+    assert(table);
+
+    memset(table, 0, sizeof(*table));
+    // The roots, covering every address of their family.
+    table->nodes[0].verdict = PREFIX_NONE;
+    table->nodes[1].verdict = PREFIX_NONE;
+    table->n_nodes = 2;
+}
+
+static int root(int af) { return af == AF_INET ? 0 : 1; }
+
+static int address_bits(int af) { return af == AF_INET ? 32 : 128; }
+
+// Writes the key of an address to key, zero padded to 16 bytes.
+static void make_key(int af, const void* address, uint8_t key[16]) {
+    memset(key, 0, 16);
+    memcpy(key, address, af == AF_INET ? 4 : 16);
+}
+
+static int bit(const uint8_t* key, int i) {
+    return (key[i / 8] >> (7 - i % 8)) & 1;
+}
+
+// Returns the number of leading bits a and b have in common, up to max.
+static int common_bits(const uint8_t* a, const uint8_t* b, int max) {
+    int i = 0;
+
+    while (i < max && a[i / 8] == b[i / 8])
+        i += 8;
+    while (i < max && bit(a, i) == bit(b, i))
+        i++;
+
+    return i < max ? i : max;
+}
+
+static int new_node(prefix_table_t* table, const uint8_t* key, int len,
+                    prefix_verdict_t verdict) {
+    prefix_node_t* n = &table->nodes[table->n_nodes];
+
+    memset(n, 0, sizeof(*n));
+    // Clear the bits past the prefix, so that equal prefixes compare
+    // equal.
+    for (int i = 0; i < 16; i++) {
+        int keep = len - i * 8;
+        n->key[i] = keep >= 8   ? key[i]
+                    : keep <= 0 ? 0
+                                : key[i] & (uint8_t)(0xFF << (8 - keep));
+    }
+    n->len = len;
+    n->verdict = verdict;
+
+    return table->n_nodes++;
+}
+
+int prefix_table_add(prefix_table_t* table, int af, const void* address,
+                     int len, prefix_verdict_t verdict) {
+    uint8_t key[16];
+    int cur;
+
+    assert(table);
+
+    if ((af != AF_INET && af != AF_INET6) || len < 0 ||
+        len > address_bits(af) || verdict == PREFIX_NONE)
+        return -1;
+
+    // Two new nodes at most.
+    if (table->n_nodes + 2 > PREFIX_MAX_NODES)
+        return -1;
+
+    make_key(af, address, key);
+    cur = root(af);
+
+    for (;;) {
+        prefix_node_t* n = &table->nodes[cur];
+        int b, c, common;
+
+        if (len == n->len) {
+            if (n->verdict == PREFIX_NONE)
+                table->n_prefixes++;
+            n->verdict = verdict;
+            return 0;
+        }
+
+        b = bit(key, n->len);
+        if (!(c = n->child[b])) {
+            n->child[b] = new_node(table, key, len, verdict);
+            table->n_prefixes++;
+            return 0;
+        }
+
+        common = common_bits(key, table->nodes[c].key,
+                             len < table->nodes[c].len ? len
+                                                       : table->nodes[c].len);
+
+        if (common == table->nodes[c].len) {
+            // The child's prefix covers ours.
+            cur = c;
+            continue;
+        }
+
+        if (common == len) {
+            // Ours covers the child's: put it in between.
+            int m = new_node(table, key, len, verdict);
+
+            table->nodes[m].child[bit(table->nodes[c].key, len)] = c;
+            table->nodes[cur].child[b] = m;
+        } else {
+            // They part ways: branch where they do.
+            int m = new_node(table, key, common, PREFIX_NONE);
+            int l = new_node(table, key, len, verdict);
+
+            table->nodes[m].child[bit(table->nodes[c].key, common)] = c;
+            table->nodes[m].child[bit(key, common)] = l;
+            table->nodes[cur].child[b] = m;
+        }
+
+        table->n_prefixes++;
+        return 0;
+    }
+}
+
+int prefix_table_parse(prefix_table_t* table, const char* text) {
+    char buf[INET6_ADDRSTRLEN + 8], *slash, *end;
+    uint8_t address[16];
+    prefix_verdict_t verdict = PREFIX_ALLOW;
+    long len = -1;
+    int af;
+
+    if (*text == '!') {
+        verdict = PREFIX_DENY;
+        text++;
+    }
+
+    if (strlen(text) >= sizeof(buf))
+        return -1;
+    strcpy(buf, text);
+
+    if ((slash = strchr(buf, '/'))) {
+        *(slash++) = 0;
+        // Only digits: strtol() would also take a sign or white space.
+        if (*slash < '0' || *slash > '9')
+            return -1;
+        len = strtol(slash, &end, 10);
+        if (*end)
+            return -1;
+    }
+
+    if (inet_pton(AF_INET, buf, address) == 1)
+        af = AF_INET;
+    else if (inet_pton(AF_INET6, buf, address) == 1)
+        af = AF_INET6;
+    else
+        return -1;
+
+    if (!slash)
+        len = address_bits(af);
+    else if (len > address_bits(af))
+        return -1;
+
+    return prefix_table_add(table, af, address, (int)len, verdict);
+}
+
+prefix_verdict_t prefix_table_lookup(const prefix_table_t* table, int af,
+                                     const void* address) {
+    uint8_t key[16];
+    const prefix_node_t* n;
+    prefix_verdict_t best;
+
+    assert(table);
+
+    if (af != AF_INET && af != AF_INET6)
+        return PREFIX_NONE;
+
+    make_key(af, address, key);
+    n = &table->nodes[root(af)];
+    best = n->verdict;
+
+    while (n->len < address_bits(af)) {
+        int c = n->child[bit(key, n->len)];
+
+        if (!c || common_bits(key, table->nodes[c].key,
+                              table->nodes[c].len) < table->nodes[c].len)
+            break;
+
+        n = &table->nodes[c];
+        if (n->verdict != PREFIX_NONE)
+            best = n->verdict;
+    }
+
+    return best;
+}
@@ -0,0 +1,76 @@
+#ifndef fooprefixhfoo
+#define fooprefixhfoo
+
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#include <inttypes.h>
+
+// Maximum number of prefixes in a table.
+#define PREFIX_MAX 63
+
+// Every prefix adds at most a leaf and a branching node, to the roots of
+// the two families.
+#define PREFIX_MAX_NODES (2 * PREFIX_MAX + 2)
+
+typedef enum {
+    PREFIX_NONE = -1,
+    PREFIX_DENY = 0,
+    PREFIX_ALLOW = 1,
+} prefix_verdict_t;
+
+// A node of a path-compressed binary trie over the bits of an address.
+// IPv4 keys only use the first 4 bytes.
+typedef struct {
+    uint8_t key[16];
+    uint8_t len;
+    int8_t verdict;
+    // Indexes of the children; 0 (a root) for none.
+    uint8_t child[2];
+} prefix_node_t;
+
+// A longest-prefix-match table of address prefixes, with one trie per
+// address family: nodes[0] is the root of the IPv4 one, nodes[1] that of
+// the IPv6 one. IPv6 prefixes, even ::/0 or ::ffff:0:0/96, never decide
+// about IPv4 addresses, nor IPv4 prefixes about IPv6 ones. Self-contained,
+// so it can be copied around.
+typedef struct {
+    prefix_node_t nodes[PREFIX_MAX_NODES];
+    int n_nodes;
+    int n_prefixes;
+} prefix_table_t;
+
+void prefix_table_init(prefix_table_t* table);
+
+// Adds the prefix of length len of the address of family af, with a
+// verdict for the addresses it covers. Returns -1 if the table is full or
+// the arguments are invalid.
+int prefix_table_add(prefix_table_t* table, int af, const void* address,
+                     int len, prefix_verdict_t verdict);
+
+// Parses "[!]ADDRESS/LEN" (or a bare address, for a single host) and adds
+// it; "!" denies the prefix. Returns -1 on error.
+int prefix_table_parse(prefix_table_t* table, const char* text);
+
+// Returns the verdict of the longest prefix covering the address, or
+// PREFIX_NONE if no prefix does.
+prefix_verdict_t prefix_table_lookup(const prefix_table_t* table, int af,
+                                     const void* address);
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef fooprobeshfoo
+#define fooprobeshfoo
+
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+// USDT probes of the provider nss_mdns, for SystemTap, bpftrace and the
+// like. They are a single nop while nobody listens, and compile to nothing
+// without <sys/sdt.h>. Strings are passed as pointers, addresses as
+// pointers to their bytes in network order.
+//
+//   gethostbyname4_entry, gethostbyname3_entry, gethostbyname2_entry,
+//   gethostbyname_entry (name, af)
+//   gethostbyname4_return, ... (name, af, enum nss_status)
+//   gethostbyaddr_entry (address, af)
+//   gethostbyaddr_return (address, af, enum nss_status)
+//   getcanonname_entry (name, af)
+//   getcanonname_return (name, af, enum nss_status)
+//   allow (name, af, use_name_result_t)
+//   soa_start ()
+//   soa_done (has SOA)
+//   connect_start (socket path)
+//   connect_done (socket path, fd or -1)
+//   convert (name, af, enum nss_status)
+//
+// and, for requests to avahi-daemon,
+//
+//   request_sent (name or address, af)
+//   reply_parsed (name or address, af, avahi_resolve_result_t)
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+
+#define PROBE0(probe) DTRACE_PROBE(nss_mdns, probe)
+#define PROBE1(probe, a) DTRACE_PROBE1(nss_mdns, probe, a)
+#define PROBE2(probe, a, b) DTRACE_PROBE2(nss_mdns, probe, a, b)
+#define PROBE3(probe, a, b, c) DTRACE_PROBE3(nss_mdns, probe, a, b, c)
+#else
+#define PROBE0(probe) ((void)0)
+#define PROBE1(probe, a) ((void)0)
+#define PROBE2(probe, a, b) ((void)0)
+#define PROBE3(probe, a, b, c) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,458 @@
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "backend.h"
+#include "resolved.h"
+#include "util.h"
+
+// Nesting limit of the JSON scanner.
+#define JSON_MAX_DEPTH 32
+
+// A small scanner for the JSON replies of systemd-resolved. It walks the
+// text in place and never allocates.
+
+static const char* json_ws(const char* p) {
+    return p + strspn(p, " \t\r\n");
+}
+
+// Skips a string, starting at its opening quote.
+static const char* json_skip_string(const char* p) {
+    if (*p != '"')
+        return NULL;
+
+    for (p++; *p; p++) {
+        if (*p == '\\') {
+            if (!*++p)
+                return NULL;
+        } else if (*p == '"') {
+            return p + 1;
+        }
+    }
+
+    return NULL;
+}
+
+// Skips any value. Returns NULL if it is malformed.
+static const char* json_skip_value(const char* p, int depth) {
+    p = json_ws(p);
+
+    if (depth > JSON_MAX_DEPTH)
+        return NULL;
+
+    if (*p == '"')
+        return json_skip_string(p);
+
+    if (*p == '{' || *p == '[') {
+        char close = *p == '{' ? '}' : ']';
+
+        p = json_ws(p + 1);
+        if (*p == close)
+            return p + 1;
+
+        for (;;) {
+            if (close == '}') {
+                if (!(p = json_skip_string(json_ws(p))))
+                    return NULL;
+                p = json_ws(p);
+                if (*p++ != ':')
+                    return NULL;
+            }
+            if (!(p = json_skip_value(p, depth + 1)))
+                return NULL;
+            p = json_ws(p);
+            if (*p == close)
+                return p + 1;
+            if (*p++ != ',')
+                return NULL;
+        }
+    }
+
+    // Numbers and the literals true, false and null.
+    if (!*p || !strchr("-0123456789tfn", *p))
+        return NULL;
+
+    return p + strspn(p, "+-.0123456789Eeaflnrstu");
+}
+
+// Returns the value of member key of the object at p, or NULL.
+static const char* json_member(const char* p, const char* key) {
+    size_t key_len = strlen(key);
+
+    p = json_ws(p);
+    if (*p != '{')
+        return NULL;
+
+    p = json_ws(p + 1);
+    if (*p == '}')
+        return NULL;
+
+    for (;;) {
+        const char* k = json_ws(p);
+        const char* end = json_skip_string(k);
+
+        if (!end)
+            return NULL;
+
+        p = json_ws(end);
+        if (*p++ != ':')
+            return NULL;
+        p = json_ws(p);
+
+        if ((size_t)(end - k - 2) == key_len &&
+            strncmp(k + 1, key, key_len) == 0)
+            return p;
+
+        if (!(p = json_skip_value(p, 1)))
+            return NULL;
+
+        p = json_ws(p);
+        if (*p++ != ',')
+            return NULL;
+    }
+}
+
+static int json_get_int(const char* p, long* value) {
+    char* end;
+
+    if (!p)
+        return -1;
+
+    p = json_ws(p);
+    errno = 0;
+    *value = strtol(p, &end, 10);
+
+    if (end == p || errno || (*end && strchr(".eE", *end)))
+        return -1;
+
+    return 0;
+}
+
+// Copies out a string value. Only ASCII \u escapes are supported, which is
+// all host names need.
+static int json_get_string(const char* p, char* out, size_t len) {
+    size_t o = 0;
+
+    if (!p || *(p = json_ws(p)) != '"')
+        return -1;
+
+    for (p++; *p != '"'; p++) {
+        char c = *p;
+
+        if (!c || o + 1 >= len)
+            return -1;
+
+        if (c == '\\') {
+            switch (*++p) {
+            case '"':
+            case '\\':
+            case '/':
+                c = *p;
+                break;
+            case 'n':
+                c = '\n';
+                break;
+            case 't':
+                c = '\t';
+                break;
+            case 'u': {
+                unsigned u;
+                if (sscanf(p + 1, "%4x", &u) != 1 || u == 0 || u >= 0x80)
+                    return -1;
+                c = (char)u;
+                p += 4;
+                break;
+            }
+            default:
+                return -1;
+            }
+        }
+
+        out[o++] = c;
+    }
+
+    out[o] = 0;
+    return 0;
+}
+
+// Returns the first element of the array at p, or NULL if it is empty.
+static const char* json_array_first(const char* p) {
+    if (!p || *(p = json_ws(p)) != '[')
+        return NULL;
+
+    p = json_ws(p + 1);
+    return *p == ']' ? NULL : p;
+}
+
+// Returns the element following the one at p, or NULL.
+static const char* json_array_next(const char* p) {
+    if (!(p = json_skip_value(p, 1)))
+        return NULL;
+
+    p = json_ws(p);
+    return *p == ',' ? json_ws(p + 1) : NULL;
+}
+
+// Writes str as a JSON string literal.
+static int json_put_string(char* out, size_t len, const char* str) {
+    size_t o = 0;
+
+    if (len < 3)
+        return -1;
+
+    out[o++] = '"';
+    for (; *str; str++) {
+        if (o + 8 >= len)
+            return -1;
+
+        if (*str == '"' || *str == '\\') {
+            out[o++] = '\\';
+            out[o++] = *str;
+        } else if ((unsigned char)*str < 0x20) {
+            o += snprintf(out + o, len - o, "\\u%04x", (unsigned char)*str);
+        } else {
+            out[o++] = *str;
+        }
+    }
+    out[o++] = '"';
+    out[o] = 0;
+
+    return 0;
+}
+
+// Checks the reply for a varlink error. Errors that mean the name does not
+// exist are reported as not found, everything else as unavailable.
+static int reply_error(const char* reply, avahi_resolve_result_t* ret) {
+    static const char* const not_found[] = {
+        "io.systemd.Resolve.NoSuchResourceRecord",
+        "io.systemd.Resolve.DNSError",
+        "io.systemd.Resolve.QueryTimedOut",
+    };
+    const char* e = json_member(reply, "error");
+    char error[128];
+
+    if (!e)
+        return 0;
+
+    *ret = AVAHI_RESOLVE_RESULT_UNAVAIL;
+
+    if (json_get_string(e, error, sizeof(error)) == 0)
+        for (size_t i = 0; i < sizeof(not_found) / sizeof(not_found[0]); i++)
+            if (strcmp(error, not_found[i]) == 0)
+                *ret = AVAHI_RESOLVE_RESULT_HOST_NOT_FOUND;
+
+    return 1;
+}
+
+avahi_resolve_result_t
+resolved_parse_hostname_reply(const char* reply, int af,
+                              query_address_result_t* result) {
+    avahi_resolve_result_t ret;
+    const char* a;
+
+    assert(reply);
+    assert(result);
+
+    if (reply_error(reply, &ret))
+        return ret;
+
+    if (!json_member(reply, "parameters"))
+        return AVAHI_RESOLVE_RESULT_UNAVAIL;
+
+    a = json_array_first(
+        json_member(json_member(reply, "parameters"), "addresses"));
+
+    for (; a; a = json_array_next(a)) {
+        long family, ifindex = 0, byte;
+        size_t n = 0, len = af == AF_INET ? 4 : 16;
+        uint8_t address[16];
+        const char* b;
+
+        if (json_get_int(json_member(a, "family"), &family) < 0 ||
+            family != af)
+            continue;
+
+        if (json_member(a, "ifindex"))
+            json_get_int(json_member(a, "ifindex"), &ifindex);
+
+        for (b = json_array_first(json_member(a, "address")); b;
+             b = json_array_next(b)) {
+            if (n >= len || json_get_int(b, &byte) < 0 || byte < 0 ||
+                byte > 255)
+                break;
+            address[n++] = (uint8_t)byte;
+        }
+
+        if (n != len || b)
+            continue;
+
+        result->af = af;
+        result->scopeid = ifindex > 0 ? (uint32_t)ifindex : 0;
+        memcpy(&result->address, address, len);
+        return AVAHI_RESOLVE_RESULT_SUCCESS;
+    }
+
+    return AVAHI_RESOLVE_RESULT_HOST_NOT_FOUND;
+}
+
+avahi_resolve_result_t resolved_parse_address_reply(const char* reply,
+                                                    char* name,
+                                                    size_t name_len) {
+    avahi_resolve_result_t ret;
+    const char* n;
+
+    assert(reply);
+    assert(name);
+
+    if (reply_error(reply, &ret))
+        return ret;
+
+    if (!json_member(reply, "parameters"))
+        return AVAHI_RESOLVE_RESULT_UNAVAIL;
+
+    n = json_array_first(
+        json_member(json_member(reply, "parameters"), "names"));
+
+    for (; n; n = json_array_next(n))
+        if (json_get_string(json_member(n, "name"), name, name_len) == 0)
+            return AVAHI_RESOLVE_RESULT_SUCCESS;
+
+    return AVAHI_RESOLVE_RESULT_HOST_NOT_FOUND;
+}
+
+// Sends a request and reads the NUL terminated reply into a newly
+// allocated buffer. Returns NULL on error.
+static char* varlink_call(const backend_endpoint_t* endpoint,
+                          const char* request, int timeout) {
+    size_t len = strlen(request) + 1, o = 0;
+    char* reply = NULL;
+    int fd;
+
+    if ((fd = unix_socket_connect(endpoint->path[0] ? endpoint->path
+                                                    : RESOLVED_SOCKET)) < 0)
+        return NULL;
+
+    if (timeout >= 0)
+        set_socket_timeout(fd, timeout);
+
+    while (o < len) {
+        ssize_t r = send(fd, request + o, len - o, MSG_NOSIGNAL);
+        if (r < 0) {
+            if (errno == EINTR)
+                continue;
+            goto fail;
+        }
+        o += r;
+    }
+
+    if (!(reply = malloc(RESOLVED_REPLY_MAX)))
+        goto fail;
+
+    for (o = 0;;) {
+        ssize_t r = recv(fd, reply + o, RESOLVED_REPLY_MAX - o, 0);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            goto fail;
+
+        if (memchr(reply + o, 0, r))
+            break;
+
+        o += r;
+        if (o >= RESOLVED_REPLY_MAX)
+            goto fail;
+    }
+
+    close(fd);
+    return reply;
+
+fail:
+    free(reply);
+    close(fd);
+    return NULL;
+}
+
+static avahi_resolve_result_t
+resolved_resolve_name(const backend_endpoint_t* endpoint, int af,
+                      const char* name, query_address_result_t* result,
+                      int timeout) {
+    char request[1400], quoted[1100];
+    avahi_resolve_result_t ret;
+    char* reply;
+
+    if (json_put_string(quoted, sizeof(quoted), name) < 0)
+        return AVAHI_RESOLVE_RESULT_UNAVAIL;
+
+    snprintf(request, sizeof(request),
+             "{\"method\":\"io.systemd.Resolve.ResolveHostname\","
+             "\"parameters\":{\"name\":%s,\"family\":%d,\"flags\":%d}}",
+             quoted, af, RESOLVED_FLAGS_MDNS);
+
+    if (!(reply = varlink_call(endpoint, request, timeout)))
+        return AVAHI_RESOLVE_RESULT_UNAVAIL;
+
+    ret = resolved_parse_hostname_reply(reply, af, result);
+    free(reply);
+    return ret;
+}
+
+static avahi_resolve_result_t
+resolved_resolve_address(const backend_endpoint_t* endpoint, int af,
+                         const void* data, char* name, size_t name_len,
+                         int timeout) {
+    char request[512];
+    const uint8_t* a = data;
+    size_t len = af == AF_INET ? 4 : 16, o;
+    avahi_resolve_result_t ret;
+    char* reply;
+
+    o = snprintf(request, sizeof(request),
+                 "{\"method\":\"io.systemd.Resolve.ResolveAddress\","
+                 "\"parameters\":{\"family\":%d,\"flags\":%d,\"address\":[",
+                 af, RESOLVED_FLAGS_MDNS);
+    for (size_t i = 0; i < len; i++)
+        o += snprintf(request + o, sizeof(request) - o, "%s%u", i ? "," : "",
+                      a[i]);
+    snprintf(request + o, sizeof(request) - o, "]}}");
+
+    if (!(reply = varlink_call(endpoint, request, timeout)))
+        return AVAHI_RESOLVE_RESULT_UNAVAIL;
+
+    ret = resolved_parse_address_reply(reply, name, name_len);
+    free(reply);
+    return ret;
+}
+
+const backend_ops_t backend_resolved = {
+    .name = "resolved",
+    .resolve_name = resolved_resolve_name,
+    .resolve_address = resolved_resolve_address,
+};
@@ -0,0 +1,46 @@
+#ifndef fooresolvedhfoo
+#define fooresolvedhfoo
+
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#include <sys/types.h>
+
+#include "avahi.h"
+
+// Lookup flags restricting systemd-resolved to multicast DNS
+// (SD_RESOLVED_MDNS_IPV4 | SD_RESOLVED_MDNS_IPV6).
+#define RESOLVED_FLAGS_MDNS ((1 << 3) | (1 << 4))
+
+// Largest varlink reply we accept.
+#define RESOLVED_REPLY_MAX 65536
+
+// Extracts the first address of family af from the reply to a
+// io.systemd.Resolve.ResolveHostname call.
+avahi_resolve_result_t
+resolved_parse_hostname_reply(const char* reply, int af,
+                              query_address_result_t* result);
+
+// Extracts the first name from the reply to a
+// io.systemd.Resolve.ResolveAddress call.
+avahi_resolve_result_t resolved_parse_address_reply(const char* reply,
+                                                    char* name,
+                                                    size_t name_len);
+
+#endif
@@ -0,0 +1,72 @@
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include "rtt.h"
+
+void rtt_init(rtt_estimator_t* rtt) {
+    memset(rtt, 0, sizeof(*rtt));
+}
+
+void rtt_sample(rtt_estimator_t* rtt, int64_t msec) {
+    if (msec < 0)
+        msec = 0;
+
+    if (rtt->samples == 0) {
+        rtt->srtt8 = msec * 8;
+        rtt->rttvar4 = msec * 2;
+    } else {
+        int64_t delta = msec - rtt->srtt8 / 8;
+
+        if (delta < 0)
+            delta = -delta;
+
+        // RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R|, SRTT = 7/8 SRTT + 1/8 R
+        rtt->rttvar4 += delta - rtt->rttvar4 / 4;
+        rtt->srtt8 += msec - rtt->srtt8 / 8;
+    }
+
+    rtt->samples++;
+    rtt->backoff = 0;
+}
+
+void rtt_timed_out(rtt_estimator_t* rtt) {
+    if (rtt->backoff < RTT_MAX_BACKOFF)
+        rtt->backoff++;
+}
+
+int rtt_timeout(const rtt_estimator_t* rtt, int min, int max) {
+    int64_t t;
+
+    if (rtt->samples == 0)
+        return max;
+
+    // RTTVAR is at least a millisecond, the granularity of the clock.
+    t = rtt->srtt8 / 8 + (rtt->rttvar4 > 4 ? rtt->rttvar4 : 4);
+    if (t < min)
+        t = min;
+    t <<= rtt->backoff;
+
+    return t > max ? max : (int)t;
+}
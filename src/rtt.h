@@ -0,0 +1,52 @@
+#ifndef foortthfoo
+#define foortthfoo
+
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#include <inttypes.h>
+
+// Maximum number of times the timeout is doubled after timeouts in a row.
+#define RTT_MAX_BACKOFF 4
+
+// A running estimate of the response time of a resolver, after RFC 6298.
+typedef struct {
+    // Smoothed response time and its mean deviation, in milliseconds,
+    // scaled by 8 and 4 respectively. Zero samples until the first answer.
+    int64_t srtt8;
+    int64_t rttvar4;
+    unsigned samples;
+    // Number of timeouts since the last answer.
+    unsigned backoff;
+} rtt_estimator_t;
+
+void rtt_init(rtt_estimator_t* rtt);
+
+// Adds the response time of an answer, in milliseconds.
+void rtt_sample(rtt_estimator_t* rtt, int64_t msec);
+
+// Records that no answer came in time.
+void rtt_timed_out(rtt_estimator_t* rtt);
+
+// Returns how long to wait for the next answer: SRTT + 4 * RTTVAR, but at
+// least min, doubled for every timeout in a row, and at most max. max until
+// there is an estimate.
+int rtt_timeout(const rtt_estimator_t* rtt, int min, int max);
+
+#endif
@@ -0,0 +1,104 @@
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <netdb.h>
+#include <nss.h>
+#include <sys/socket.h>
+
+#include "nss.h"
+
+// The NSS entry points of one module variant, built once per variant. The
+// lookups themselves are in the core library, so that every variant loaded
+// in a process shares its cache, connections and counters.
+
+static const nss_variant_t variant = {
+#if defined(NSS_IPV4_ONLY)
+    .af = AF_INET,
+#elif defined(NSS_IPV6_ONLY)
+    .af = AF_INET6,
+#else
+    .af = AF_UNSPEC,
+#endif
+#ifdef MDNS_MINIMAL
+    .minimal = 1,
+#endif
+};
+
+#ifdef __FreeBSD__
+// Used by bsdnss.c, which is linked into each variant.
+enum nss_status _nss_mdns_gethostbyname_impl(const char* name, int af,
+                                             userdata_t* u, int* errnop,
+                                             int* h_errnop) {
+    return mdns_core_gethostbyname_impl(&variant, name, af, u, errnop,
+                                        h_errnop);
+}
+#else
+enum nss_status _nss_mdns_gethostbyname4_r(const char* name,
+                                           struct gaih_addrtuple** pat,
+                                           char* buffer, size_t buflen,
+                                           int* errnop, int* h_errnop,
+                                           int32_t* ttlp) {
+    return mdns_core_gethostbyname4_r(&variant, name, pat, buffer, buflen,
+                                      errnop, h_errnop, ttlp);
+}
+
+enum nss_status _nss_mdns_getcanonname_r(const char* name, char* buffer,
+                                         size_t buflen, char** result,
+                                         int* errnop, int* h_errnop) {
+    return mdns_core_getcanonname_r(&variant, name, buffer, buflen, result,
+                                    errnop, h_errnop);
+}
+#endif
+
+enum nss_status _nss_mdns_gethostbyname3_r(const char* name, int af,
+                                           struct hostent* result, char* buffer,
+                                           size_t buflen, int* errnop,
+                                           int* h_errnop, int32_t* ttlp,
+                                           char** canonp) {
+    return mdns_core_gethostbyname3_r(&variant, name, af, result, buffer,
+                                      buflen, errnop, h_errnop, ttlp, canonp);
+}
+
+enum nss_status _nss_mdns_gethostbyname2_r(const char* name, int af,
+                                           struct hostent* result, char* buffer,
+                                           size_t buflen, int* errnop,
+                                           int* h_errnop) {
+    return mdns_core_gethostbyname2_r(&variant, name, af, result, buffer,
+                                      buflen, errnop, h_errnop);
+}
+
+enum nss_status _nss_mdns_gethostbyname_r(const char* name,
+                                          struct hostent* result, char* buffer,
+                                          size_t buflen, int* errnop,
+                                          int* h_errnop) {
+    return mdns_core_gethostbyname_r(&variant, name, result, buffer, buflen,
+                                     errnop, h_errnop);
+}
+
+enum nss_status _nss_mdns_gethostbyaddr_r(const void* addr, int len, int af,
+                                          struct hostent* result, char* buffer,
+                                          size_t buflen, int* errnop,
+                                          int* h_errnop) {
+    return mdns_core_gethostbyaddr_r(&variant, addr, len, af, result, buffer,
+                                     buflen, errnop, h_errnop);
+}
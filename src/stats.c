@@ -0,0 +1,461 @@
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <assert.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "stats.h"
+
+static const char* const counter_names[STATS_COUNTER_MAX] = {
+    [STATS_LOOKUP_NAME4] = "lookup_gethostbyname4",
+    [STATS_LOOKUP_NAME3] = "lookup_gethostbyname3",
+    [STATS_LOOKUP_ADDRESS] = "lookup_gethostbyaddr",
+    [STATS_LOOKUP_CANONNAME] = "lookup_getcanonname",
+    [STATS_ALLOW_SKIP] = "allow_skip",
+    [STATS_ALLOW_AUTHORITATIVE] = "allow_authoritative",
+    [STATS_ALLOW_OPTIONAL] = "allow_optional",
+    [STATS_SOA_PRESENT] = "soa_present",
+    [STATS_SOA_ABSENT] = "soa_absent",
+    [STATS_SOA_FAILED] = "soa_failed",
+    [STATS_RESULT_SUCCESS] = "result_success",
+    [STATS_RESULT_HOST_NOT_FOUND] = "result_host_not_found",
+    [STATS_RESULT_UNAVAIL] = "result_unavail",
+    [STATS_CACHE_HIT] = "cache_hit",
+    [STATS_CACHE_MISS] = "cache_miss",
+    [STATS_ERANGE] = "erange",
+    [STATS_TIMEOUT] = "timeout",
+    [STATS_ADMISSION_QUEUED] = "admission_queued",
+    [STATS_ADMISSION_EXPIRED] = "admission_expired",
+    [STATS_ADMISSION_REJECTED] = "admission_rejected",
+    [STATS_FAMILY_SKIPPED] = "family_skipped",
+    [STATS_FAMILY_PROBED] = "family_probed",
+};
+
+static const char* const gauge_names[STATS_GAUGE_MAX] = {
+    [STATS_GAUGE_ACTIVE] = "backend_active",
+    [STATS_GAUGE_QUEUED] = "backend_queued",
+    [STATS_GAUGE_MISSING_IPV4] = "family_missing_ipv4",
+    [STATS_GAUGE_MISSING_IPV6] = "family_missing_ipv6",
+};
+
+static const char* const phase_names[STATS_PHASE_MAX] = {
+    [STATS_PHASE_LOOKUP] = "lookup",
+    [STATS_PHASE_ALLOW] = "allow",
+    [STATS_PHASE_BACKEND] = "backend",
+    [STATS_PHASE_QUEUE] = "queue",
+};
+
+// Where the counters go until they are exported, and again in children
+// after a fork.
+static stats_segment_t local_segment;
+
+static pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+static stats_segment_t* segment = &local_segment;
+static int exported = 0;
+static pthread_once_t atfork_once = PTHREAD_ONCE_INIT;
+
+static unsigned next_shard = 0;
+static __thread int thread_shard = -1;
+
+// A shard only holds 64-bit values, so stats_export() can move them as
+// words without knowing which is which.
+#define SHARD_WORDS (sizeof(stats_shard_t) / sizeof(uint64_t))
+
+static int shard_index(void) {
+    if (thread_shard < 0)
+        thread_shard =
+            (int)(__atomic_fetch_add(&next_shard, 1, __ATOMIC_RELAXED) %
+                  STATS_SHARDS);
+
+    return thread_shard;
+}
+
+static uint64_t* word(stats_segment_t* s, int i, size_t offset) {
+    return (uint64_t*)((char*)&s->shards[i] + offset);
+}
+
+// Moves what was added to a word of local_segment over to the exported
+// segment. Each update is taken by exactly one exchange.
+static void move_word(stats_segment_t* to, int i, size_t offset) {
+    uint64_t v = __atomic_exchange_n(word(&local_segment, i, offset), 0,
+                                     __ATOMIC_SEQ_CST);
+
+    if (v)
+        __atomic_fetch_add(word(to, i, offset), v, __ATOMIC_RELAXED);
+}
+
+// Adds delta to the value at offset in the shard of this thread. An update
+// may land in local_segment after stats_export() moved its contents; the
+// thread notices the export then and moves the update itself. Either it
+// sees the new segment after its add, or the export had not switched yet
+// and its moves come after the add.
+static void add(size_t offset, uint64_t delta) {
+    stats_segment_t* s = __atomic_load_n(&segment, __ATOMIC_SEQ_CST);
+    stats_segment_t* now;
+    int i = shard_index();
+
+    if (s != &local_segment) {
+        __atomic_fetch_add(word(s, i, offset), delta, __ATOMIC_RELAXED);
+        return;
+    }
+
+    __atomic_fetch_add(word(s, i, offset), delta, __ATOMIC_SEQ_CST);
+    if ((now = __atomic_load_n(&segment, __ATOMIC_SEQ_CST)) != &local_segment)
+        move_word(now, i, offset);
+}
+
+static uint64_t now_usec(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+void stats_count(stats_counter_t counter) {
+    assert(counter < STATS_COUNTER_MAX);
+
+    add(offsetof(stats_shard_t, counters[counter]), 1);
+}
+
+void stats_gauge_add(stats_gauge_t gauge, int64_t delta) {
+    assert(gauge < STATS_GAUGE_MAX);
+
+    add(offsetof(stats_shard_t, gauges[gauge]), (uint64_t)delta);
+}
+
+uint64_t stats_start(void) {
+    if (__atomic_load_n(&segment, __ATOMIC_RELAXED) == &local_segment)
+        return 0;
+
+    return now_usec();
+}
+
+void stats_observe(stats_phase_t phase, uint64_t start) {
+    uint64_t usec;
+    int bucket;
+
+    assert(phase < STATS_PHASE_MAX);
+
+    if (!start)
+        return;
+
+    usec = now_usec() - start;
+    bucket = usec ? 64 - __builtin_clzll(usec) : 0;
+    if (bucket >= STATS_BUCKETS)
+        bucket = STATS_BUCKETS - 1;
+
+    add(offsetof(stats_shard_t, latency[phase][bucket]), 1);
+    add(offsetof(stats_shard_t, latency_sum[phase]), usec);
+}
+
+static void segment_name(pid_t pid, char* name, size_t len) {
+    snprintf(name, len, STATS_SEGMENT_PREFIX "%d", (int)pid);
+}
+
+// Returns when a process started, in clock ticks since boot, or 0 if that
+// can't be told.
+static uint64_t start_time(pid_t pid) {
+    char path[64], buf[1024], *p;
+    unsigned long long ticks;
+    size_t n;
+    FILE* f;
+
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    if (!(f = fopen(path, "re")))
+        return 0;
+    n = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[n] = 0;
+
+    // The name in parentheses may hold anything; field 22 is the start
+    // time, counting the name as field 2.
+    if (!(p = strrchr(buf, ')')))
+        return 0;
+    for (int field = 2; field < 21; field++)
+        if (!(p = strchr(p + 1, ' ')))
+            return 0;
+
+    return sscanf(p, " %llu", &ticks) == 1 ? (uint64_t)ticks : 0;
+}
+
+// Maps the segment of pid read-only, if it is of this version.
+static const stats_segment_t* map_segment(pid_t pid) {
+    stats_segment_t* s;
+    struct stat st;
+    char name[32];
+    int fd;
+
+    segment_name(pid, name, sizeof(name));
+
+    if ((fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0)) < 0)
+        return NULL;
+
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(*s) ||
+        (s = mmap(NULL, sizeof(*s), PROT_READ, MAP_SHARED, fd, 0)) ==
+            MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+    close(fd);
+
+    if (__atomic_load_n(&s->magic, __ATOMIC_ACQUIRE) != STATS_MAGIC ||
+        s->version != STATS_VERSION || s->size != sizeof(*s)) {
+        munmap(s, sizeof(*s));
+        return NULL;
+    }
+
+    return s;
+}
+
+static int reused(pid_t pid, const stats_segment_t* s) {
+    return s->start_time && s->start_time != start_time(pid);
+}
+
+int stats_stale(pid_t pid) {
+    const stats_segment_t* s;
+    int stale;
+
+    if (kill(pid, 0) < 0 && errno == ESRCH)
+        return 1;
+
+    // Segments of other versions are left alone.
+    if (!(s = map_segment(pid)))
+        return 0;
+    stale = reused(pid, s);
+    stats_detach(s);
+
+    return stale;
+}
+
+void stats_remove(pid_t pid) {
+    char name[32];
+
+    segment_name(pid, name, sizeof(name));
+    shm_unlink(name);
+}
+
+void stats_reap(void) {
+    size_t prefix_len = strlen(STATS_SEGMENT_PREFIX) - 1;
+    struct dirent* de;
+    DIR* d;
+
+    if (!(d = opendir(STATS_SEGMENT_DIR)))
+        return;
+
+    while ((de = readdir(d))) {
+        char* end;
+        long pid;
+
+        // The segment name without its leading slash.
+        if (strncmp(de->d_name, STATS_SEGMENT_PREFIX + 1, prefix_len) != 0)
+            continue;
+
+        pid = strtol(de->d_name + prefix_len, &end, 10);
+        if (pid > 0 && !*end && stats_stale((pid_t)pid))
+            stats_remove((pid_t)pid);
+    }
+
+    closedir(d);
+}
+
+static stats_segment_t* create_segment(void) {
+    stats_segment_t* s;
+    char name[32];
+    int fd;
+
+    segment_name(getpid(), name, sizeof(name));
+
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0 && errno == EEXIST) {
+        // Left behind by an earlier process with the same ID.
+        shm_unlink(name);
+        fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    }
+    if (fd < 0)
+        return NULL;
+
+    if (ftruncate(fd, sizeof(*s)) < 0 ||
+        (s = mmap(NULL, sizeof(*s), PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                  0)) == MAP_FAILED) {
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+    close(fd);
+
+    s->version = STATS_VERSION;
+    s->size = sizeof(*s);
+    s->pid = (int32_t)getpid();
+    s->start_time = start_time(getpid());
+    __atomic_store_n(&s->magic, STATS_MAGIC, __ATOMIC_RELEASE);
+
+    return s;
+}
+
+// A child starts counting afresh, and exports its counters in a segment of
+// its own.
+static void atfork_child(void) {
+    if (segment != &local_segment)
+        munmap(segment, sizeof(*segment));
+
+    memset(&local_segment, 0, sizeof(local_segment));
+    segment = &local_segment;
+    exported = 0;
+    pthread_mutex_init(&stats_mutex, NULL);
+}
+
+static void register_atfork(void) {
+    pthread_atfork(NULL, NULL, atfork_child);
+}
+
+void stats_export(void) {
+    stats_segment_t* s = NULL;
+
+    if (__atomic_load_n(&exported, __ATOMIC_ACQUIRE))
+        return;
+
+    pthread_once(&atfork_once, register_atfork);
+
+    pthread_mutex_lock(&stats_mutex);
+
+    // Tried once per process, not on every lookup.
+    if (!exported && (s = create_segment())) {
+        // What was counted so far carries over. Threads still adding to
+        // local_segment move their updates themselves, see add().
+        __atomic_store_n(&segment, s, __ATOMIC_SEQ_CST);
+        for (int i = 0; i < STATS_SHARDS; i++)
+            for (size_t w = 0; w < SHARD_WORDS; w++)
+                move_word(s, i, w * sizeof(uint64_t));
+    }
+    __atomic_store_n(&exported, 1, __ATOMIC_RELEASE);
+
+    pthread_mutex_unlock(&stats_mutex);
+
+    // Segments are removed on a normal exit only: also clean up after
+    // processes that crashed, were killed or called exec or _exit.
+    if (s)
+        stats_reap();
+}
+
+__attribute__((destructor)) static void stats_unexport(void) {
+    char name[32];
+
+    if (segment == &local_segment || segment->pid != (int32_t)getpid())
+        return;
+
+    segment_name(getpid(), name, sizeof(name));
+    shm_unlink(name);
+}
+
+void stats_sum(const stats_segment_t* s, stats_shard_t* total) {
+    assert(s);
+    assert(total);
+
+    memset(total, 0, sizeof(*total));
+
+    for (int i = 0; i < STATS_SHARDS; i++) {
+        const stats_shard_t* sh = &s->shards[i];
+
+        for (int c = 0; c < STATS_COUNTER_MAX; c++)
+            total->counters[c] +=
+                __atomic_load_n(&sh->counters[c], __ATOMIC_RELAXED);
+
+        for (int g = 0; g < STATS_GAUGE_MAX; g++)
+            total->gauges[g] +=
+                __atomic_load_n(&sh->gauges[g], __ATOMIC_RELAXED);
+
+        for (int p = 0; p < STATS_PHASE_MAX; p++) {
+            for (int b = 0; b < STATS_BUCKETS; b++)
+                total->latency[p][b] +=
+                    __atomic_load_n(&sh->latency[p][b], __ATOMIC_RELAXED);
+            total->latency_sum[p] +=
+                __atomic_load_n(&sh->latency_sum[p], __ATOMIC_RELAXED);
+        }
+    }
+}
+
+const stats_segment_t* stats_attach(pid_t pid) {
+    const stats_segment_t* s;
+
+    if (!(s = map_segment(pid)))
+        return NULL;
+
+    if (reused(pid, s)) {
+        stats_detach(s);
+        return NULL;
+    }
+
+    return s;
+}
+
+void stats_detach(const stats_segment_t* s) {
+    if (s)
+        munmap((void*)s, sizeof(*s));
+}
+
+double stats_quantile(const uint64_t* buckets, double q) {
+    uint64_t count = 0;
+    double rank, seen = 0;
+
+    for (int b = 0; b < STATS_BUCKETS; b++)
+        count += buckets[b];
+    if (!count)
+        return 0;
+
+    rank = q * (double)count;
+
+    for (int b = 0; b < STATS_BUCKETS; b++) {
+        double lower = b ? (double)(1ULL << (b - 1)) : 0;
+        double upper = (double)(1ULL << b);
+
+        if (buckets[b] && seen + (double)buckets[b] >= rank)
+            return lower + (upper - lower) * (rank - seen) / (double)buckets[b];
+        seen += (double)buckets[b];
+    }
+
+    return (double)(1ULL << (STATS_BUCKETS - 1));
+}
+
+const char* stats_counter_name(stats_counter_t counter) {
+    return counter < STATS_COUNTER_MAX ? counter_names[counter] : NULL;
+}
+
+const char* stats_gauge_name(stats_gauge_t gauge) {
+    return gauge < STATS_GAUGE_MAX ? gauge_names[gauge] : NULL;
+}
+
+const char* stats_phase_name(stats_phase_t phase) {
+    return phase < STATS_PHASE_MAX ? phase_names[phase] : NULL;
+}
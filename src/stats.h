@@ -0,0 +1,179 @@
+#ifndef foostatshfoo
+#define foostatshfoo
+
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#include <inttypes.h>
+#include <sys/types.h>
+
+// The events counted.
+typedef enum {
+    // Lookups, by NSS entry point. gethostbyname_r and gethostbyname2_r
+    // count as gethostbyname3_r.
+    STATS_LOOKUP_NAME4,
+    STATS_LOOKUP_NAME3,
+    STATS_LOOKUP_ADDRESS,
+    STATS_LOOKUP_CANONNAME,
+    // Verdicts of the allow rules.
+    STATS_ALLOW_SKIP,
+    STATS_ALLOW_AUTHORITATIVE,
+    STATS_ALLOW_OPTIONAL,
+    // Outcomes of probing unicast DNS for a .local SOA.
+    STATS_SOA_PRESENT,
+    STATS_SOA_ABSENT,
+    STATS_SOA_FAILED,
+    // Answers of the backends.
+    STATS_RESULT_SUCCESS,
+    STATS_RESULT_HOST_NOT_FOUND,
+    STATS_RESULT_UNAVAIL,
+    STATS_CACHE_HIT,
+    STATS_CACHE_MISS,
+    // Lookups the caller has to retry with a larger buffer.
+    STATS_ERANGE,
+    // Backend attempts that got no answer in time.
+    STATS_TIMEOUT,
+    // Lookups that had to wait for their turn to ask a backend, those
+    // that ran out of time while waiting, and those turned away because
+    // too many were waiting already.
+    STATS_ADMISSION_QUEUED,
+    STATS_ADMISSION_EXPIRED,
+    STATS_ADMISSION_REJECTED,
+    // Queries for a family learned to be missing in a domain that were
+    // skipped, and those sent anyway to check that nothing changed.
+    STATS_FAMILY_SKIPPED,
+    STATS_FAMILY_PROBED,
+    STATS_COUNTER_MAX,
+} stats_counter_t;
+
+// Levels that go up and down.
+typedef enum {
+    // Backend attempts running.
+    STATS_GAUGE_ACTIVE,
+    // Lookups waiting for their turn to ask a backend.
+    STATS_GAUGE_QUEUED,
+    // Domains hosts were learned to have no IPv4, or no IPv6, addresses in.
+    STATS_GAUGE_MISSING_IPV4,
+    STATS_GAUGE_MISSING_IPV6,
+    STATS_GAUGE_MAX,
+} stats_gauge_t;
+
+// The phases of a lookup whose latencies are recorded.
+typedef enum {
+    // A whole NSS call.
+    STATS_PHASE_LOOKUP,
+    // Checking the allow rules, including the SOA probe.
+    STATS_PHASE_ALLOW,
+    // Asking the backends, on cache misses.
+    STATS_PHASE_BACKEND,
+    // Waiting for a turn to ask a backend, of lookups that had to.
+    STATS_PHASE_QUEUE,
+    STATS_PHASE_MAX,
+} stats_phase_t;
+
+// Latencies are counted in buckets of powers of two: bucket 0 holds those
+// below a microsecond, bucket i those from 2^(i-1) up to 2^i microseconds.
+// The last bucket holds everything longer.
+#define STATS_BUCKETS 32
+
+// Threads are spread over this many shards, so they rarely write the same
+// cache lines.
+#define STATS_SHARDS 16
+
+typedef struct {
+    uint64_t counters[STATS_COUNTER_MAX];
+    // A level may go up in one shard and down in another; only their sum
+    // means anything.
+    int64_t gauges[STATS_GAUGE_MAX];
+    uint64_t latency[STATS_PHASE_MAX][STATS_BUCKETS];
+    // Sums of the latencies, in microseconds.
+    uint64_t latency_sum[STATS_PHASE_MAX];
+} __attribute__((aligned(64))) stats_shard_t;
+
+#define STATS_MAGIC 0x6e6d6473
+#define STATS_VERSION 5
+
+// The shared memory segment the statistics of a process are exported in,
+// named STATS_SEGMENT_PREFIX followed by its process ID. Readers add up
+// the shards.
+#define STATS_SEGMENT_PREFIX "/nss-mdns-"
+
+// Where shared memory segments show up on Linux.
+#define STATS_SEGMENT_DIR "/dev/shm/"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;
+    int32_t pid;
+    // When the process started, in clock ticks since boot, or 0 if unknown.
+    // Tells it from a later one that got the same ID.
+    uint64_t start_time;
+    stats_shard_t shards[STATS_SHARDS];
+} stats_segment_t;
+
+// Counts an event. Lock-free.
+void stats_count(stats_counter_t counter);
+
+// Moves a level by delta. Lock-free.
+void stats_gauge_add(stats_gauge_t gauge, int64_t delta);
+
+// Returns the start time of a phase for stats_observe, or 0 while the
+// statistics are not exported and latencies aren't recorded.
+uint64_t stats_start(void);
+
+// Records the latency of a phase that began at start.
+void stats_observe(stats_phase_t phase, uint64_t start);
+
+// Starts exporting the statistics of this process in a shared memory
+// segment, unless it already does or failed to. Nothing counted before or
+// meanwhile is lost. The segment is removed when the process exits
+// normally; segments of processes that didn't are reaped when a new one
+// is created.
+void stats_export(void);
+
+// Returns whether the segment of pid was left behind: its process no
+// longer exists, or the ID now belongs to another one.
+int stats_stale(pid_t pid);
+
+// Removes the segment of pid.
+void stats_remove(pid_t pid);
+
+// Removes all stale segments.
+void stats_reap(void);
+
+// Adds up the shards of a segment.
+void stats_sum(const stats_segment_t* segment, stats_shard_t* total);
+
+// Maps the segment of another process read-only. Returns NULL if it has
+// none, it is of another version or it is stale.
+const stats_segment_t* stats_attach(pid_t pid);
+
+void stats_detach(const stats_segment_t* segment);
+
+// Estimates the q-quantile of the latencies in the buckets of a
+// histogram, in microseconds, interpolating within the bucket it falls in.
+// Returns 0 for an empty histogram.
+double stats_quantile(const uint64_t* buckets, double q);
+
+const char* stats_counter_name(stats_counter_t counter);
+const char* stats_gauge_name(stats_gauge_t gauge);
+const char* stats_phase_name(stats_phase_t phase);
+
+#endif
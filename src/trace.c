@@ -0,0 +1,307 @@
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "trace.h"
+#include "util.h"
+
+// A record is written with a single write(), so that records of concurrent
+// lookups and processes don't interleave.
+#define TRACE_RECORD_SIZE 4096
+
+static const char* const phase_names[TRACE_PHASE_MAX] = {
+    [TRACE_PHASE_ALLOW] = "allow",     [TRACE_PHASE_SOA] = "soa",
+    [TRACE_PHASE_CONNECT] = "connect", [TRACE_PHASE_QUERY] = "query",
+    [TRACE_PHASE_BACKEND] = "backend", [TRACE_PHASE_CONVERT] = "convert",
+};
+
+typedef struct {
+    trace_phase_t phase;
+    int af;
+    int result;
+    uint64_t begin;
+    uint64_t end;
+} trace_span_t;
+
+typedef struct {
+    int active;
+    const char* entry;
+    char name[256];
+    int af;
+    uint64_t begin;
+    char decisions[128];
+    int n_spans;
+    trace_span_t spans[TRACE_MAX_SPANS];
+} trace_record_t;
+
+int trace_enabled = 0;
+
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+static char trace_path[4096];
+static unsigned trace_sample = 1;
+static int trace_fd = -1;
+static unsigned lookups = 0;
+static __thread trace_record_t record;
+
+static uint64_t monotonic_nsec(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+void trace_setup(const char* spec) {
+    const char* comma;
+    size_t len;
+    unsigned long sample = 1;
+
+    pthread_mutex_lock(&trace_mutex);
+    trace_enabled = 0;
+    if (trace_fd >= 0) {
+        close(trace_fd);
+        trace_fd = -1;
+    }
+    lookups = 0;
+
+    if (!spec)
+        goto finish;
+
+    comma = strchr(spec, ',');
+    len = comma ? (size_t)(comma - spec) : strlen(spec);
+    if (len == 0 || len >= sizeof(trace_path))
+        goto finish;
+
+    if (comma) {
+        char* end;
+
+        if (strncmp(comma + 1, "sample=", 7) != 0)
+            goto finish;
+        sample = strtoul(comma + 8, &end, 10);
+        if (end == comma + 8 || *end || sample == 0 || sample > UINT32_MAX)
+            goto finish;
+    }
+
+    memcpy(trace_path, spec, len);
+    trace_path[len] = 0;
+    trace_sample = (unsigned)sample;
+    trace_enabled = 1;
+
+finish:
+    pthread_mutex_unlock(&trace_mutex);
+}
+
+__attribute__((constructor)) static void trace_init(void) {
+    trace_setup(secure_env("NSS_MDNS_TRACE"));
+}
+
+void trace_begin(const char* entry, const char* name, int af,
+                 const void* address) {
+    trace_record_t* r = &record;
+
+    r->active =
+        __atomic_fetch_add(&lookups, 1, __ATOMIC_RELAXED) % trace_sample == 0;
+    if (!r->active)
+        return;
+
+    r->entry = entry;
+    r->af = af;
+    r->n_spans = 0;
+    r->decisions[0] = 0;
+
+    if (name)
+        snprintf(r->name, sizeof(r->name), "%s", name);
+    else if (!inet_ntop(af, address, r->name, sizeof(r->name)))
+        strcpy(r->name, "?");
+
+    r->begin = monotonic_nsec();
+}
+
+int trace_phase_begin(trace_phase_t phase, int af) {
+    trace_record_t* r = &record;
+    trace_span_t* s;
+
+    if (!r->active || r->n_spans >= TRACE_MAX_SPANS)
+        return -1;
+
+    s = &r->spans[r->n_spans];
+    s->phase = phase;
+    s->af = af;
+    s->result = 0;
+    s->begin = monotonic_nsec();
+    s->end = s->begin;
+    return r->n_spans++;
+}
+
+void trace_phase_end(int span, int result) {
+    trace_record_t* r = &record;
+
+    if (!r->active || span < 0 || span >= r->n_spans)
+        return;
+
+    r->spans[span].end = monotonic_nsec();
+    r->spans[span].result = result;
+}
+
+void trace_decision(const char* decision) {
+    trace_record_t* r = &record;
+    size_t len;
+
+    if (!r->active)
+        return;
+
+    len = strlen(r->decisions);
+
+    snprintf(r->decisions + len, sizeof(r->decisions) - len, "%s%s",
+             len ? "," : "", decision);
+}
+
+// Returns the descriptor of the trace file, opening it the first time.
+// Whoever creates the file starts the JSON array; the trace viewers accept
+// it without the closing bracket.
+static int trace_file(void) {
+    int fd;
+
+    pthread_mutex_lock(&trace_mutex);
+    if (trace_fd < 0 && trace_enabled) {
+        fd = open(trace_path,
+                  O_WRONLY | O_APPEND | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (fd >= 0) {
+            if (write(fd, "[\n", 2) != 2) {
+                close(fd);
+                fd = -1;
+            }
+        } else
+            fd = open(trace_path, O_WRONLY | O_APPEND | O_CLOEXEC);
+
+        // Don't retry on every lookup.
+        if (fd < 0)
+            trace_enabled = 0;
+        trace_fd = fd;
+    }
+    fd = trace_fd;
+    pthread_mutex_unlock(&trace_mutex);
+
+    return fd;
+}
+
+// Appends s to buf, escaped as the contents of a JSON string.
+static size_t json_escape(char* buf, size_t size, const char* s) {
+    size_t n = 0;
+
+    for (; *s && n + 7 < size; s++) {
+        unsigned char c = (unsigned char)*s;
+
+        if (c == '"' || c == '\\') {
+            buf[n++] = '\\';
+            buf[n++] = (char)c;
+        } else if (c < 0x20)
+            n += (size_t)snprintf(buf + n, size - n, "\\u%04x", c);
+        else
+            buf[n++] = (char)c;
+    }
+    buf[n] = 0;
+
+    return n;
+}
+
+// Appends to buf at *n, keeping track of truncation by leaving *n at size.
+static void append(char* buf, size_t size, size_t* n, const char* format,
+                   ...) __attribute__((format(printf, 4, 5)));
+
+static void append(char* buf, size_t size, size_t* n, const char* format,
+                   ...) {
+    va_list ap;
+    int ret;
+
+    if (*n >= size)
+        return;
+
+    va_start(ap, format);
+    ret = vsnprintf(buf + *n, size - *n, format, ap);
+    va_end(ap);
+
+    *n = ret < 0 || (size_t)ret >= size - *n ? size : *n + (size_t)ret;
+}
+
+// Chrome trace timestamps are in microseconds.
+#define USEC(ns) ((double)(ns) / 1000.0)
+
+void trace_end(int status) {
+    trace_record_t* r = &record;
+    char buf[TRACE_RECORD_SIZE], name[sizeof(r->name) * 6];
+    uint64_t end;
+    size_t n = 0;
+    long tid;
+    int pid, fd;
+
+    if (!r->active)
+        return;
+    r->active = 0;
+
+    end = monotonic_nsec();
+    pid = (int)getpid();
+#ifdef SYS_gettid
+    tid = syscall(SYS_gettid);
+#else
+    tid = pid;
+#endif
+
+    json_escape(name, sizeof(name), r->name);
+    append(buf, sizeof(buf), &n,
+           "{\"name\":\"%s\",\"cat\":\"nss-mdns\",\"ph\":\"X\",\"ts\":%.3f,"
+           "\"dur\":%.3f,\"pid\":%d,\"tid\":%ld,\"args\":{\"name\":\"%s\","
+           "\"af\":%d,\"decision\":\"%s\",\"status\":%d}},",
+           r->entry, USEC(r->begin), USEC(end - r->begin), pid, tid, name,
+           r->af, r->decisions, status);
+
+    for (int i = 0; i < r->n_spans; i++) {
+        const trace_span_t* s = &r->spans[i];
+
+        append(buf, sizeof(buf), &n,
+               "{\"name\":\"%s\",\"cat\":\"nss-mdns\",\"ph\":\"X\","
+               "\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%ld,"
+               "\"args\":{\"af\":%d,\"result\":%d}},",
+               phase_names[s->phase], USEC(s->begin), USEC(s->end - s->begin),
+               pid, tid, s->af, s->result);
+    }
+
+    // Names are short enough that this doesn't happen; drop the record
+    // rather than write broken JSON if it does.
+    if (n + 1 >= sizeof(buf))
+        return;
+    buf[n++] = '\n';
+
+    // A failed write loses the record; there is nobody to tell.
+    if ((fd = trace_file()) >= 0 && write(fd, buf, n) < 0)
+        return;
+}
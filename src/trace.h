@@ -0,0 +1,80 @@
+#ifndef footracehfoo
+#define footracehfoo
+
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#include <inttypes.h>
+
+// Lookup timelines, written when NSS_MDNS_TRACE is set to
+// "PATH[,sample=N]": one record for every Nth lookup, appended to PATH in
+// the JSON array format of Chrome's trace viewer, which Perfetto reads as
+// well. The environment is read once, when the module is loaded.
+
+// The phases of a lookup with spans of their own.
+typedef enum {
+    TRACE_PHASE_ALLOW,
+    TRACE_PHASE_SOA,
+    TRACE_PHASE_CONNECT,
+    TRACE_PHASE_QUERY,
+    // The part of a query the backends answered, on cache misses.
+    TRACE_PHASE_BACKEND,
+    TRACE_PHASE_CONVERT,
+    TRACE_PHASE_MAX,
+} trace_phase_t;
+
+// Spans recorded per lookup at most; later ones are dropped.
+#define TRACE_MAX_SPANS 16
+
+extern int trace_enabled;
+
+// Runs call only while tracing, so that otherwise a trace point costs one
+// branch that is predicted not taken.
+#define TRACE(call)                                                            \
+    do {                                                                       \
+        if (__builtin_expect(trace_enabled, 0))                                \
+            call;                                                              \
+    } while (0)
+
+// Starts the record of a lookup through the NSS function entry, of a name
+// or, if name is NULL, of an address of family af. Decides whether this
+// lookup is sampled; the other trace calls do nothing for lookups that are
+// not.
+void trace_begin(const char* entry, const char* name, int af,
+                 const void* address);
+
+// Starts a span of a phase, for family af or 0. Returns its number for
+// trace_phase_end, or -1.
+int trace_phase_begin(trace_phase_t phase, int af);
+
+// Ends a span with a result code of the phase.
+void trace_phase_end(int span, int result);
+
+// Notes a decision taken, such as the allow verdict or where the answer
+// came from.
+void trace_decision(const char* decision);
+
+// Ends the record of the lookup with the status returned, and writes it.
+void trace_end(int status);
+
+// Sets up tracing from a value like that of NSS_MDNS_TRACE, or turns it
+// off for NULL. Called on load; exposed for testing.
+void trace_setup(const char* spec);
+
+#endif
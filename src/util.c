@@ -23,14 +23,20 @@ SPDX-License-Identifier: LGPL-2.1-or-later
 
 #include <sys/select.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <errno.h>
 #include <string.h>
 #include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <fcntl.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <unistd.h>
 
+#include "probes.h"
+#include "stats.h"
+#include "trace.h"
 #include "util.h"
 
 int set_cloexec(int fd) {
@@ -46,6 +52,76 @@ int set_cloexec(int fd) {
     return fcntl(fd, F_SETFD, n | FD_CLOEXEC);
 }
 
+int unix_socket_connect(const char* path) {
+    int fd, span = -1;
+    struct sockaddr_un sa;
+
+    assert(path);
+
+    PROBE1(connect_start, path);
+    TRACE(span = trace_phase_begin(TRACE_PHASE_CONNECT, 0));
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+        PROBE2(connect_done, path, -1);
+        TRACE(trace_phase_end(span, -1));
+        return -1;
+    }
+
+    set_cloexec(fd);
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    strncpy(sa.sun_path, path, sizeof(sa.sun_path) - 1);
+    sa.sun_path[sizeof(sa.sun_path) - 1] = 0;
+
+    if (connect(fd, (struct sockaddr*)&sa, sizeof(sa)) < 0) {
+        close(fd);
+        fd = -1;
+    }
+
+    PROBE2(connect_done, path, fd);
+    TRACE(trace_phase_end(span, fd < 0 ? -1 : 0));
+    return fd;
+}
+
+int set_socket_timeout(int fd, int timeout) {
+    struct timeval tv;
+
+    assert(fd >= 0);
+    assert(timeout >= 0);
+
+    tv.tv_sec = timeout / 1000;
+    tv.tv_usec = (timeout % 1000) * 1000;
+
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) < 0)
+        return -1;
+
+    return 0;
+}
+
+uint64_t monotonic_msec(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+int stat_changed(const struct stat* a, const struct stat* b) {
+    return a->st_dev != b->st_dev || a->st_ino != b->st_ino ||
+           a->st_size != b->st_size || a->st_mtime != b->st_mtime;
+}
+
+const char* secure_env(const char* name) {
+#ifdef HAVE_SECURE_GETENV
+    return secure_getenv(name);
+#else
+    if (getuid() != geteuid() || getgid() != getegid())
+        return NULL;
+    return getenv(name);
+#endif
+}
+
 int ends_with(const char* name, const char* suffix) {
     size_t ln, ls;
     assert(name);
@@ -129,12 +205,19 @@ int local_soa(void) {
     struct __res_state state = {
         0,
     };
-    int result;
+    int result, span = -1;
     unsigned char answer[NS_MAXMSG];
 
+    PROBE0(soa_start);
+    TRACE(span = trace_phase_begin(TRACE_PHASE_SOA, 0));
+
     result = res_ninit(&state);
-    if (result == -1)
+    if (result == -1) {
+        stats_count(STATS_SOA_FAILED);
+        PROBE1(soa_done, 0);
+        TRACE(trace_phase_end(span, -1));
         return 0;
+    }
     result =
         res_nquery(&state, "local", ns_c_in, ns_t_soa, answer, sizeof answer);
 #ifdef __FreeBSD__
@@ -142,6 +225,9 @@ int local_soa(void) {
 #else
     res_nclose(&state);
 #endif
+    stats_count(result > 0 ? STATS_SOA_PRESENT : STATS_SOA_ABSENT);
+    PROBE1(soa_done, result > 0);
+    TRACE(trace_phase_end(span, result > 0));
     return result > 0;
 }
 
@@ -231,57 +317,53 @@ enum nss_status convert_userdata_to_addrtuple(const userdata_t* u,
                                               struct gaih_addrtuple** pat,
                                               buffer_t* buf, int* errnop,
                                               int* h_errnop) {
+    // The caller may provide a valid initial location in *pat, which is
+    // then used for the first result. Without this, nscd will segfault
+    // because it assumes that the buffer is only used as an overflow.
+    // See
+    // https://lists.freedesktop.org/archives/systemd-devel/2013-February/008606.html
+    int provided = *pat != NULL && u->count > 0;
+    size_t n_tuples = (size_t)(u->count - provided);
+    size_t name_len = strlen(name) + 1;
+    struct gaih_addrtuple *tuples, *first, *tuple;
+    char* buffer_name;
+
+    if (u->count == 0)
+        return NSS_STATUS_SUCCESS;
+
+    // The tuples come first, so that the name needs no alignment after
+    // them. Nothing is written unless all of it fits.
+    if (!buffer_fits(buf, n_tuples * sizeof(*tuples) + name_len)) {
+        *errnop = ERANGE;
+        *h_errnop = NO_RECOVERY;
+        return NSS_STATUS_TRYAGAIN;
+    }
+    tuples = buffer_alloc_uninit(buf, n_tuples * sizeof(*tuples));
+    buffer_name = buffer_alloc_uninit(buf, name_len);
+    memcpy(buffer_name, name, name_len);
 
-    // Copy name to buffer (referenced in every result address tuple).
-    char* buffer_name = buffer_strdup(buf, name);
-    RETURN_IF_FAILED_ALLOC(buffer_name);
-
-    struct gaih_addrtuple* tuple_prev = NULL;
+    first = tuple = provided ? *pat : tuples++;
     for (int i = 0; i < u->count; i++) {
         const query_address_result_t* result = &u->result[i];
-        struct gaih_addrtuple* tuple;
-        if (tuple_prev == NULL && *pat) {
-            // The caller has provided a valid initial location in *pat,
-            // so use that as the first result. Without this, nscd will
-            // segfault because it assumes that the buffer is only used as
-            // an overflow.
-            // See
-            // https://lists.freedesktop.org/archives/systemd-devel/2013-February/008606.html
-            tuple = *pat;
-            memset(tuple, 0, sizeof(*tuple));
-        } else {
-            // Allocate a new tuple from the buffer.
-            tuple = buffer_alloc(buf, sizeof(struct gaih_addrtuple));
-            RETURN_IF_FAILED_ALLOC(tuple);
-        }
-
-        size_t address_length = result->af == AF_INET ? sizeof(ipv4_address_t)
-                                                      : sizeof(ipv6_address_t);
+        int last = i + 1 == u->count;
 
-        // Assign the (always same) name.
+        // Every field is set, so tuples need not be zeroed first.
+        tuple->next = last ? NULL : tuples;
         tuple->name = buffer_name;
-
-        // Assign actual address family of address.
         tuple->family = result->af;
-
-        // Copy address.
-        memcpy(&(tuple->addr), &(result->address), address_length);
-
-        // Assign interface scope id
+        if (result->af == AF_INET) {
+            memcpy(tuple->addr, &result->address.ipv4, sizeof(ipv4_address_t));
+            memset(&tuple->addr[1], 0,
+                   sizeof(tuple->addr) - sizeof(ipv4_address_t));
+        } else
+            memcpy(tuple->addr, &result->address.ipv6, sizeof(ipv6_address_t));
         tuple->scopeid = result->scopeid;
 
-        if (tuple_prev == NULL) {
-            // This is the first tuple.
-            // Return the start of the list in *pat.
-            *pat = tuple;
-        } else {
-            // Link the new tuple into the previous tuple.
-            tuple_prev->next = tuple;
-        }
-
-        tuple_prev = tuple;
+        if (!last)
+            tuple = tuples++;
     }
 
+    *pat = first;
     return NSS_STATUS_SUCCESS;
 }
 #endif
@@ -301,23 +383,34 @@ void buffer_init(buffer_t* buf, char* buffer, size_t buflen) {
     buf->end = buffer + buflen;
 }
 
-void* buffer_alloc(buffer_t* buf, size_t size) {
+int buffer_fits(const buffer_t* buf, size_t size) {
+    return size == 0 ||
+           (buf->next <= buf->end && size <= (size_t)(buf->end - buf->next));
+}
+
+void* buffer_alloc_uninit(buffer_t* buf, size_t size) {
     // Zero-length allocations always succeed with non-NULL.
     if (size == 0) {
         return buf; // Just a convenient non-NULL pointer.
     }
 
-    char* alloc_end = buf->next + size;
-    if (alloc_end > buf->end) {
+    if (!buffer_fits(buf, size)) {
         // No more memory in the buffer.
         return NULL;
     }
 
     // We have enough space. Set up the next aligned pointer and return
-    // the current one, zeroed.
+    // the current one.
     char* current = buf->next;
-    buf->next = aligned_ptr(alloc_end);
-    memset(current, 0, size);
+    buf->next = aligned_ptr(current + size);
+    return current;
+}
+
+void* buffer_alloc(buffer_t* buf, size_t size) {
+    void* current = buffer_alloc_uninit(buf, size);
+
+    if (current && size)
+        memset(current, 0, size);
     return current;
 }
 
@@ -338,7 +431,8 @@ void append_address_to_userdata(const query_address_result_t* result,
         return;
 
     query_address_result_t* dst = &u->result[u->count];
-    memcpy(dst, result, sizeof(*dst));
+    if (result != dst)
+        memcpy(dst, result, sizeof(*dst));
 
     // The scope id holds the interface index the record was seen on. That is
     // only meaningful for link-local IPv6 addresses (fe80::/10), which cannot
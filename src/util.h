@@ -20,6 +20,7 @@
 SPDX-License-Identifier: LGPL-2.1-or-later
 */
 
+#include <sys/stat.h>
 #include <sys/time.h>
 #include <time.h>
 #include <inttypes.h>
@@ -47,6 +48,12 @@ void buffer_init(buffer_t* buf, char* buffer, size_t buflen);
 // If there is insufficient space, returns NULL.
 void* buffer_alloc(buffer_t* buf, size_t size);
 
+// Like buffer_alloc(), for callers that set all of the memory themselves.
+void* buffer_alloc_uninit(buffer_t* buf, size_t size);
+
+// Returns whether an allocation of a given size would succeed.
+int buffer_fits(const buffer_t* buf, size_t size);
+
 // Duplicates a string into a newly allocated chunk of memory.
 // If there is insufficient space, returns NULL.
 char* buffer_strdup(buffer_t* buf, const char* str);
@@ -60,8 +67,27 @@ char* buffer_strdup(buffer_t* buf, const char* str);
     }
 
 int set_cloexec(int fd);
+
+// Connects a stream socket to the Unix socket at path. Returns the file
+// descriptor, or -1 on error.
+int unix_socket_connect(const char* path);
+
+// Sets the send and receive timeouts of a socket, in milliseconds.
+int set_socket_timeout(int fd, int timeout);
 int ends_with(const char* name, const char* suffix);
 
+// Returns the current value of the monotonic clock, in milliseconds.
+uint64_t monotonic_msec(void);
+
+// Returns whether two stat results are of different files, or of a file
+// that was modified in between.
+int stat_changed(const struct stat* a, const struct stat* b);
+
+// Returns the value of an environment variable, or NULL if it is unset or
+// the program runs with privileges it was not started with, as then the
+// environment cannot be trusted.
+const char* secure_env(const char* name);
+
 typedef enum {
     USE_NAME_RESULT_SKIP,
     USE_NAME_RESULT_AUTHORITATIVE,
@@ -122,7 +148,8 @@ enum nss_status convert_userdata_for_name_to_hostent(const userdata_t* u,
                                                      int* h_errnop);
 
 // Converts from the userdata struct into the gaih_addrtuple format, used by
-// gethostbyaddr4_r.
+// gethostbyaddr4_r. Lays out the tuples and the name in one pass, and
+// leaves buf and *pat alone if they don't fit.
 #ifndef __FreeBSD__
 enum nss_status convert_userdata_to_addrtuple(const userdata_t* u,
                                               const char* name,
@@ -131,7 +158,8 @@ enum nss_status convert_userdata_to_addrtuple(const userdata_t* u,
                                               int* h_errnop);
 #endif
 
-// Appends a query_address_result to userdata.
+// Appends a query_address_result to userdata. result may be the next free
+// entry of userdata itself, which saves copying it.
 void append_address_to_userdata(const query_address_result_t* result,
                                 userdata_t* u);
 
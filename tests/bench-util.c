@@ -0,0 +1,444 @@
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+// Microbenchmarks of the util.c functions every lookup runs through, over
+// a range of realistic inputs. Prints one tab-separated line per case:
+//
+//   BENCHMARK  PARAMETERS  UNIT  MIN  MEDIAN
+//
+// with the time per call in cycles where the CPU has a cycle counter, in
+// nanoseconds elsewhere. With -c BASELINE, compares the medians with those
+// of an earlier run saved to BASELINE and exits with 1 if any of them got
+// slower by more than the threshold.
+
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "../src/util.h"
+
+// Timed batches per case; the minimum and median of them are reported.
+#define REPETITIONS 21
+// Batches are made long enough to take at least this many ticks.
+#define MIN_BATCH_TICKS 200000
+#define MAX_CASES 256
+
+typedef struct {
+    char name[64];
+    char parameters[64];
+    double median;
+} entry_t;
+
+static const char* filter;
+static entry_t baseline[MAX_CASES];
+static int n_baseline;
+static double threshold = 10;
+static int regressions;
+
+// Keeps the compiler from optimizing away the calls measured.
+static volatile uintptr_t sink;
+
+#if defined(__x86_64__) || defined(__i386__)
+#define UNIT "cycles"
+static inline uint64_t ticks(void) {
+    return __rdtsc();
+}
+#else
+#define UNIT "ns"
+static inline uint64_t ticks(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+#endif
+
+typedef void (*bench_fn_t)(void* arg);
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static double time_batch(bench_fn_t fn, void* arg, unsigned iterations) {
+    uint64_t start = ticks();
+
+    for (unsigned i = 0; i < iterations; i++)
+        fn(arg);
+
+    return (double)(ticks() - start);
+}
+
+static void compare(const char* name, const char* parameters, double median) {
+    for (int i = 0; i < n_baseline; i++) {
+        const entry_t* e = &baseline[i];
+
+        if (strcmp(e->name, name) != 0 ||
+            strcmp(e->parameters, parameters) != 0)
+            continue;
+
+        if (median > e->median * (1 + threshold / 100)) {
+            fprintf(stderr,
+                    "REGRESSION %s %s: %.1f -> %.1f " UNIT " (%+.0f%%)\n",
+                    name, parameters, e->median, median,
+                    100 * (median / e->median - 1));
+            regressions++;
+        }
+        return;
+    }
+}
+
+static void run(const char* name, const char* parameters, bench_fn_t fn,
+                void* arg) {
+    double per_call[REPETITIONS];
+    unsigned iterations = 1;
+
+    if (filter && !strstr(name, filter))
+        return;
+
+    // Warms up caches and finds how many calls fill a batch.
+    while (time_batch(fn, arg, iterations) < MIN_BATCH_TICKS &&
+           iterations < (1u << 24))
+        iterations *= 2;
+
+    for (int i = 0; i < REPETITIONS; i++)
+        per_call[i] = time_batch(fn, arg, iterations) / iterations;
+    qsort(per_call, REPETITIONS, sizeof(double), compare_doubles);
+
+    printf("%s\t%s\t%s\t%.1f\t%.1f\n", name, parameters, UNIT, per_call[0],
+           per_call[REPETITIONS / 2]);
+    fflush(stdout);
+
+    compare(name, parameters, per_call[REPETITIONS / 2]);
+}
+
+static int read_baseline(const char* path) {
+    char line[256];
+    FILE* f = fopen(path, "r");
+
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), f) && n_baseline < MAX_CASES) {
+        entry_t* e = &baseline[n_baseline];
+        double min;
+        char unit[16];
+
+        if (line[0] == '#')
+            continue;
+        if (sscanf(line, "%63s %63s %15s %lf %lf", e->name, e->parameters,
+                   unit, &min, &e->median) != 5)
+            continue;
+
+        // Cycles and nanoseconds don't compare.
+        if (strcmp(unit, UNIT) == 0)
+            n_baseline++;
+    }
+
+    fclose(f);
+    return 0;
+}
+
+// Names of a given length ending in ".local", as looked up.
+static void make_name(char* name, size_t len, int labels) {
+    size_t label_len;
+
+    memset(name, 0, 256);
+    if (labels < 2)
+        labels = 2;
+    label_len = (len - 6) / (size_t)(labels - 1);
+
+    for (int i = 0; i < labels - 1; i++) {
+        if (i > 0)
+            strcat(name, ".");
+        memset(name + strlen(name), 'a' + i % 26,
+               i == labels - 2 ? len - 6 - strlen(name) : label_len - 1);
+    }
+    strcat(name, ".local");
+}
+
+typedef struct {
+    char name[256];
+} name_arg_t;
+
+static void bench_ends_with(void* arg) {
+    sink += (uintptr_t)ends_with(((name_arg_t*)arg)->name, ".local");
+}
+
+static void bench_label_count(void* arg) {
+    sink += (uintptr_t)label_count(((name_arg_t*)arg)->name);
+}
+
+typedef struct {
+    char name[256];
+    FILE* f;
+} allow_arg_t;
+
+static void bench_verify_name_allowed(void* arg) {
+    allow_arg_t* a = arg;
+
+    if (a->f)
+        rewind(a->f);
+    sink += (uintptr_t)verify_name_allowed(a->name, a->f);
+}
+
+typedef struct {
+    size_t size;
+    char buffer[4096];
+} alloc_arg_t;
+
+static void bench_buffer_alloc(void* arg) {
+    alloc_arg_t* a = arg;
+    buffer_t buf;
+
+    // A conversion makes about this many allocations.
+    buffer_init(&buf, a->buffer, sizeof(a->buffer));
+    for (int i = 0; i < 16; i++)
+        sink += (uintptr_t)buffer_alloc(&buf, a->size);
+}
+
+typedef struct {
+    userdata_t u;
+    char name[256];
+    size_t buflen;
+    char buffer[65536];
+} convert_arg_t;
+
+#ifndef __FreeBSD__
+static enum nss_status convert_addrtuple(convert_arg_t* a) {
+    struct gaih_addrtuple* pat = NULL;
+    buffer_t buf;
+    int err, herr;
+
+    buffer_init(&buf, a->buffer, a->buflen);
+    return convert_userdata_to_addrtuple(&a->u, a->name, &pat, &buf, &err,
+                                         &herr);
+}
+
+static void bench_convert_addrtuple(void* arg) {
+    sink += (uintptr_t)convert_addrtuple(arg);
+}
+#endif
+
+static enum nss_status convert_hostent(convert_arg_t* a) {
+    struct hostent he;
+    buffer_t buf;
+    int err, herr;
+
+    buffer_init(&buf, a->buffer, a->buflen);
+    return convert_userdata_for_name_to_hostent(&a->u, a->name, AF_INET, &he,
+                                                &buf, &err, &herr);
+}
+
+static void bench_convert_hostent(void* arg) {
+    sink += (uintptr_t)convert_hostent(arg);
+}
+
+// Fills u with n results, of family af or, for AF_UNSPEC, alternating.
+static void make_results(userdata_t* u, int n, int af) {
+    memset(u, 0, sizeof(*u));
+
+    for (int i = 0; i < n; i++) {
+        query_address_result_t r;
+
+        memset(&r, 0, sizeof(r));
+        r.af = af != AF_UNSPEC ? af : i % 2 ? AF_INET6 : AF_INET;
+        if (r.af == AF_INET)
+            r.address.ipv4.address = htonl(0xc0000200 + (uint32_t)i);
+        else {
+            r.address.ipv6.address[0] = 0xfe;
+            r.address.ipv6.address[1] = 0x80;
+            r.address.ipv6.address[15] = (uint8_t)i;
+            r.scopeid = 2;
+        }
+        append_address_to_userdata(&r, u);
+    }
+}
+
+// Finds the smallest buffer a conversion succeeds with.
+static size_t tight_buflen(convert_arg_t* a,
+                           enum nss_status (*convert)(convert_arg_t*)) {
+    for (a->buflen = 1; a->buflen < sizeof(a->buffer); a->buflen++)
+        if (convert(a) == NSS_STATUS_SUCCESS)
+            break;
+
+    return a->buflen;
+}
+
+static void run_names(void) {
+    static const size_t lengths[] = {10, 32, 64, 128, 253};
+    static const int labels[] = {2, 3, 8, 32};
+    name_arg_t a;
+    char parameters[64];
+
+    for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+        make_name(a.name, lengths[i], 2);
+        snprintf(parameters, sizeof(parameters), "length=%zu", lengths[i]);
+        run("ends_with", parameters, bench_ends_with, &a);
+    }
+
+    for (size_t i = 0; i < sizeof(labels) / sizeof(labels[0]); i++) {
+        make_name(a.name, 128, labels[i]);
+        snprintf(parameters, sizeof(parameters), "labels=%d", labels[i]);
+        run("label_count", parameters, bench_label_count, &a);
+    }
+}
+
+static void run_allow(void) {
+    static const int lines[] = {0, 1, 10, 100, 1000, 10000};
+    allow_arg_t a;
+    char parameters[64];
+
+    make_name(a.name, 32, 2);
+
+    a.f = NULL;
+    run("verify_name_allowed", "lines=none", bench_verify_name_allowed, &a);
+
+    for (size_t i = 0; i < sizeof(lines) / sizeof(lines[0]); i++) {
+        size_t size = (size_t)lines[i] * 32 + 16, len = 0;
+        char* contents = malloc(size);
+
+        // Only the last line matches, so that all of them are read.
+        for (int j = 0; j < lines[i] - 1; j++)
+            len += (size_t)snprintf(contents + len, size - len,
+                                    ".domain%d.example\n", j);
+        if (lines[i] > 0)
+            len += (size_t)snprintf(contents + len, size - len, ".local\n");
+
+        // fmemopen() doesn't take empty buffers everywhere.
+        a.f = len > 0 ? fmemopen(contents, len, "r") : fopen("/dev/null", "r");
+        if (!a.f) {
+            perror("fmemopen");
+            exit(1);
+        }
+
+        snprintf(parameters, sizeof(parameters), "lines=%d", lines[i]);
+        run("verify_name_allowed", parameters, bench_verify_name_allowed,
+            &a);
+
+        fclose(a.f);
+        free(contents);
+    }
+}
+
+static void run_buffer_alloc(void) {
+    static const size_t sizes[] = {4, 16, 64, 200};
+    static alloc_arg_t a;
+    char parameters[64];
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        a.size = sizes[i];
+        snprintf(parameters, sizeof(parameters), "size=%zu,count=16",
+                 sizes[i]);
+        run("buffer_alloc", parameters, bench_buffer_alloc, &a);
+    }
+}
+
+static void run_convert(const char* name, int af, bench_fn_t fn,
+                        enum nss_status (*convert)(convert_arg_t*)) {
+    static const int counts[] = {1, 2, 4, 8, 16};
+    static convert_arg_t a;
+    char parameters[64];
+
+    make_name(a.name, 32, 2);
+
+    for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+        make_results(&a.u, counts[i], af);
+
+        tight_buflen(&a, convert);
+        snprintf(parameters, sizeof(parameters), "results=%d,buffer=tight",
+                 counts[i]);
+        run(name, parameters, fn, &a);
+
+        a.buflen = sizeof(a.buffer);
+        snprintf(parameters, sizeof(parameters), "results=%d,buffer=generous",
+                 counts[i]);
+        run(name, parameters, fn, &a);
+    }
+}
+
+static void usage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s [-f FILTER] [-c BASELINE [-t PERCENT]]\n"
+            "\n"
+            "  -f FILTER    only benchmarks whose name contains FILTER\n"
+            "  -c BASELINE  compare with the output of an earlier run\n"
+            "  -t PERCENT   slowdown flagged as a regression, default 10\n",
+            argv0);
+}
+
+int main(int argc, char* argv[]) {
+    int c;
+
+    while ((c = getopt(argc, argv, "f:c:t:h")) != -1) {
+        switch (c) {
+        case 'f':
+            filter = optarg;
+            break;
+        case 'c':
+            if (read_baseline(optarg) < 0)
+                return 2;
+            break;
+        case 't':
+            threshold = atof(optarg);
+            if (threshold <= 0) {
+                usage(argv[0]);
+                return 2;
+            }
+            break;
+        case 'h':
+            usage(argv[0]);
+            return 0;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (optind != argc) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    printf("# benchmark\tparameters\tunit\tmin\tmedian\n");
+
+    run_names();
+    run_allow();
+    run_buffer_alloc();
+#ifndef __FreeBSD__
+    run_convert("convert_userdata_to_addrtuple", AF_UNSPEC,
+                bench_convert_addrtuple, convert_addrtuple);
+#endif
+    run_convert("convert_userdata_for_name_to_hostent", AF_INET,
+                bench_convert_hostent, convert_hostent);
+
+    return regressions ? 1 : 0;
+}
@@ -0,0 +1,197 @@
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#include <check.h>
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include "../src/addrsort.h"
+#include "../src/config.h"
+
+#define BOTH (MDNS_SORT_IPV4 | MDNS_SORT_IPV6)
+
+static ifstate_address_t local[8];
+static int n_local;
+
+static void setup(void) { n_local = 0; }
+
+// Adds an address of this host, "ADDRESS/LEN".
+static void add_local(const char* text, uint32_t ifindex, unsigned flags) {
+    ifstate_address_t* a = &local[n_local++];
+    char address[64];
+
+    memset(a, 0, sizeof(*a));
+    ck_assert_int_eq(sscanf(text, "%63[^/]/%d", address, &a->prefixlen), 2);
+    a->af = strchr(address, ':') ? AF_INET6 : AF_INET;
+    ck_assert_int_eq(inet_pton(a->af, address, a->address), 1);
+    a->ifindex = ifindex;
+    a->flags = flags;
+}
+
+static query_address_result_t result(const char* text, uint32_t scopeid) {
+    query_address_result_t r;
+
+    memset(&r, 0, sizeof(r));
+    r.af = strchr(text, ':') ? AF_INET6 : AF_INET;
+    r.scopeid = scopeid;
+    ck_assert_int_eq(inet_pton(r.af, text, &r.address), 1);
+    return r;
+}
+
+static void assert_order(const query_address_result_t* results, int n,
+                         const char* const* expected) {
+    for (int i = 0; i < n; i++) {
+        char text[INET6_ADDRSTRLEN];
+
+        inet_ntop(results[i].af, &results[i].address, text, sizeof(text));
+        ck_assert_str_eq(text, expected[i]);
+    }
+}
+
+START_TEST(test_unusable_last) {
+    query_address_result_t results[] = {result("2001:db8::5", 0),
+                                        result("192.0.2.5", 0)};
+    static const char* const expected[] = {"192.0.2.5", "2001:db8::5"};
+
+    // No IPv6 address to reach the first one from.
+    add_local("192.0.2.1/24", 2, IFSTATE_USABLE);
+    addrsort_sort_with(results, 2, BOTH, local, n_local);
+    assert_order(results, 2, expected);
+}
+END_TEST
+
+START_TEST(test_link_local_on_its_interface) {
+    query_address_result_t results[] = {result("fe80::a", 3),
+                                        result("fe80::b", 2)};
+    static const char* const expected[] = {"fe80::b", "fe80::a"};
+
+    // Interface 3 is up but not running.
+    add_local("fe80::1/64", 2, IFSTATE_USABLE);
+    add_local("fe80::2/64", 3, 0);
+    addrsort_sort_with(results, 2, BOTH, local, n_local);
+    assert_order(results, 2, expected);
+}
+END_TEST
+
+START_TEST(test_matching_scope) {
+    query_address_result_t results[] = {result("2001:db8:1::5", 0),
+                                        result("fe80::5", 2)};
+    static const char* const expected[] = {"fe80::5", "2001:db8:1::5"};
+
+    // Only a link-local source for the global address.
+    add_local("fe80::1/64", 2, IFSTATE_USABLE);
+    addrsort_sort_with(results, 2, BOTH, local, n_local);
+    assert_order(results, 2, expected);
+}
+END_TEST
+
+START_TEST(test_smaller_scope) {
+    query_address_result_t results[] = {result("2001:db8:1::5", 0),
+                                        result("fe80::5", 2)};
+    static const char* const expected[] = {"fe80::5", "2001:db8:1::5"};
+
+    add_local("2001:db8:1::1/64", 2, IFSTATE_USABLE);
+    add_local("fe80::1/64", 2, IFSTATE_USABLE);
+    addrsort_sort_with(results, 2, BOTH, local, n_local);
+    assert_order(results, 2, expected);
+}
+END_TEST
+
+START_TEST(test_precedence) {
+    query_address_result_t results[] = {result("192.168.1.7", 0),
+                                        result("2001:db8::7", 0)};
+    static const char* const expected[] = {"2001:db8::7", "192.168.1.7"};
+
+    add_local("192.168.1.2/24", 2, IFSTATE_USABLE);
+    add_local("2001:db8::1/64", 2, IFSTATE_USABLE);
+    addrsort_sort_with(results, 2, BOTH, local, n_local);
+    assert_order(results, 2, expected);
+}
+END_TEST
+
+START_TEST(test_longest_matching_prefix) {
+    query_address_result_t results[] = {result("2001:db8:2::5", 0),
+                                        result("2001:db8:1::5", 0)};
+    static const char* const expected[] = {"2001:db8:1::5", "2001:db8:2::5"};
+
+    add_local("2001:db8:1::1/64", 2, IFSTATE_USABLE);
+    addrsort_sort_with(results, 2, BOTH, local, n_local);
+    assert_order(results, 2, expected);
+}
+END_TEST
+
+START_TEST(test_only_configured_families_move) {
+    query_address_result_t results[] = {
+        result("10.0.0.1", 0), result("2001:db8:2::5", 0),
+        result("192.0.2.1", 0), result("2001:db8:1::5", 0)};
+    static const char* const expected[] = {"10.0.0.1", "2001:db8:1::5",
+                                           "192.0.2.1", "2001:db8:2::5"};
+
+    add_local("192.0.2.2/24", 2, IFSTATE_USABLE);
+    add_local("2001:db8:1::1/64", 2, IFSTATE_USABLE);
+    addrsort_sort_with(results, 4, MDNS_SORT_IPV6, local, n_local);
+    assert_order(results, 4, expected);
+}
+END_TEST
+
+START_TEST(test_ties_keep_their_order) {
+    query_address_result_t results[] = {result("192.0.2.9", 0),
+                                        result("192.0.2.8", 0),
+                                        result("192.0.2.7", 0)};
+    static const char* const expected[] = {"192.0.2.9", "192.0.2.8",
+                                           "192.0.2.7"};
+
+    add_local("192.0.2.1/24", 2, IFSTATE_USABLE);
+    addrsort_sort_with(results, 3, BOTH, local, n_local);
+    assert_order(results, 3, expected);
+}
+END_TEST
+
+static Suite* addrsort_suite(void) {
+    Suite* s = suite_create("addrsort");
+
+    TCase* tc_rules = tcase_create("rules");
+    tcase_add_checked_fixture(tc_rules, setup, NULL);
+    tcase_add_test(tc_rules, test_unusable_last);
+    tcase_add_test(tc_rules, test_link_local_on_its_interface);
+    tcase_add_test(tc_rules, test_matching_scope);
+    tcase_add_test(tc_rules, test_smaller_scope);
+    tcase_add_test(tc_rules, test_precedence);
+    tcase_add_test(tc_rules, test_longest_matching_prefix);
+    tcase_add_test(tc_rules, test_only_configured_families_move);
+    tcase_add_test(tc_rules, test_ties_keep_their_order);
+    suite_add_tcase(s, tc_rules);
+
+    return s;
+}
+
+int main(void) {
+    int number_failed;
+    Suite* s;
+    SRunner* sr;
+
+    s = addrsort_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_VERBOSE);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,251 @@
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#define _DEFAULT_SOURCE
+
+#include <check.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../src/avahi.h"
+#include "../src/backend.h"
+#include "../src/util.h"
+#include "fake-avahi.h"
+
+static char dir[] = "/tmp/nss-mdns-test-XXXXXX";
+static backend_endpoint_t endpoint;
+static fake_avahi_t* fake;
+
+static const char script[] =
+    "# A host with addresses of both families, on interface 3.\n"
+    "foo.local ifindex=3 192.0.2.5 192.0.2.6 2001:db8::5\n"
+    "v6only.local fe80::1\n"
+    "slow.local latency=150 jitter=20 192.0.2.7\n"
+    "trickle.local partial 192.0.2.8\n"
+    "gone.local disconnect 192.0.2.9\n"
+    "stuck.local hang 192.0.2.10\n";
+
+static void setup(void) {
+    strcpy(dir, "/tmp/nss-mdns-test-XXXXXX");
+    ck_assert_ptr_nonnull(mkdtemp(dir));
+    backend_health_reset();
+
+    memset(&endpoint, 0, sizeof(endpoint));
+    endpoint.type = BACKEND_AVAHI;
+    snprintf(endpoint.path, sizeof(endpoint.path), "%s/socket", dir);
+    fake = fake_avahi_start(endpoint.path, script);
+    ck_assert_ptr_nonnull(fake);
+}
+
+static void teardown(void) {
+    char cmd[64];
+
+    fake_avahi_stop(fake);
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+    system(cmd);
+}
+
+static avahi_resolve_result_t resolve_name(int af, const char* name,
+                                           query_address_result_t* result,
+                                           int timeout) {
+    return backend_avahi.resolve_name(&endpoint, af, name, result, timeout);
+}
+
+START_TEST(test_config_override) {
+    char config[64];
+    query_address_result_t result;
+    FILE* f;
+
+    snprintf(config, sizeof(config), "%s/nss-mdns.conf", dir);
+    ck_assert_ptr_nonnull(f = fopen(config, "w"));
+    fprintf(f, "backend avahi %s\nmulticast-fallback no\n", endpoint.path);
+    fclose(f);
+    setenv("NSS_MDNS_CONFIG", config, 1);
+
+    ck_assert_int_eq(avahi_resolve_name(AF_INET, "foo.local", &result, NULL),
+                     AVAHI_RESOLVE_RESULT_SUCCESS);
+    ck_assert_uint_eq(result.address.ipv4.address, inet_addr("192.0.2.5"));
+    ck_assert_uint_eq(fake_avahi_requests(fake), 1);
+
+    unsetenv("NSS_MDNS_CONFIG");
+}
+END_TEST
+
+START_TEST(test_resolve_name) {
+    query_address_result_t result;
+    struct in6_addr expected;
+
+    // Only the first of several answers is used.
+    ck_assert_int_eq(resolve_name(AF_INET, "foo.local", &result, 1000),
+                     AVAHI_RESOLVE_RESULT_SUCCESS);
+    ck_assert_int_eq(result.af, AF_INET);
+    ck_assert_int_eq(result.scopeid, 3);
+    ck_assert_uint_eq(result.address.ipv4.address, inet_addr("192.0.2.5"));
+
+    ck_assert_int_eq(resolve_name(AF_INET6, "FOO.local", &result, 1000),
+                     AVAHI_RESOLVE_RESULT_SUCCESS);
+    inet_pton(AF_INET6, "2001:db8::5", &expected);
+    ck_assert_mem_eq(&result.address.ipv6, &expected, 16);
+
+    ck_assert_int_eq(resolve_name(AF_INET, "v6only.local", &result, 1000),
+                     AVAHI_RESOLVE_RESULT_HOST_NOT_FOUND);
+    ck_assert_int_eq(resolve_name(AF_INET, "bar.local", &result, 1000),
+                     AVAHI_RESOLVE_RESULT_HOST_NOT_FOUND);
+    ck_assert_uint_eq(fake_avahi_requests(fake), 4);
+}
+END_TEST
+
+START_TEST(test_resolve_address) {
+    struct in_addr address;
+    char name[256];
+
+    inet_pton(AF_INET, "192.0.2.6", &address);
+    ck_assert_int_eq(backend_avahi.resolve_address(&endpoint, AF_INET,
+                                                   &address, name,
+                                                   sizeof(name), 1000),
+                     AVAHI_RESOLVE_RESULT_SUCCESS);
+    ck_assert_str_eq(name, "foo.local");
+
+    inet_pton(AF_INET, "192.0.2.99", &address);
+    ck_assert_int_eq(backend_avahi.resolve_address(&endpoint, AF_INET,
+                                                   &address, name,
+                                                   sizeof(name), 1000),
+                     AVAHI_RESOLVE_RESULT_HOST_NOT_FOUND);
+}
+END_TEST
+
+START_TEST(test_latency) {
+    query_address_result_t result;
+    uint64_t start = monotonic_msec(), elapsed;
+
+    // Being answered at all bounds the wait by the timeout; a tighter
+    // bound would only measure how busy the machine is.
+    ck_assert_int_eq(resolve_name(AF_INET, "slow.local", &result, 1000),
+                     AVAHI_RESOLVE_RESULT_SUCCESS);
+    elapsed = monotonic_msec() - start;
+    ck_assert_uint_ge(elapsed, 150);
+
+    // Gives up when the answer comes too late.
+    ck_assert_int_eq(resolve_name(AF_INET, "slow.local", &result, 50),
+                     AVAHI_RESOLVE_RESULT_UNAVAIL);
+}
+END_TEST
+
+START_TEST(test_slow_misses_after_fast_hits) {
+    char path[128];
+    mdns_config_t cfg;
+    query_address_result_t result;
+    fake_avahi_t* slow_misses;
+
+    // avahi-daemon takes a while to give up on names nobody answers for.
+    snprintf(path, sizeof(path), "%s/misses", dir);
+    slow_misses =
+        fake_avahi_start(path, "foo.local 192.0.2.5\n* latency=300\n");
+    ck_assert_ptr_nonnull(slow_misses);
+
+    config_init(&cfg);
+    cfg.backend_timeout = 3000;
+    cfg.backend_timeout_min = 50;
+    cfg.n_backends = 1;
+    cfg.backends[0].type = BACKEND_AVAHI;
+    strcpy(cfg.backends[0].path, path);
+
+    // Fast answers don't cut off the slower not-found replies, before or
+    // after one was seen, and the backend is not taken for down.
+    for (int round = 0; round < 2; round++) {
+        for (int i = 0; i < 5; i++)
+            ck_assert_int_eq(
+                backend_resolve_name(&cfg, AF_INET, "foo.local", &result),
+                AVAHI_RESOLVE_RESULT_SUCCESS);
+        ck_assert_int_eq(
+            backend_resolve_name(&cfg, AF_INET, "bar.local", &result),
+            AVAHI_RESOLVE_RESULT_HOST_NOT_FOUND);
+    }
+
+    fake_avahi_stop(slow_misses);
+}
+END_TEST
+
+START_TEST(test_partial_writes) {
+    query_address_result_t result;
+
+    ck_assert_int_eq(resolve_name(AF_INET, "trickle.local", &result, 1000),
+                     AVAHI_RESOLVE_RESULT_SUCCESS);
+    ck_assert_uint_eq(result.address.ipv4.address, inet_addr("192.0.2.8"));
+}
+END_TEST
+
+START_TEST(test_failures) {
+    query_address_result_t result;
+    uint64_t start;
+
+    ck_assert_int_eq(resolve_name(AF_INET, "gone.local", &result, 1000),
+                     AVAHI_RESOLVE_RESULT_UNAVAIL);
+
+    start = monotonic_msec();
+    ck_assert_int_eq(resolve_name(AF_INET, "stuck.local", &result, 100),
+                     AVAHI_RESOLVE_RESULT_UNAVAIL);
+    ck_assert_uint_ge(monotonic_msec() - start, 100);
+    ck_assert_uint_lt(monotonic_msec() - start, 500);
+}
+END_TEST
+
+START_TEST(test_bad_script) {
+    char path[64];
+
+    snprintf(path, sizeof(path), "%s/other", dir);
+    ck_assert_ptr_null(fake_avahi_start(path, "foo.local 192.0.2.300\n"));
+    ck_assert_ptr_null(fake_avahi_start(path, "foo.local fast\n"));
+    ck_assert_ptr_null(fake_avahi_start(path, "foo.local latency=x\n"));
+}
+END_TEST
+
+static Suite* avahi_suite(void) {
+    Suite* s = suite_create("avahi");
+
+    TCase* tc_avahi = tcase_create("avahi");
+    tcase_add_checked_fixture(tc_avahi, setup, teardown);
+    tcase_add_test(tc_avahi, test_config_override);
+    tcase_add_test(tc_avahi, test_resolve_name);
+    tcase_add_test(tc_avahi, test_resolve_address);
+    tcase_add_test(tc_avahi, test_latency);
+    tcase_add_test(tc_avahi, test_slow_misses_after_fast_hits);
+    tcase_add_test(tc_avahi, test_partial_writes);
+    tcase_add_test(tc_avahi, test_failures);
+    tcase_add_test(tc_avahi, test_bad_script);
+    suite_add_tcase(s, tc_avahi);
+
+    return s;
+}
+
+int main(void) {
+    int number_failed;
+    Suite* s;
+    SRunner* sr;
+
+    s = avahi_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_VERBOSE);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
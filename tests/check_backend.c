@@ -0,0 +1,441 @@
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#define _DEFAULT_SOURCE
+
+#include <check.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "../src/backend.h"
+#include "../src/util.h"
+
+static char dir[] = "/tmp/nss-mdns-test-XXXXXX";
+
+static int listen_on(const char* path) {
+    struct sockaddr_un sa;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    strcpy(sa.sun_path, path);
+    ck_assert_int_eq(bind(fd, (struct sockaddr*)&sa, sizeof(sa)), 0);
+    ck_assert_int_eq(listen(fd, 8), 0);
+    return fd;
+}
+
+// A stand-in for avahi-daemon: answers requests for foo.local on every
+// connection with the same address, and others with not found, until the
+// listening socket is shut down. While hang is set, requests are read but
+// not answered.
+typedef struct {
+    int fd;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int hang;
+    // Requests read so far.
+    unsigned requests;
+} server_t;
+
+static void* avahi_thread(void* arg) {
+    server_t* s = arg;
+    int fd;
+
+    while ((fd = accept(s->fd, NULL, NULL)) >= 0) {
+        static const char found[] = "+ 2 0 foo.local 192.0.2.5\n";
+        static const char not_found[] = "-15 Timeout reached\n";
+        const char* reply = not_found;
+        char request[256];
+        ssize_t n;
+        int hang = 1;
+
+        if ((n = read(fd, request, sizeof(request) - 1)) > 0) {
+            request[n] = 0;
+            if (strstr(request, " foo.local"))
+                reply = found;
+            pthread_mutex_lock(&s->mutex);
+            hang = s->hang;
+            s->requests++;
+            pthread_cond_broadcast(&s->cond);
+            pthread_mutex_unlock(&s->mutex);
+        }
+
+        if (!hang)
+            write(fd, reply, strlen(reply));
+        else
+            // Wait for the client to give up.
+            read(fd, request, sizeof(request));
+        close(fd);
+    }
+
+    return NULL;
+}
+
+static void set_hang(server_t* s, int hang) {
+    pthread_mutex_lock(&s->mutex);
+    s->hang = hang;
+    pthread_mutex_unlock(&s->mutex);
+}
+
+static void start_server(server_t* s, const char* path, pthread_t* thread) {
+    s->fd = listen_on(path);
+    pthread_mutex_init(&s->mutex, NULL);
+    pthread_cond_init(&s->cond, NULL);
+    s->hang = 0;
+    s->requests = 0;
+    ck_assert_int_eq(pthread_create(thread, NULL, avahi_thread, s), 0);
+}
+
+static void stop_server(server_t* s, pthread_t thread) {
+    shutdown(s->fd, SHUT_RDWR);
+    pthread_join(thread, NULL);
+    close(s->fd);
+    pthread_cond_destroy(&s->cond);
+    pthread_mutex_destroy(&s->mutex);
+}
+
+static void setup(void) {
+    strcpy(dir, "/tmp/nss-mdns-test-XXXXXX");
+    ck_assert_ptr_nonnull(mkdtemp(dir));
+    backend_health_reset();
+}
+
+static void teardown(void) {
+    char cmd[64];
+
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+    system(cmd);
+}
+
+static void config_with_backends(mdns_config_t* cfg, int n) {
+    config_init(cfg);
+    cfg->multicast_fallback = 0;
+    cfg->backend_timeout = 200;
+    cfg->backend_timeout_min = 50;
+    cfg->n_backends = n;
+    for (int i = 0; i < n; i++) {
+        cfg->backends[i].type = BACKEND_AVAHI;
+        snprintf(cfg->backends[i].path, sizeof(cfg->backends[i].path),
+                 "%s/socket%d", dir, i);
+    }
+}
+
+START_TEST(test_failover_to_second_backend) {
+    mdns_config_t cfg;
+    query_address_result_t result;
+    pthread_t thread;
+    server_t server;
+    uint64_t start;
+
+    config_with_backends(&cfg, 2);
+    start_server(&server, cfg.backends[1].path, &thread);
+
+    // Nothing listens on the first socket.
+    ck_assert_int_eq(backend_resolve_name(&cfg, AF_INET, "foo.local", &result),
+                     AVAHI_RESOLVE_RESULT_SUCCESS);
+    ck_assert_int_eq(result.scopeid, 2);
+    ck_assert_uint_eq(result.address.ipv4.address, inet_addr("192.0.2.5"));
+
+    // The first backend is now marked down, the second is used directly.
+    start = monotonic_msec();
+    ck_assert_int_eq(backend_resolve_name(&cfg, AF_INET, "foo.local", &result),
+                     AVAHI_RESOLVE_RESULT_SUCCESS);
+    ck_assert_uint_lt(monotonic_msec() - start, 100);
+
+    stop_server(&server, thread);
+}
+END_TEST
+
+START_TEST(test_failover_from_wedged_backend) {
+    mdns_config_t cfg;
+    query_address_result_t result;
+    pthread_t thread;
+    server_t server;
+    int wedged;
+    uint64_t start;
+
+    config_with_backends(&cfg, 2);
+    // Accepts connections but never answers.
+    wedged = listen_on(cfg.backends[0].path);
+    start_server(&server, cfg.backends[1].path, &thread);
+
+    start = monotonic_msec();
+    ck_assert_int_eq(backend_resolve_name(&cfg, AF_INET, "foo.local", &result),
+                     AVAHI_RESOLVE_RESULT_SUCCESS);
+    ck_assert_uint_ge(monotonic_msec() - start, 150);
+
+    // Skipped while it is marked down.
+    start = monotonic_msec();
+    ck_assert_int_eq(backend_resolve_name(&cfg, AF_INET, "foo.local", &result),
+                     AVAHI_RESOLVE_RESULT_SUCCESS);
+    ck_assert_uint_lt(monotonic_msec() - start, 100);
+
+    stop_server(&server, thread);
+    close(wedged);
+}
+END_TEST
+
+START_TEST(test_down_backends_are_last_resort) {
+    mdns_config_t cfg;
+    query_address_result_t result;
+    pthread_t thread;
+    server_t server;
+
+    config_with_backends(&cfg, 1);
+    ck_assert_int_eq(backend_resolve_name(&cfg, AF_INET, "foo.local", &result),
+                     AVAHI_RESOLVE_RESULT_UNAVAIL);
+
+    // The only backend is still tried although it was marked down.
+    start_server(&server, cfg.backends[0].path, &thread);
+    ck_assert_int_eq(backend_resolve_name(&cfg, AF_INET, "foo.local", &result),
+                     AVAHI_RESOLVE_RESULT_SUCCESS);
+
+    stop_server(&server, thread);
+}
+END_TEST
+
+START_TEST(test_adaptive_timeout) {
+    mdns_config_t cfg;
+    query_address_result_t result;
+    pthread_t thread;
+    server_t server;
+    uint64_t start, elapsed;
+
+    config_with_backends(&cfg, 1);
+    cfg.backend_timeout = 2000;
+    start_server(&server, cfg.backends[0].path, &thread);
+
+    // Fast answers and not-found replies bring the timeout down to its
+    // lower bound. The upper bounds below only need to stay clear of the
+    // configured timeout, so leave plenty of room for a busy machine.
+    for (int i = 0; i < 10; i++) {
+        ck_assert_int_eq(
+            backend_resolve_name(&cfg, AF_INET, "foo.local", &result),
+            AVAHI_RESOLVE_RESULT_SUCCESS);
+        ck_assert_int_eq(
+            backend_resolve_name(&cfg, AF_INET, "bar.local", &result),
+            AVAHI_RESOLVE_RESULT_HOST_NOT_FOUND);
+    }
+
+    set_hang(&server, 1);
+    start = monotonic_msec();
+    ck_assert_int_eq(backend_resolve_name(&cfg, AF_INET, "foo.local", &result),
+                     AVAHI_RESOLVE_RESULT_UNAVAIL);
+    elapsed = monotonic_msec() - start;
+    ck_assert_uint_ge(elapsed, 50);
+    ck_assert_uint_lt(elapsed, 1000);
+
+    // Doubled after a timeout.
+    start = monotonic_msec();
+    ck_assert_int_eq(backend_resolve_name(&cfg, AF_INET, "foo.local", &result),
+                     AVAHI_RESOLVE_RESULT_UNAVAIL);
+    elapsed = monotonic_msec() - start;
+    ck_assert_uint_ge(elapsed, 100);
+    ck_assert_uint_lt(elapsed, 1000);
+
+    // Other kinds of queries have estimates of their own.
+    start = monotonic_msec();
+    ck_assert_int_eq(backend_resolve_name(&cfg, AF_INET6, "foo.local", &result),
+                     AVAHI_RESOLVE_RESULT_UNAVAIL);
+    ck_assert_uint_ge(monotonic_msec() - start, 2000);
+
+    set_hang(&server, 0);
+    stop_server(&server, thread);
+}
+END_TEST
+
+START_TEST(test_lookup_time_budget) {
+    mdns_config_t cfg;
+    query_address_result_t result;
+    int wedged[3];
+    uint64_t start;
+
+    config_with_backends(&cfg, 3);
+    cfg.timeout = 300;
+    for (int i = 0; i < 3; i++)
+        wedged[i] = listen_on(cfg.backends[i].path);
+
+    start = monotonic_msec();
+    ck_assert_int_eq(backend_resolve_name(&cfg, AF_INET, "foo.local", &result),
+                     AVAHI_RESOLVE_RESULT_UNAVAIL);
+    ck_assert_uint_lt(monotonic_msec() - start, 450);
+
+    for (int i = 0; i < 3; i++)
+        close(wedged[i]);
+}
+END_TEST
+
+// A lookup made in a thread of its own, to take up an admission slot.
+typedef struct {
+    mdns_config_t cfg;
+    avahi_resolve_result_t ret;
+} background_lookup_t;
+
+static void* lookup_thread(void* arg) {
+    background_lookup_t* l = arg;
+    query_address_result_t result;
+
+    l->ret = backend_resolve_name(&l->cfg, AF_INET, "foo.local", &result);
+    return NULL;
+}
+
+// Starts a lookup that holds the only slot for about backend_timeout
+// milliseconds, as the server does not answer it. Returns once the server
+// has its request, so the slot is taken.
+static void start_slow_lookup(background_lookup_t* l, server_t* server,
+                              pthread_t* thread) {
+    unsigned requests;
+
+    pthread_mutex_lock(&server->mutex);
+    server->hang = 1;
+    requests = server->requests;
+    pthread_mutex_unlock(&server->mutex);
+
+    ck_assert_int_eq(pthread_create(thread, NULL, lookup_thread, l), 0);
+
+    pthread_mutex_lock(&server->mutex);
+    while (server->requests == requests)
+        pthread_cond_wait(&server->cond, &server->mutex);
+    pthread_mutex_unlock(&server->mutex);
+}
+
+START_TEST(test_admission_waits_for_slot) {
+    background_lookup_t slow;
+    query_address_result_t result;
+    pthread_t thread, lookup;
+    server_t server;
+    uint64_t start;
+
+    config_with_backends(&slow.cfg, 1);
+    slow.cfg.max_concurrent = 1;
+    slow.cfg.backend_timeout = slow.cfg.backend_timeout_min = 300;
+    start_server(&server, slow.cfg.backends[0].path, &thread);
+    start_slow_lookup(&slow, &server, &lookup);
+
+    // Answered once the slow lookup has given up.
+    set_hang(&server, 0);
+    start = monotonic_msec();
+    ck_assert_int_eq(
+        backend_resolve_name(&slow.cfg, AF_INET, "foo.local", &result),
+        AVAHI_RESOLVE_RESULT_SUCCESS);
+    ck_assert_uint_ge(monotonic_msec() - start, 200);
+
+    pthread_join(lookup, NULL);
+    ck_assert_int_eq(slow.ret, AVAHI_RESOLVE_RESULT_UNAVAIL);
+    stop_server(&server, thread);
+}
+END_TEST
+
+START_TEST(test_admission_wait_is_bounded_by_deadline) {
+    background_lookup_t slow;
+    mdns_config_t cfg;
+    query_address_result_t result;
+    pthread_t thread, lookup;
+    server_t server;
+    uint64_t start, elapsed;
+
+    config_with_backends(&slow.cfg, 1);
+    slow.cfg.max_concurrent = 1;
+    slow.cfg.backend_timeout = slow.cfg.backend_timeout_min = 1500;
+    start_server(&server, slow.cfg.backends[0].path, &thread);
+    start_slow_lookup(&slow, &server, &lookup);
+
+    // Gives up long before the slot is free.
+    cfg = slow.cfg;
+    cfg.timeout = 150;
+    start = monotonic_msec();
+    ck_assert_int_eq(backend_resolve_name(&cfg, AF_INET, "foo.local", &result),
+                     AVAHI_RESOLVE_RESULT_UNAVAIL);
+    elapsed = monotonic_msec() - start;
+    ck_assert_uint_ge(elapsed, 140);
+    ck_assert_uint_lt(elapsed, 1000);
+
+    pthread_join(lookup, NULL);
+    set_hang(&server, 0);
+    stop_server(&server, thread);
+}
+END_TEST
+
+START_TEST(test_admission_rejects_when_queue_full) {
+    background_lookup_t slow;
+    query_address_result_t result;
+    pthread_t thread, lookup;
+    server_t server;
+    uint64_t start;
+
+    config_with_backends(&slow.cfg, 1);
+    slow.cfg.max_concurrent = 1;
+    slow.cfg.max_queued = 0;
+    slow.cfg.backend_timeout = slow.cfg.backend_timeout_min = 1500;
+    start_server(&server, slow.cfg.backends[0].path, &thread);
+    start_slow_lookup(&slow, &server, &lookup);
+
+    // Turned away without waiting for the slot.
+    start = monotonic_msec();
+    ck_assert_int_eq(
+        backend_resolve_name(&slow.cfg, AF_INET, "foo.local", &result),
+        AVAHI_RESOLVE_RESULT_UNAVAIL);
+    ck_assert_uint_lt(monotonic_msec() - start, 1000);
+
+    pthread_join(lookup, NULL);
+    set_hang(&server, 0);
+    stop_server(&server, thread);
+}
+END_TEST
+
+static Suite* backend_suite(void) {
+    Suite* s = suite_create("backend");
+
+    TCase* tc_failover = tcase_create("failover");
+    tcase_add_checked_fixture(tc_failover, setup, teardown);
+    tcase_add_test(tc_failover, test_failover_to_second_backend);
+    tcase_add_test(tc_failover, test_failover_from_wedged_backend);
+    tcase_add_test(tc_failover, test_down_backends_are_last_resort);
+    tcase_add_test(tc_failover, test_lookup_time_budget);
+    tcase_add_test(tc_failover, test_adaptive_timeout);
+    suite_add_tcase(s, tc_failover);
+
+    TCase* tc_admission = tcase_create("admission");
+    tcase_add_checked_fixture(tc_admission, setup, teardown);
+    tcase_add_test(tc_admission, test_admission_waits_for_slot);
+    tcase_add_test(tc_admission, test_admission_wait_is_bounded_by_deadline);
+    tcase_add_test(tc_admission, test_admission_rejects_when_queue_full);
+    suite_add_tcase(s, tc_admission);
+
+    return s;
+}
+
+int main(void) {
+    int number_failed;
+    Suite* s;
+    SRunner* sr;
+
+    s = backend_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_VERBOSE);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,426 @@
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#define _GNU_SOURCE
+
+#include <check.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <linux/rtnetlink.h>
+#include "../src/cache.h"
+
+static query_address_result_t ipv4_result(const char* address,
+                                          uint32_t scopeid) {
+    query_address_result_t r;
+
+    memset(&r, 0, sizeof(r));
+    r.af = AF_INET;
+    r.scopeid = scopeid;
+    inet_pton(AF_INET, address, &r.address);
+    return r;
+}
+
+static int cached(int af, const char* name) {
+    avahi_resolve_result_t status;
+    query_address_result_t result;
+
+    return cache_lookup(af, name, &status, &result);
+}
+
+START_TEST(test_store_and_lookup) {
+    query_address_result_t r = ipv4_result("192.0.2.7", 2), out;
+    avahi_resolve_result_t status;
+
+    cache_flush();
+    ck_assert(!cached(AF_INET, "foo.local"));
+
+    cache_store(AF_INET, "foo.local", AVAHI_RESOLVE_RESULT_SUCCESS, &r, 1000);
+    cache_store(AF_INET6, "foo.local", AVAHI_RESOLVE_RESULT_HOST_NOT_FOUND,
+                NULL, 1000);
+    cache_store(AF_INET, "bar.local", AVAHI_RESOLVE_RESULT_UNAVAIL, NULL,
+                1000);
+    cache_store(AF_INET, "baz.local", AVAHI_RESOLVE_RESULT_SUCCESS, &r, 0);
+
+    ck_assert(cache_lookup(AF_INET, "FOO.local", &status, &out));
+    ck_assert_int_eq(status, AVAHI_RESOLVE_RESULT_SUCCESS);
+    ck_assert_mem_eq(&out, &r, sizeof(r));
+
+    ck_assert(cache_lookup(AF_INET6, "foo.local", &status, &out));
+    ck_assert_int_eq(status, AVAHI_RESOLVE_RESULT_HOST_NOT_FOUND);
+
+    // Failures and zero TTLs are not cached.
+    ck_assert(!cached(AF_INET, "bar.local"));
+    ck_assert(!cached(AF_INET, "baz.local"));
+}
+END_TEST
+
+START_TEST(test_expiry) {
+    query_address_result_t r = ipv4_result("192.0.2.7", 2);
+
+    cache_flush();
+    cache_store(AF_INET, "foo.local", AVAHI_RESOLVE_RESULT_SUCCESS, &r, 50);
+    ck_assert(cached(AF_INET, "foo.local"));
+    usleep(80000);
+    ck_assert(!cached(AF_INET, "foo.local"));
+}
+END_TEST
+
+START_TEST(test_eviction) {
+    query_address_result_t r = ipv4_result("192.0.2.7", 2);
+    char name[32];
+    int hits = 0;
+
+    cache_flush();
+    for (int i = 0; i < CACHE_SIZE * 2; i++) {
+        snprintf(name, sizeof(name), "host%d.local", i);
+        cache_store(AF_INET, name, AVAHI_RESOLVE_RESULT_SUCCESS, &r,
+                    10000 + i);
+    }
+
+    for (int i = 0; i < CACHE_SIZE * 2; i++) {
+        snprintf(name, sizeof(name), "host%d.local", i);
+        hits += cached(AF_INET, name);
+    }
+
+    ck_assert_int_gt(hits, 0);
+    ck_assert_int_le(hits, CACHE_SIZE);
+
+    // The most recent entry always survives.
+    snprintf(name, sizeof(name), "host%d.local", CACHE_SIZE * 2 - 1);
+    ck_assert(cached(AF_INET, name));
+}
+END_TEST
+
+static void store_fixture(void) {
+    query_address_result_t a = ipv4_result("192.0.2.7", 2);
+    query_address_result_t b = ipv4_result("198.51.100.7", 3);
+    query_address_result_t c = ipv4_result("169.254.1.1", 3);
+
+    cache_flush();
+    cache_store(AF_INET, "a.local", AVAHI_RESOLVE_RESULT_SUCCESS, &a, 10000);
+    cache_store(AF_INET, "b.local", AVAHI_RESOLVE_RESULT_SUCCESS, &b, 10000);
+    cache_store(AF_INET, "c.local", AVAHI_RESOLVE_RESULT_SUCCESS, &c, 10000);
+    cache_store(AF_INET, "n.local", AVAHI_RESOLVE_RESULT_HOST_NOT_FOUND, NULL,
+                10000);
+}
+
+static netlink_event_t address_event(int type, const char* address,
+                                     int prefixlen, uint32_t ifindex) {
+    netlink_event_t event;
+
+    memset(&event, 0, sizeof(event));
+    event.type = type;
+    event.af = AF_INET;
+    event.ifindex = ifindex;
+    event.prefixlen = prefixlen;
+    inet_pton(AF_INET, address, event.address);
+    return event;
+}
+
+START_TEST(test_invalidate_link) {
+    netlink_event_t event;
+
+    store_fixture();
+    memset(&event, 0, sizeof(event));
+    event.type = RTM_DELLINK;
+    event.ifindex = 3;
+    cache_invalidate(&event);
+
+    ck_assert(cached(AF_INET, "a.local"));
+    ck_assert(!cached(AF_INET, "b.local"));
+    ck_assert(!cached(AF_INET, "c.local"));
+    ck_assert(cached(AF_INET, "n.local"));
+
+    // A link coming up may make unknown names resolvable.
+    event.type = RTM_NEWLINK;
+    event.ifindex = 7;
+    cache_invalidate(&event);
+    ck_assert(cached(AF_INET, "a.local"));
+    ck_assert(!cached(AF_INET, "n.local"));
+}
+END_TEST
+
+START_TEST(test_invalidate_address) {
+    netlink_event_t event;
+
+    // Removing a prefix drops the entries within it.
+    store_fixture();
+    event = address_event(RTM_DELADDR, "192.0.2.1", 24, 2);
+    cache_invalidate(&event);
+    ck_assert(!cached(AF_INET, "a.local"));
+    ck_assert(cached(AF_INET, "b.local"));
+    ck_assert(cached(AF_INET, "c.local"));
+    ck_assert(cached(AF_INET, "n.local"));
+
+    // A refresh of the same prefix on the same interface keeps them.
+    store_fixture();
+    event = address_event(RTM_NEWADDR, "192.0.2.1", 24, 2);
+    cache_invalidate(&event);
+    ck_assert(cached(AF_INET, "a.local"));
+    ck_assert(!cached(AF_INET, "n.local"));
+
+    // The prefix moved to another interface.
+    event = address_event(RTM_NEWADDR, "192.0.2.1", 24, 5);
+    cache_invalidate(&event);
+    ck_assert(!cached(AF_INET, "a.local"));
+
+    // Losing the link-local address of an interface drops the link-local
+    // peers seen there.
+    store_fixture();
+    event = address_event(RTM_DELADDR, "169.254.9.9", 32, 3);
+    cache_invalidate(&event);
+    ck_assert(!cached(AF_INET, "c.local"));
+    ck_assert(cached(AF_INET, "b.local"));
+
+    // Lost events drop everything.
+    store_fixture();
+    memset(&event, 0, sizeof(event));
+    cache_invalidate(&event);
+    ck_assert(!cached(AF_INET, "a.local"));
+    ck_assert(!cached(AF_INET, "b.local"));
+}
+END_TEST
+
+static int cached_address(const char* address, uint32_t scopeid,
+                          char* name) {
+    avahi_resolve_result_t status;
+    uint8_t a[4];
+
+    inet_pton(AF_INET, address, a);
+    if (!cache_lookup_address(AF_INET, a, scopeid, &status, name, 256))
+        return 0;
+    return status == AVAHI_RESOLVE_RESULT_SUCCESS ? 1 : -1;
+}
+
+static void store_address(const char* address, uint32_t scopeid,
+                          const char* name) {
+    uint8_t a[4];
+
+    inet_pton(AF_INET, address, a);
+    cache_store_address(AF_INET, a, scopeid,
+                        name ? AVAHI_RESOLVE_RESULT_SUCCESS
+                             : AVAHI_RESOLVE_RESULT_HOST_NOT_FOUND,
+                        name, 10000);
+}
+
+START_TEST(test_address_store_and_lookup) {
+    avahi_resolve_result_t status;
+    char name[256];
+    uint8_t a[4];
+
+    cache_flush();
+    ck_assert_int_eq(cached_address("192.0.2.7", 0, name), 0);
+
+    store_address("192.0.2.7", 0, "foo.local");
+    store_address("192.0.2.8", 0, NULL);
+    store_address("169.254.1.1", 2, "bar.local");
+    inet_pton(AF_INET, "192.0.2.9", a);
+    cache_store_address(AF_INET, a, 0, AVAHI_RESOLVE_RESULT_UNAVAIL, NULL,
+                        10000);
+
+    ck_assert_int_eq(cached_address("192.0.2.7", 0, name), 1);
+    ck_assert_str_eq(name, "foo.local");
+    ck_assert_int_eq(cached_address("192.0.2.8", 0, name), -1);
+    ck_assert_int_eq(cached_address("192.0.2.9", 0, name), 0);
+
+    // The scope is part of the key.
+    ck_assert_int_eq(cached_address("169.254.1.1", 2, name), 1);
+    ck_assert_str_eq(name, "bar.local");
+    ck_assert_int_eq(cached_address("169.254.1.1", 3, name), 0);
+    ck_assert_int_eq(cached_address("169.254.1.1", 0, name), 0);
+
+    // Names are truncated to the buffer.
+    inet_pton(AF_INET, "192.0.2.7", a);
+    ck_assert(cache_lookup_address(AF_INET, a, 0, &status, name, 4));
+    ck_assert_str_eq(name, "foo");
+}
+END_TEST
+
+START_TEST(test_address_forward_changes) {
+    query_address_result_t r = ipv4_result("192.0.2.7", 2);
+    query_address_result_t moved = ipv4_result("192.0.2.70", 2);
+    char name[256];
+
+    cache_flush();
+    store_address("192.0.2.7", 0, "foo.local");
+    store_address("192.0.2.70", 0, "bar.local");
+    store_address("192.0.2.99", 0, NULL);
+
+    // Agrees with the reverse answers.
+    cache_store(AF_INET, "foo.local", AVAHI_RESOLVE_RESULT_SUCCESS, &r, 10000);
+    ck_assert_int_eq(cached_address("192.0.2.7", 0, name), 1);
+    ck_assert_int_eq(cached_address("192.0.2.70", 0, name), 1);
+
+    // foo.local moved to an address bar.local had.
+    cache_store(AF_INET, "foo.local", AVAHI_RESOLVE_RESULT_SUCCESS, &moved,
+                10000);
+    ck_assert_int_eq(cached_address("192.0.2.7", 0, name), 0);
+    ck_assert_int_eq(cached_address("192.0.2.70", 0, name), 0);
+
+    // An address nobody had now has a name.
+    r = ipv4_result("192.0.2.99", 2);
+    cache_store(AF_INET, "baz.local", AVAHI_RESOLVE_RESULT_SUCCESS, &r, 10000);
+    ck_assert_int_eq(cached_address("192.0.2.99", 0, name), 0);
+
+    // A name that went away.
+    store_address("192.0.2.70", 0, "foo.local");
+    cache_store(AF_INET, "foo.local", AVAHI_RESOLVE_RESULT_HOST_NOT_FOUND,
+                NULL, 10000);
+    ck_assert_int_eq(cached_address("192.0.2.70", 0, name), 0);
+}
+END_TEST
+
+START_TEST(test_address_invalidate) {
+    netlink_event_t event;
+    char name[256];
+
+    cache_flush();
+    store_address("192.0.2.7", 0, "a.local");
+    store_address("169.254.1.1", 0, "c.local");
+    store_address("169.254.1.2", 4, "d.local");
+    store_address("198.51.100.9", 0, NULL);
+
+    // Link-local answers of unknown interfaces may be on any.
+    memset(&event, 0, sizeof(event));
+    event.type = RTM_DELLINK;
+    event.ifindex = 3;
+    cache_invalidate(&event);
+    ck_assert_int_eq(cached_address("192.0.2.7", 0, name), 1);
+    ck_assert_int_eq(cached_address("169.254.1.1", 0, name), 0);
+    ck_assert_int_eq(cached_address("169.254.1.2", 4, name), 1);
+    ck_assert_int_eq(cached_address("198.51.100.9", 0, name), -1);
+
+    event = address_event(RTM_DELADDR, "192.0.2.1", 24, 2);
+    cache_invalidate(&event);
+    ck_assert_int_eq(cached_address("192.0.2.7", 0, name), 0);
+
+    event = address_event(RTM_NEWADDR, "203.0.113.1", 24, 2);
+    cache_invalidate(&event);
+    ck_assert_int_eq(cached_address("198.51.100.9", 0, name), 0);
+    ck_assert_int_eq(cached_address("169.254.1.2", 4, name), 1);
+
+    memset(&event, 0, sizeof(event));
+    cache_invalidate(&event);
+    ck_assert_int_eq(cached_address("169.254.1.2", 4, name), 0);
+}
+END_TEST
+
+// Runs in a network namespace of its own. Returns 77 if that cannot be set
+// up, 0 on success, or the line number of the failed check.
+#define CHECK(x)                                                               \
+    if (!(x))                                                                  \
+        return __LINE__;
+
+static int run_in_namespace(void) {
+    query_address_result_t a, b, c;
+
+    if (unshare(CLONE_NEWNET) < 0 ||
+        system("ip link set lo up &&"
+               " ip link add v0 type veth peer name v1 &&"
+               " ip link set v0 up && ip link set v1 up &&"
+               " ip addr add 192.0.2.1/24 dev v0 &&"
+               " ip addr add 198.51.100.1/24 dev v1") != 0)
+        return 77;
+
+    a = ipv4_result("192.0.2.7", if_nametoindex("v0"));
+    b = ipv4_result("198.51.100.7", if_nametoindex("v1"));
+    c = ipv4_result("203.0.113.7", if_nametoindex("lo"));
+
+    // Start monitoring.
+    CHECK(!cached(AF_INET, "a.local"));
+
+    cache_store(AF_INET, "a.local", AVAHI_RESOLVE_RESULT_SUCCESS, &a, 10000);
+    cache_store(AF_INET, "b.local", AVAHI_RESOLVE_RESULT_SUCCESS, &b, 10000);
+    cache_store(AF_INET, "c.local", AVAHI_RESOLVE_RESULT_SUCCESS, &c, 10000);
+
+    CHECK(system("ip addr del 192.0.2.1/24 dev v0") == 0);
+    CHECK(!cached(AF_INET, "a.local"));
+    CHECK(cached(AF_INET, "b.local"));
+
+    // Takes the carrier of v0 away as well.
+    CHECK(system("ip link set v1 down") == 0);
+    CHECK(!cached(AF_INET, "b.local"));
+
+    // Untouched throughout.
+    CHECK(cached(AF_INET, "c.local"));
+
+    return 0;
+}
+
+START_TEST(test_netlink_namespace) {
+    int status;
+    pid_t pid;
+
+    cache_flush();
+
+    if ((pid = fork()) == 0)
+        _exit(run_in_namespace());
+
+    ck_assert_int_gt(pid, 0);
+    ck_assert_int_eq(waitpid(pid, &status, 0), pid);
+    ck_assert(WIFEXITED(status));
+
+    // Not privileged or no veth support: nothing to test.
+    if (WEXITSTATUS(status) == 77)
+        return;
+
+    ck_assert_int_eq(WEXITSTATUS(status), 0);
+}
+END_TEST
+
+static Suite* cache_suite(void) {
+    Suite* s = suite_create("cache");
+
+    TCase* tc_cache = tcase_create("cache");
+    tcase_add_test(tc_cache, test_store_and_lookup);
+    tcase_add_test(tc_cache, test_expiry);
+    tcase_add_test(tc_cache, test_eviction);
+    tcase_add_test(tc_cache, test_address_store_and_lookup);
+    tcase_add_test(tc_cache, test_address_forward_changes);
+    suite_add_tcase(s, tc_cache);
+
+    TCase* tc_invalidate = tcase_create("invalidate");
+    tcase_add_test(tc_invalidate, test_invalidate_link);
+    tcase_add_test(tc_invalidate, test_invalidate_address);
+    tcase_add_test(tc_invalidate, test_address_invalidate);
+    tcase_add_test(tc_invalidate, test_netlink_namespace);
+    suite_add_tcase(s, tc_invalidate);
+
+    return s;
+}
+
+int main(void) {
+    int number_failed;
+    Suite* s;
+    SRunner* sr;
+
+    s = cache_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_VERBOSE);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
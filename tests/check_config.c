@@ -0,0 +1,213 @@
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#define _DEFAULT_SOURCE
+
+#include <check.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "../src/config.h"
+
+// Parses file_contents on top of the default config.
+static mdns_config_t config_from_string(const char* file_contents) {
+    mdns_config_t cfg;
+    FILE* f = fmemopen((void*)file_contents, strlen(file_contents), "r");
+    ck_assert_ptr_nonnull(f);
+
+    config_init(&cfg);
+    config_parse(f, &cfg);
+    fclose(f);
+    return cfg;
+}
+
+START_TEST(test_config_defaults) {
+    mdns_config_t cfg;
+    config_init(&cfg);
+
+    ck_assert_int_eq(cfg.n_backends, 1);
+    ck_assert_int_eq(cfg.backends[0].type, BACKEND_AVAHI);
+    ck_assert_str_eq(cfg.backends[0].path, "");
+    ck_assert_int_eq(cfg.timeout, MDNS_DEFAULT_TIMEOUT);
+    ck_assert_int_eq(cfg.backend_timeout, MDNS_DEFAULT_BACKEND_TIMEOUT);
+    ck_assert_int_eq(cfg.multicast_fallback, 0);
+    ck_assert_int_eq(cfg.multicast_timeout, MDNS_DEFAULT_MULTICAST_TIMEOUT);
+    ck_assert_int_eq(cfg.max_concurrent, MDNS_DEFAULT_MAX_CONCURRENT);
+    ck_assert_int_eq(cfg.max_queued, MDNS_DEFAULT_MAX_QUEUED);
+    // Skipping families is opt-in.
+    ck_assert_int_eq(cfg.family_miss_threshold, 0);
+}
+END_TEST
+
+START_TEST(test_config_parses_directives) {
+    mdns_config_t cfg = config_from_string("# /etc/nss-mdns.conf\n"
+                                           "backend multicast\n"
+                                           "  multicast-fallback yes  \n"
+                                           "multicast-timeout 500 # ms\n"
+                                           "max-concurrent 0\n"
+                                           "max-queued 10\n"
+                                           "family-miss-threshold 3\n");
+
+    ck_assert_int_eq(cfg.n_backends, 1);
+    ck_assert_int_eq(cfg.backends[0].type, BACKEND_MULTICAST);
+    ck_assert_int_eq(cfg.multicast_fallback, 1);
+    ck_assert_int_eq(cfg.multicast_timeout, 500);
+    ck_assert_int_eq(cfg.max_concurrent, 0);
+    ck_assert_int_eq(cfg.max_queued, 10);
+    ck_assert_int_eq(cfg.family_miss_threshold, 3);
+}
+END_TEST
+
+START_TEST(test_config_ignores_invalid_lines) {
+    mdns_config_t cfg = config_from_string("backend carrier-pigeon\n"
+                                           "multicast-fallback maybe\n"
+                                           "multicast-timeout -5\n"
+                                           "multicast-timeout 12abc\n"
+                                           "no-such-directive 1\n"
+                                           "\n"
+                                           "backend\n"
+                                           "backend multicast /some/path\n");
+
+    ck_assert_int_eq(cfg.n_backends, 1);
+    ck_assert_int_eq(cfg.backends[0].type, BACKEND_AVAHI);
+    ck_assert_int_eq(cfg.multicast_fallback, 0);
+    ck_assert_int_eq(cfg.multicast_timeout, MDNS_DEFAULT_MULTICAST_TIMEOUT);
+}
+END_TEST
+
+START_TEST(test_config_parses_backend_path) {
+    mdns_config_t cfg =
+        config_from_string("backend resolved /run/test/io.systemd.Resolve\n");
+
+    ck_assert_int_eq(cfg.n_backends, 1);
+    ck_assert_int_eq(cfg.backends[0].type, BACKEND_RESOLVED);
+    ck_assert_str_eq(cfg.backends[0].path, "/run/test/io.systemd.Resolve");
+}
+END_TEST
+
+START_TEST(test_config_parses_backend_list) {
+    mdns_config_t cfg = config_from_string("backend avahi /host/avahi/socket\n"
+                                           "backend avahi\n"
+                                           "backend resolved\n"
+                                           "timeout 3000\n"
+                                           "backend-timeout 1000\n"
+                                           "backend-timeout-min 200\n");
+
+    ck_assert_int_eq(cfg.n_backends, 3);
+    ck_assert_int_eq(cfg.backends[0].type, BACKEND_AVAHI);
+    ck_assert_str_eq(cfg.backends[0].path, "/host/avahi/socket");
+    ck_assert_int_eq(cfg.backends[1].type, BACKEND_AVAHI);
+    ck_assert_str_eq(cfg.backends[1].path, "");
+    ck_assert_int_eq(cfg.backends[2].type, BACKEND_RESOLVED);
+    ck_assert_int_eq(cfg.timeout, 3000);
+    ck_assert_int_eq(cfg.backend_timeout, 1000);
+    ck_assert_int_eq(cfg.backend_timeout_min, 200);
+}
+END_TEST
+
+START_TEST(test_config_parses_sort_addresses) {
+    mdns_config_t cfg = config_from_string("sort-addresses ipv6\n");
+
+    ck_assert_uint_eq(cfg.sort_addresses, MDNS_SORT_IPV6);
+
+    cfg = config_from_string("sort-addresses IPv4 ipv6\n");
+    ck_assert_uint_eq(cfg.sort_addresses, MDNS_SORT_IPV4 | MDNS_SORT_IPV6);
+
+    cfg = config_from_string("sort-addresses ipv4\n"
+                             "sort-addresses ipv5\n");
+    ck_assert_uint_eq(cfg.sort_addresses, MDNS_SORT_IPV4);
+
+    cfg = config_from_string("sort-addresses ipv4\n"
+                             "sort-addresses no\n");
+    ck_assert_uint_eq(cfg.sort_addresses, 0);
+}
+END_TEST
+
+static void write_file(const char* path, const char* contents) {
+    FILE* f = fopen(path, "w");
+
+    ck_assert_ptr_nonnull(f);
+    fputs(contents, f);
+    fclose(f);
+}
+
+START_TEST(test_config_get_shares_snapshots) {
+    char path[] = "/tmp/nss-mdns-config-XXXXXX";
+    const mdns_config_t *a, *b, *c;
+    int fd = mkstemp(path);
+
+    ck_assert_int_ge(fd, 0);
+    close(fd);
+    write_file(path, "timeout 1234\n");
+    setenv("NSS_MDNS_CONFIG", path, 1);
+
+    a = config_get();
+    b = config_get();
+    ck_assert_ptr_eq(a, b);
+    ck_assert_int_eq(a->timeout, 1234);
+    config_put(b);
+
+    // Lookups still using the old settings keep them across a reload.
+    write_file(path, "timeout 98765\n");
+    usleep(1100 * 1000);
+    c = config_get();
+    ck_assert_ptr_ne(a, c);
+    ck_assert_int_eq(c->timeout, 98765);
+    ck_assert_int_eq(a->timeout, 1234);
+    config_put(a);
+    config_put(c);
+
+    unsetenv("NSS_MDNS_CONFIG");
+    unlink(path);
+}
+END_TEST
+
+static Suite* config_suite(void) {
+    Suite* s = suite_create("config");
+
+    TCase* tc_parse = tcase_create("parse");
+    tcase_add_test(tc_parse, test_config_defaults);
+    tcase_add_test(tc_parse, test_config_parses_directives);
+    tcase_add_test(tc_parse, test_config_ignores_invalid_lines);
+    tcase_add_test(tc_parse, test_config_parses_backend_path);
+    tcase_add_test(tc_parse, test_config_parses_backend_list);
+    tcase_add_test(tc_parse, test_config_parses_sort_addresses);
+    suite_add_tcase(s, tc_parse);
+
+    TCase* tc_get = tcase_create("get");
+    tcase_add_test(tc_get, test_config_get_shares_snapshots);
+    suite_add_tcase(s, tc_get);
+
+    return s;
+}
+
+int main(void) {
+    int number_failed;
+    Suite* s;
+    SRunner* sr;
+
+    s = config_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_VERBOSE);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,200 @@
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#define _GNU_SOURCE
+
+#include <check.h>
+#include <arpa/inet.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../src/hostname.h"
+#include "../src/ifstate.h"
+
+START_TEST(test_mdns_name) {
+    char name[256];
+
+    ck_assert_int_eq(hostname_mdns_name("foo", name, sizeof(name)), 0);
+    ck_assert_str_eq(name, "foo.local");
+    ck_assert_int_eq(hostname_mdns_name("foo.example.com", name, sizeof(name)),
+                     0);
+    ck_assert_str_eq(name, "foo.local");
+
+    ck_assert_int_eq(hostname_mdns_name("", name, sizeof(name)), -1);
+    ck_assert_int_eq(hostname_mdns_name("localhost", name, sizeof(name)), -1);
+    ck_assert_int_eq(hostname_mdns_name("foo", name, 9), -1);
+}
+END_TEST
+
+START_TEST(test_conflict_form) {
+    ck_assert(hostname_is_conflict_form("foo.local", "foo.local"));
+    ck_assert(hostname_is_conflict_form("foo.local", "FOO.local."));
+    ck_assert(hostname_is_conflict_form("foo.local", "foo-2.local"));
+    ck_assert(hostname_is_conflict_form("foo.local", "foo-13.local"));
+
+    ck_assert(!hostname_is_conflict_form("foo.local", "foo-1.local"));
+    ck_assert(!hostname_is_conflict_form("foo.local", "foo-02.local"));
+    ck_assert(!hostname_is_conflict_form("foo.local", "foo-.local"));
+    ck_assert(!hostname_is_conflict_form("foo.local", "foo-2x.local"));
+    ck_assert(!hostname_is_conflict_form("foo.local", "foobar.local"));
+    ck_assert(!hostname_is_conflict_form("foo.local", "foo-2.example"));
+}
+END_TEST
+
+START_TEST(test_is_self) {
+    char host[256], name[256], renamed[300];
+    struct in_addr loopback;
+
+    ck_assert_int_eq(gethostname(host, sizeof(host)), 0);
+    if (hostname_mdns_name(host, name, sizeof(name)) < 0)
+        return;
+
+    ck_assert(hostname_is_self(name));
+    ck_assert(!hostname_is_self("some-other-host.local"));
+
+    // Answers for addresses that are not ours teach nothing.
+    snprintf(renamed, sizeof(renamed), "%.*s-2.local",
+             (int)strcspn(host, "."), host);
+    inet_pton(AF_INET, "192.0.2.1", &loopback);
+    hostname_observe(renamed, AF_INET, &loopback);
+    ck_assert(hostname_is_self(name));
+
+    // Learn the renamed form from an answer with a local address.
+    inet_pton(AF_INET, "127.0.0.1", &loopback);
+    hostname_observe(renamed, AF_INET, &loopback);
+    ck_assert(hostname_is_self(renamed));
+    ck_assert(!hostname_is_self(name));
+
+    // And back.
+    hostname_observe(name, AF_INET, &loopback);
+    ck_assert(hostname_is_self(name));
+    ck_assert(!hostname_is_self(renamed));
+}
+END_TEST
+
+START_TEST(test_local_addresses) {
+    query_address_result_t result[IFSTATE_MAX_ADDRESSES];
+    struct in_addr a;
+    int n;
+
+    inet_pton(AF_INET, "127.0.0.1", &a);
+    ck_assert(ifstate_is_local_address(AF_INET, &a));
+    inet_pton(AF_INET, "192.0.2.1", &a);
+    ck_assert(!ifstate_is_local_address(AF_INET, &a));
+
+    // Loopback addresses are never announced.
+    n = ifstate_usable_addresses(AF_UNSPEC, result, IFSTATE_MAX_ADDRESSES);
+    for (int i = 0; i < n; i++) {
+        ck_assert(result[i].af == AF_INET || result[i].af == AF_INET6);
+        ck_assert_int_ne(result[i].scopeid, 0);
+        if (result[i].af == AF_INET)
+            ck_assert_uint_ne(result[i].address.ipv4.address,
+                              htonl(INADDR_LOOPBACK));
+        // IPv4 first.
+        if (i > 0)
+            ck_assert_int_le(result[i - 1].af == AF_INET6, result[i].af == AF_INET6);
+    }
+}
+END_TEST
+
+// Runs in a network namespace of its own. Returns 77 if that cannot be set
+// up, 0 on success, or the line number of the failed check.
+#define CHECK(x)                                                               \
+    if (!(x))                                                                  \
+        return __LINE__;
+
+static int run_in_namespace(void) {
+    if (unshare(CLONE_NEWNET) < 0 || system("ip link set lo up") != 0)
+        return 77;
+
+    // Loopback addresses do not count.
+    CHECK(!ifstate_has_family(AF_INET));
+    CHECK(!ifstate_has_family(AF_INET6));
+
+    if (system("ip link add v0 type veth peer name v1 &&"
+               " ip link set v0 up &&"
+               " ip addr add 192.0.2.1/24 dev v0") != 0)
+        return 77;
+
+    CHECK(ifstate_has_family(AF_INET));
+    CHECK(!ifstate_has_family(AF_INET6));
+
+    // Link-local addresses are enough for mDNS.
+    CHECK(system("ip addr add fe80::1/64 dev v0") == 0);
+    CHECK(ifstate_has_family(AF_INET6));
+
+    CHECK(system("ip link set v0 down") == 0);
+    CHECK(!ifstate_has_family(AF_INET));
+    CHECK(!ifstate_has_family(AF_INET6));
+
+    return 0;
+}
+
+START_TEST(test_has_family) {
+    int status;
+    pid_t pid;
+
+    if ((pid = fork()) == 0)
+        _exit(run_in_namespace());
+
+    ck_assert_int_gt(pid, 0);
+    ck_assert_int_eq(waitpid(pid, &status, 0), pid);
+    ck_assert(WIFEXITED(status));
+
+    // Not privileged or no veth support: nothing to test.
+    if (WEXITSTATUS(status) == 77)
+        return;
+
+    ck_assert_int_eq(WEXITSTATUS(status), 0);
+}
+END_TEST
+
+static Suite* hostname_suite(void) {
+    Suite* s = suite_create("hostname");
+
+    TCase* tc_names = tcase_create("names");
+    tcase_add_test(tc_names, test_mdns_name);
+    tcase_add_test(tc_names, test_conflict_form);
+    suite_add_tcase(s, tc_names);
+
+    TCase* tc_local = tcase_create("local");
+    tcase_add_test(tc_local, test_is_self);
+    tcase_add_test(tc_local, test_local_addresses);
+    tcase_add_test(tc_local, test_has_family);
+    suite_add_tcase(s, tc_local);
+
+    return s;
+}
+
+int main(void) {
+    int number_failed;
+    Suite* s;
+    SRunner* sr;
+
+    s = hostname_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_VERBOSE);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,187 @@
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#include <check.h>
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include "../src/hosts.h"
+
+static void parse(hosts_table_t* table, const char* text, const char* allow) {
+    FILE* f = fmemopen((void*)text, strlen(text), "r");
+    FILE* a = allow ? fmemopen((void*)allow, strlen(allow), "r") : NULL;
+
+    hosts_table_init(table);
+    hosts_parse(f, a, table);
+    fclose(f);
+    if (a)
+        fclose(a);
+}
+
+static int reverse(const hosts_table_t* table, const char* address,
+                   char* name) {
+    uint8_t a[16];
+    int af = strchr(address, ':') ? AF_INET6 : AF_INET;
+
+    ck_assert_int_eq(inet_pton(af, address, a), 1);
+    return hosts_table_lookup_address(table, af, a, name, 256);
+}
+
+START_TEST(test_forward) {
+    static const char text[] =
+        "# lab\n"
+        "192.0.2.20   scope.local   scope-alias.local # comment\n"
+        "fe80::20%1   scope.local\n"
+        "\n"
+        "192.0.2.21\tpsu.local.\n"
+        "192.0.2.22   SCOPE.local\n";
+    hosts_table_t table;
+    query_address_result_t r[4];
+
+    parse(&table, text, NULL);
+    ck_assert_int_eq(table.n_entries, 5);
+
+    ck_assert_int_eq(hosts_table_lookup_name(&table, AF_UNSPEC, "scope.local",
+                                             r, 4),
+                     3);
+    ck_assert_int_eq(r[0].af, AF_INET);
+    ck_assert_uint_eq(r[0].address.ipv4.address, inet_addr("192.0.2.20"));
+    ck_assert_int_eq(r[1].af, AF_INET6);
+    ck_assert_int_eq(r[1].scopeid, 1);
+    ck_assert_uint_eq(r[2].address.ipv4.address, inet_addr("192.0.2.22"));
+
+    ck_assert_int_eq(
+        hosts_table_lookup_name(&table, AF_INET6, "Scope.Local.", r, 4), 1);
+    ck_assert_int_eq(
+        hosts_table_lookup_name(&table, AF_INET, "scope.local", r, 1), 1);
+    ck_assert_int_eq(
+        hosts_table_lookup_name(&table, AF_INET, "scope-alias.local", r, 4),
+        1);
+    ck_assert_int_eq(
+        hosts_table_lookup_name(&table, AF_INET, "psu.local", r, 4), 1);
+    ck_assert_int_eq(
+        hosts_table_lookup_name(&table, AF_INET6, "psu.local", r, 4), 0);
+    ck_assert_int_eq(
+        hosts_table_lookup_name(&table, AF_UNSPEC, "other.local", r, 4), 0);
+}
+END_TEST
+
+START_TEST(test_reverse) {
+    static const char text[] = "192.0.2.20 scope.local scope-alias.local\n"
+                               "192.0.2.20 other.local\n"
+                               "fe80::20 scope.local\n";
+    hosts_table_t table;
+    char name[256];
+
+    parse(&table, text, NULL);
+
+    // The first name of the first line of an address.
+    ck_assert(reverse(&table, "192.0.2.20", name));
+    ck_assert_str_eq(name, "scope.local");
+    ck_assert(reverse(&table, "fe80::20", name));
+    ck_assert_str_eq(name, "scope.local");
+    ck_assert(!reverse(&table, "192.0.2.21", name));
+    ck_assert(!reverse(&table, "::ffff:192.0.2.20", name));
+}
+END_TEST
+
+START_TEST(test_allowed_names) {
+    static const char text[] = "192.0.2.1 router.lan router.local\n"
+                               "192.0.2.2 a.b.local\n"
+                               "192.0.2.3 printer.lab\n"
+                               "bogus nas.local\n"
+                               "192.0.2.4%1 nas.local\n";
+    hosts_table_t table;
+    query_address_result_t r[4];
+    char name[256];
+
+    // Without an allow file, only names directly in .local.
+    parse(&table, text, NULL);
+    ck_assert_int_eq(table.n_entries, 1);
+    ck_assert_int_eq(
+        hosts_table_lookup_name(&table, AF_INET, "router.local", r, 4), 1);
+    // The first allowed name is the canonical one.
+    ck_assert(reverse(&table, "192.0.2.1", name));
+    ck_assert_str_eq(name, "router.local");
+
+    parse(&table, text, "lab\nlocal\n");
+    ck_assert_int_eq(table.n_entries, 3);
+    ck_assert_int_eq(
+        hosts_table_lookup_name(&table, AF_INET, "printer.lab", r, 4), 1);
+    ck_assert_int_eq(
+        hosts_table_lookup_name(&table, AF_INET, "a.b.local", r, 4), 1);
+    ck_assert_int_eq(
+        hosts_table_lookup_name(&table, AF_INET, "router.lan", r, 4), 0);
+}
+END_TEST
+
+START_TEST(test_full) {
+    hosts_table_t table;
+    query_address_result_t r[1];
+    char* text = malloc(HOSTS_MAX_ENTRIES * 2 * 40);
+    char name[32];
+    size_t used = 0;
+
+    for (int i = 0; i < HOSTS_MAX_ENTRIES * 2; i++)
+        used += sprintf(text + used, "10.0.%d.%d host%d.local\n", i / 256,
+                        i % 256, i);
+
+    parse(&table, text, NULL);
+    ck_assert_int_eq(table.n_entries, HOSTS_MAX_ENTRIES);
+
+    for (int i = 0; i < HOSTS_MAX_ENTRIES; i++) {
+        snprintf(name, sizeof(name), "host%d.local", i);
+        ck_assert_int_eq(hosts_table_lookup_name(&table, AF_INET, name, r, 1),
+                         1);
+    }
+    ck_assert_int_eq(
+        hosts_table_lookup_name(&table, AF_INET, "host300.local", r, 1), 0);
+
+    free(text);
+}
+END_TEST
+
+static Suite* hosts_suite(void) {
+    Suite* s = suite_create("hosts");
+
+    TCase* tc_hosts = tcase_create("hosts");
+    tcase_add_test(tc_hosts, test_forward);
+    tcase_add_test(tc_hosts, test_reverse);
+    tcase_add_test(tc_hosts, test_allowed_names);
+    tcase_add_test(tc_hosts, test_full);
+    suite_add_tcase(s, tc_hosts);
+
+    return s;
+}
+
+int main(void) {
+    int number_failed;
+    Suite* s;
+    SRunner* sr;
+
+    s = hosts_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_VERBOSE);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
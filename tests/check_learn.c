@@ -0,0 +1,160 @@
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#include <check.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "../src/learn.h"
+#include "../src/stats.h"
+
+#define THRESHOLD 3
+#define INTERVAL 100
+
+static void miss(const char* name, int times) {
+    for (int i = 0; i < times; i++)
+        learn_report(name, AF_INET6, 0, THRESHOLD, INTERVAL);
+}
+
+START_TEST(test_learn_missing_family) {
+    learn_reset();
+
+    miss("a.foo.local", THRESHOLD - 1);
+    ck_assert(!learn_is_missing("b.foo.local", AF_INET6, THRESHOLD));
+    ck_assert(learn_should_query("b.foo.local", AF_INET6, THRESHOLD, INTERVAL));
+
+    // Any host in the same domain counts.
+    miss("c.FOO.local.", 1);
+    ck_assert(learn_is_missing("b.foo.local", AF_INET6, THRESHOLD));
+    ck_assert(!learn_is_missing("b.foo.local", AF_INET, THRESHOLD));
+    ck_assert(!learn_should_query("b.foo.local", AF_INET6, THRESHOLD, INTERVAL));
+    ck_assert(learn_should_query("b.foo.local", AF_INET, THRESHOLD, INTERVAL));
+
+    // Other domains are not affected.
+    ck_assert(!learn_is_missing("a.bar.local", AF_INET6, THRESHOLD));
+    ck_assert(learn_should_query("a.bar.local", AF_INET6, THRESHOLD, INTERVAL));
+
+    // Disabled.
+    ck_assert(!learn_is_missing("b.foo.local", AF_INET6, 0));
+    ck_assert(learn_should_query("b.foo.local", AF_INET6, 0, INTERVAL));
+}
+END_TEST
+
+START_TEST(test_learn_probes) {
+    learn_reset();
+    miss("a.foo.local", THRESHOLD);
+    ck_assert(!learn_should_query("a.foo.local", AF_INET6, THRESHOLD, INTERVAL));
+
+    // Asked again after the interval, then after twice that.
+    usleep((INTERVAL + 20) * 1000);
+    ck_assert(learn_should_query("a.foo.local", AF_INET6, THRESHOLD, INTERVAL));
+    miss("a.foo.local", 1);
+    usleep((INTERVAL + 20) * 1000);
+    ck_assert(!learn_should_query("a.foo.local", AF_INET6, THRESHOLD, INTERVAL));
+    usleep(INTERVAL * 1000);
+    ck_assert(learn_should_query("a.foo.local", AF_INET6, THRESHOLD, INTERVAL));
+
+    // A host with the family starts over.
+    learn_report("b.foo.local", AF_INET6, 1, THRESHOLD, INTERVAL);
+    ck_assert(!learn_is_missing("a.foo.local", AF_INET6, THRESHOLD));
+    ck_assert(learn_should_query("a.foo.local", AF_INET6, THRESHOLD, INTERVAL));
+}
+END_TEST
+
+static stats_shard_t totals(void) {
+    const stats_segment_t* s = stats_attach(getpid());
+    stats_shard_t total;
+
+    ck_assert_ptr_nonnull(s);
+    stats_sum(s, &total);
+    stats_detach(s);
+    return total;
+}
+
+START_TEST(test_learn_stats) {
+    stats_shard_t before, total;
+    char name[64];
+
+    stats_export();
+    learn_reset();
+    before = totals();
+    ck_assert_int_eq(before.gauges[STATS_GAUGE_MISSING_IPV6], 0);
+
+    miss("a.foo.local", THRESHOLD);
+    learn_should_query("a.foo.local", AF_INET6, THRESHOLD, INTERVAL);
+    learn_should_query("a.foo.local", AF_INET6, THRESHOLD, INTERVAL);
+    miss("a.bar.local", THRESHOLD);
+
+    total = totals();
+    ck_assert_int_eq(total.gauges[STATS_GAUGE_MISSING_IPV6], 2);
+    ck_assert_int_eq(total.gauges[STATS_GAUGE_MISSING_IPV4], 0);
+    ck_assert_uint_eq(total.counters[STATS_FAMILY_SKIPPED] -
+                          before.counters[STATS_FAMILY_SKIPPED],
+                      2);
+    ck_assert_uint_eq(total.counters[STATS_FAMILY_PROBED] -
+                          before.counters[STATS_FAMILY_PROBED],
+                      0);
+
+    // A host with the family makes the domain count no more.
+    learn_report("b.bar.local", AF_INET6, 1, THRESHOLD, INTERVAL);
+    ck_assert_int_eq(totals().gauges[STATS_GAUGE_MISSING_IPV6], 1);
+
+    // The least recently used domains make room for new ones.
+    for (int i = 0; i < LEARN_MAX_SUFFIXES; i++) {
+        snprintf(name, sizeof(name), "a.d%d.local", i);
+        miss(name, 1);
+    }
+    ck_assert(!learn_is_missing("a.foo.local", AF_INET6, 1));
+    ck_assert(learn_is_missing("a.d0.local", AF_INET6, 1));
+    ck_assert_int_eq(totals().gauges[STATS_GAUGE_MISSING_IPV6], 0);
+
+    miss("a.foo.local", THRESHOLD);
+    ck_assert_int_eq(totals().gauges[STATS_GAUGE_MISSING_IPV6], 1);
+    learn_reset();
+    ck_assert_int_eq(totals().gauges[STATS_GAUGE_MISSING_IPV6], 0);
+}
+END_TEST
+
+static Suite* learn_suite(void) {
+    Suite* s = suite_create("learn");
+
+    TCase* tc_learn = tcase_create("learn");
+    tcase_add_test(tc_learn, test_learn_missing_family);
+    tcase_add_test(tc_learn, test_learn_probes);
+    tcase_add_test(tc_learn, test_learn_stats);
+    suite_add_tcase(s, tc_learn);
+
+    return s;
+}
+
+int main(void) {
+    int number_failed;
+    Suite* s;
+    SRunner* sr;
+
+    s = learn_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_VERBOSE);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
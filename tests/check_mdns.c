@@ -0,0 +1,387 @@
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#define _DEFAULT_SOURCE
+
+#include <check.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "../src/mdns.h"
+
+static const uint8_t test_addr[4] = {192, 0, 2, 1};
+
+// Builds a response with the question and a single answer record, using a
+// compression pointer to the question name for the answer name.
+static size_t build_response(uint8_t* p, const uint8_t* question,
+                             size_t question_len, uint16_t type,
+                             const uint8_t* rdata, uint16_t rdlength,
+                             uint32_t ttl) {
+    static const uint8_t header[12] = {0, 0, 0x84, 0, 0, 1, 0, 1, 0, 0, 0, 0};
+    size_t o = 0;
+
+    memcpy(p, header, sizeof(header));
+    o += sizeof(header);
+    memcpy(p + o, question, question_len);
+    o += question_len;
+
+    p[o++] = 0xC0;
+    p[o++] = 12;
+    p[o++] = type >> 8;
+    p[o++] = type & 0xFF;
+    p[o++] = 0x80; // cache-flush
+    p[o++] = MDNS_CLASS_IN;
+    p[o++] = ttl >> 24;
+    p[o++] = (ttl >> 16) & 0xFF;
+    p[o++] = (ttl >> 8) & 0xFF;
+    p[o++] = ttl & 0xFF;
+    p[o++] = rdlength >> 8;
+    p[o++] = rdlength & 0xFF;
+    memcpy(p + o, rdata, rdlength);
+    return o + rdlength;
+}
+
+// Builds a response to a query for name/type, as a responder would.
+static size_t build_test_response(uint8_t* p, const char* name, uint16_t type,
+                                  const uint8_t* rdata, uint16_t rdlength,
+                                  uint32_t ttl) {
+    uint8_t query[512];
+    size_t l = mdns_build_query(query, sizeof(query), name, type);
+    ck_assert_uint_gt(l, 12);
+    return build_response(p, query + 12, l - 12, type, rdata, rdlength, ttl);
+}
+
+START_TEST(test_build_query) {
+    static const uint8_t expected[] = {
+        0,   0,   0,   0,   0,   1,   0,   0,   0,   0,   0,   0,
+        3,   'f', 'o', 'o', 5,   'l', 'o', 'c', 'a', 'l', 0,   0,
+        1,   0x80, 1};
+    uint8_t packet[512];
+
+    ck_assert_uint_eq(
+        mdns_build_query(packet, sizeof(packet), "foo.local", MDNS_TYPE_A),
+        sizeof(expected));
+    ck_assert_mem_eq(packet, expected, sizeof(expected));
+
+    // A trailing dot makes no difference.
+    ck_assert_uint_eq(
+        mdns_build_query(packet, sizeof(packet), "foo.local.", MDNS_TYPE_A),
+        sizeof(expected));
+    ck_assert_mem_eq(packet, expected, sizeof(expected));
+}
+END_TEST
+
+START_TEST(test_build_query_rejects_invalid_names) {
+    uint8_t packet[512];
+    char long_label[80];
+
+    memset(long_label, 'a', sizeof(long_label) - 1);
+    long_label[sizeof(long_label) - 1] = 0;
+
+    ck_assert_uint_eq(
+        mdns_build_query(packet, sizeof(packet), "foo..local", MDNS_TYPE_A), 0);
+    ck_assert_uint_eq(
+        mdns_build_query(packet, sizeof(packet), long_label, MDNS_TYPE_A), 0);
+    ck_assert_uint_eq(mdns_build_query(packet, 20, "foo.local", MDNS_TYPE_A),
+                      0);
+}
+END_TEST
+
+START_TEST(test_parse_response_a) {
+    uint8_t packet[512];
+    mdns_answer_t answer;
+    size_t l = build_test_response(packet, "foo.local", MDNS_TYPE_A,
+                                   test_addr, sizeof(test_addr), 120);
+
+    ck_assert_int_eq(
+        mdns_parse_response(packet, l, "FOO.local.", MDNS_TYPE_A, &answer), 1);
+    ck_assert_int_eq(answer.type, MDNS_TYPE_A);
+    ck_assert_int_eq(answer.ttl, 120);
+    ck_assert_mem_eq(answer.data.address, test_addr, sizeof(test_addr));
+
+    // Records for other names or types do not answer the question.
+    ck_assert_int_eq(
+        mdns_parse_response(packet, l, "bar.local", MDNS_TYPE_A, &answer), 0);
+    ck_assert_int_eq(
+        mdns_parse_response(packet, l, "foo.local", MDNS_TYPE_AAAA, &answer),
+        0);
+}
+END_TEST
+
+START_TEST(test_parse_response_ignores_goodbye) {
+    uint8_t packet[512];
+    mdns_answer_t answer;
+    size_t l = build_test_response(packet, "foo.local", MDNS_TYPE_A,
+                                   test_addr, sizeof(test_addr), 0);
+
+    ck_assert_int_eq(
+        mdns_parse_response(packet, l, "foo.local", MDNS_TYPE_A, &answer), 0);
+}
+END_TEST
+
+START_TEST(test_parse_response_ignores_queries) {
+    uint8_t packet[512];
+    mdns_answer_t answer;
+    size_t l = build_test_response(packet, "foo.local", MDNS_TYPE_A,
+                                   test_addr, sizeof(test_addr), 120);
+
+    packet[2] = 0;
+    ck_assert_int_eq(
+        mdns_parse_response(packet, l, "foo.local", MDNS_TYPE_A, &answer), 0);
+}
+END_TEST
+
+START_TEST(test_parse_response_ignores_other_question) {
+    uint8_t query[512], packet[512];
+    mdns_answer_t answer;
+    size_t ql = mdns_build_query(query, sizeof(query), "foo.local",
+                                 MDNS_TYPE_AAAA);
+
+    // An A record for the name, in a response to the AAAA question.
+    size_t l = build_response(packet, query + 12, ql - 12, MDNS_TYPE_A,
+                              test_addr, sizeof(test_addr), 120);
+    ck_assert_int_eq(
+        mdns_parse_response(packet, l, "foo.local", MDNS_TYPE_A, &answer), 0);
+}
+END_TEST
+
+START_TEST(test_parse_response_rejects_truncated) {
+    uint8_t packet[512];
+    mdns_answer_t answer;
+    size_t l = build_test_response(packet, "foo.local", MDNS_TYPE_A,
+                                   test_addr, sizeof(test_addr), 120);
+
+    for (size_t i = 0; i < l; i++)
+        ck_assert_int_eq(
+            mdns_parse_response(packet, i, "foo.local", MDNS_TYPE_A, &answer),
+            -1);
+}
+END_TEST
+
+START_TEST(test_parse_response_rejects_pointer_loop) {
+    uint8_t packet[512];
+    mdns_answer_t answer;
+    size_t l = build_test_response(packet, "foo.local", MDNS_TYPE_A,
+                                   test_addr, sizeof(test_addr), 120);
+
+    // Point the question name at itself.
+    packet[12] = 0xC0;
+    packet[13] = 12;
+    ck_assert_int_eq(
+        mdns_parse_response(packet, l, "foo.local", MDNS_TYPE_A, &answer), -1);
+}
+END_TEST
+
+START_TEST(test_parse_response_ptr) {
+    static const uint8_t rdata[] = {3, 'f', 'o', 'o', 5, 'l', 'o',
+                                    'c', 'a', 'l', 0};
+    uint8_t packet[512];
+    mdns_answer_t answer;
+    char reverse[80];
+
+    ck_assert_int_eq(
+        mdns_reverse_name(AF_INET, test_addr, reverse, sizeof(reverse)), 0);
+    ck_assert_str_eq(reverse, "1.2.0.192.in-addr.arpa");
+
+    size_t l = build_test_response(packet, reverse, MDNS_TYPE_PTR, rdata,
+                                   sizeof(rdata), 120);
+    ck_assert_int_eq(
+        mdns_parse_response(packet, l, reverse, MDNS_TYPE_PTR, &answer), 1);
+    ck_assert_str_eq(answer.data.name, "foo.local");
+}
+END_TEST
+
+START_TEST(test_reverse_name_ipv6) {
+    uint8_t addr[16] = {0xfe, 0x80, 0, 0, 0, 0, 0, 0,
+                        0,    0,    0, 0, 0, 0, 0, 0x1a};
+    char reverse[80];
+
+    ck_assert_int_eq(mdns_reverse_name(AF_INET6, addr, reverse, sizeof(reverse)),
+                     0);
+    ck_assert_str_eq(reverse, "a.1.0.0.0.0.0.0.0.0.0.0.0.0.0.0."
+                              "0.0.0.0.0.0.0.0.0.0.0.0.0.8.e.f.ip6.arpa");
+    ck_assert_int_eq(mdns_reverse_name(AF_INET6, addr, reverse, 20), -1);
+}
+END_TEST
+
+START_TEST(test_source_on_link) {
+    unsigned lo = if_nametoindex("lo");
+    struct sockaddr_in sa4;
+    struct sockaddr_in6 sa6;
+
+    if (!lo)
+        return;
+
+    memset(&sa4, 0, sizeof(sa4));
+    sa4.sin_family = AF_INET;
+    memset(&sa6, 0, sizeof(sa6));
+    sa6.sin6_family = AF_INET6;
+
+    // 127.0.0.0/8 is the link of the loopback interface, 192.0.2.0/24 is
+    // not.
+    inet_pton(AF_INET, "127.0.0.2", &sa4.sin_addr);
+    ck_assert(mdns_source_on_link((struct sockaddr*)&sa4, lo));
+    inet_pton(AF_INET, "192.0.2.1", &sa4.sin_addr);
+    ck_assert(!mdns_source_on_link((struct sockaddr*)&sa4, lo));
+
+    // Link-local addresses are on every link.
+    inet_pton(AF_INET, "169.254.1.1", &sa4.sin_addr);
+    ck_assert(mdns_source_on_link((struct sockaddr*)&sa4, lo));
+    inet_pton(AF_INET6, "fe80::1", &sa6.sin6_addr);
+    ck_assert(mdns_source_on_link((struct sockaddr*)&sa6, lo));
+    inet_pton(AF_INET6, "2001:db8::1", &sa6.sin6_addr);
+    ck_assert(!mdns_source_on_link((struct sockaddr*)&sa6, lo));
+}
+END_TEST
+
+typedef struct {
+    int fd;
+    int answer;
+    // If not -1, the response is sent from this socket instead of fd.
+    int reply_fd;
+} responder_t;
+
+// A scripted responder on the loopback interface. It answers a single query
+// with the test address, after checking that a unicast response was asked
+// for.
+static void* responder_thread(void* arg) {
+    responder_t* r = arg;
+    uint8_t query[512], response[512];
+    struct sockaddr_in from;
+    socklen_t from_len = sizeof(from);
+
+    ssize_t l = recvfrom(r->fd, query, sizeof(query), 0,
+                         (struct sockaddr*)&from, &from_len);
+    if (l < 16 || !(query[l - 2] & 0x80) || !r->answer)
+        return NULL;
+
+    size_t rl = build_response(response, query + 12, l - 12, MDNS_TYPE_A,
+                               test_addr, sizeof(test_addr), 120);
+    sendto(r->reply_fd >= 0 ? r->reply_fd : r->fd, response, rl, 0,
+           (struct sockaddr*)&from, from_len);
+    return NULL;
+}
+
+// Opens a UDP socket bound to addr and port (0 for any) on the loopback
+// interface, and returns the address it was bound to in sa.
+static int open_loopback_socket(const char* addr, uint16_t port,
+                                struct sockaddr_in* sa) {
+    socklen_t sa_len = sizeof(*sa);
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    ck_assert_int_ge(fd, 0);
+
+    memset(sa, 0, sizeof(*sa));
+    sa->sin_family = AF_INET;
+    sa->sin_port = port;
+    inet_pton(AF_INET, addr, &sa->sin_addr);
+    ck_assert_int_eq(bind(fd, (struct sockaddr*)sa, sizeof(*sa)), 0);
+    ck_assert_int_eq(getsockname(fd, (struct sockaddr*)sa, &sa_len), 0);
+    return fd;
+}
+
+static void run_loopback_query(int answer, const char* reply_addr,
+                               int timeout, avahi_resolve_result_t expected) {
+    struct sockaddr_in sa, reply_sa;
+    responder_t r = {.answer = answer, .reply_fd = -1};
+    pthread_t thread;
+    mdns_answer_t result;
+
+    r.fd = open_loopback_socket("127.0.0.1", 0, &sa);
+    if (reply_addr)
+        r.reply_fd = open_loopback_socket(reply_addr, sa.sin_port, &reply_sa);
+
+    ck_assert_int_eq(pthread_create(&thread, NULL, responder_thread, &r), 0);
+
+    ck_assert_int_eq(mdns_query("foo.local", MDNS_TYPE_A,
+                                (struct sockaddr*)&sa, sizeof(sa), timeout,
+                                &result),
+                     expected);
+    if (expected == AVAHI_RESOLVE_RESULT_SUCCESS)
+        ck_assert_mem_eq(result.data.address, test_addr, sizeof(test_addr));
+
+    if (!answer)
+        pthread_cancel(thread);
+    pthread_join(thread, NULL);
+    close(r.fd);
+    if (r.reply_fd >= 0)
+        close(r.reply_fd);
+}
+
+START_TEST(test_query_loopback_responder) {
+    run_loopback_query(1, NULL, 2000, AVAHI_RESOLVE_RESULT_SUCCESS);
+}
+END_TEST
+
+START_TEST(test_query_times_out) {
+    run_loopback_query(0, NULL, 100, AVAHI_RESOLVE_RESULT_HOST_NOT_FOUND);
+}
+END_TEST
+
+START_TEST(test_query_ignores_other_sources) {
+    // A unicast query is only answered by the host it was sent to, not by
+    // another one on the same link, even from the same port.
+    run_loopback_query(1, "127.0.0.2", 500,
+                       AVAHI_RESOLVE_RESULT_HOST_NOT_FOUND);
+}
+END_TEST
+
+static Suite* mdns_suite(void) {
+    Suite* s = suite_create("mdns");
+
+    TCase* tc_packet = tcase_create("packet");
+    tcase_add_test(tc_packet, test_build_query);
+    tcase_add_test(tc_packet, test_build_query_rejects_invalid_names);
+    tcase_add_test(tc_packet, test_parse_response_a);
+    tcase_add_test(tc_packet, test_parse_response_ignores_goodbye);
+    tcase_add_test(tc_packet, test_parse_response_ignores_queries);
+    tcase_add_test(tc_packet, test_parse_response_ignores_other_question);
+    tcase_add_test(tc_packet, test_parse_response_rejects_truncated);
+    tcase_add_test(tc_packet, test_parse_response_rejects_pointer_loop);
+    tcase_add_test(tc_packet, test_parse_response_ptr);
+    tcase_add_test(tc_packet, test_reverse_name_ipv6);
+    tcase_add_test(tc_packet, test_source_on_link);
+    suite_add_tcase(s, tc_packet);
+
+    TCase* tc_query = tcase_create("query");
+    tcase_add_test(tc_query, test_query_loopback_responder);
+    tcase_add_test(tc_query, test_query_times_out);
+    tcase_add_test(tc_query, test_query_ignores_other_sources);
+    suite_add_tcase(s, tc_query);
+
+    return s;
+}
+
+int main(void) {
+    int number_failed;
+    Suite* s;
+    SRunner* sr;
+
+    s = mdns_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_VERBOSE);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
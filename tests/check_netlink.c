@@ -0,0 +1,175 @@
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#include <check.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include "../src/netlink.h"
+
+static netlink_event_t events[8];
+static int n_events;
+
+static void record(const netlink_event_t* event) {
+    if (n_events < 8)
+        events[n_events++] = *event;
+}
+
+// Appends a message of the given type and payload to buf at *o.
+static struct nlmsghdr* put_message(char* buf, size_t* o, int type,
+                                    const void* payload, size_t len) {
+    struct nlmsghdr* nh = (struct nlmsghdr*)(buf + *o);
+
+    nh->nlmsg_len = NLMSG_LENGTH(len);
+    nh->nlmsg_type = type;
+    memcpy(NLMSG_DATA(nh), payload, len);
+    *o += NLMSG_ALIGN(nh->nlmsg_len);
+    return nh;
+}
+
+static void put_attribute(char* buf, size_t* o, struct nlmsghdr* nh, int type,
+                          const void* data, size_t len) {
+    struct rtattr* rta = (struct rtattr*)(buf + *o);
+
+    rta->rta_type = type;
+    rta->rta_len = RTA_LENGTH(len);
+    memcpy(RTA_DATA(rta), data, len);
+    *o += RTA_ALIGN(rta->rta_len);
+    nh->nlmsg_len = *o - ((char*)nh - buf);
+}
+
+START_TEST(test_parse_events) {
+    static const uint8_t ll[16] = {0xfe, 0x80, [15] = 1};
+    static const uint8_t v4[4] = {192, 0, 2, 1};
+    static const uint8_t peer[4] = {192, 0, 2, 2};
+    char buf[1024] __attribute__((aligned(NLMSG_ALIGNTO)));
+    size_t o = 0;
+    struct ifaddrmsg ifa;
+    struct ifinfomsg ifi;
+    struct rtmsg rt;
+    struct nlmsghdr* nh;
+
+    memset(buf, 0, sizeof(buf));
+
+    memset(&ifa, 0, sizeof(ifa));
+    ifa.ifa_family = AF_INET6;
+    ifa.ifa_prefixlen = 64;
+    ifa.ifa_index = 3;
+    nh = put_message(buf, &o, RTM_NEWADDR, &ifa, sizeof(ifa));
+    put_attribute(buf, &o, nh, IFA_ADDRESS, ll, sizeof(ll));
+
+    // A route change is of no interest.
+    memset(&rt, 0, sizeof(rt));
+    put_message(buf, &o, RTM_NEWROUTE, &rt, sizeof(rt));
+
+    // Point-to-point: IFA_LOCAL is ours, IFA_ADDRESS the peer's.
+    ifa.ifa_family = AF_INET;
+    ifa.ifa_prefixlen = 32;
+    ifa.ifa_index = 5;
+    nh = put_message(buf, &o, RTM_DELADDR, &ifa, sizeof(ifa));
+    put_attribute(buf, &o, nh, IFA_LOCAL, v4, sizeof(v4));
+    put_attribute(buf, &o, nh, IFA_ADDRESS, peer, sizeof(peer));
+
+    memset(&ifi, 0, sizeof(ifi));
+    ifi.ifi_index = 4;
+    put_message(buf, &o, RTM_DELLINK, &ifi, sizeof(ifi));
+
+    n_events = 0;
+    netlink_parse(buf, o, record);
+
+    ck_assert_int_eq(n_events, 3);
+
+    ck_assert_int_eq(events[0].type, RTM_NEWADDR);
+    ck_assert_int_eq(events[0].ifindex, 3);
+    ck_assert_int_eq(events[0].af, AF_INET6);
+    ck_assert_int_eq(events[0].prefixlen, 64);
+    ck_assert_mem_eq(events[0].address, ll, sizeof(ll));
+
+    ck_assert_int_eq(events[1].type, RTM_DELADDR);
+    ck_assert_int_eq(events[1].ifindex, 5);
+    ck_assert_mem_eq(events[1].address, v4, sizeof(v4));
+
+    ck_assert_int_eq(events[2].type, RTM_DELLINK);
+    ck_assert_int_eq(events[2].ifindex, 4);
+}
+END_TEST
+
+START_TEST(test_parse_truncated) {
+    char buf[64] __attribute__((aligned(NLMSG_ALIGNTO)));
+    struct nlmsghdr* nh = (struct nlmsghdr*)buf;
+
+    memset(buf, 0, sizeof(buf));
+    nh->nlmsg_len = NLMSG_LENGTH(2);
+    nh->nlmsg_type = RTM_NEWADDR;
+
+    n_events = 0;
+    netlink_parse(buf, nh->nlmsg_len, record);
+    ck_assert_int_eq(n_events, 0);
+
+    // A length running past the buffer.
+    nh->nlmsg_len = 1000;
+    netlink_parse(buf, sizeof(buf), record);
+    ck_assert_int_eq(n_events, 0);
+}
+END_TEST
+
+START_TEST(test_poll_resets_on_subscribe) {
+    n_events = 0;
+    netlink_subscribe(record);
+    netlink_subscribe(record);
+
+    if (netlink_poll() < 0)
+        return;
+
+    // Opening the socket invalidates everything once.
+    ck_assert_int_ge(n_events, 1);
+    ck_assert_int_eq(events[0].type, 0);
+}
+END_TEST
+
+static Suite* netlink_suite(void) {
+    Suite* s = suite_create("netlink");
+
+    TCase* tc_parse = tcase_create("parse");
+    tcase_add_test(tc_parse, test_parse_events);
+    tcase_add_test(tc_parse, test_parse_truncated);
+    suite_add_tcase(s, tc_parse);
+
+    TCase* tc_poll = tcase_create("poll");
+    tcase_add_test(tc_poll, test_poll_resets_on_subscribe);
+    suite_add_tcase(s, tc_poll);
+
+    return s;
+}
+
+int main(void) {
+    int number_failed;
+    Suite* s;
+    SRunner* sr;
+
+    s = netlink_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_VERBOSE);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,228 @@
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#include <check.h>
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include "../src/prefix.h"
+
+static prefix_verdict_t lookup(const prefix_table_t* table, const char* text) {
+    uint8_t address[16];
+    int af = strchr(text, ':') ? AF_INET6 : AF_INET;
+
+    ck_assert_int_eq(inet_pton(af, text, address), 1);
+    return prefix_table_lookup(table, af, address);
+}
+
+START_TEST(test_empty) {
+    prefix_table_t table;
+
+    prefix_table_init(&table);
+    ck_assert_int_eq(table.n_prefixes, 0);
+    ck_assert_int_eq(lookup(&table, "169.254.1.1"), PREFIX_NONE);
+    ck_assert_int_eq(lookup(&table, "fe80::1"), PREFIX_NONE);
+}
+END_TEST
+
+START_TEST(test_longest_match) {
+    prefix_table_t table;
+
+    prefix_table_init(&table);
+    ck_assert_int_eq(prefix_table_parse(&table, "10.0.0.0/8"), 0);
+    ck_assert_int_eq(prefix_table_parse(&table, "!10.1.0.0/16"), 0);
+    ck_assert_int_eq(prefix_table_parse(&table, "10.1.2.0/24"), 0);
+    ck_assert_int_eq(prefix_table_parse(&table, "!10.1.2.3"), 0);
+    ck_assert_int_eq(table.n_prefixes, 4);
+
+    ck_assert_int_eq(lookup(&table, "10.9.9.9"), PREFIX_ALLOW);
+    ck_assert_int_eq(lookup(&table, "10.1.9.9"), PREFIX_DENY);
+    ck_assert_int_eq(lookup(&table, "10.1.2.9"), PREFIX_ALLOW);
+    ck_assert_int_eq(lookup(&table, "10.1.2.3"), PREFIX_DENY);
+    ck_assert_int_eq(lookup(&table, "11.0.0.1"), PREFIX_NONE);
+}
+END_TEST
+
+START_TEST(test_insertion_order) {
+    prefix_table_t table;
+
+    // Longer prefixes first, so shorter ones have to be put above them.
+    prefix_table_init(&table);
+    ck_assert_int_eq(prefix_table_parse(&table, "!10.1.2.3"), 0);
+    ck_assert_int_eq(prefix_table_parse(&table, "10.1.2.0/24"), 0);
+    ck_assert_int_eq(prefix_table_parse(&table, "!10.1.0.0/16"), 0);
+    ck_assert_int_eq(prefix_table_parse(&table, "10.0.0.0/8"), 0);
+    ck_assert_int_eq(prefix_table_parse(&table, "192.168.0.0/16"), 0);
+
+    ck_assert_int_eq(lookup(&table, "10.9.9.9"), PREFIX_ALLOW);
+    ck_assert_int_eq(lookup(&table, "10.1.9.9"), PREFIX_DENY);
+    ck_assert_int_eq(lookup(&table, "10.1.2.9"), PREFIX_ALLOW);
+    ck_assert_int_eq(lookup(&table, "10.1.2.3"), PREFIX_DENY);
+    ck_assert_int_eq(lookup(&table, "192.168.7.7"), PREFIX_ALLOW);
+    ck_assert_int_eq(lookup(&table, "192.169.7.7"), PREFIX_NONE);
+
+    // Adding a prefix again changes its verdict.
+    ck_assert_int_eq(prefix_table_parse(&table, "!10.0.0.0/8"), 0);
+    ck_assert_int_eq(table.n_prefixes, 5);
+    ck_assert_int_eq(lookup(&table, "10.9.9.9"), PREFIX_DENY);
+}
+END_TEST
+
+START_TEST(test_ipv6) {
+    prefix_table_t table;
+
+    prefix_table_init(&table);
+    ck_assert_int_eq(prefix_table_parse(&table, "fe80::/10"), 0);
+    ck_assert_int_eq(prefix_table_parse(&table, "2001:db8::/32"), 0);
+    ck_assert_int_eq(prefix_table_parse(&table, "!2001:db8:1::/48"), 0);
+    ck_assert_int_eq(prefix_table_parse(&table, "169.254.0.0/16"), 0);
+
+    ck_assert_int_eq(lookup(&table, "fe80::1"), PREFIX_ALLOW);
+    ck_assert_int_eq(lookup(&table, "febf::1"), PREFIX_ALLOW);
+    ck_assert_int_eq(lookup(&table, "fec0::1"), PREFIX_NONE);
+    ck_assert_int_eq(lookup(&table, "2001:db8:2::1"), PREFIX_ALLOW);
+    ck_assert_int_eq(lookup(&table, "2001:db8:1::1"), PREFIX_DENY);
+    ck_assert_int_eq(lookup(&table, "169.254.3.4"), PREFIX_ALLOW);
+    // IPv4 prefixes don't leak into the rest of the IPv6 space.
+    ck_assert_int_eq(lookup(&table, "::a9fe:304"), PREFIX_NONE);
+}
+END_TEST
+
+START_TEST(test_default_route) {
+    prefix_table_t table;
+
+    prefix_table_init(&table);
+    ck_assert_int_eq(prefix_table_parse(&table, "::/0"), 0);
+    ck_assert_int_eq(prefix_table_parse(&table, "!0.0.0.0/0"), 0);
+    ck_assert_int_eq(prefix_table_parse(&table, "169.254.0.0/16"), 0);
+
+    ck_assert_int_eq(lookup(&table, "2001:db8::1"), PREFIX_ALLOW);
+    ck_assert_int_eq(lookup(&table, "192.0.2.1"), PREFIX_DENY);
+    ck_assert_int_eq(lookup(&table, "169.254.0.1"), PREFIX_ALLOW);
+}
+END_TEST
+
+START_TEST(test_families_apart) {
+    prefix_table_t table;
+
+    // IPv6 prefixes covering the whole space decide nothing about IPv4
+    // addresses.
+    prefix_table_init(&table);
+    ck_assert_int_eq(prefix_table_parse(&table, "::/0"), 0);
+    ck_assert_int_eq(lookup(&table, "192.0.2.1"), PREFIX_NONE);
+    ck_assert_int_eq(lookup(&table, "::ffff:192.0.2.1"), PREFIX_ALLOW);
+
+    prefix_table_init(&table);
+    ck_assert_int_eq(prefix_table_parse(&table, "!::/0"), 0);
+    ck_assert_int_eq(prefix_table_parse(&table, "::/1"), 0);
+    ck_assert_int_eq(prefix_table_parse(&table, "192.0.2.0/24"), 0);
+    ck_assert_int_eq(lookup(&table, "192.0.2.1"), PREFIX_ALLOW);
+    ck_assert_int_eq(lookup(&table, "198.51.100.1"), PREFIX_NONE);
+    ck_assert_int_eq(lookup(&table, "2001:db8::1"), PREFIX_ALLOW);
+    ck_assert_int_eq(lookup(&table, "fe80::1"), PREFIX_DENY);
+
+    // Nor do IPv4 prefixes about IPv4-mapped IPv6 addresses.
+    prefix_table_init(&table);
+    ck_assert_int_eq(prefix_table_parse(&table, "0.0.0.0/0"), 0);
+    ck_assert_int_eq(prefix_table_parse(&table, "!10.0.0.0/8"), 0);
+    ck_assert_int_eq(lookup(&table, "10.1.2.3"), PREFIX_DENY);
+    ck_assert_int_eq(lookup(&table, "::ffff:10.1.2.3"), PREFIX_NONE);
+    ck_assert_int_eq(lookup(&table, "::ffff:192.0.2.1"), PREFIX_NONE);
+}
+END_TEST
+
+START_TEST(test_parse_errors) {
+    prefix_table_t table;
+
+    prefix_table_init(&table);
+    ck_assert_int_eq(prefix_table_parse(&table, ""), -1);
+    ck_assert_int_eq(prefix_table_parse(&table, "10.0.0.0/"), -1);
+    ck_assert_int_eq(prefix_table_parse(&table, "10.0.0.0/33"), -1);
+    ck_assert_int_eq(prefix_table_parse(&table, "10.0.0.0/8x"), -1);
+    ck_assert_int_eq(prefix_table_parse(&table, "fe80::/129"), -1);
+    ck_assert_int_eq(prefix_table_parse(&table, "10.0.0.0/-1"), -1);
+    ck_assert_int_eq(prefix_table_parse(&table, "10.0.0.0/+8"), -1);
+    ck_assert_int_eq(prefix_table_parse(&table, "10.0.0.0/ 8"), -1);
+    ck_assert_int_eq(prefix_table_parse(&table, "10.0.0.0/4294967304"), -1);
+    ck_assert_int_eq(
+        prefix_table_parse(&table, "::/18446744073709551616"), -1);
+    ck_assert_int_eq(prefix_table_parse(&table, "foo.local"), -1);
+    ck_assert_int_eq(table.n_prefixes, 0);
+}
+END_TEST
+
+START_TEST(test_full) {
+    prefix_table_t table;
+    uint8_t address[4] = {10, 0, 0, 0};
+
+    prefix_table_init(&table);
+    for (int i = 0; i < PREFIX_MAX; i++) {
+        address[1] = (uint8_t)(i * 37);
+        address[2] = (uint8_t)i;
+        ck_assert_int_eq(
+            prefix_table_add(&table, AF_INET, address, 24, PREFIX_ALLOW), 0);
+    }
+    ck_assert_int_eq(table.n_prefixes, PREFIX_MAX);
+
+    address[1] = 255;
+    address[2] = 255;
+    ck_assert_int_eq(
+        prefix_table_add(&table, AF_INET, address, 24, PREFIX_ALLOW), -1);
+
+    for (int i = 0; i < PREFIX_MAX; i++) {
+        address[1] = (uint8_t)(i * 37);
+        address[2] = (uint8_t)i;
+        address[3] = 99;
+        ck_assert_int_eq(prefix_table_lookup(&table, AF_INET, address),
+                         PREFIX_ALLOW);
+    }
+}
+END_TEST
+
+static Suite* prefix_suite(void) {
+    Suite* s = suite_create("prefix");
+
+    TCase* tc_lookup = tcase_create("lookup");
+    tcase_add_test(tc_lookup, test_empty);
+    tcase_add_test(tc_lookup, test_longest_match);
+    tcase_add_test(tc_lookup, test_insertion_order);
+    tcase_add_test(tc_lookup, test_ipv6);
+    tcase_add_test(tc_lookup, test_default_route);
+    tcase_add_test(tc_lookup, test_families_apart);
+    tcase_add_test(tc_lookup, test_parse_errors);
+    tcase_add_test(tc_lookup, test_full);
+    suite_add_tcase(s, tc_lookup);
+
+    return s;
+}
+
+int main(void) {
+    int number_failed;
+    Suite* s;
+    SRunner* sr;
+
+    s = prefix_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_VERBOSE);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
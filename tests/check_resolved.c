@@ -0,0 +1,227 @@
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#define _DEFAULT_SOURCE
+
+#include <check.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "../src/backend.h"
+#include "../src/resolved.h"
+
+START_TEST(test_parse_hostname_reply) {
+    static const char reply[] =
+        "{\"parameters\":{\"addresses\":["
+        "{\"ifindex\":3,\"family\":10,\"address\":"
+        "[254,128,0,0,0,0,0,0,0,0,0,0,0,0,0,1]},"
+        "{\"ifindex\":2,\"family\":2,\"address\":[192,0,2,7]}],"
+        "\"name\":\"foo.local\",\"flags\":1048584}}";
+    static const uint8_t ipv4[4] = {192, 0, 2, 7};
+    query_address_result_t result;
+
+    ck_assert_int_eq(resolved_parse_hostname_reply(reply, AF_INET, &result),
+                     AVAHI_RESOLVE_RESULT_SUCCESS);
+    ck_assert_int_eq(result.af, AF_INET);
+    ck_assert_int_eq(result.scopeid, 2);
+    ck_assert_mem_eq(&result.address, ipv4, sizeof(ipv4));
+
+    ck_assert_int_eq(resolved_parse_hostname_reply(reply, AF_INET6, &result),
+                     AVAHI_RESOLVE_RESULT_SUCCESS);
+    ck_assert_int_eq(result.af, AF_INET6);
+    ck_assert_int_eq(result.scopeid, 3);
+    ck_assert_int_eq(result.address.ipv6.address[0], 254);
+    ck_assert_int_eq(result.address.ipv6.address[15], 1);
+}
+END_TEST
+
+START_TEST(test_parse_hostname_reply_errors) {
+    query_address_result_t result;
+
+    ck_assert_int_eq(
+        resolved_parse_hostname_reply(
+            "{\"error\":\"io.systemd.Resolve.NoSuchResourceRecord\","
+            "\"parameters\":{}}",
+            AF_INET, &result),
+        AVAHI_RESOLVE_RESULT_HOST_NOT_FOUND);
+    ck_assert_int_eq(
+        resolved_parse_hostname_reply(
+            "{\"error\":\"io.systemd.Resolve.DNSError\","
+            "\"parameters\":{\"rcode\":3}}",
+            AF_INET, &result),
+        AVAHI_RESOLVE_RESULT_HOST_NOT_FOUND);
+    ck_assert_int_eq(
+        resolved_parse_hostname_reply(
+            "{\"error\":\"org.varlink.service.MethodNotFound\"}", AF_INET,
+            &result),
+        AVAHI_RESOLVE_RESULT_UNAVAIL);
+
+    // Only addresses of another family.
+    ck_assert_int_eq(
+        resolved_parse_hostname_reply(
+            "{\"parameters\":{\"addresses\":[{\"family\":2,"
+            "\"address\":[192,0,2,7]}]}}",
+            AF_INET6, &result),
+        AVAHI_RESOLVE_RESULT_HOST_NOT_FOUND);
+
+    // Malformed replies.
+    ck_assert_int_eq(resolved_parse_hostname_reply("", AF_INET, &result),
+                     AVAHI_RESOLVE_RESULT_UNAVAIL);
+    ck_assert_int_eq(
+        resolved_parse_hostname_reply("{\"parameters\"", AF_INET, &result),
+        AVAHI_RESOLVE_RESULT_UNAVAIL);
+    ck_assert_int_eq(
+        resolved_parse_hostname_reply(
+            "{\"parameters\":{\"addresses\":[{\"family\":2,"
+            "\"address\":[192,0,2,700]}]}}",
+            AF_INET, &result),
+        AVAHI_RESOLVE_RESULT_HOST_NOT_FOUND);
+}
+END_TEST
+
+START_TEST(test_parse_address_reply) {
+    char name[256];
+
+    ck_assert_int_eq(
+        resolved_parse_address_reply(
+            "{\"parameters\":{\"names\":[{\"ifindex\":2,"
+            "\"name\":\"foo\\u002dbar.local\"}],\"flags\":8}}",
+            name, sizeof(name)),
+        AVAHI_RESOLVE_RESULT_SUCCESS);
+    ck_assert_str_eq(name, "foo-bar.local");
+
+    ck_assert_int_eq(
+        resolved_parse_address_reply(
+            "{\"parameters\":{\"names\":[{\"name\":\"foo.local\"}]}}", name,
+            4),
+        AVAHI_RESOLVE_RESULT_HOST_NOT_FOUND);
+}
+END_TEST
+
+typedef struct {
+    int fd;
+    const char* reply;
+    char request[1024];
+} server_t;
+
+// A stand-in for systemd-resolved: accepts one connection, reads one
+// request and sends the canned reply.
+static void* server_thread(void* arg) {
+    server_t* s = arg;
+    size_t o = 0;
+    int fd = accept(s->fd, NULL, NULL);
+
+    if (fd < 0)
+        return NULL;
+
+    while (o < sizeof(s->request) - 1) {
+        ssize_t r = read(fd, s->request + o, sizeof(s->request) - 1 - o);
+        if (r <= 0)
+            break;
+        o += r;
+        if (memchr(s->request, 0, o))
+            break;
+    }
+
+    write(fd, s->reply, strlen(s->reply) + 1);
+    close(fd);
+    return NULL;
+}
+
+START_TEST(test_resolve_name_with_server) {
+    char dir[] = "/tmp/nss-mdns-test-XXXXXX";
+    struct sockaddr_un sa;
+    backend_endpoint_t endpoint;
+    server_t s;
+    pthread_t thread;
+    query_address_result_t result;
+    static const uint8_t ipv4[4] = {192, 0, 2, 9};
+
+    ck_assert_ptr_nonnull(mkdtemp(dir));
+
+    memset(&endpoint, 0, sizeof(endpoint));
+    endpoint.type = BACKEND_RESOLVED;
+    snprintf(endpoint.path, sizeof(endpoint.path), "%s/io.systemd.Resolve",
+             dir);
+
+    memset(&s, 0, sizeof(s));
+    s.reply = "{\"parameters\":{\"addresses\":[{\"ifindex\":2,\"family\":2,"
+              "\"address\":[192,0,2,9]}],\"name\":\"foo.local\",\"flags\":8}}";
+    s.fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    strcpy(sa.sun_path, endpoint.path);
+    ck_assert_int_eq(bind(s.fd, (struct sockaddr*)&sa, sizeof(sa)), 0);
+    ck_assert_int_eq(listen(s.fd, 1), 0);
+    ck_assert_int_eq(pthread_create(&thread, NULL, server_thread, &s), 0);
+
+    ck_assert_int_eq(backend_resolved.resolve_name(&endpoint, AF_INET,
+                                                   "foo.local", &result, 1000),
+                     AVAHI_RESOLVE_RESULT_SUCCESS);
+    ck_assert_mem_eq(&result.address, ipv4, sizeof(ipv4));
+
+    pthread_join(thread, NULL);
+    ck_assert_ptr_nonnull(
+        strstr(s.request, "\"method\":\"io.systemd.Resolve.ResolveHostname\""));
+    ck_assert_ptr_nonnull(strstr(s.request, "\"name\":\"foo.local\""));
+
+    close(s.fd);
+    unlink(endpoint.path);
+    rmdir(dir);
+
+    // Nobody listening any more.
+    ck_assert_int_eq(backend_resolved.resolve_name(&endpoint, AF_INET,
+                                                   "foo.local", &result, 1000),
+                     AVAHI_RESOLVE_RESULT_UNAVAIL);
+}
+END_TEST
+
+static Suite* resolved_suite(void) {
+    Suite* s = suite_create("resolved");
+
+    TCase* tc_parse = tcase_create("parse");
+    tcase_add_test(tc_parse, test_parse_hostname_reply);
+    tcase_add_test(tc_parse, test_parse_hostname_reply_errors);
+    tcase_add_test(tc_parse, test_parse_address_reply);
+    suite_add_tcase(s, tc_parse);
+
+    TCase* tc_varlink = tcase_create("varlink");
+    tcase_add_test(tc_varlink, test_resolve_name_with_server);
+    suite_add_tcase(s, tc_varlink);
+
+    return s;
+}
+
+int main(void) {
+    int number_failed;
+    Suite* s;
+    SRunner* sr;
+
+    s = resolved_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_VERBOSE);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,120 @@
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#include <check.h>
+#include <stdlib.h>
+#include "../src/rtt.h"
+
+START_TEST(test_no_estimate) {
+    rtt_estimator_t rtt;
+
+    rtt_init(&rtt);
+    ck_assert_int_eq(rtt_timeout(&rtt, 100, 5000), 5000);
+
+    // Timeouts alone give no estimate either.
+    rtt_timed_out(&rtt);
+    ck_assert_int_eq(rtt_timeout(&rtt, 100, 5000), 5000);
+}
+END_TEST
+
+START_TEST(test_first_sample) {
+    rtt_estimator_t rtt;
+
+    // SRTT = R, RTTVAR = R / 2, so the timeout is 3 R.
+    rtt_init(&rtt);
+    rtt_sample(&rtt, 400);
+    ck_assert_int_eq(rtt_timeout(&rtt, 100, 5000), 1200);
+
+    // Clamped to the bounds.
+    ck_assert_int_eq(rtt_timeout(&rtt, 2000, 5000), 2000);
+    ck_assert_int_eq(rtt_timeout(&rtt, 100, 1000), 1000);
+}
+END_TEST
+
+START_TEST(test_converges) {
+    rtt_estimator_t rtt;
+    int t;
+
+    rtt_init(&rtt);
+    rtt_sample(&rtt, 2000);
+
+    for (int i = 0; i < 100; i++)
+        rtt_sample(&rtt, 100);
+
+    // Close to the steady response time, plus the clock granularity.
+    t = rtt_timeout(&rtt, 1, 10000);
+    ck_assert_int_ge(t, 100);
+    ck_assert_int_le(t, 110);
+
+    // A jittery backend gets more headroom than a steady one.
+    for (int i = 0; i < 50; i++)
+        rtt_sample(&rtt, i % 2 ? 50 : 150);
+    ck_assert_int_gt(rtt_timeout(&rtt, 1, 10000), 250);
+}
+END_TEST
+
+START_TEST(test_backoff) {
+    rtt_estimator_t rtt;
+
+    rtt_init(&rtt);
+    rtt_sample(&rtt, 10);
+    ck_assert_int_eq(rtt_timeout(&rtt, 100, 5000), 100);
+
+    rtt_timed_out(&rtt);
+    ck_assert_int_eq(rtt_timeout(&rtt, 100, 5000), 200);
+    rtt_timed_out(&rtt);
+    ck_assert_int_eq(rtt_timeout(&rtt, 100, 5000), 400);
+
+    for (int i = 0; i < 10; i++)
+        rtt_timed_out(&rtt);
+    ck_assert_int_eq(rtt_timeout(&rtt, 100, 5000), 100 << RTT_MAX_BACKOFF);
+    ck_assert_int_eq(rtt_timeout(&rtt, 100, 1000), 1000);
+
+    // An answer ends the back-off.
+    rtt_sample(&rtt, 10);
+    ck_assert_int_eq(rtt_timeout(&rtt, 100, 5000), 100);
+}
+END_TEST
+
+static Suite* rtt_suite(void) {
+    Suite* s = suite_create("rtt");
+
+    TCase* tc_rtt = tcase_create("rtt");
+    tcase_add_test(tc_rtt, test_no_estimate);
+    tcase_add_test(tc_rtt, test_first_sample);
+    tcase_add_test(tc_rtt, test_converges);
+    tcase_add_test(tc_rtt, test_backoff);
+    suite_add_tcase(s, tc_rtt);
+
+    return s;
+}
+
+int main(void) {
+    int number_failed;
+    Suite* s;
+    SRunner* sr;
+
+    s = rtt_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_VERBOSE);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
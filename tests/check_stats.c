@@ -0,0 +1,355 @@
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#include <check.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../src/stats.h"
+
+static uint64_t counter(stats_counter_t c) {
+    const stats_segment_t* s = stats_attach(getpid());
+    stats_shard_t total;
+
+    ck_assert_ptr_nonnull(s);
+    stats_sum(s, &total);
+    stats_detach(s);
+    return total.counters[c];
+}
+
+START_TEST(test_export) {
+    const stats_segment_t* s;
+
+    // Counted before the export as well.
+    stats_count(STATS_CACHE_HIT);
+    ck_assert_uint_eq(stats_start(), 0);
+
+    stats_export();
+    ck_assert_uint_ne(stats_start(), 0);
+
+    s = stats_attach(getpid());
+    ck_assert_ptr_nonnull(s);
+    ck_assert_int_eq(s->pid, getpid());
+    stats_detach(s);
+
+    ck_assert_uint_ge(counter(STATS_CACHE_HIT), 1);
+    ck_assert_ptr_null(stats_attach(1));
+}
+END_TEST
+
+#define THREADS 8
+#define COUNTS 10000
+
+static void* count_thread(void* arg) {
+    (void)arg;
+    for (int i = 0; i < COUNTS; i++)
+        stats_count(STATS_LOOKUP_NAME4);
+    return NULL;
+}
+
+START_TEST(test_threads) {
+    pthread_t threads[THREADS];
+    uint64_t before;
+
+    stats_export();
+    before = counter(STATS_LOOKUP_NAME4);
+
+    for (int i = 0; i < THREADS; i++)
+        ck_assert_int_eq(
+            pthread_create(&threads[i], NULL, count_thread, NULL), 0);
+    for (int i = 0; i < THREADS; i++)
+        pthread_join(threads[i], NULL);
+
+    ck_assert_uint_eq(counter(STATS_LOOKUP_NAME4) - before, THREADS * COUNTS);
+}
+END_TEST
+
+static void* up_and_down_thread(void* arg) {
+    (void)arg;
+    for (int i = 0; i < COUNTS; i++) {
+        stats_count(STATS_LOOKUP_ADDRESS);
+        stats_gauge_add(STATS_GAUGE_QUEUED, 1);
+        stats_gauge_add(STATS_GAUGE_QUEUED, -1);
+    }
+    return NULL;
+}
+
+// Exports while threads count, in a fresh child. Returns 0 if nothing
+// got lost on the way to the segment.
+static int export_while_counting(void) {
+    const stats_segment_t* s;
+    pthread_t threads[THREADS];
+    stats_shard_t total;
+
+    for (int i = 0; i < THREADS; i++)
+        if (pthread_create(&threads[i], NULL, up_and_down_thread, NULL) != 0)
+            return 1;
+    stats_export();
+    for (int i = 0; i < THREADS; i++)
+        pthread_join(threads[i], NULL);
+
+    if (!(s = stats_attach(getpid())))
+        return 1;
+    stats_sum(s, &total);
+    stats_detach(s);
+    return total.counters[STATS_LOOKUP_ADDRESS] != THREADS * COUNTS ||
+           total.gauges[STATS_GAUGE_QUEUED] != 0;
+}
+
+START_TEST(test_export_while_counting) {
+    // Updates racing the export are rare: give them many chances.
+    for (int round = 0; round < 50; round++) {
+        int status;
+        pid_t pid;
+
+        if ((pid = fork()) == 0)
+            exit(export_while_counting());
+        ck_assert_int_gt(pid, 0);
+        ck_assert_int_eq(waitpid(pid, &status, 0), pid);
+        ck_assert(WIFEXITED(status));
+        ck_assert_int_eq(WEXITSTATUS(status), 0);
+    }
+}
+END_TEST
+
+static void* gauge_down_thread(void* arg) {
+    (void)arg;
+    for (int i = 0; i < COUNTS; i++)
+        stats_gauge_add(STATS_GAUGE_ACTIVE, -1);
+    return NULL;
+}
+
+START_TEST(test_gauge_across_threads) {
+    const stats_segment_t* s;
+    stats_shard_t total;
+    pthread_t thread;
+
+    stats_export();
+
+    // Up in this thread's shard, down in another one's.
+    for (int i = 0; i < COUNTS + 3; i++)
+        stats_gauge_add(STATS_GAUGE_ACTIVE, 1);
+    ck_assert_int_eq(
+        pthread_create(&thread, NULL, gauge_down_thread, NULL), 0);
+    pthread_join(thread, NULL);
+
+    s = stats_attach(getpid());
+    ck_assert_ptr_nonnull(s);
+    stats_sum(s, &total);
+    stats_detach(s);
+    ck_assert_int_eq(total.gauges[STATS_GAUGE_ACTIVE], 3);
+
+    stats_gauge_add(STATS_GAUGE_ACTIVE, -3);
+}
+END_TEST
+
+START_TEST(test_latency) {
+    const stats_segment_t* s;
+    stats_shard_t before, after;
+    uint64_t start, count = 0;
+
+    stats_export();
+    s = stats_attach(getpid());
+    ck_assert_ptr_nonnull(s);
+    stats_sum(s, &before);
+
+    start = stats_start();
+    usleep(3000);
+    stats_observe(STATS_PHASE_BACKEND, start);
+    // Not timed.
+    stats_observe(STATS_PHASE_BACKEND, 0);
+
+    stats_sum(s, &after);
+    stats_detach(s);
+
+    // 2048 to 4095 microseconds, or however much longer a busy machine
+    // takes.
+    for (int b = 12; b < STATS_BUCKETS; b++)
+        count += after.latency[STATS_PHASE_BACKEND][b] -
+                 before.latency[STATS_PHASE_BACKEND][b];
+    ck_assert_uint_eq(count, 1);
+    ck_assert_uint_ge(after.latency_sum[STATS_PHASE_BACKEND] -
+                          before.latency_sum[STATS_PHASE_BACKEND],
+                      3000);
+}
+END_TEST
+
+START_TEST(test_fork) {
+    int status;
+    pid_t pid;
+
+    stats_export();
+    stats_count(STATS_ERANGE);
+
+    if ((pid = fork()) == 0) {
+        // The child counts afresh, in a segment of its own.
+        if (stats_attach(getpid()))
+            _exit(1);
+        stats_count(STATS_ERANGE);
+        stats_export();
+        if (counter(STATS_ERANGE) != 1)
+            _exit(2);
+        // Removes the segment.
+        exit(0);
+    }
+
+    ck_assert_int_gt(pid, 0);
+    ck_assert_int_eq(waitpid(pid, &status, 0), pid);
+    ck_assert(WIFEXITED(status));
+    ck_assert_int_eq(WEXITSTATUS(status), 0);
+
+    ck_assert_ptr_null(stats_attach(pid));
+    ck_assert_uint_ge(counter(STATS_ERANGE), 1);
+}
+END_TEST
+
+START_TEST(test_reap) {
+    char name[32];
+    int status, fd;
+    pid_t pid;
+
+    // A segment left behind by a process that was killed.
+    if ((pid = fork()) == 0)
+        _exit(0);
+    ck_assert_int_gt(pid, 0);
+    ck_assert_int_eq(waitpid(pid, &status, 0), pid);
+
+    snprintf(name, sizeof(name), STATS_SEGMENT_PREFIX "%d", (int)pid);
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    ck_assert_int_ge(fd, 0);
+    close(fd);
+
+    stats_export();
+    stats_reap();
+    ck_assert_int_lt(shm_open(name, O_RDONLY, 0), 0);
+    ck_assert_int_eq(errno, ENOENT);
+
+    // Our own stays.
+    ck_assert_ptr_nonnull(stats_attach(getpid()));
+}
+END_TEST
+
+START_TEST(test_reused_pid) {
+    stats_segment_t* s;
+    char name[32];
+    int status, fd;
+    pid_t pid;
+
+    // A running process that got the ID of one that left its segment.
+    if ((pid = fork()) == 0) {
+        pause();
+        _exit(0);
+    }
+    ck_assert_int_gt(pid, 0);
+
+    snprintf(name, sizeof(name), STATS_SEGMENT_PREFIX "%d", (int)pid);
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    ck_assert_int_ge(fd, 0);
+    ck_assert_int_eq(ftruncate(fd, sizeof(*s)), 0);
+    s = mmap(NULL, sizeof(*s), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ck_assert(s != MAP_FAILED);
+    close(fd);
+    s->magic = STATS_MAGIC;
+    s->version = STATS_VERSION;
+    s->size = sizeof(*s);
+    s->pid = (int32_t)pid;
+    s->start_time = 1;
+    munmap(s, sizeof(*s));
+
+    ck_assert(stats_stale(pid));
+    ck_assert_ptr_null(stats_attach(pid));
+    stats_remove(pid);
+    ck_assert_int_lt(shm_open(name, O_RDONLY, 0), 0);
+
+    kill(pid, SIGKILL);
+    ck_assert_int_eq(waitpid(pid, &status, 0), pid);
+
+    // Our own is not.
+    stats_export();
+    ck_assert(!stats_stale(getpid()));
+}
+END_TEST
+
+START_TEST(test_quantile) {
+    uint64_t buckets[STATS_BUCKETS];
+
+    memset(buckets, 0, sizeof(buckets));
+    ck_assert(stats_quantile(buckets, 0.5) == 0);
+
+    // 100 latencies from 512 to 1023 microseconds, one from 2048 up.
+    buckets[10] = 100;
+    buckets[12] = 1;
+    ck_assert(stats_quantile(buckets, 0.5) >= 512);
+    ck_assert(stats_quantile(buckets, 0.5) < 1024);
+    ck_assert(stats_quantile(buckets, 0.99) < 1024);
+    ck_assert(stats_quantile(buckets, 0.999) >= 2048);
+    ck_assert(stats_quantile(buckets, 0.999) <= 4096);
+}
+END_TEST
+
+START_TEST(test_names) {
+    for (int c = 0; c < STATS_COUNTER_MAX; c++)
+        ck_assert_ptr_nonnull(stats_counter_name(c));
+    for (int g = 0; g < STATS_GAUGE_MAX; g++)
+        ck_assert_ptr_nonnull(stats_gauge_name(g));
+    for (int p = 0; p < STATS_PHASE_MAX; p++)
+        ck_assert_ptr_nonnull(stats_phase_name(p));
+    ck_assert_ptr_null(stats_counter_name(STATS_COUNTER_MAX));
+}
+END_TEST
+
+static Suite* stats_suite(void) {
+    Suite* s = suite_create("stats");
+
+    TCase* tc_stats = tcase_create("stats");
+    tcase_add_test(tc_stats, test_export);
+    tcase_add_test(tc_stats, test_threads);
+    tcase_add_test(tc_stats, test_export_while_counting);
+    tcase_add_test(tc_stats, test_gauge_across_threads);
+    tcase_add_test(tc_stats, test_latency);
+    tcase_add_test(tc_stats, test_fork);
+    tcase_add_test(tc_stats, test_reap);
+    tcase_add_test(tc_stats, test_reused_pid);
+    tcase_add_test(tc_stats, test_quantile);
+    tcase_add_test(tc_stats, test_names);
+    suite_add_tcase(s, tc_stats);
+
+    return s;
+}
+
+int main(void) {
+    int number_failed;
+    Suite* s;
+    SRunner* sr;
+
+    s = stats_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_VERBOSE);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,414 @@
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#define _GNU_SOURCE
+
+#include <check.h>
+#include <errno.h>
+#include <libgen.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mount.h>
+#include <sys/ptrace.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../src/util.h"
+#include "../src/nss.h"
+#include "fake-avahi.h"
+
+#ifndef PTRACE_GET_SYSCALL_INFO
+#define PTRACE_GET_SYSCALL_INFO 0x420e
+#endif
+#define SYSCALL_INFO_ENTRY 1
+
+// The start of the kernel's struct ptrace_syscall_info, which not every C
+// library declares.
+typedef struct {
+    uint8_t op;
+    uint8_t pad[3];
+    uint32_t arch;
+    uint64_t instruction_pointer;
+    uint64_t stack_pointer;
+    uint64_t nr;
+    uint64_t args[6];
+} syscall_info_t;
+
+// Lookups are measured from one call of getppid(), which they never make,
+// to the next.
+#define MARK() getppid()
+
+// Syscalls between the marks, of which opens.
+typedef struct {
+    unsigned syscalls;
+    unsigned opens;
+    // The syscall numbers, to tell what changed when a budget is exceeded.
+    long numbers[256];
+} count_t;
+
+static char dir[] = "/tmp/nss-mdns-test-XXXXXX";
+static char socket_path[64];
+static fake_avahi_t* fake;
+
+static void write_file(const char* path, const char* contents) {
+    FILE* f = fopen(path, "w");
+
+    ck_assert_ptr_nonnull(f);
+    fputs(contents, f);
+    fclose(f);
+}
+
+static void write_config(const char* backend_path) {
+    char path[64], config[128];
+
+    snprintf(path, sizeof(path), "%s/nss-mdns.conf", dir);
+    // Interfaces have no addresses in the namespace lookups run in.
+    snprintf(config, sizeof(config),
+             "backend avahi %s\nmulticast-fallback no\naddrconfig no\n",
+             backend_path);
+    write_file(path, config);
+    setenv("NSS_MDNS_CONFIG", path, 1);
+}
+
+static void setup(void) {
+    strcpy(dir, "/tmp/nss-mdns-test-XXXXXX");
+    ck_assert_ptr_nonnull(mkdtemp(dir));
+
+    snprintf(socket_path, sizeof(socket_path), "%s/socket", dir);
+    fake = fake_avahi_start(socket_path, "foo.local 192.0.2.5 2001:db8::5\n");
+    ck_assert_ptr_nonnull(fake);
+    write_config(socket_path);
+}
+
+static void teardown(void) {
+    char cmd[64];
+
+    fake_avahi_stop(fake);
+    unsetenv("NSS_MDNS_CONFIG");
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+    system(cmd);
+}
+
+// Hides the configuration of the host behind empty directories, so that
+// lookups see the defaults, and takes the network away. The .local SOA
+// probe then fails right away instead of waiting for a name server.
+static int isolate(void) {
+    const char* const files[] = {MDNS_ALLOW_FILE, MDNS_HOSTS_FILE};
+    FILE* f;
+
+    if (unshare(CLONE_NEWNS | CLONE_NEWNET) < 0 ||
+        mount(NULL, "/", NULL, MS_REC | MS_PRIVATE, NULL) < 0 ||
+        mount("tmpfs", "/etc", "tmpfs", 0, NULL) < 0)
+        return -1;
+
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        char path[256];
+        const char* d;
+
+        snprintf(path, sizeof(path), "%s", files[i]);
+        d = dirname(path);
+        if (strcmp(d, "/etc") != 0 && access(d, F_OK) == 0 &&
+            mount("tmpfs", d, "tmpfs", 0, NULL) < 0)
+            return -1;
+    }
+
+    if (!(f = fopen("/etc/resolv.conf", "w")))
+        return -1;
+    fputs("nameserver 127.0.0.1\noptions timeout:1 attempts:1\n", f);
+    fclose(f);
+
+    return 0;
+}
+
+static int is_open(long nr) {
+#ifdef SYS_open
+    if (nr == SYS_open)
+        return 1;
+#endif
+#ifdef SYS_openat2
+    if (nr == SYS_openat2)
+        return 1;
+#endif
+    return nr == SYS_openat;
+}
+
+// Runs scenario in an isolated child traced by this process and counts the
+// syscalls it makes between the marks. Returns the exit status of the
+// child, which is that of scenario, or 77 if it can't be traced.
+static int run_traced(int (*scenario)(void), count_t* count) {
+    int status, counting = 0, sig = 0;
+    pid_t pid;
+
+    memset(count, 0, sizeof(*count));
+
+    if ((pid = fork()) == 0) {
+        if (isolate() < 0 || ptrace(PTRACE_TRACEME, 0, NULL, NULL) < 0)
+            _exit(77);
+        raise(SIGSTOP);
+        _exit(scenario());
+    }
+    ck_assert_int_gt(pid, 0);
+
+    ck_assert_int_eq(waitpid(pid, &status, 0), pid);
+    if (!WIFSTOPPED(status))
+        return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    ptrace(PTRACE_SETOPTIONS, pid, NULL,
+           PTRACE_O_TRACESYSGOOD | PTRACE_O_EXITKILL);
+
+    for (;;) {
+        syscall_info_t info;
+
+        ck_assert_int_eq(ptrace(PTRACE_SYSCALL, pid, NULL, sig), 0);
+        sig = 0;
+        ck_assert_int_eq(waitpid(pid, &status, 0), pid);
+
+        if (WIFEXITED(status))
+            return WEXITSTATUS(status);
+        if (WIFSIGNALED(status))
+            return -1;
+
+        if (WSTOPSIG(status) != (SIGTRAP | 0x80)) {
+            // Pass on signals.
+            sig = WSTOPSIG(status);
+            continue;
+        }
+
+        memset(&info, 0, sizeof(info));
+        if (ptrace(PTRACE_GET_SYSCALL_INFO, pid, sizeof(info), &info) <= 0) {
+            // Kernels before 5.3.
+            kill(pid, SIGKILL);
+            waitpid(pid, &status, 0);
+            return 77;
+        }
+        if (info.op != SYSCALL_INFO_ENTRY)
+            continue;
+
+        if (info.nr == SYS_getppid) {
+            counting = !counting;
+            continue;
+        }
+
+        if (counting) {
+            if (count->syscalls < sizeof(count->numbers) / sizeof(long))
+                count->numbers[count->syscalls] = (long)info.nr;
+            count->syscalls++;
+            count->opens += is_open((long)info.nr);
+        }
+    }
+}
+
+// Checks that a child can be isolated and traced, and that the kernel
+// reports syscalls through PTRACE_GET_SYSCALL_INFO (Linux 5.3 and later).
+// Without privileges or ptrace there is nothing to test.
+static int can_trace(void) {
+    syscall_info_t info;
+    int status, ok;
+    pid_t pid;
+
+    if ((pid = fork()) == 0) {
+        if (isolate() < 0 || ptrace(PTRACE_TRACEME, 0, NULL, NULL) < 0)
+            _exit(77);
+        raise(SIGSTOP);
+        getppid();
+        _exit(0);
+    }
+    if (pid < 0 || waitpid(pid, &status, 0) != pid)
+        return 0;
+    if (!WIFSTOPPED(status))
+        return 0;
+
+    ptrace(PTRACE_SETOPTIONS, pid, NULL,
+           PTRACE_O_TRACESYSGOOD | PTRACE_O_EXITKILL);
+    memset(&info, 0, sizeof(info));
+    ok = ptrace(PTRACE_SYSCALL, pid, NULL, 0) == 0 &&
+         waitpid(pid, &status, 0) == pid && WIFSTOPPED(status) &&
+         ptrace(PTRACE_GET_SYSCALL_INFO, pid, sizeof(info), &info) > 0;
+
+    kill(pid, SIGKILL);
+    waitpid(pid, &status, 0);
+    return ok;
+}
+
+static void check_budget(int (*scenario)(void), unsigned max_syscalls,
+                         unsigned max_opens) {
+    count_t count;
+    int ret = run_traced(scenario, &count);
+
+    ck_assert_int_eq(ret, 0);
+
+    if (count.syscalls > max_syscalls || count.opens > max_opens) {
+        fprintf(stderr, "%u syscalls, %u opens:", count.syscalls,
+                count.opens);
+        for (unsigned i = 0;
+             i < count.syscalls && i < sizeof(count.numbers) / sizeof(long);
+             i++)
+            fprintf(stderr, " %ld", count.numbers[i]);
+        fprintf(stderr, "\n");
+    }
+    ck_assert_uint_le(count.syscalls, max_syscalls);
+    ck_assert_uint_le(count.opens, max_opens);
+}
+
+static enum nss_status lookup(const char* name) {
+    struct gaih_addrtuple* pat = NULL;
+    char buffer[1024];
+    int err, herr;
+
+    return _nss_mdns_gethostbyname4_r(name, &pat, buffer, sizeof(buffer),
+                                      &err, &herr, NULL);
+}
+
+static int cold_hit(void) {
+    enum nss_status status;
+
+    MARK();
+    status = lookup("foo.local");
+    MARK();
+
+    return status == NSS_STATUS_SUCCESS ? 0 : 1;
+}
+
+static int cache_hit(void) {
+    enum nss_status status;
+
+    lookup("foo.local");
+    MARK();
+    status = lookup("foo.local");
+    MARK();
+
+    return status == NSS_STATUS_SUCCESS ? 0 : 1;
+}
+
+// Asked for by getaddrinfo() with AI_CANONNAME, right after the addresses.
+static int canonname_after_lookup(void) {
+    enum nss_status status;
+    char buffer[256], *canon = NULL;
+    int err, herr;
+
+    lookup("foo.local");
+    MARK();
+    status = _nss_mdns_getcanonname_r("foo.local", buffer, sizeof(buffer),
+                                      &canon, &err, &herr);
+    MARK();
+
+    return status == NSS_STATUS_SUCCESS && canon &&
+                   strcmp(canon, "foo.local") == 0
+               ? 0
+               : 1;
+}
+
+static int not_found(void) {
+    enum nss_status status;
+
+    MARK();
+    status = lookup("bar.local");
+    MARK();
+
+    return status == NSS_STATUS_NOTFOUND ? 0 : 1;
+}
+
+static int daemon_down(void) {
+    enum nss_status status;
+
+    MARK();
+    status = lookup("foo.local");
+    MARK();
+
+    return status == NSS_STATUS_UNAVAIL ? 0 : 1;
+}
+
+// Upper bounds of the syscalls and file opens of each scenario. They leave
+// a little room, but not enough for another round trip or file read. Even
+// a cache hit opens the allow file and probes for a .local SOA; misses
+// read the config and resolv.conf and connect to the daemon, once per
+// address family.
+#define COLD_HIT_SYSCALLS 60
+#define COLD_HIT_OPENS 5
+#define CACHE_HIT_SYSCALLS 16
+#define CACHE_HIT_OPENS 1
+#define NOT_FOUND_SYSCALLS 58
+#define NOT_FOUND_OPENS 5
+#define DAEMON_DOWN_SYSCALLS 38
+#define DAEMON_DOWN_OPENS 5
+
+START_TEST(test_cold_hit) {
+    check_budget(cold_hit, COLD_HIT_SYSCALLS, COLD_HIT_OPENS);
+}
+END_TEST
+
+START_TEST(test_cache_hit) {
+    check_budget(cache_hit, CACHE_HIT_SYSCALLS, CACHE_HIT_OPENS);
+}
+END_TEST
+
+START_TEST(test_canonname_after_lookup) {
+    check_budget(canonname_after_lookup, CACHE_HIT_SYSCALLS, CACHE_HIT_OPENS);
+}
+END_TEST
+
+START_TEST(test_not_found) {
+    check_budget(not_found, NOT_FOUND_SYSCALLS, NOT_FOUND_OPENS);
+}
+END_TEST
+
+START_TEST(test_daemon_down) {
+    char path[64];
+
+    snprintf(path, sizeof(path), "%s/nothing", dir);
+    write_config(path);
+    check_budget(daemon_down, DAEMON_DOWN_SYSCALLS, DAEMON_DOWN_OPENS);
+}
+END_TEST
+
+static Suite* syscalls_suite(void) {
+    Suite* s = suite_create("syscalls");
+
+    TCase* tc_syscalls = tcase_create("syscalls");
+    tcase_add_checked_fixture(tc_syscalls, setup, teardown);
+    tcase_add_test(tc_syscalls, test_cold_hit);
+    tcase_add_test(tc_syscalls, test_cache_hit);
+    tcase_add_test(tc_syscalls, test_canonname_after_lookup);
+    tcase_add_test(tc_syscalls, test_not_found);
+    tcase_add_test(tc_syscalls, test_daemon_down);
+    suite_add_tcase(s, tc_syscalls);
+
+    return s;
+}
+
+int main(void) {
+    int number_failed;
+    Suite* s;
+    SRunner* sr;
+
+    // Tell automake the test was skipped rather than passed.
+    if (!can_trace())
+        return 77;
+
+    s = syscalls_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_VERBOSE);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,186 @@
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#include <check.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../src/trace.h"
+
+static char path[] = "/tmp/nss-mdns-trace-XXXXXX";
+
+static void setup(void) {
+    int fd;
+
+    strcpy(path, "/tmp/nss-mdns-trace-XXXXXX");
+    fd = mkstemp(path);
+    ck_assert_int_ge(fd, 0);
+    close(fd);
+    // The first lookup creates the file.
+    unlink(path);
+}
+
+static void teardown(void) {
+    trace_setup(NULL);
+    unlink(path);
+}
+
+static char* read_trace(void) {
+    static char contents[65536];
+    FILE* f = fopen(path, "r");
+    size_t n;
+
+    ck_assert_ptr_nonnull(f);
+    n = fread(contents, 1, sizeof(contents) - 1, f);
+    contents[n] = 0;
+    fclose(f);
+    return contents;
+}
+
+static int count_lines(const char* s) {
+    int n = 0;
+
+    for (; *s; s++)
+        n += *s == '\n';
+    return n;
+}
+
+static void lookup(const char* name) {
+    int span;
+
+    TRACE(trace_begin("gethostbyname4_r", name, AF_UNSPEC, NULL));
+    TRACE(span = trace_phase_begin(TRACE_PHASE_ALLOW, AF_UNSPEC));
+    TRACE(trace_phase_end(span, 1));
+    TRACE(trace_decision("allow_authoritative"));
+    TRACE(trace_decision("backend"));
+    TRACE(span = trace_phase_begin(TRACE_PHASE_QUERY, AF_INET));
+    TRACE(trace_phase_end(span, 0));
+    TRACE(trace_end(0));
+}
+
+START_TEST(test_record) {
+    char spec[64];
+    const char* trace;
+
+    trace_setup(path);
+    ck_assert_int_eq(trace_enabled, 1);
+    lookup("foo.local");
+
+    trace = read_trace();
+    ck_assert_int_eq(strncmp(trace, "[\n", 2), 0);
+    ck_assert_int_eq(count_lines(trace), 2);
+    ck_assert_ptr_nonnull(strstr(trace, "{\"name\":\"gethostbyname4_r\","));
+    ck_assert_ptr_nonnull(strstr(trace, "\"name\":\"foo.local\""));
+    ck_assert_ptr_nonnull(
+        strstr(trace, "\"decision\":\"allow_authoritative,backend\""));
+    ck_assert_ptr_nonnull(strstr(trace, "{\"name\":\"allow\","));
+    ck_assert_ptr_nonnull(strstr(trace, "{\"name\":\"query\","));
+    ck_assert_ptr_nonnull(strstr(trace, "\"args\":{\"af\":2,\"result\":0}"));
+
+    // Records are appended to an existing file without another bracket.
+    snprintf(spec, sizeof(spec), "%s,sample=1", path);
+    trace_setup(spec);
+    lookup("bar.local");
+    trace = read_trace();
+    ck_assert_int_eq(count_lines(trace), 3);
+    ck_assert_ptr_null(strchr(trace + 1, '['));
+    ck_assert_ptr_nonnull(strstr(trace, "\"name\":\"bar.local\""));
+}
+END_TEST
+
+START_TEST(test_address_and_escaping) {
+    struct in_addr address;
+    const char* trace;
+
+    trace_setup(path);
+    inet_pton(AF_INET, "192.0.2.5", &address);
+    TRACE(trace_begin("gethostbyaddr_r", NULL, AF_INET, &address));
+    TRACE(trace_end(1));
+    lookup("a\"b\\c\n.local");
+
+    trace = read_trace();
+    ck_assert_ptr_nonnull(strstr(trace, "\"name\":\"192.0.2.5\""));
+    ck_assert_ptr_nonnull(
+        strstr(trace, "\"name\":\"a\\\"b\\\\c\\u000a.local\""));
+}
+END_TEST
+
+START_TEST(test_sampling) {
+    char spec[64];
+
+    snprintf(spec, sizeof(spec), "%s,sample=3", path);
+    trace_setup(spec);
+    for (int i = 0; i < 7; i++)
+        lookup("foo.local");
+
+    // Lookups 0, 3 and 6, after the opening bracket.
+    ck_assert_int_eq(count_lines(read_trace()), 4);
+}
+END_TEST
+
+START_TEST(test_disabled) {
+    char spec[64];
+
+    trace_setup(NULL);
+    ck_assert_int_eq(trace_enabled, 0);
+    lookup("foo.local");
+    ck_assert_int_ne(access(path, F_OK), 0);
+
+    trace_setup("");
+    ck_assert_int_eq(trace_enabled, 0);
+
+    snprintf(spec, sizeof(spec), "%s,sample=0", path);
+    trace_setup(spec);
+    ck_assert_int_eq(trace_enabled, 0);
+
+    snprintf(spec, sizeof(spec), "%s,every=2", path);
+    trace_setup(spec);
+    ck_assert_int_eq(trace_enabled, 0);
+}
+END_TEST
+
+static Suite* trace_suite(void) {
+    Suite* s = suite_create("trace");
+
+    TCase* tc_trace = tcase_create("trace");
+    tcase_add_checked_fixture(tc_trace, setup, teardown);
+    tcase_add_test(tc_trace, test_record);
+    tcase_add_test(tc_trace, test_address_and_escaping);
+    tcase_add_test(tc_trace, test_sampling);
+    tcase_add_test(tc_trace, test_disabled);
+    suite_add_tcase(s, tc_trace);
+
+    return s;
+}
+
+int main(void) {
+    int number_failed;
+    Suite* s;
+    SRunner* sr;
+
+    s = trace_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_VERBOSE);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -648,6 +648,26 @@ START_TEST(test_append_address_normalizes_scopeid) {
 }
 END_TEST
 
+START_TEST(test_append_address_in_place) {
+    static const uint8_t global[16] = {0x20, 0x01, 0x0d, 0xb8, 0, 0, 0, 0,
+                                       0,    0,    0,    0,    0, 0, 0, 0x01};
+
+    userdata_t u;
+    u.count = 0;
+
+    // Written by a resolver directly into the next free entry.
+    query_address_result_t* next = &u.result[0];
+    next->af = AF_INET6;
+    next->scopeid = 3;
+    memcpy(next->address.ipv6.address, global, sizeof global);
+    append_address_to_userdata(next, &u);
+
+    ck_assert_int_eq(u.count, 1);
+    ck_assert_int_eq(u.result[0].scopeid, 0);
+    ck_assert_mem_eq(u.result[0].address.ipv6.address, global, sizeof global);
+}
+END_TEST
+
 static void poison(char* buf, size_t buflen) { memset(buf, 0x55, buflen); }
 
 static void validate_poison(char* buf, size_t buflen, size_t full_buflen) {
@@ -755,6 +775,42 @@ START_TEST(test_userdata_to_addrtuple_smallest_buffer_eventually_works) {
 }
 END_TEST
 
+START_TEST(test_userdata_to_addrtuple_too_small_writes_nothing) {
+    userdata_t u = create_address_userdata(16, AF_UNSPEC);
+    struct gaih_addrtuple tuple, before;
+    struct gaih_addrtuple* pat = &tuple;
+    // The first tuple is the caller's; the others and the name go to the
+    // buffer, with nothing in between.
+    size_t needed = 15 * sizeof(tuple) + sizeof("example.local");
+    void* aligned[2048 / sizeof(void*)];
+    char* buffer = (char*)aligned;
+    int errnop = 0;
+    int h_errnop = 0;
+
+    poison((char*)&tuple, sizeof(tuple));
+    before = tuple;
+    poison(buffer, sizeof(aligned));
+
+    buffer_t buf;
+    buffer_init(&buf, buffer, needed - 1);
+    enum nss_status status = convert_userdata_to_addrtuple(
+        &u, "example.local", &pat, &buf, &errnop, &h_errnop);
+    ck_assert_int_eq(status, NSS_STATUS_TRYAGAIN);
+    ck_assert_int_eq(errnop, ERANGE);
+    ck_assert_ptr_eq(pat, &tuple);
+    ck_assert_mem_eq(&tuple, &before, sizeof(tuple));
+    validate_poison(buffer, 0, sizeof(aligned));
+
+    buffer_init(&buf, buffer, needed);
+    status = convert_userdata_to_addrtuple(&u, "example.local", &pat, &buf,
+                                           &errnop, &h_errnop);
+    ck_assert_int_eq(status, NSS_STATUS_SUCCESS);
+    ck_assert_ptr_eq(pat, &tuple);
+    validate_addrtuples(pat, "example.local", 16);
+    validate_poison(buffer, needed, sizeof(aligned));
+}
+END_TEST
+
 START_TEST(test_userdata_to_addrtuple_nonnull_pat_is_used) {
     userdata_t u = create_address_userdata(16, AF_UNSPEC);
     struct gaih_addrtuple tuple;
@@ -1047,11 +1103,14 @@ static Suite* util_suite(void) {
                    test_userdata_to_addrtuple_smallest_buffer_eventually_works);
     tcase_add_test(tc_userdata_to_addrtuple,
                    test_userdata_to_addrtuple_nonnull_pat_is_used);
+    tcase_add_test(tc_userdata_to_addrtuple,
+                   test_userdata_to_addrtuple_too_small_writes_nothing);
     suite_add_tcase(s, tc_userdata_to_addrtuple);
 #endif
 
     TCase* tc_append_address = tcase_create("append_address");
     tcase_add_test(tc_append_address, test_append_address_normalizes_scopeid);
+    tcase_add_test(tc_append_address, test_append_address_in_place);
     suite_add_tcase(s, tc_append_address);
 
     TCase* tc_userdata_for_name_to_hostent =
@@ -0,0 +1,71 @@
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#define _DEFAULT_SOURCE
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "fake-avahi.h"
+
+// Serves a script, as described in fake-avahi.h, until interrupted; for
+// trying out and load-testing the module without a network.
+int main(int argc, char* argv[]) {
+    fake_avahi_t* fake;
+    char* script;
+    size_t len = 0;
+    FILE* f;
+    sigset_t signals;
+    int sig;
+
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s SOCKET SCRIPT\n", argv[0]);
+        return 2;
+    }
+
+    if (!(f = fopen(argv[2], "r"))) {
+        perror(argv[2]);
+        return 1;
+    }
+    if (!(script = malloc(65536)) ||
+        (len = fread(script, 1, 65535, f), ferror(f))) {
+        perror(argv[2]);
+        return 1;
+    }
+    script[len] = 0;
+    fclose(f);
+
+    // Handled by sigwait() below, in no thread before.
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    if (!(fake = fake_avahi_start(argv[1], script)))
+        return 1;
+    free(script);
+
+    sigwait(&signals, &sig);
+    fprintf(stderr, "fake-avahi: %u requests\n", fake_avahi_requests(fake));
+    fake_avahi_stop(fake);
+
+    return 0;
+}
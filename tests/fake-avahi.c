@@ -0,0 +1,544 @@
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#define _DEFAULT_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fake-avahi.h"
+
+#define FAKE_AVAHI_MAX_ADDRESSES 8
+#define FAKE_AVAHI_MAX_CONNECTIONS 256
+
+#define WHITESPACE " \t\r\n"
+
+// avahi-daemon's protocol numbers.
+#define AVAHI_PROTO_INET 0
+#define AVAHI_PROTO_INET6 1
+
+typedef struct {
+    int af;
+    unsigned char data[16];
+} fake_address_t;
+
+typedef struct {
+    char name[256];
+    int n_addresses;
+    fake_address_t addresses[FAKE_AVAHI_MAX_ADDRESSES];
+    int ifindex;
+    int latency;
+    int jitter;
+    int partial;
+    int disconnect;
+    int hang;
+} fake_host_t;
+
+typedef struct {
+    const fake_address_t* address;
+    const fake_host_t* host;
+} fake_entry_t;
+
+struct fake_avahi {
+    char path[sizeof(((struct sockaddr_un*)0)->sun_path)];
+    int fd;
+    pthread_t acceptor;
+
+    int n_hosts;
+    fake_host_t* hosts;
+    // The hosts by name, and their addresses by value, for bsearch().
+    const fake_host_t** names;
+    int n_addresses;
+    fake_entry_t* addresses;
+    // The "*" entry, if any.
+    const fake_host_t* wildcard;
+
+    unsigned requests;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t idle;
+    int connections[FAKE_AVAHI_MAX_CONNECTIONS];
+    int n_connections;
+};
+
+typedef struct {
+    fake_avahi_t* fake;
+    int fd;
+} connection_t;
+
+static int parse_option(const char* word, fake_host_t* host) {
+    char* end;
+    const char* value = strchr(word, '=');
+    long n = 0;
+
+    if (value) {
+        value++;
+        n = strtol(value, &end, 10);
+        if (end == value || *end || n < 0 || n > 1000000)
+            return -1;
+    }
+
+    if (strncmp(word, "latency=", 8) == 0)
+        host->latency = (int)n;
+    else if (strncmp(word, "jitter=", 7) == 0)
+        host->jitter = (int)n;
+    else if (strncmp(word, "ifindex=", 8) == 0)
+        host->ifindex = (int)n;
+    else if (strcmp(word, "partial") == 0)
+        host->partial = 1;
+    else if (strcmp(word, "disconnect") == 0)
+        host->disconnect = 1;
+    else if (strcmp(word, "hang") == 0)
+        host->hang = 1;
+    else
+        return -1;
+
+    return 0;
+}
+
+static int parse_word(const char* word, fake_host_t* host) {
+    fake_address_t* a;
+
+    if (!strchr(word, '.') && !strchr(word, ':'))
+        return parse_option(word, host);
+
+    if (host->n_addresses >= FAKE_AVAHI_MAX_ADDRESSES)
+        return -1;
+
+    a = &host->addresses[host->n_addresses];
+    if (inet_pton(AF_INET, word, a->data) == 1)
+        a->af = AF_INET;
+    else if (inet_pton(AF_INET6, word, a->data) == 1)
+        a->af = AF_INET6;
+    else
+        return -1;
+
+    host->n_addresses++;
+    return 0;
+}
+
+static int parse_script(fake_avahi_t* fake, const char* script) {
+    char* copy = strdup(script);
+    char *line, *save_line;
+    int n = 0, ret = 0, size = 0;
+
+    if (!copy)
+        return -1;
+
+    for (line = strtok_r(copy, "\n", &save_line); line;
+         line = strtok_r(NULL, "\n", &save_line)) {
+        char *word, *save_word;
+        fake_host_t* host;
+
+        n++;
+        word = strtok_r(line, WHITESPACE, &save_word);
+        if (!word || word[0] == '#')
+            continue;
+
+        if (strlen(word) >= sizeof(host->name)) {
+            fprintf(stderr, "fake-avahi: line %d: name too long\n", n);
+            ret = -1;
+            continue;
+        }
+
+        if (fake->n_hosts == size) {
+            fake_host_t* hosts;
+
+            size = size ? size * 2 : 64;
+            if (!(hosts = realloc(fake->hosts, size * sizeof(*hosts)))) {
+                ret = -1;
+                break;
+            }
+            fake->hosts = hosts;
+        }
+
+        host = &fake->hosts[fake->n_hosts++];
+        memset(host, 0, sizeof(*host));
+        strcpy(host->name, word);
+        host->ifindex = 1;
+
+        while ((word = strtok_r(NULL, WHITESPACE, &save_word)))
+            if (parse_word(word, host) < 0) {
+                fprintf(stderr, "fake-avahi: line %d: bad word '%s'\n", n,
+                        word);
+                ret = -1;
+            }
+
+    }
+
+    free(copy);
+    return ret;
+}
+
+// Hosts listed earlier win over later ones with the same name or address.
+static int compare_names(const void* a, const void* b) {
+    const fake_host_t* x = *(const fake_host_t* const*)a;
+    const fake_host_t* y = *(const fake_host_t* const*)b;
+    int r = strcasecmp(x->name, y->name);
+
+    return r ? r : (x > y) - (x < y);
+}
+
+static int compare_addresses(const fake_address_t* x,
+                             const fake_address_t* y) {
+    if (x->af != y->af)
+        return x->af - y->af;
+
+    return memcmp(x->data, y->data, x->af == AF_INET ? 4 : 16);
+}
+
+static int compare_entries(const void* a, const void* b) {
+    const fake_entry_t* x = a;
+    const fake_entry_t* y = b;
+    int r = compare_addresses(x->address, y->address);
+
+    return r ? r : (x->host > y->host) - (x->host < y->host);
+}
+
+// Sorts the hosts, so that large scripts such as those replaying captured
+// workloads don't slow down every request.
+static int index_hosts(fake_avahi_t* fake) {
+    int n = 0;
+
+    for (int i = 0; i < fake->n_hosts; i++) {
+        if (strcmp(fake->hosts[i].name, "*") == 0 && !fake->wildcard)
+            fake->wildcard = &fake->hosts[i];
+        n += fake->hosts[i].n_addresses;
+    }
+
+    fake->names = malloc((fake->n_hosts + 1) * sizeof(*fake->names));
+    fake->addresses = malloc((n + 1) * sizeof(*fake->addresses));
+    if (!fake->names || !fake->addresses)
+        return -1;
+
+    for (int i = 0; i < fake->n_hosts; i++) {
+        const fake_host_t* host = &fake->hosts[i];
+
+        fake->names[i] = host;
+        for (int j = 0; j < host->n_addresses; j++)
+            fake->addresses[fake->n_addresses++] =
+                (fake_entry_t){&host->addresses[j], host};
+    }
+
+    qsort(fake->names, fake->n_hosts, sizeof(*fake->names), compare_names);
+    qsort(fake->addresses, fake->n_addresses, sizeof(*fake->addresses),
+          compare_entries);
+    return 0;
+}
+
+static const fake_host_t* find_name(const fake_avahi_t* fake,
+                                    const char* name) {
+    int lo = 0, hi = fake->n_hosts;
+
+    // The first host not sorting before name.
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+
+        if (strcasecmp(fake->names[mid]->name, name) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (lo < fake->n_hosts && strcasecmp(fake->names[lo]->name, name) == 0)
+        return fake->names[lo];
+
+    return fake->wildcard;
+}
+
+static const fake_host_t* find_address(const fake_avahi_t* fake, int af,
+                                       const void* data) {
+    fake_address_t key = {.af = af};
+    int lo = 0, hi = fake->n_addresses;
+
+    memcpy(key.data, data, af == AF_INET ? 4 : 16);
+
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+
+        if (compare_addresses(fake->addresses[mid].address, &key) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (lo < fake->n_addresses &&
+        compare_addresses(fake->addresses[lo].address, &key) == 0)
+        return fake->addresses[lo].host;
+
+    return fake->wildcard;
+}
+
+static void sleep_msec(int msec) {
+    struct timespec ts = {msec / 1000, (long)(msec % 1000) * 1000000};
+
+    while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+        ;
+}
+
+static int write_all(int fd, const char* data, size_t len, int partial) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, partial ? 1 : len, MSG_NOSIGNAL);
+
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        data += n;
+        len -= (size_t)n;
+
+        // Give the client the chance to see every byte on its own.
+        if (partial)
+            sleep_msec(1);
+    }
+
+    return 0;
+}
+
+// Answers a request, or returns -1 if the connection is to be closed.
+static int answer(fake_avahi_t* fake, int fd, char* request,
+                  unsigned* seed) {
+    static const char not_found[] = "-15 Timeout reached\n";
+    static const char invalid[] = "-2 Invalid command\n";
+    char reply[4096], text[INET6_ADDRSTRLEN];
+    const fake_host_t* host = NULL;
+    char *command, *argument, *save;
+    size_t n = 0;
+
+    __atomic_fetch_add(&fake->requests, 1, __ATOMIC_RELAXED);
+
+    command = strtok_r(request, WHITESPACE, &save);
+    argument = command ? strtok_r(NULL, WHITESPACE, &save) : NULL;
+    if (!argument)
+        return write_all(fd, invalid, strlen(invalid), 0);
+
+    if (strncmp(command, "RESOLVE-HOSTNAME", 16) == 0) {
+        int af = strcmp(command, "RESOLVE-HOSTNAME-IPV4") == 0   ? AF_INET
+                 : strcmp(command, "RESOLVE-HOSTNAME-IPV6") == 0 ? AF_INET6
+                                                                 : AF_UNSPEC;
+
+        if ((host = find_name(fake, argument)))
+            for (int i = 0; i < host->n_addresses; i++) {
+                const fake_address_t* a = &host->addresses[i];
+
+                if (af != AF_UNSPEC && a->af != af)
+                    continue;
+                inet_ntop(a->af, a->data, text, sizeof(text));
+                n += (size_t)snprintf(
+                    reply + n, sizeof(reply) - n, "+ %i %u %s %s\n",
+                    host->ifindex,
+                    a->af == AF_INET ? AVAHI_PROTO_INET : AVAHI_PROTO_INET6,
+                    argument, text);
+            }
+    } else if (strcmp(command, "RESOLVE-ADDRESS") == 0) {
+        unsigned char data[16];
+        int af = strchr(argument, ':') ? AF_INET6 : AF_INET;
+
+        if (inet_pton(af, argument, data) == 1 &&
+            (host = find_address(fake, af, data)) && host != fake->wildcard)
+            n = (size_t)snprintf(
+                reply, sizeof(reply), "+ %i %u %s\n", host->ifindex,
+                af == AF_INET ? AVAHI_PROTO_INET : AVAHI_PROTO_INET6,
+                host->name);
+    } else
+        return write_all(fd, invalid, strlen(invalid), 0);
+
+    if (host) {
+        if (host->latency || host->jitter)
+            sleep_msec(host->latency +
+                       (host->jitter ? rand_r(seed) % (host->jitter + 1) : 0));
+        if (host->disconnect)
+            return -1;
+        if (host->hang) {
+            // Until the client gives up.
+            while (read(fd, reply, sizeof(reply)) > 0)
+                ;
+            return -1;
+        }
+    }
+
+    if (n == 0)
+        return write_all(fd, not_found, strlen(not_found), 0);
+
+    return write_all(fd, reply, n, host->partial);
+}
+
+static void* connection_thread(void* arg) {
+    connection_t c = *(connection_t*)arg;
+    fake_avahi_t* fake = c.fake;
+    char buf[1024];
+    size_t used = 0;
+    unsigned seed = (unsigned)c.fd;
+    int done = 0;
+
+    free(arg);
+
+    // Clients may send several requests over one connection.
+    while (!done) {
+        char* nl;
+        ssize_t n = read(c.fd, buf + used, sizeof(buf) - 1 - used);
+
+        if (n <= 0)
+            break;
+        used += (size_t)n;
+        buf[used] = 0;
+
+        while (!done && (nl = strchr(buf, '\n'))) {
+            *nl = 0;
+            done = answer(fake, c.fd, buf, &seed) < 0;
+            used -= (size_t)(nl + 1 - buf);
+            memmove(buf, nl + 1, used + 1);
+        }
+
+        // A request that doesn't fit.
+        if (used == sizeof(buf) - 1)
+            break;
+    }
+
+    pthread_mutex_lock(&fake->mutex);
+    for (int i = 0; i < fake->n_connections; i++)
+        if (fake->connections[i] == c.fd) {
+            fake->connections[i] = fake->connections[--fake->n_connections];
+            break;
+        }
+    close(c.fd);
+    if (fake->n_connections == 0)
+        pthread_cond_broadcast(&fake->idle);
+    pthread_mutex_unlock(&fake->mutex);
+
+    return NULL;
+}
+
+static void* accept_thread(void* arg) {
+    fake_avahi_t* fake = arg;
+    int fd;
+
+    while ((fd = accept(fake->fd, NULL, NULL)) >= 0 || errno == EINTR) {
+        connection_t* c;
+        pthread_t thread;
+
+        if (fd < 0)
+            continue;
+
+        pthread_mutex_lock(&fake->mutex);
+        if (fake->n_connections >= FAKE_AVAHI_MAX_CONNECTIONS ||
+            !(c = malloc(sizeof(*c)))) {
+            pthread_mutex_unlock(&fake->mutex);
+            close(fd);
+            continue;
+        }
+        c->fake = fake;
+        c->fd = fd;
+        fake->connections[fake->n_connections++] = fd;
+
+        if (pthread_create(&thread, NULL, connection_thread, c) != 0) {
+            fake->n_connections--;
+            close(fd);
+            free(c);
+        } else
+            pthread_detach(thread);
+        pthread_mutex_unlock(&fake->mutex);
+    }
+
+    return NULL;
+}
+
+static void free_hosts(fake_avahi_t* fake) {
+    free(fake->hosts);
+    free(fake->names);
+    free(fake->addresses);
+    free(fake);
+}
+
+fake_avahi_t* fake_avahi_start(const char* path, const char* script) {
+    fake_avahi_t* fake = calloc(1, sizeof(*fake));
+    struct sockaddr_un sa;
+
+    if (!fake)
+        return NULL;
+
+    if (parse_script(fake, script) < 0 || index_hosts(fake) < 0)
+        goto fail;
+
+    if (strlen(path) >= sizeof(fake->path)) {
+        fprintf(stderr, "fake-avahi: socket path too long\n");
+        goto fail;
+    }
+    strcpy(fake->path, path);
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    strcpy(sa.sun_path, path);
+
+    if ((fake->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0 ||
+        bind(fake->fd, (struct sockaddr*)&sa, sizeof(sa)) < 0 ||
+        listen(fake->fd, 128) < 0) {
+        fprintf(stderr, "fake-avahi: %s: %s\n", path, strerror(errno));
+        if (fake->fd >= 0)
+            close(fake->fd);
+        goto fail;
+    }
+
+    pthread_mutex_init(&fake->mutex, NULL);
+    pthread_cond_init(&fake->idle, NULL);
+
+    if (pthread_create(&fake->acceptor, NULL, accept_thread, fake) != 0) {
+        close(fake->fd);
+        unlink(path);
+        goto fail;
+    }
+
+    return fake;
+
+fail:
+    free_hosts(fake);
+    return NULL;
+}
+
+unsigned fake_avahi_requests(fake_avahi_t* fake) {
+    return __atomic_load_n(&fake->requests, __ATOMIC_RELAXED);
+}
+
+void fake_avahi_stop(fake_avahi_t* fake) {
+    shutdown(fake->fd, SHUT_RDWR);
+    pthread_join(fake->acceptor, NULL);
+    close(fake->fd);
+    unlink(fake->path);
+
+    pthread_mutex_lock(&fake->mutex);
+    for (int i = 0; i < fake->n_connections; i++)
+        shutdown(fake->connections[i], SHUT_RDWR);
+    while (fake->n_connections > 0)
+        pthread_cond_wait(&fake->idle, &fake->mutex);
+    pthread_mutex_unlock(&fake->mutex);
+
+    pthread_mutex_destroy(&fake->mutex);
+    pthread_cond_destroy(&fake->idle);
+    free_hosts(fake);
+}
@@ -0,0 +1,59 @@
+#ifndef foofakeavahihfoo
+#define foofakeavahihfoo
+
+/*
+  This file is part of nss-mdns.
+
+  nss-mdns is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+// A stand-in for avahi-daemon, serving its simple protocol on a Unix
+// socket from a script, so that the module can be tested and load-tested
+// without a daemon or a network.
+//
+// Every line of a script describes a host:
+//
+//   NAME [OPTION...] [ADDRESS...]
+//
+// RESOLVE-HOSTNAME requests for NAME are answered with each of its
+// addresses of the family asked for, one line each; RESOLVE-ADDRESS
+// requests for one of the addresses with NAME. A NAME of "*" matches any
+// name not listed otherwise, so that its options apply to all of them.
+// Names without addresses of the family asked for are not found. The
+// options are:
+//
+//   latency=MSEC   wait that long before answering
+//   jitter=MSEC    and up to that much longer, at random
+//   ifindex=N      the interface reported with answers, 1 by default
+//   partial        write answers a byte at a time
+//   disconnect     close the connection instead of answering
+//   hang           never answer, until the client closes the connection
+//
+// Empty lines and those starting with '#' are ignored.
+
+typedef struct fake_avahi fake_avahi_t;
+
+// Starts serving script on a new socket at path. Returns NULL and reports
+// why on stderr if the script has errors or the socket can't be set up.
+fake_avahi_t* fake_avahi_start(const char* path, const char* script);
+
+// Returns the number of requests received so far.
+unsigned fake_avahi_requests(fake_avahi_t* fake);
+
+// Closes all connections, stops serving and removes the socket.
+void fake_avahi_stop(fake_avahi_t* fake);
+
+#endif